@@ -0,0 +1,441 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "archive.h"
+
+/* Size of the fixed part of the header and of the footer */
+#define ARCHIVE_HEADER_SIZE 12
+#define ARCHIVE_FOOTER_SIZE 12
+
+/* This helper function appends a value to a column buffer */
+void archive_column_push(column_buf* c, uint64_t v) {
+    if (c->len == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 1024;
+        c->values = (uint64_t*)realloc(c->values, sizeof(uint64_t) * c->cap);
+        check_malloc(c->values);
+    }
+    c->values[c->len++] = v;
+}
+
+/* This helper function writes v to f in four little-endian bytes */
+void archive_put_u32(FILE* f, uint32_t v) {
+    unsigned char b[4] = {v, v >> 8, v >> 16, v >> 24};
+    fwrite(b, 1, 4, f);
+}
+
+/* This helper function writes v to f in eight little-endian bytes */
+void archive_put_u64(FILE* f, uint64_t v) {
+    archive_put_u32(f, v);
+    archive_put_u32(f, v >> 32);
+}
+
+/* This helper function reads four little-endian bytes at p */
+uint32_t archive_get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/* This helper function reads eight little-endian bytes at p */
+uint64_t archive_get_u64(const unsigned char* p) {
+    return archive_get_u32(p) | ((uint64_t)archive_get_u32(p + 4) << 32);
+}
+
+/* This helper function maps a signed value to an unsigned one, small
+   magnitudes to small values: 0, -1, 1, -2, ... to 0, 1, 2, 3, ... */
+uint64_t archive_zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+/* This helper function undoes archive_zigzag */
+int64_t archive_unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/* This helper function writes v as a LEB128 varint at out and returns the
+   number of bytes used, at most 10 */
+size_t archive_encode_varint(uint64_t v, unsigned char* out) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+/* This helper function reads a LEB128 varint at in[*pos], advancing *pos */
+uint64_t archive_decode_varint(const unsigned char* in, size_t len,
+                              size_t* pos) {
+    uint64_t v = 0;
+    for (unsigned int shift = 0; shift < 64 && *pos < len; shift += 7) {
+        unsigned char byte = in[(*pos)++];
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return v;
+        }
+    }
+    fprintf(stderr, "Corrupt archive column\n");
+    exit(1);
+}
+
+/* This helper function returns true for the columns stored as deltas */
+bool archive_is_delta_column(unsigned int column) {
+    return column < COL_MOVES;
+}
+
+/* This helper function encodes a column's values as varints in out, after
+   turning them into deltas or XORs according to the column, and returns the
+   number of bytes written. out must hold 10 bytes per value */
+size_t archive_encode_column(unsigned int column, column_buf* c,
+                            unsigned char* out) {
+    size_t n = 0, prev_len = 0;
+    uint64_t prev = 0;
+    uint64_t* prev_words = NULL;
+    for (size_t i = 0; i < c->len; i++) {
+        if (archive_is_delta_column(column)) {
+            n += archive_encode_varint(archive_zigzag(c->values[i] - prev),
+                                       out + n);
+            prev = c->values[i];
+        } else if (column >= COL_POSITIONS) {
+            size_t words = c->values[i];
+            uint64_t* curr = &c->values[i + 1];
+            n += archive_encode_varint(words, out + n);
+            for (size_t j = 0; j < words; j++) {
+                uint64_t x = curr[j];
+                if (j < prev_len) {
+                    x ^= prev_words[j];
+                }
+                n += archive_encode_varint(x, out + n);
+            }
+            if (words) {
+                prev_words = curr;
+                prev_len = words;
+            }
+            i += words;
+        } else {
+            n += archive_encode_varint(c->values[i], out + n);
+        }
+    }
+    return n;
+}
+
+/* This helper function compresses and writes the current row group, then
+   empties the column buffers for the next one */
+void archive_flush_group(archive_writer* w) {
+    if (w->group_games == 0) {
+        return;
+    }
+    if (w->num_groups == w->groups_cap) {
+        w->groups_cap *= 2;
+        w->group_sizes = (unsigned int*)realloc(w->group_sizes,
+                            sizeof(unsigned int) * w->groups_cap);
+        w->chunks = (archive_chunk*)realloc(w->chunks,
+                        sizeof(archive_chunk) * w->groups_cap *
+                        w->num_columns);
+        check_malloc(w->group_sizes);
+        check_malloc(w->chunks);
+    }
+    w->group_sizes[w->num_groups] = w->group_games;
+    for (unsigned int col = 0; col < w->num_columns; col++) {
+        column_buf* c = &w->columns[col];
+        unsigned char* raw = (unsigned char*)malloc(c->len * 10 + 1);
+        check_malloc(raw);
+        size_t raw_len = archive_encode_column(col, c, raw);
+        uLongf packed_len = compressBound(raw_len);
+        unsigned char* packed = (unsigned char*)malloc(packed_len);
+        check_malloc(packed);
+        if (compress2(packed, &packed_len, raw, raw_len, 6) != Z_OK) {
+            fprintf(stderr, "Could not compress archive column\n");
+            exit(1);
+        }
+        if (fwrite(packed, 1, packed_len, w->f) != packed_len) {
+            fprintf(stderr, "Could not write archive\n");
+            exit(1);
+        }
+        archive_chunk* chunk = &w->chunks[w->num_groups * w->num_columns +
+                                          col];
+        chunk->offset = w->offset;
+        chunk->compressed_len = packed_len;
+        chunk->raw_len = raw_len;
+        w->offset += packed_len;
+        c->len = 0;
+        free(raw);
+        free(packed);
+    }
+    w->num_groups++;
+    w->group_games = 0;
+}
+
+archive_writer* archive_writer_new(const char* path, const unsigned int* plies,
+                                   unsigned int num_plies) {
+    if (num_plies > ARCHIVE_MAX_PLIES) {
+        fprintf(stderr, "Too many plies for an archive\n");
+        exit(1);
+    }
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Could not create %s\n", path);
+        exit(1);
+    }
+    archive_writer* w = (archive_writer*)malloc(sizeof(archive_writer));
+    check_malloc(w);
+    w->f = f;
+    w->num_plies = num_plies;
+    w->num_columns = COL_POSITIONS + num_plies;
+    memcpy(w->plies, plies, sizeof(unsigned int) * num_plies);
+    w->columns = (column_buf*)calloc(w->num_columns, sizeof(column_buf));
+    check_malloc(w->columns);
+    w->group_games = 0;
+    w->num_groups = 0;
+    w->groups_cap = 16;
+    w->group_sizes = (unsigned int*)malloc(sizeof(unsigned int) *
+                                           w->groups_cap);
+    w->chunks = (archive_chunk*)malloc(sizeof(archive_chunk) *
+                                       w->groups_cap * w->num_columns);
+    check_malloc(w->group_sizes);
+    check_malloc(w->chunks);
+    fwrite(ARCHIVE_MAGIC, 1, 4, f);
+    archive_put_u32(f, ARCHIVE_VERSION);
+    archive_put_u32(f, num_plies);
+    for (unsigned int i = 0; i < num_plies; i++) {
+        archive_put_u32(f, plies[i]);
+    }
+    w->offset = ARCHIVE_HEADER_SIZE + 4 * num_plies;
+    return w;
+}
+
+/* This helper function appends the board of g to a position column as its
+   number of words followed by the words, 32 cells to a word */
+void archive_push_position(column_buf* c, game* g) {
+    board* b = g->b;
+    uint64_t cells = (uint64_t)b->width * b->height;
+    uint64_t words = (cells + 31) / 32, word = 0;
+    archive_column_push(c, words);
+    uint64_t i = 0;
+    for (unsigned int r = 0; r < b->height; r++) {
+        for (unsigned int col = 0; col < b->width; col++, i++) {
+            word |= (uint64_t)board_get(b, make_pos(r, col)) << (2 * (i % 32));
+            if (i % 32 == 31) {
+                archive_column_push(c, word);
+                word = 0;
+            }
+        }
+    }
+    if (i % 32) {
+        archive_column_push(c, word);
+    }
+}
+
+void archive_add_game(archive_writer* w, game* g, const move* moves,
+                      size_t num_moves) {
+    check_null_pointer(w);
+    check_null_pointer(g);
+    column_buf* cols = w->columns;
+    bool taken[ARCHIVE_MAX_PLIES] = {false};
+    for (size_t i = 0; i <= num_moves; i++) {
+        for (unsigned int p = 0; p < w->num_plies; p++) {
+            if (w->plies[p] == i) {
+                archive_push_position(&cols[COL_POSITIONS + p], g);
+                taken[p] = true;
+            }
+        }
+        if (i == num_moves) {
+            break;
+        }
+        if (!play_move(g, moves[i])) {
+            fprintf(stderr, "Illegal move in archived game\n");
+            exit(1);
+        }
+        if (moves[i].kind == MOVE_OFFSET) {
+            archive_column_push(&cols[COL_MOVES], 0);
+        } else if (moves[i].kind == MOVE_DISARRAY) {
+            archive_column_push(&cols[COL_MOVES], 1);
+        } else {
+            archive_column_push(&cols[COL_MOVES],
+                                2 + (uint64_t)moves[i].column);
+        }
+    }
+    for (unsigned int p = 0; p < w->num_plies; p++) {
+        if (!taken[p]) {
+            archive_column_push(&cols[COL_POSITIONS + p], 0);
+        }
+    }
+    archive_column_push(&cols[COL_WIDTH], g->b->width);
+    archive_column_push(&cols[COL_HEIGHT], g->b->height);
+    archive_column_push(&cols[COL_RUN], g->run);
+    archive_column_push(&cols[COL_TYPE], g->b->type);
+    archive_column_push(&cols[COL_OUTCOME], game_outcome(g));
+    archive_column_push(&cols[COL_LENGTH], num_moves);
+    if (++w->group_games == ARCHIVE_GROUP_GAMES) {
+        archive_flush_group(w);
+    }
+}
+
+void archive_writer_finish(archive_writer* w) {
+    check_null_pointer(w);
+    archive_flush_group(w);
+    uint64_t directory = w->offset;
+    archive_put_u32(w->f, w->num_groups);
+    for (unsigned int g = 0; g < w->num_groups; g++) {
+        archive_put_u32(w->f, w->group_sizes[g]);
+        for (unsigned int col = 0; col < w->num_columns; col++) {
+            archive_chunk* chunk = &w->chunks[g * w->num_columns + col];
+            archive_put_u64(w->f, chunk->offset);
+            archive_put_u64(w->f, chunk->compressed_len);
+            archive_put_u64(w->f, chunk->raw_len);
+        }
+    }
+    archive_put_u64(w->f, directory);
+    fwrite(ARCHIVE_MAGIC, 1, 4, w->f);
+    if (fclose(w->f) != 0) {
+        fprintf(stderr, "Could not write archive\n");
+        exit(1);
+    }
+    for (unsigned int col = 0; col < w->num_columns; col++) {
+        free(w->columns[col].values);
+    }
+    free(w->columns);
+    free(w->group_sizes);
+    free(w->chunks);
+    free(w);
+}
+
+/* This helper function reads exactly len bytes at offset, returning false
+   if the file is too short */
+bool archive_read_at(int fd, void* buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char*)buf + done, len - done, offset + done);
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+archive* archive_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    unsigned char head[ARCHIVE_HEADER_SIZE + 4 * ARCHIVE_MAX_PLIES];
+    unsigned char foot[ARCHIVE_FOOTER_SIZE];
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < ARCHIVE_HEADER_SIZE + ARCHIVE_FOOTER_SIZE ||
+        !archive_read_at(fd, head, ARCHIVE_HEADER_SIZE, 0) ||
+        !archive_read_at(fd, foot, ARCHIVE_FOOTER_SIZE,
+                         size - ARCHIVE_FOOTER_SIZE) ||
+        memcmp(head, ARCHIVE_MAGIC, 4) != 0 ||
+        memcmp(foot + 8, ARCHIVE_MAGIC, 4) != 0 ||
+        archive_get_u32(head + 4) != ARCHIVE_VERSION ||
+        archive_get_u32(head + 8) > ARCHIVE_MAX_PLIES) {
+        close(fd);
+        return NULL;
+    }
+    archive* a = (archive*)malloc(sizeof(archive));
+    check_malloc(a);
+    a->fd = fd;
+    a->num_plies = archive_get_u32(head + 8);
+    a->num_columns = COL_POSITIONS + a->num_plies;
+    archive_read_at(fd, head + ARCHIVE_HEADER_SIZE, 4 * a->num_plies,
+            ARCHIVE_HEADER_SIZE);
+    for (unsigned int i = 0; i < a->num_plies; i++) {
+        a->plies[i] = archive_get_u32(head + ARCHIVE_HEADER_SIZE + 4 * i);
+    }
+    uint64_t directory = archive_get_u64(foot);
+    size_t dir_len = size - ARCHIVE_FOOTER_SIZE - directory;
+    unsigned char* dir = (unsigned char*)malloc(dir_len);
+    check_malloc(dir);
+    if (!archive_read_at(fd, dir, dir_len, directory)) {
+        fprintf(stderr, "Corrupt archive directory\n");
+        exit(1);
+    }
+    a->num_groups = archive_get_u32(dir);
+    size_t entry = 4 + 24 * a->num_columns;
+    if (4 + a->num_groups * entry != dir_len) {
+        fprintf(stderr, "Corrupt archive directory\n");
+        exit(1);
+    }
+    a->group_sizes = (unsigned int*)malloc(sizeof(unsigned int) *
+                                           (a->num_groups + 1));
+    a->chunks = (archive_chunk*)malloc(sizeof(archive_chunk) *
+                                       (a->num_groups * a->num_columns + 1));
+    check_malloc(a->group_sizes);
+    check_malloc(a->chunks);
+    a->num_games = 0;
+    for (unsigned int g = 0; g < a->num_groups; g++) {
+        unsigned char* p = dir + 4 + g * entry;
+        a->group_sizes[g] = archive_get_u32(p);
+        a->num_games += a->group_sizes[g];
+        for (unsigned int col = 0; col < a->num_columns; col++) {
+            archive_chunk* chunk = &a->chunks[g * a->num_columns + col];
+            chunk->offset = archive_get_u64(p + 4 + 24 * col);
+            chunk->compressed_len = archive_get_u64(p + 12 + 24 * col);
+            chunk->raw_len = archive_get_u64(p + 20 + 24 * col);
+        }
+    }
+    free(dir);
+    return a;
+}
+
+size_t archive_read_column(archive* a, unsigned int group,
+                           unsigned int column, uint64_t** out) {
+    check_null_pointer(a);
+    if (group >= a->num_groups || column >= a->num_columns) {
+        fprintf(stderr, "No such archive column\n");
+        exit(1);
+    }
+    archive_chunk* chunk = &a->chunks[group * a->num_columns + column];
+    unsigned char* packed = (unsigned char*)malloc(chunk->compressed_len + 1);
+    unsigned char* raw = (unsigned char*)malloc(chunk->raw_len + 1);
+    uint64_t* values = (uint64_t*)malloc(sizeof(uint64_t) *
+                                         (chunk->raw_len + 1));
+    check_malloc(packed);
+    check_malloc(raw);
+    check_malloc(values);
+    uLongf raw_len = chunk->raw_len;
+    if (!archive_read_at(a->fd, packed, chunk->compressed_len, chunk->offset) ||
+        uncompress(raw, &raw_len, packed, chunk->compressed_len) != Z_OK ||
+        raw_len != chunk->raw_len) {
+        fprintf(stderr, "Corrupt archive column\n");
+        exit(1);
+    }
+    size_t n = 0, pos = 0, prev_at = 0, prev_len = 0;
+    uint64_t prev = 0;
+    while (pos < raw_len) {
+        uint64_t v = archive_decode_varint(raw, raw_len, &pos);
+        if (archive_is_delta_column(column)) {
+            prev += archive_unzigzag(v);
+            values[n++] = prev;
+        } else if (column >= COL_POSITIONS) {
+            size_t start = n;
+            values[n++] = v;
+            for (size_t j = 0; j < v; j++) {
+                uint64_t x = archive_decode_varint(raw, raw_len, &pos);
+                if (j < prev_len) {
+                    x ^= values[prev_at + 1 + j];
+                }
+                values[n++] = x;
+            }
+            if (v) {
+                prev_at = start;
+                prev_len = v;
+            }
+        } else {
+            values[n++] = v;
+        }
+    }
+    free(packed);
+    free(raw);
+    *out = values;
+    return n;
+}
+
+void archive_close(archive* a) {
+    close(a->fd);
+    free(a->group_sizes);
+    free(a->chunks);
+    free(a);
+}
@@ -0,0 +1,188 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include "logic.h"
+
+/* A columnar archive stores many finished games, column by column, so that a
+   query only reads and decodes the columns it needs.
+ * Games are grouped into row groups of ARCHIVE_GROUP_GAMES games. Within a
+   group every column is encoded on its own and compressed with zlib, which
+   lets scans hand whole groups to different threads.
+ * Column encodings:
+     - width, height, run, type, outcome and length: zigzag varints of the
+       difference with the previous game's value, so runs of games with the
+       same configuration cost almost nothing.
+     - moves: one varint per move, 0 for an offset, 1 for a disarray and
+       2 + c for a drop into column c, games back to back (their lengths
+       come from the length column).
+     - one position column per requested ply: the number of 64-bit words of
+       the packed board (2 bits per cell, row by row, 0 if the game ended
+       before that ply) then the words, each XORed with the same word of the
+       previous game's position so that shared openings compress away.
+ * The file is the magic "TTCA", a version, the number of plies and the
+   plies themselves, then the compressed column chunks, then a directory of
+   every chunk, and finally the directory's offset and the magic again */
+
+#define ARCHIVE_MAGIC "TTCA"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_GROUP_GAMES 4096
+#define ARCHIVE_MAX_PLIES 16
+
+enum archive_column {
+    COL_WIDTH,
+    COL_HEIGHT,
+    COL_RUN,
+    COL_TYPE,
+    COL_OUTCOME,
+    COL_LENGTH,
+    COL_MOVES,
+    COL_POSITIONS
+};
+
+typedef enum archive_column archive_column;
+
+
+struct column_buf {
+    uint64_t* values;
+    size_t len, cap;
+};
+
+typedef struct column_buf column_buf;
+
+
+struct archive_chunk {
+    uint64_t offset, compressed_len, raw_len;
+};
+
+typedef struct archive_chunk archive_chunk;
+
+
+struct archive_writer {
+    FILE* f;
+    unsigned int num_plies, num_columns;
+    unsigned int plies[ARCHIVE_MAX_PLIES];
+    column_buf* columns;
+    unsigned int group_games, num_groups, groups_cap;
+    unsigned int* group_sizes;
+    archive_chunk* chunks;
+    uint64_t offset;
+};
+
+typedef struct archive_writer archive_writer;
+
+
+struct archive {
+    int fd;
+    unsigned int num_plies, num_columns, num_groups;
+    unsigned int plies[ARCHIVE_MAX_PLIES];
+    unsigned int* group_sizes;
+    archive_chunk* chunks;
+    unsigned long long num_games;
+};
+
+typedef struct archive archive;
+
+
+/**
+ * archive_writer_new
+ *
+ * Creates an archive file and a writer to fill it.
+ *
+ * Parameters:
+ *   - path: The file to create.
+ *   - plies: The plies at which a position column is kept, in any order.
+ *   - num_plies: The number of plies, at most ARCHIVE_MAX_PLIES.
+ *
+ * Returns:
+ *   - A pointer to the new `archive_writer`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `archive_writer_finish`.
+ *   - Raises an error if the file cannot be created.
+ */
+archive_writer* archive_writer_new(const char* path, const unsigned int* plies,
+                                   unsigned int num_plies);
+
+/**
+ * archive_add_game
+ *
+ * Plays a game's moves on a fresh game and appends the game to the archive,
+ *  taking its outcome and the positions at the archive's plies along the
+ *  way.
+ *
+ * Parameters:
+ *   - w: A pointer to the `archive_writer`.
+ *   - g: A game with no move played yet. It is modified.
+ *   - moves: The moves of the game, in order.
+ *   - num_moves: The number of moves.
+ *
+ * Note:
+ *   - Raises an error if one of the moves is illegal.
+ */
+void archive_add_game(archive_writer* w, game* g, const move* moves,
+                      size_t num_moves);
+
+/**
+ * archive_writer_finish
+ *
+ * Writes the last row group and the directory, closes the file and frees
+ *  the writer.
+ *
+ * Parameters:
+ *   - w: A pointer to the `archive_writer`.
+ */
+void archive_writer_finish(archive_writer* w);
+
+/**
+ * archive_open
+ *
+ * Opens an archive and reads its directory. Column data is only read when
+ *  asked for.
+ *
+ * Parameters:
+ *   - path: The archive file.
+ *
+ * Returns:
+ *   - A pointer to the `archive`, or NULL if the file is missing or is not
+ *      an archive.
+ *
+ * Note:
+ *   - The caller is responsible for calling `archive_close`.
+ */
+archive* archive_open(const char* path);
+
+/**
+ * archive_read_column
+ *
+ * Reads, decompresses and decodes one column of one row group.
+ *
+ * Parameters:
+ *   - a: A pointer to the `archive`.
+ *   - group: The row group, below `a->num_groups`.
+ *   - column: The column. Position columns are COL_POSITIONS + i for the
+ *      i-th ply of `a->plies`.
+ *   - out: Out-parameter receiving the values; for delta and XOR encoded
+ *      columns the original values are restored.
+ *
+ * Returns:
+ *   - The number of values, after which *out must be freed by the caller.
+ *
+ * Note:
+ *   - Safe to call from several threads at once.
+ *   - Raises an error if the chunk is corrupt.
+ */
+size_t archive_read_column(archive* a, unsigned int group,
+                           unsigned int column, uint64_t** out);
+
+/**
+ * archive_close
+ *
+ * Closes the archive and frees its directory.
+ *
+ * Parameters:
+ *   - a: A pointer to the `archive`.
+ */
+void archive_close(archive* a);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,199 @@
+#include <string.h>
+#include "logic.h"
+#include "perf.h"
+#include "record.h"
+#include "trace.h"
+
+/* Benchmark harness: plays the same sequence of random games once on a
+   MATRIX board, once on a BITS board and once on a SPARSE board, and
+   reports wall-clock time for each. With -p, hardware counters are
+   attributed to the regions of perf.h so that cache and branch behaviour
+   of the representations can be compared directly. With -t, a Chrome
+   trace of the run is written to the given file. With -o, the BITS games
+   are appended to a game record file, with a keyframe every -k moves */
+
+struct bench_options {
+    unsigned int width, height, run, games, seed, keyframe_interval;
+    bool perf;
+    char* trace_path;
+    char* record_path;
+};
+
+typedef struct bench_options bench_options;
+
+/* This helper function prints the usage line and exits */
+void bench_usage() {
+    fprintf(stderr, "Usage: bench -w <width> -h <height> -r <run> "
+                    "[-n <games>] [-s <seed>] [-p] [-t <trace.json>]\n"
+                    "             [-o <games.rec>] [-k <keyframe interval>]\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * -w, -h and -r are required, -n defaults to 1000 games and -s to seed 1 */
+void parse_bench_arguments(int argc, char** argv, bench_options* opts) {
+    bool w_found = false, h_found = false, r_found = false;
+    opts->games = 1000;
+    opts->seed = 1;
+    opts->perf = false;
+    opts->trace_path = NULL;
+    opts->record_path = NULL;
+    opts->keyframe_interval = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0) {
+            opts->perf = true;
+            continue;
+        }
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            bench_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'w':
+                opts->width = v;
+                w_found = true;
+                break;
+            case 'h':
+                opts->height = v;
+                h_found = true;
+                break;
+            case 'r':
+                opts->run = v;
+                r_found = true;
+                break;
+            case 'n':
+                opts->games = v;
+                break;
+            case 's':
+                opts->seed = v;
+                break;
+            case 't':
+                opts->trace_path = argv[i + 1];
+                break;
+            case 'o':
+                opts->record_path = argv[i + 1];
+                break;
+            case 'k':
+                opts->keyframe_interval = v;
+                break;
+            default:
+                bench_usage();
+        }
+        i++;
+    }
+    if (!w_found || !h_found || !r_found) {
+        bench_usage();
+    }
+}
+
+/* This helper function reads every cell of the board through board_get.
+ * It exercises the representation-specific branch in board_get the same way
+   rendering and evaluation do */
+unsigned int scan_board(board* b) {
+    unsigned int pieces = 0;
+    perf_begin(PERF_BOARD_SCAN);
+    for (unsigned int r = 0; r < b->height; r++) {
+        for (unsigned int c = 0; c < b->width; c++) {
+            pieces += board_get(b, make_pos(r, c)) != EMPTY;
+        }
+    }
+    perf_end(PERF_BOARD_SCAN);
+    return pieces;
+}
+
+/* This helper function plays a move, through the writer when the game is 
+   being recorded */
+bool bench_play(game* g, record_writer* w, move m) {
+    if (w) {
+        return record_play(w, m);
+    }
+    return play_move(g, m);
+}
+
+/* This helper function plays one random game to completion and returns the
+   number of moves made. Roughly 5% of moves are disarrays and 5% offsets;
+   the rest are drops into uniformly chosen columns.
+ * w is the writer attached to g, or NULL when the game is not recorded */
+unsigned int play_random_game(game* g, record_writer* w, unsigned int* seed) {
+    unsigned int moves = 0, width = g->b->width;
+    unsigned int max_moves = 4 * width * g->b->height;
+    while (game_outcome(g) == IN_PROGRESS && moves < max_moves) {
+        unsigned int roll = rand_r(seed) % 100;
+        bool played = false;
+        if (roll < 5) {
+            played = bench_play(g, w, make_move(MOVE_DISARRAY, 0));
+        } else if (roll < 10) {
+            played = bench_play(g, w, make_move(MOVE_OFFSET, 0));
+        }
+        unsigned int col = rand_r(seed) % width;
+        while (!played) {
+            played = bench_play(g, w, make_move(MOVE_DROP, col));
+            col = (col + 1) % width;
+        }
+        scan_board(g->b);
+        moves++;
+    }
+    return moves;
+}
+
+/* This helper function runs every game of the benchmark on one board
+   representation and prints the results.
+ * rec is the stream the games are recorded to, or NULL */
+void run_bench(bench_options* opts, enum type type, FILE* rec) {
+    unsigned int seed = opts->seed;
+    unsigned long long total_moves = 0;
+    perf_reset();
+    uint64_t start = now_ns();
+    for (unsigned int i = 0; i < opts->games; i++) {
+        game* g = new_game(opts->run, opts->width, opts->height, type);
+        record_writer* w = NULL;
+        if (rec) {
+            w = record_writer_new(rec, g, opts->keyframe_interval);
+        }
+        total_moves += play_random_game(g, w, &seed);
+        if (w) {
+            record_writer_finish(w);
+        }
+        game_free(g);
+    }
+    double secs = (now_ns() - start) / 1e9;
+    printf("%s: %u games, %llu moves, %.3f s, %.0f moves/s\n",
+           type == MATRIX ? "MATRIX" : type == BITS ? "BITS" : "SPARSE", 
+           opts->games, total_moves,
+           secs, total_moves / secs);
+    if (opts->perf) {
+        perf_report(stdout);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    bench_options opts;
+    parse_bench_arguments(argc, argv, &opts);
+    if (opts.perf) {
+        perf_enable();
+    }
+    if (opts.trace_path) {
+        trace_enable();
+    }
+    FILE* rec = NULL;
+    if (opts.record_path) {
+        rec = fopen(opts.record_path, "ab");
+        if (rec == NULL) {
+            fprintf(stderr, "Could not open %s\n", opts.record_path);
+            exit(1);
+        }
+    }
+    run_bench(&opts, MATRIX, NULL);
+    run_bench(&opts, BITS, rec);
+    run_bench(&opts, SPARSE, NULL);
+    if (rec) {
+        fclose(rec);
+    }
+    perf_disable();
+    if (opts.trace_path && !trace_flush(opts.trace_path)) {
+        fprintf(stderr, "Could not write trace to %s\n", opts.trace_path);
+        exit(1);
+    }
+    return 0;
+}
@@ -1,3 +1,7 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
 #include "board.h"
 
 board* board_new(unsigned int width, unsigned int height, enum type type) {
@@ -22,8 +26,8 @@ board* board_new(unsigned int width, unsigned int height, enum type type) {
         }
         b->type = MATRIX;
         b->u.matrix = matrix;
-    } else {
-        unsigned int len_array, bits_needed = width * height * 2; 
+    } else if (type == BITS) {
+        size_t len_array, bits_needed = (size_t)width * height * 2; 
         if ((bits_needed % 32) != 0) {
             len_array = (bits_needed / 32) + 1;
         } else {
@@ -32,12 +36,21 @@ board* board_new(unsigned int width, unsigned int height, enum type type) {
         unsigned int* a = (unsigned int*)malloc(sizeof(unsigned int) * 
                             len_array);
         check_malloc(a);
-        for (unsigned int i = 0; i < len_array; i++) {
+        for (size_t i = 0; i < len_array; i++) {
             a[i] = 0;
         }
         b->type = BITS;
         b->u.bits = a;
+    } else {
+        column_stack* columns = (column_stack*)calloc(width, 
+                                                      sizeof(column_stack));
+        check_malloc(columns);
+        b->type = SPARSE;
+        b->u.columns = columns;
     }
+    b->heights = (unsigned int*)calloc(width, sizeof(unsigned int));
+    check_malloc(b->heights);
+    b->full_columns = 0;
     b->width = width;
     b->height = height;
     return b;
@@ -51,60 +64,227 @@ void board_free(board* b) {
             free(matrix[r]);
         }
         free(matrix);
-    } else {
+    } else if (b->type == BITS) {
         free(b->u.bits);
+    } else {
+        for (unsigned int c = 0; c < b->width; c++) {
+            free(b->u.columns[c].chunks);
+        }
+        free(b->u.columns);
     }
+    free(b->heights);
     free(b);
 }
 
-/* This helper function takes in an index i and prints out the corresponding 
-   character or digit.
-   It prints out:   digits if i < 10, 
-                    capital letters if 10 <= i < 36, 
-                    lower-case letters if 36 <= i < 62,
-                    ? for any greater size to indicate that we have run out 
-                    of labels */
-void print_from_ind(unsigned int i) {
-    if (i < 10) {
-        printf("%d", i);
-    } else if (i >= 10 && i < 36) {
-        printf("%c", 'A' + (i - 10));
-    } else if (i >= 36 && i < 62) {
-        printf("%c", 'a' + (i - 36));
+/* This helper function takes in a base 62 digit and returns its character: 
+   digits below 10, capital letters from 10 to 35 and lower-case letters 
+   from 36 to 61 */
+char label_char(unsigned int d) {
+    if (d < 10) {
+        return '0' + d;
+    } else if (d < 36) {
+        return 'A' + (d - 10);
     } else {
-        printf("?");
+        return 'a' + (d - 36);
+    }
+}
+
+unsigned int label_digits(unsigned int n) {
+    unsigned int digits = 1;
+    for (unsigned long long limit = 62; limit < n; limit *= 62) {
+        digits++;
+    }
+    return digits;
+}
+
+/* This helper function writes the label of index i padded to the given 
+   number of digits at out and returns the position right after it */
+char* write_label(char* out, unsigned int i, unsigned int digits) {
+    for (unsigned int k = digits; k > 0; k--) {
+        out[k - 1] = label_char(i % 62);
+        i /= 62;
+    }
+    return out + digits;
+}
+
+void print_label(unsigned int i, unsigned int digits) {
+    char s[8];
+    fwrite(s, 1, write_label(s, i, digits) - s, stdout);
+}
+
+void print_from_ind(unsigned int i) {
+    print_label(i, label_digits(i + 1));
+}
+
+/* This helper function returns the length of one rendered line, which is 
+   the same for the header and every row: the row label and a space, then 
+   every column as a label or cell padded to the column label width and a 
+   space, then the newline */
+size_t render_line_len(board* b) {
+    return label_digits(b->height) + 2 + 
+           (size_t)b->width * (label_digits(b->width) + 1);
+}
+
+size_t board_render_size(board* b) {
+    check_null_pointer(b);
+    return 2 + render_line_len(b) * ((size_t)b->height + 1);
+}
+
+/* This helper function renders row r of the board at out, reading the 
+   cells straight from the representation rather than through board_get, 
+   and returns the position right after the row's newline */
+char* render_row(board* b, unsigned int r, char* out, unsigned int row_digits,
+                 unsigned int col_digits) {
+    static const char symbols[4] = {'.', '*', 'o', '?'};
+    out = write_label(out, r, row_digits);
+    *out++ = ' ';
+    for (unsigned int c = 0; c < b->width; c++) {
+        unsigned int ce;
+        if (b->type == MATRIX) {
+            ce = b->u.matrix[r][c];
+        } else if (b->type == BITS) {
+            uint64_t i = (uint64_t)r * b->width + c;
+            ce = (b->u.bits[i / 16] >> (2 * (i % 16))) & 0x3;
+        } else {
+            column_stack* st = &b->u.columns[c];
+            unsigned int i = b->height - 1 - r;
+            ce = i < st->len ? (st->chunks[i / 16] >> (2 * (i % 16))) & 0x3 
+                             : EMPTY;
+        }
+        *out++ = symbols[ce & 0x3];
+        memset(out, ' ', col_digits);
+        out += col_digits;
+    }
+    *out++ = '\n';
+    return out;
+}
+
+size_t board_render(board* b, char* buf, size_t cap) {
+    check_null_pointer(b);
+    check_null_pointer(buf);
+    size_t len = board_render_size(b);
+    if (cap < len) {
+        return 0;
+    }
+    unsigned int col_digits = label_digits(b->width), 
+                 row_digits = label_digits(b->height);
+    char* out = buf;
+    *out++ = '\n';
+    memset(out, ' ', row_digits + 1);
+    out += row_digits + 1;
+    for (unsigned int c = 0; c < b->width; c++) {
+        out = write_label(out, c, col_digits);
+        *out++ = ' ';
+    }
+    *out++ = '\n';
+    for (unsigned int r = 0; r < b->height; r++) {
+        out = render_row(b, r, out, row_digits, col_digits);
+    }
+    *out++ = '\n';
+    return len;
+}
+
+/* This helper function writes all len bytes of buf to standard output, 
+   after flushing whatever stdio still holds so that output stays in 
+   order */
+void write_stdout(const char* buf, size_t len) {
+    fflush(stdout);
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= n;
     }
 }
 
 void board_show(board* b) {
     check_null_pointer(b);
-    printf("\n");
-    printf("  ");
-    unsigned int width = b->width;
-    for (unsigned int c = 0; c < width; c++) {
-        print_from_ind(c);
-        printf(" ");
-    }
-    printf("\n");
-    unsigned int height = b->height;
-    cell ce; 
-    for (unsigned int r = 0; r < height; r++) {
-        print_from_ind(r);
-        printf(" ");
-        for (unsigned int c = 0; c < width; c++) {
-            ce = board_get(b, make_pos(r, c));
-            if (ce == EMPTY) {
-                printf(".");
-            } else if (ce == BLACK) {
-                printf("*");
-            } else if (ce == WHITE) {
-                printf("o");
+    size_t len = board_render_size(b);
+    char* buf = (char*)malloc(len);
+    check_malloc(buf);
+    board_render(b, buf, len);
+    write_stdout(buf, len);
+    free(buf);
+}
+
+board_view* board_view_new() {
+    board_view* v = (board_view*)calloc(1, sizeof(board_view));
+    check_malloc(v);
+    return v;
+}
+
+/* This helper function appends len bytes to the output of a view */
+void view_append(board_view* v, const char* s, size_t len) {
+    memcpy(v->out + v->out_len, s, len);
+    v->out_len += len;
+}
+
+const char* board_view_update(board_view* v, board* b, size_t* len) {
+    check_null_pointer(v);
+    check_null_pointer(b);
+    size_t size = board_render_size(b), line = render_line_len(b);
+    bool redraw = v->prev == NULL || v->width != b->width || 
+                  v->height != b->height;
+    if (redraw) {
+        free(v->prev);
+        free(v->cur);
+        free(v->out);
+        v->prev = (char*)malloc(size);
+        v->cur = (char*)malloc(size);
+        /* Every row may change, each then costing a cursor move of at most 
+           16 bytes besides itself, and a full redraw clears the screen */
+        v->out_cap = size + 16 * ((size_t)b->height + 2);
+        v->out = (char*)malloc(v->out_cap);
+        check_malloc(v->prev);
+        check_malloc(v->cur);
+        check_malloc(v->out);
+        v->width = b->width;
+        v->height = b->height;
+    }
+    board_render(b, v->cur, size);
+    v->out_len = 0;
+    char move[16];
+    if (redraw) {
+        view_append(v, "\x1b[H\x1b[2J", 7);
+        view_append(v, v->cur, size);
+    } else {
+        /* Line 1 is blank, line 2 holds the column labels and row r is on 
+           line 3 + r, counting from 1 as the terminal does */
+        for (unsigned int r = 0; r < b->height; r++) {
+            size_t at = 1 + line * ((size_t)r + 1);
+            if (memcmp(v->cur + at, v->prev + at, line) == 0) {
+                continue;
             }
-            printf(" ");
+            int n = snprintf(move, sizeof(move), "\x1b[%u;1H", r + 3);
+            view_append(v, move, n);
+            view_append(v, v->cur + at, line);
         }
-        printf("\n"); 
+        int n = snprintf(move, sizeof(move), "\x1b[%u;1H", b->height + 4);
+        view_append(v, move, n);
     }
-    printf("\n");
+    char* t = v->prev;
+    v->prev = v->cur;
+    v->cur = t;
+    *len = v->out_len;
+    return v->out;
+}
+
+void board_show_diff(board_view* v, board* b) {
+    size_t len;
+    const char* out = board_view_update(v, b, &len);
+    write_stdout(out, len);
+}
+
+void board_view_free(board_view* v) {
+    free(v->prev);
+    free(v->cur);
+    free(v->out);
+    free(v);
 }
 
 /* This helper function takes in a board and a position and raises an error 
@@ -122,9 +302,16 @@ cell board_get(board* b, pos p) {
     check_out_of_bounds_indexing(b, p);
     if (b->type == MATRIX) {
         return b->u.matrix[p.r][p.c];
+    } else if (b->type == SPARSE) {
+        column_stack* s = &b->u.columns[p.c];
+        unsigned int i = b->height - 1 - p.r;
+        if (i >= s->len) {
+            return EMPTY;
+        }
+        return (s->chunks[i / 16] >> (2 * (i % 16))) & 0x3;
     } else {
-        unsigned int glob_rank_pair = (p.c + 1) + (p.r * b->width) - 1;
-        unsigned int i = glob_rank_pair / 16;
+        uint64_t glob_rank_pair = (uint64_t)p.r * b->width + p.c;
+        size_t i = glob_rank_pair / 16;
         unsigned char loc_rank_pair = glob_rank_pair % 16;
         unsigned int cell_val = (b->u.bits[i] >> (loc_rank_pair * 2)) & 0x3;
         switch (cell_val) {
@@ -138,22 +325,153 @@ cell board_get(board* b, pos p) {
     }
 }
 
+/* This helper function sets the i-th cell from the bottom of a column 
+   stack. Chunks are added when a piece goes above the stack and the stack
+   shrinks back to its highest piece when the top is emptied */
+void column_stack_set(column_stack* s, unsigned int i, cell c) {
+    if (i >= s->len) {
+        if (c == EMPTY) {
+            return;
+        }
+        unsigned int chunks = i / 16 + 1;
+        if (chunks > s->cap) {
+            unsigned int cap = s->cap ? s->cap : 1;
+            while (cap < chunks) {
+                cap *= 2;
+            }
+            s->chunks = (uint32_t*)realloc(s->chunks, sizeof(uint32_t) * cap);
+            check_malloc(s->chunks);
+            memset(s->chunks + s->cap, 0, sizeof(uint32_t) * (cap - s->cap));
+            s->cap = cap;
+        }
+        s->len = i + 1;
+    }
+    uint32_t* w = &s->chunks[i / 16];
+    *w = (*w & ~(0x3u << (2 * (i % 16)))) | ((uint32_t)c << (2 * (i % 16)));
+    while (s->len && ((s->chunks[(s->len - 1) / 16] >> 
+                       (2 * ((s->len - 1) % 16))) & 0x3) == EMPTY) {
+        s->len--;
+    }
+}
+
+/* This helper function keeps the height of a column and the count of full 
+   columns up to date after the cell at position p was set to c. Setting 
+   the top piece of a column to EMPTY walks down to the next piece, which 
+   under gravity is the cell right below */
+void update_height(board* b, pos p, cell c) {
+    unsigned int i = b->height - 1 - p.r, *h = &b->heights[p.c];
+    bool was_full = *h == b->height;
+    if (c != EMPTY && i >= *h) {
+        *h = i + 1;
+    } else if (c == EMPTY && i + 1 == *h) {
+        do {
+            (*h)--;
+        } while (*h > 0 && 
+                 board_get(b, make_pos(b->height - *h, p.c)) == EMPTY);
+    }
+    if (was_full != (*h == b->height)) {
+        if (was_full) {
+            b->full_columns--;
+        } else {
+            b->full_columns++;
+        }
+    }
+}
+
 void board_set(board* b, pos p, cell c) {
     check_null_pointer(b);
     if (b->type == MATRIX) {
         check_out_of_bounds_indexing(b, p);
         b->u.matrix[p.r][p.c] = c;
+    } else if (b->type == SPARSE) {
+        check_out_of_bounds_indexing(b, p);
+        column_stack_set(&b->u.columns[p.c], b->height - 1 - p.r, c);
     } else {
-        unsigned int glob_rank_pair = (p.c + 1) + (p.r * b->width) - 1;
-        unsigned int i = glob_rank_pair / 16;
+        check_out_of_bounds_indexing(b, p);
+        uint64_t glob_rank_pair = (uint64_t)p.r * b->width + p.c;
+        size_t i = glob_rank_pair / 16;
         unsigned char loc_rank_pair = glob_rank_pair % 16;
         unsigned int* a = b->u.bits;
-        a[i] &= 0xFFFFFFFF ^ (0x3 << (loc_rank_pair * 2));
+        a[i] &= 0xFFFFFFFF ^ (0x3u << (loc_rank_pair * 2));
         if (c == BLACK) {
-            a[i] |= 0x1 << (loc_rank_pair * 2);
+            a[i] |= 0x1u << (loc_rank_pair * 2);
         } else if (c == WHITE) {
-            a[i] |= 0x2 << (loc_rank_pair * 2);
+            a[i] |= 0x2u << (loc_rank_pair * 2);
+        }
+    }
+    update_height(b, p, c);
+}
+
+size_t board_packed_words(unsigned int width, unsigned int height) {
+    return ((size_t)width * height * 2 + 31) / 32;
+}
+
+void board_pack(board* b, unsigned int* words) {
+    check_null_pointer(b);
+    check_null_pointer(words);
+    size_t len = board_packed_words(b->width, b->height);
+    if (b->type == BITS) {
+        memcpy(words, b->u.bits, sizeof(unsigned int) * len);
+        return;
+    }
+    memset(words, 0, sizeof(unsigned int) * len);
+    size_t i = 0;
+    for (unsigned int r = 0; r < b->height; r++) {
+        for (unsigned int c = 0; c < b->width; c++, i++) {
+            words[i / 16] |= (unsigned int)board_get(b, make_pos(r, c)) << 
+                             (2 * (i % 16));
+        }
+    }
+}
+
+/* This helper function recomputes the column heights and the count of full 
+   columns of a board whose cells were written without board_set */
+void recount_heights(board* b) {
+    b->full_columns = 0;
+    for (unsigned int c = 0; c < b->width; c++) {
+        unsigned int r = 0;
+        while (r < b->height && board_get(b, make_pos(r, c)) == EMPTY) {
+            r++;
         }
+        b->heights[c] = b->height - r;
+        b->full_columns += r == 0;
     }
 }
 
+board* board_unpack(unsigned int width, unsigned int height, enum type type,
+                    const unsigned int* words) {
+    check_null_pointer((void*)words);
+    board* b = board_new(width, height, type);
+    if (type == BITS) {
+        memcpy(b->u.bits, words, 
+               sizeof(unsigned int) * board_packed_words(width, height));
+        recount_heights(b);
+        return b;
+    } else if (type == SPARSE) {
+        size_t i = 0;
+        for (unsigned int r = 0; r < height; r++) {
+            for (unsigned int c = 0; c < width; c++, i++) {
+                cell ce = (words[i / 16] >> (2 * (i % 16))) & 0x3;
+                if (ce != EMPTY) {
+                    board_set(b, make_pos(r, c), ce);
+                }
+            }
+        }
+        return b;
+    }
+    size_t i = 0;
+    for (unsigned int r = 0; r < height; r++) {
+        cell* row = b->u.matrix[r];
+        for (unsigned int c = 0; c < width; c++, i++) {
+            row[c] = (words[i / 16] >> (2 * (i % 16))) & 0x3;
+        }
+    }
+    recount_heights(b);
+    return b;
+}
+
+unsigned int board_column_height(board* b, unsigned int c) {
+    check_null_pointer(b);
+    check_out_of_bounds_indexing(b, make_pos(0, c));
+    return b->heights[c];
+}
@@ -1,6 +1,7 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include <stdint.h>
 #include "pos.h"
 
 enum cell {
@@ -12,27 +13,58 @@ enum cell {
 typedef enum cell cell;
 
 
+/* A column stack holds one column of a SPARSE board from the bottom up, 2 
+   bits per cell, in chunks of 16 cells that are only allocated once a 
+   piece reaches them. len is the number of cells up to the highest piece, 
+   so under gravity memory follows the number of pieces, not the height */
+struct column_stack {
+    uint32_t* chunks;
+    unsigned int len, cap;
+};
+
+typedef struct column_stack column_stack;
+
+
 union board_rep {
     enum cell** matrix;
     unsigned int* bits;
+    column_stack* columns;
 };
 
 typedef union board_rep board_rep;
 
 enum type {
-    MATRIX, BITS
+    MATRIX, BITS, SPARSE
 };
 
 
+/* heights holds, for every column, the number of cells from the bottom up 
+   to its highest piece, and full_columns the number of columns whose top 
+   cell is taken. Both are kept up to date by board_set whatever the 
+   representation */
 struct board {
     unsigned int width, height;
     enum type type;
     board_rep u;
+    unsigned int* heights;
+    unsigned int full_columns;
 };
 
 typedef struct board board;
 
 
+/* A board view remembers the last rendering of a board shown in a terminal,
+   so that the next one only redraws the rows that changed. cur and out are
+   reused from call to call */
+struct board_view {
+    char *prev, *cur, *out;
+    size_t out_len, out_cap;
+    unsigned int width, height;
+};
+
+typedef struct board_view board_view;
+
+
 /**
  * board_new
  * 
@@ -46,6 +78,8 @@ typedef struct board board;
  * Returns:
  *   - A pointer to the newly created `board` structure.
  *     The board is fully initialized and all cells are set to EMPTY.
+ *     MATRIX and BITS boards allocate every cell up front; SPARSE boards 
+ *      only allocate one empty stack per column.
  */
 board* board_new(unsigned int width, unsigned int height, enum type type);
 
@@ -76,12 +110,140 @@ void board_free(board* b);
  *     - `.` for EMPTY cells
  *     - `*` for BLACK pieces
  *     - `o` for WHITE pieces
+ *   - Labels are as wide as the largest one needs, and so are the cells, so 
+ *      columns stay aligned on boards wider than 62 columns.
+ *   - The board is rendered into one buffer by `board_render` and written 
+ *      with a single `write` call, after flushing standard output.
  * 
  * Note:
  *   - Raises an error if the board pointer is NULL 
  */
 void board_show(board* b);
 
+/**
+ * board_render_size
+ * 
+ * Returns the number of bytes `board_render` writes for a board, which is 
+ *  exactly what `board_show` prints.
+ * 
+ * Parameters:
+ *   - b: A pointer to the `board` structure.
+ */
+size_t board_render_size(board* b);
+
+/**
+ * board_render
+ * 
+ * Renders the board the way `board_show` displays it into a buffer, row by 
+ *  row straight from the representation. This is meant for logging 
+ *  positions without going through standard output.
+ * 
+ * Parameters:
+ *   - b: A pointer to the `board` structure.
+ *   - buf: The buffer to render into. It is not NUL-terminated.
+ *   - cap: The size of the buffer.
+ * 
+ * Returns:
+ *   - The number of bytes written, or 0 if cap is below 
+ *      `board_render_size`.
+ * 
+ * Note:
+ *   - Raises an error if a pointer is NULL.
+ */
+size_t board_render(board* b, char* buf, size_t cap);
+
+/**
+ * board_view_new
+ * 
+ * Creates a view for showing successive positions in a terminal.
+ * 
+ * Returns:
+ *   - A pointer to a `board_view` that has shown nothing yet.
+ * 
+ * Note:
+ *   - The caller is responsible for calling `board_view_free`.
+ */
+board_view* board_view_new();
+
+/**
+ * board_view_update
+ * 
+ * Renders a board and returns the bytes that bring a terminal showing the 
+ *  view's last board to this one: the whole board after clearing the 
+ *  screen the first time or when the size changed, and otherwise only the 
+ *  changed rows, each behind an ANSI cursor move, then a move to the line 
+ *  below the board.
+ * 
+ * Parameters:
+ *   - v: A pointer to the `board_view`.
+ *   - b: A pointer to the `board` structure.
+ *   - len: Out-parameter receiving the number of bytes.
+ * 
+ * Returns:
+ *   - The bytes, owned by the view and valid until its next update.
+ * 
+ * Note:
+ *   - Raises an error if a pointer is NULL.
+ */
+const char* board_view_update(board_view* v, board* b, size_t* len);
+
+/**
+ * board_show_diff
+ * 
+ * Shows a board in the terminal through a view, writing the output of 
+ *  `board_view_update` with a single `write` call.
+ * 
+ * Parameters:
+ *   - v: A pointer to the `board_view`.
+ *   - b: A pointer to the `board` structure.
+ */
+void board_show_diff(board_view* v, board* b);
+
+/**
+ * board_view_free
+ * 
+ * Frees a view and its buffers.
+ * 
+ * Parameters:
+ *   - v: A pointer to the `board_view`.
+ */
+void board_view_free(board_view* v);
+
+/**
+ * print_from_ind
+ * 
+ * Prints the label of a row or column with as few characters as it needs. 
+ *  Labels are numbers in base 62 whose digits are `0`-`9`, then upper-case 
+ *  and then lower-case letters, so indices below 62 take one character.
+ * 
+ * Parameters:
+ *   - i: The row or column index (unsigned integer).
+ */
+void print_from_ind(unsigned int i);
+
+/**
+ * label_digits
+ * 
+ * Returns the number of base 62 digits needed to label every index below n, 
+ *  which is at least 1.
+ * 
+ * Parameters:
+ *   - n: The number of rows or columns (unsigned integer).
+ */
+unsigned int label_digits(unsigned int n);
+
+/**
+ * print_label
+ * 
+ * Prints the label of a row or column padded with leading `0` digits, so 
+ *  that all the labels of a board line up.
+ * 
+ * Parameters:
+ *   - i: The row or column index (unsigned integer).
+ *   - digits: The number of characters to print, from `label_digits`.
+ */
+void print_label(unsigned int i, unsigned int digits);
+
 /**
  * board_get
  * 
@@ -121,4 +283,67 @@ cell board_get(board* b, pos p);
  */
 void board_set(board* b, pos p, cell c);
 
+/**
+ * board_packed_words
+ * 
+ * Returns the number of 32-bit words taken by the packed form of a board of 
+ *  the given size.
+ * 
+ * Parameters:
+ *   - width: The number of columns (unsigned integer).
+ *   - height: The number of rows (unsigned integer).
+ */
+size_t board_packed_words(unsigned int width, unsigned int height);
+
+/**
+ * board_column_height
+ * 
+ * Returns the number of cells of a column from the bottom up to its highest
+ *  piece, which under gravity is its number of pieces.
+ * 
+ * Parameters:
+ *   - b: A pointer to the `board` structure.
+ *   - c: The column (unsigned integer).
+ * 
+ * Note:
+ *   - Takes constant time, as heights are kept by `board_set`.
+ */
+unsigned int board_column_height(board* b, unsigned int c);
+
+/**
+ * board_pack
+ * 
+ * Writes the packed form of a board: 2 bits per cell (0 for EMPTY, 1 for 
+ *  BLACK, 2 for WHITE), cells in row-major order, 16 cells to a word, 
+ *  starting from the low bits. This is the layout of the BITS 
+ *  representation, so packing a BITS board is a plain copy.
+ * 
+ * Parameters:
+ *   - b: A pointer to the `board` structure.
+ *   - words: Out-parameter of `board_packed_words` words.
+ * 
+ * Note:
+ *   - Raises an error if a pointer is NULL.
+ */
+void board_pack(board* b, unsigned int* words);
+
+/**
+ * board_unpack
+ * 
+ * Creates a board of any representation from its packed form.
+ * 
+ * Parameters:
+ *   - width: The number of columns (unsigned integer).
+ *   - height: The number of rows (unsigned integer).
+ *   - type: The representation type of the board (enum type).
+ *   - words: The packed form, as written by `board_pack`.
+ * 
+ * Returns:
+ *   - A pointer to the newly created `board` structure. BITS boards take 
+ *      one copy of the words; MATRIX boards are filled row by row without 
+ *      going through `board_set`.
+ */
+board* board_unpack(unsigned int width, unsigned int height, enum type type,
+                    const unsigned int* words);
+
 #endif /* BOARD_H */
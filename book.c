@@ -0,0 +1,166 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "book.h"
+#include "hash.h"
+#include "serial.h"
+
+/* Interpolation steps tried before a lookup falls back to bisection, which
+   bounds the cost of a badly skewed book */
+#define BOOK_INTERPOLATION_STEPS 8
+
+bool book_write(const char* path, const book_entry* entries, 
+                uint64_t num_entries, unsigned int width, 
+                unsigned int height, unsigned int run) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    book_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BOOK_MAGIC, 4);
+    h.version = BOOK_VERSION;
+    h.width = width;
+    h.height = height;
+    h.run = run;
+    h.num_entries = num_entries;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(entries, sizeof(book_entry), num_entries, f) == 
+              num_entries;
+    return fclose(f) == 0 && ok;
+}
+
+book* book_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(book_header)) {
+        close(fd);
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const book_header* h = (const book_header*)map;
+    if (memcmp(h->magic, BOOK_MAGIC, 4) != 0 || 
+        (h->version != BOOK_VERSION && h->version != 1) ||
+        h->num_entries > (st.st_size - sizeof(book_header)) / 
+                         sizeof(book_entry)) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    madvise(map, st.st_size, MADV_RANDOM);
+    book* bk = (book*)malloc(sizeof(book));
+    check_malloc(bk);
+    bk->map = map;
+    bk->map_len = st.st_size;
+    bk->header = h;
+    bk->entries = (const book_entry*)(h + 1);
+    bk->num_entries = h->num_entries;
+    return bk;
+}
+
+const book_entry* book_probe(book* bk, uint64_t key) {
+    check_null_pointer(bk);
+    const book_entry* e = bk->entries;
+    if (bk->num_entries == 0) {
+        return NULL;
+    }
+    uint64_t lo = 0, hi = bk->num_entries - 1;
+    for (unsigned int i = 0; i < BOOK_INTERPOLATION_STEPS; i++) {
+        if (key < e[lo].key || key > e[hi].key) {
+            return NULL;
+        }
+        if (e[hi].key == e[lo].key) {
+            break;
+        }
+        uint64_t mid = lo + (unsigned __int128)(key - e[lo].key) * 
+                            (hi - lo) / (e[hi].key - e[lo].key);
+        if (e[mid].key == key) {
+            return &e[mid];
+        } else if (e[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+        if (lo > hi || hi == UINT64_MAX) {
+            return NULL;
+        }
+    }
+    while (lo <= hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (e[mid].key == key) {
+            return &e[mid];
+        } else if (e[mid].key < key) {
+            lo = mid + 1;
+        } else if (mid == 0) {
+            return NULL;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+double book_score(const book_entry* e, turn player) {
+    check_null_pointer((void*)e);
+    if (e->games == 0) {
+        return 0.0;
+    }
+    uint32_t wins = player == BLACKS_TURN ? e->black_wins : e->white_wins;
+    return (wins + 0.5 * e->draws) / e->games;
+}
+
+bool book_choose(book* bk, game* g, unsigned int min_games, move* out,
+                 const book_entry** out_entry) {
+    check_null_pointer(bk);
+    check_null_pointer(g);
+    check_null_pointer(out);
+    const book_header* h = bk->header;
+    if (h->width != g->b->width || h->height != g->b->height || 
+        h->run != g->run) {
+        return false;
+    }
+    size_t size = game_serialized_size(g);
+    unsigned char* buf = (unsigned char*)malloc(size);
+    check_malloc(buf);
+    game_serialize(g, buf, size);
+    const book_entry* best = NULL;
+    double best_score = -1.0;
+    for (unsigned int i = 0; i < g->b->width + 2; i++) {
+        move m = move_from_index(g->b->width, i);
+        game* child = game_deserialize(buf, size, -1);
+        if (play_move(child, m)) {
+            key_pair k = game_key_pair(child);
+            const book_entry* e = book_probe(bk, h->version == 1 ? k.key :
+                                             canonical_key(k, NULL));
+            if (e && e->games >= min_games) {
+                double score = book_score(e, g->player);
+                if (score > best_score || 
+                    (score == best_score && e->games > best->games)) {
+                    best = e;
+                    best_score = score;
+                    *out = m;
+                }
+            }
+        }
+        game_free(child);
+    }
+    free(buf);
+    if (out_entry) {
+        *out_entry = best;
+    }
+    return best != NULL;
+}
+
+void book_close(book* bk) {
+    check_null_pointer(bk);
+    munmap(bk->map, bk->map_len);
+    free(bk);
+}
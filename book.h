@@ -0,0 +1,147 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stdint.h>
+#include "logic.h"
+
+/* An opening book maps position keys (see hash.h) to the outcomes of the
+   self-play games that went through that position.
+ * The file is a 32-byte header followed by fixed 24-byte entries sorted by
+   key, all in the host's byte order. It is used in place through mmap, so
+   opening a book costs the same whatever its size: lookups only touch the
+   pages they search, and the kernel keeps the hot ones cached.
+ * Since version 2 a position and its mirror image share one entry, under 
+   their canonical key (see hash.h). Version 1 books, keyed by plain 
+   position keys, can still be read.
+ * Keys are uniformly spread 64-bit values, which lets a lookup interpolate
+   where a key should be instead of bisecting, typically reaching it in two
+   or three probes */
+
+#define BOOK_MAGIC "TTBK"
+#define BOOK_VERSION 2
+
+struct book_header {
+    char magic[4];
+    uint32_t version, width, height, run, reserved;
+    uint64_t num_entries;
+};
+
+typedef struct book_header book_header;
+
+
+struct book_entry {
+    uint64_t key;
+    uint32_t games, black_wins, white_wins, draws;
+};
+
+typedef struct book_entry book_entry;
+
+
+struct book {
+    void* map;
+    size_t map_len;
+    const book_header* header;
+    const book_entry* entries;
+    uint64_t num_entries;
+};
+
+typedef struct book book;
+
+
+/**
+ * book_write
+ *
+ * Writes a book file from entries already sorted by key, with no key 
+ *  repeated.
+ *
+ * Parameters:
+ *   - path: The file to create.
+ *   - entries: The entries.
+ *   - num_entries: The number of entries.
+ *   - width, height, run: The configuration of the games in the book.
+ *
+ * Returns:
+ *   - `true` on success, `false` if the file could not be written.
+ */
+bool book_write(const char* path, const book_entry* entries, 
+                uint64_t num_entries, unsigned int width, 
+                unsigned int height, unsigned int run);
+
+/**
+ * book_open
+ *
+ * Maps a book file into memory. Nothing is read or parsed beyond the 
+ *  header.
+ *
+ * Parameters:
+ *   - path: The book file.
+ *
+ * Returns:
+ *   - A pointer to the `book`, or NULL if the file is missing, truncated or
+ *      is not a book.
+ *
+ * Note:
+ *   - The caller is responsible for calling `book_close`.
+ */
+book* book_open(const char* path);
+
+/**
+ * book_probe
+ *
+ * Looks a position key up in the book.
+ *
+ * Parameters:
+ *   - bk: A pointer to the `book`.
+ *   - key: The position key.
+ *
+ * Returns:
+ *   - A pointer to the entry inside the mapping, or NULL if the key is not 
+ *      in the book.
+ */
+const book_entry* book_probe(book* bk, uint64_t key);
+
+/**
+ * book_score
+ *
+ * Returns the share of an entry's games won by a player, counting draws as
+ *  half a win.
+ *
+ * Parameters:
+ *   - e: A pointer to the `book_entry`.
+ *   - player: The player to score for.
+ */
+double book_score(const book_entry* e, turn player);
+
+/**
+ * book_choose
+ *
+ * Picks the book move for the player to move: every legal drop, the offset 
+ *  and the disarray are tried on a copy of the game, and the move leading to
+ *  the book position with the best score for the mover is chosen.
+ *
+ * Parameters:
+ *   - bk: A pointer to the `book`.
+ *   - g: A pointer to the `game` structure. It is not modified.
+ *   - min_games: Positions seen in fewer games are ignored.
+ *   - out: Out-parameter receiving the move.
+ *   - out_entry: Out-parameter receiving the entry of the position the move
+ *      leads to. May be NULL.
+ *
+ * Returns:
+ *   - `true` if a move was found, `false` if the game is out of book or 
+ *      its configuration differs from the book's.
+ */
+bool book_choose(book* bk, game* g, unsigned int min_games, move* out,
+                 const book_entry** out_entry);
+
+/**
+ * book_close
+ *
+ * Unmaps the book and frees it.
+ *
+ * Parameters:
+ *   - bk: A pointer to the `book`.
+ */
+void book_close(book* bk);
+
+#endif /* BOOK_H */
@@ -0,0 +1,279 @@
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "book.h"
+#include "hash.h"
+#include "trace.h"
+
+/* Builds an opening book from random self-play. Every thread plays its share
+   of the games and notes the key of each position within the first -d
+   plies, in canonical form so that mirror images share an entry; once a 
+   game ends, its outcome is credited once to each distinct position it
+   noted, even one the game went through several times. Each thread adds
+   the outcomes up in its own table as it goes, so memory grows with the
+   positions seen rather than the games played. The tables of all threads
+   are then sorted by key and merged into one entry per position, and
+   positions seen in fewer than -m games are dropped.
+ * Moves are drawn like in bench: roughly 5% disarrays, 5% offsets and
+   otherwise a drop into a uniformly chosen column. Games still running
+   after 4 * width * height moves count as draws */
+
+struct bookgen_options {
+    unsigned int width, height, run, games, seed, depth, threads, min_games;
+    char* path;
+};
+
+typedef struct bookgen_options bookgen_options;
+
+
+/* A thread's table is open-addressed by key, with linear probing. Slots
+   with no games are free */
+struct bookgen_thread {
+    bookgen_options* opts;
+    unsigned int games, seed;
+    uint64_t* keys;
+    book_entry* table;
+    size_t len, cap;
+    unsigned long long samples;
+};
+
+typedef struct bookgen_thread bookgen_thread;
+
+/* This helper function prints the usage line and exits */
+void bookgen_usage() {
+    fprintf(stderr, "Usage: bookgen -w <width> -h <height> -r <run> "
+                    "[-n <games>] [-d <plies>] [-s <seed>]\n"
+                    "               [-j <threads>] [-m <min games>] "
+                    "<out.book>\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * -w, -h and -r are required. By default 100000 games are played from seed
+   1 on every core, positions up to ply 16 are kept if seen at least once */
+void parse_bookgen_arguments(int argc, char** argv, bookgen_options* opts) {
+    bool w_found = false, h_found = false, r_found = false;
+    opts->games = 100000;
+    opts->seed = 1;
+    opts->depth = 16;
+    opts->threads = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->min_games = 1;
+    opts->path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' && i == argc - 1) {
+            opts->path = argv[i];
+            break;
+        }
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            bookgen_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'w':
+                opts->width = v;
+                w_found = true;
+                break;
+            case 'h':
+                opts->height = v;
+                h_found = true;
+                break;
+            case 'r':
+                opts->run = v;
+                r_found = true;
+                break;
+            case 'n':
+                opts->games = v;
+                break;
+            case 'd':
+                opts->depth = v;
+                break;
+            case 's':
+                opts->seed = v;
+                break;
+            case 'j':
+                opts->threads = v;
+                break;
+            case 'm':
+                opts->min_games = v;
+                break;
+            default:
+                bookgen_usage();
+        }
+        i++;
+    }
+    if (!w_found || !h_found || !r_found || !opts->path || 
+        opts->threads == 0) {
+        bookgen_usage();
+    }
+}
+
+/* This helper function returns the slot of a key in a table of cap slots,
+   or the free slot where it belongs */
+size_t find_slot(book_entry* table, size_t cap, uint64_t key) {
+    size_t i = key & (cap - 1);
+    while (table[i].games && table[i].key != key) {
+        i = (i + 1) & (cap - 1);
+    }
+    return i;
+}
+
+/* This helper function credits an outcome to a position in a thread's
+   table, doubling the table once it is three quarters full */
+void add_outcome(bookgen_thread* t, uint64_t key, outcome o) {
+    if (4 * (t->len + 1) > 3 * t->cap) {
+        size_t cap = t->cap ? 2 * t->cap : 4096;
+        book_entry* table = (book_entry*)calloc(cap, sizeof(book_entry));
+        check_malloc(table);
+        for (size_t i = 0; i < t->cap; i++) {
+            if (t->table[i].games) {
+                table[find_slot(table, cap, t->table[i].key)] = t->table[i];
+            }
+        }
+        free(t->table);
+        t->table = table;
+        t->cap = cap;
+    }
+    book_entry* e = &t->table[find_slot(t->table, t->cap, key)];
+    if (e->games == 0) {
+        e->key = key;
+        t->len++;
+    }
+    e->games++;
+    e->black_wins += o == BLACK_WIN;
+    e->white_wins += o == WHITE_WIN;
+    e->draws += o == DRAW;
+}
+
+/* This helper function orders keys for qsort */
+int compare_book_keys(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* This helper function plays one random game, noting the keys of its 
+   opening, and credits the outcome to each distinct one */
+void play_book_game(bookgen_thread* t) {
+    bookgen_options* opts = t->opts;
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    size_t n = 0;
+    unsigned int moves = 0, max_moves = 4 * opts->width * opts->height;
+    outcome o = IN_PROGRESS;
+    t->keys[n++] = canonical_key(game_key_pair(g), NULL);
+    while (o == IN_PROGRESS && moves < max_moves) {
+        unsigned int roll = rand_r(&t->seed) % 100;
+        bool played = false;
+        if (roll < 5) {
+            played = play_move(g, make_move(MOVE_DISARRAY, 0));
+        } else if (roll < 10) {
+            played = play_move(g, make_move(MOVE_OFFSET, 0));
+        }
+        unsigned int col = rand_r(&t->seed) % opts->width;
+        while (!played) {
+            played = play_move(g, make_move(MOVE_DROP, col));
+            col = (col + 1) % opts->width;
+        }
+        moves++;
+        if (moves <= opts->depth) {
+            t->keys[n++] = canonical_key(game_key_pair(g), NULL);
+        }
+        o = game_outcome(g);
+    }
+    o = o == IN_PROGRESS ? DRAW : o;
+    qsort(t->keys, n, sizeof(uint64_t), compare_book_keys);
+    for (size_t i = 0; i < n; i++) {
+        if (i == 0 || t->keys[i] != t->keys[i - 1]) {
+            add_outcome(t, t->keys[i], o);
+            t->samples++;
+        }
+    }
+    game_free(g);
+}
+
+/* This is the thread routine of the builder */
+void* bookgen_routine(void* arg) {
+    bookgen_thread* t = (bookgen_thread*)arg;
+    t->keys = (uint64_t*)malloc(sizeof(uint64_t) * (t->opts->depth + 1));
+    check_malloc(t->keys);
+    for (unsigned int i = 0; i < t->games; i++) {
+        trace_begin("book_game");
+        play_book_game(t);
+        trace_end("book_game");
+    }
+    free(t->keys);
+    return NULL;
+}
+
+/* This helper function orders book entries by key for qsort */
+int compare_entries(const void* a, const void* b) {
+    uint64_t x = ((const book_entry*)a)->key, 
+             y = ((const book_entry*)b)->key;
+    return (x > y) - (x < y);
+}
+
+/* This helper function merges entries sorted by key in place, adding up
+   those of the same position, drops the positions seen in fewer than
+   min_games games and returns the number of entries left */
+size_t merge_entries(book_entry* entries, size_t n, unsigned int min_games) {
+    size_t len = 0;
+    for (size_t i = 0; i < n;) {
+        book_entry e = entries[i++];
+        for (; i < n && entries[i].key == e.key; i++) {
+            e.games += entries[i].games;
+            e.black_wins += entries[i].black_wins;
+            e.white_wins += entries[i].white_wins;
+            e.draws += entries[i].draws;
+        }
+        if (e.games >= min_games) {
+            entries[len++] = e;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char** argv) {
+    bookgen_options opts;
+    parse_bookgen_arguments(argc, argv, &opts);
+    uint64_t start = now_ns();
+    bookgen_thread* threads = (bookgen_thread*)calloc(opts.threads, 
+                                                      sizeof(bookgen_thread));
+    check_malloc(threads);
+    pthread_t tids[opts.threads];
+    for (unsigned int i = 0; i < opts.threads; i++) {
+        threads[i].opts = &opts;
+        threads[i].games = opts.games / opts.threads + 
+                           (i < opts.games % opts.threads);
+        threads[i].seed = opts.seed * 7919 + i;
+        pthread_create(&tids[i], NULL, bookgen_routine, &threads[i]);
+    }
+    size_t total = 0;
+    unsigned long long samples = 0;
+    for (unsigned int i = 0; i < opts.threads; i++) {
+        pthread_join(tids[i], NULL);
+        total += threads[i].len;
+        samples += threads[i].samples;
+    }
+    book_entry* entries = (book_entry*)malloc(sizeof(book_entry) * 
+                                              (total ? total : 1));
+    check_malloc(entries);
+    size_t n = 0;
+    for (unsigned int i = 0; i < opts.threads; i++) {
+        for (size_t j = 0; j < threads[i].cap; j++) {
+            if (threads[i].table[j].games) {
+                entries[n++] = threads[i].table[j];
+            }
+        }
+        free(threads[i].table);
+    }
+    free(threads);
+    qsort(entries, n, sizeof(book_entry), compare_entries);
+    size_t len = merge_entries(entries, n, opts.min_games);
+    if (!book_write(opts.path, entries, len, opts.width, opts.height, 
+                    opts.run)) {
+        fprintf(stderr, "Could not write %s\n", opts.path);
+        exit(1);
+    }
+    free(entries);
+    printf("%u games, %llu samples, %zu positions written to %s in %.3f s\n",
+           opts.games, samples, len, opts.path, (now_ns() - start) / 1e9);
+    return 0;
+}
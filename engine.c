@@ -0,0 +1,715 @@
+#include <string.h>
+#include <time.h>
+#include "engine.h"
+#include "hash.h"
+#include "perf.h"
+#include "serial.h"
+#include "trace.h"
+
+#define TT_LOWER 1
+#define TT_UPPER 2
+#define TT_EXACT 3
+#define TT_MOVE_BITS 22
+#define SCORE_INFINITY (ENGINE_WIN + 1)
+
+/* The state of one running search. Each thread searching has its own,
+   and with it the state of the engine's network for the board it plays
+   on, if the engine has a network */
+struct search_ctx {
+    engine* e;
+    unsigned int width;
+    unsigned long long nodes;
+    bool aborted;
+    ntuple_state* st;
+};
+
+typedef struct search_ctx search_ctx;
+
+
+engine* engine_new(size_t tt_bytes) {
+    engine* e = (engine*)calloc(1, sizeof(engine));
+    check_malloc(e);
+    size_t entries = 1;
+    while (entries * 2 * sizeof(tt_entry) <= tt_bytes) {
+        entries *= 2;
+    }
+    e->tt = (tt_entry*)calloc(entries, sizeof(tt_entry));
+    check_malloc(e->tt);
+    e->tt_mask = entries - 1;
+    e->max_depth = ENGINE_MAX_PLY;
+    e->book_min_games = 1;
+    return e;
+}
+
+void engine_use_book(engine* e, book* bk, unsigned int min_games) {
+    check_null_pointer(e);
+    e->bk = bk;
+    e->book_min_games = min_games;
+}
+
+void engine_use_tablebase(engine* e, tablebase* tb) {
+    check_null_pointer(e);
+    e->tb = tb;
+}
+
+void engine_use_ntuple(engine* e, ntuple_net* net) {
+    check_null_pointer(e);
+    e->net = net;
+}
+
+void engine_use_eval_queue(engine* e, eval_queue* q) {
+    check_null_pointer(e);
+    e->queue = q;
+    if (q) {
+        e->net = q->net;
+    }
+}
+
+/* This helper function returns the index of a move in the order of
+   move_from_index: drops by column, then the offset, then the disarray */
+unsigned int move_index(unsigned int width, move m) {
+    if (m.kind == MOVE_DROP) {
+        return m.column;
+    }
+    return m.kind == MOVE_OFFSET ? width : width + 1;
+}
+
+/* This helper function copies a game for searches to play on, and to 
+   play offsets on, since those cannot be undone. MATRIX boards are copied 
+   as BITS boards, whose disarrays do not spawn threads, and copies track 
+   their window counts so that evaluations take constant time */
+game* clone_game(game* g) {
+    size_t size = game_serialized_size(g);
+    unsigned char* buf = (unsigned char*)malloc(size);
+    check_malloc(buf);
+    game_serialize(g, buf, size);
+    game* copy = game_deserialize(buf, size,
+                                  g->b->type == MATRIX ? BITS : g->b->type);
+    free(buf);
+    game_track_windows(copy);
+    return copy;
+}
+
+/* This helper function returns the move index at position j of the 
+   default search order: drops from the center outwards (columns mid, 
+   mid + 1, mid - 1, mid + 2, ...), then the offset and the disarray */
+unsigned int order_index(unsigned int width, unsigned int j) {
+    if (j >= width) {
+        return j;
+    }
+    unsigned int mid = (width - 1) / 2, d = (j + 1) / 2;
+    return j % 2 ? mid + d : mid - d;
+}
+
+/* This helper function is the inverse of order_index */
+unsigned int order_position(unsigned int width, unsigned int index) {
+    if (index >= width) {
+        return index;
+    }
+    int d = (int)index - (int)(width - 1) / 2;
+    return d > 0 ? 2 * d - 1 : -2 * d;
+}
+
+/* This helper function returns the i-th candidate move of a node: the 
+   table's move first, if there is one, then the default order without it.
+   Returns false once i is past the last candidate */
+bool candidate(unsigned int width, int tt_index, unsigned int i, move* m) {
+    if (tt_index >= 0) {
+        if (i == 0) {
+            *m = move_from_index(width, tt_index);
+            return true;
+        }
+        i--;
+        if (i >= order_position(width, tt_index)) {
+            i++;
+        }
+    }
+    if (i >= width + 2) {
+        return false;
+    }
+    *m = move_from_index(width, order_index(width, i));
+    return true;
+}
+
+/* This helper function returns the score of a finished game for the player
+   to move, ply plies from the root of the search */
+int terminal_score(game* g, outcome o, unsigned int ply) {
+    if (o == DRAW) {
+        return 0;
+    }
+    bool mover_won = (o == BLACK_WIN) == (g->player == BLACKS_TURN);
+    return mover_won ? ENGINE_WIN - (int)ply : -(ENGINE_WIN - (int)ply);
+}
+
+/* This helper function scores a position for the player to move from 
+   the state of the search's network, if any, through the engine's queue
+   if it has one, or else from the window counts of its game (see
+   window.h) */
+int evaluate(search_ctx* ctx, game* g) {
+    int score;
+    if (!ctx->st) {
+        score = window_counts_score(g->windows);
+    } else if (ctx->e->queue) {
+        score = (int)(NTUPLE_SCALE * eval_queue_evaluate(ctx->e->queue,
+                                                         ctx->st, g->player));
+    } else {
+        score = (int)(NTUPLE_SCALE * ntuple_state_value(ctx->st,
+                                                        g->player));
+    }
+    return g->player == BLACKS_TURN ? score : -score;
+}
+
+/* This helper function looks a position up in the table. Returns true if
+   the entry is for this key, filling the stored depth, bound flag, score
+   (made relative to this ply for forced results) and move index, -1 for
+   none */
+bool tt_probe(engine* e, uint64_t key, unsigned int ply, unsigned int* depth,
+              unsigned int* flag, int* score, int* index) {
+    tt_entry* t = &e->tt[key & e->tt_mask];
+    uint64_t check = __atomic_load_n(&t->check, __ATOMIC_RELAXED);
+    uint64_t data = __atomic_load_n(&t->data, __ATOMIC_RELAXED);
+    if ((check ^ data) != key || data == 0) {
+        return false;
+    }
+    int s = (int32_t)(uint32_t)data;
+    if (s > ENGINE_WIN_BOUND) {
+        s -= ply;
+    } else if (s < -ENGINE_WIN_BOUND) {
+        s += ply;
+    }
+    *score = s;
+    *depth = (data >> 32) & 0xFF;
+    *flag = (data >> 40) & 0x3;
+    *index = (int)(data >> 42) - 1;
+    return true;
+}
+
+/* This helper function stores a search result in the table, replacing
+   whatever was in its slot */
+void tt_store(engine* e, uint64_t key, unsigned int ply, unsigned int depth,
+              unsigned int flag, int score, int index) {
+    if (score > ENGINE_WIN_BOUND) {
+        score += ply;
+    } else if (score < -ENGINE_WIN_BOUND) {
+        score -= ply;
+    }
+    if (index >= (1 << TT_MOVE_BITS) - 1) {
+        index = -1;
+    }
+    uint64_t data = (uint64_t)(uint32_t)score | ((uint64_t)depth << 32) |
+                    ((uint64_t)flag << 40) |
+                    ((uint64_t)(index + 1) << 42);
+    tt_entry* t = &e->tt[key & e->tt_mask];
+    __atomic_store_n(&t->check, key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->data, data, __ATOMIC_RELAXED);
+}
+
+/* This helper function returns true once the search has to stop: the
+   engine was stopped or the deadline passed. The clock is only read every
+   ENGINE_CHECK_NODES nodes */
+bool out_of_time(search_ctx* ctx) {
+    if (ctx->aborted) {
+        return true;
+    }
+    if (ctx->nodes % ENGINE_CHECK_NODES) {
+        return false;
+    }
+    uint64_t deadline = __atomic_load_n(&ctx->e->deadline_ns,
+                                        __ATOMIC_RELAXED);
+    if (__atomic_load_n(&ctx->e->stop, __ATOMIC_RELAXED) ||
+        (deadline && now_ns() >= deadline)) {
+        ctx->aborted = true;
+    }
+    return ctx->aborted;
+}
+
+int negamax(search_ctx* ctx, game* g, key_pair k, unsigned int depth,
+            unsigned int ply, int alpha, int beta);
+
+/* This helper function plays a move, searches the resulting position and
+   takes the move back, keeping the state of the search's network in step
+   with the board. Returns the score for the player who moved */
+int search_move(search_ctx* ctx, game* g, key_pair k, move m,
+                unsigned int depth, unsigned int ply, int alpha, int beta) {
+    game* child = g;
+    if (m.kind == MOVE_DROP) {
+        drop_piece(g, m.column);
+        key_pair_drop(&k, g);
+    } else if (m.kind == MOVE_DISARRAY) {
+        disarray(g);
+        k = game_key_pair(g);
+    } else {
+        outcome o = offset_outcome(g);
+        if (o != IN_PROGRESS) {
+            return terminal_score(g, o, ply + 1);
+        }
+        child = clone_game(g);
+        offset(child);
+        k = game_key_pair(child);
+    }
+    if (ctx->st) {
+        ntuple_state_play(ctx->st, child->b, m);
+    }
+    int score;
+    outcome o = game_outcome(child);
+    if (o != IN_PROGRESS) {
+        score = -terminal_score(child, o, ply + 1);
+    } else {
+        score = -negamax(ctx, child, k, depth - 1, ply + 1, -beta, -alpha);
+    }
+    if (m.kind == MOVE_DROP) {
+        if (ctx->st) {
+            ntuple_state_take_back(ctx->st, g->b, m.column);
+        }
+        take_back_drop(g);
+    } else {
+        if (m.kind == MOVE_DISARRAY) {
+            disarray(g);
+        } else {
+            game_free(child);
+        }
+        if (ctx->st) {
+            ntuple_state_rebuild(ctx->st, g->b);
+        }
+    }
+    return score;
+}
+
+/* This is the alpha-beta search. It returns the score of a game that is
+   not over for the player to move, searched depth plies deep, within the
+   window (alpha, beta) */
+int negamax(search_ctx* ctx, game* g, key_pair k, unsigned int depth,
+            unsigned int ply, int alpha, int beta) {
+    ctx->nodes++;
+    if (out_of_time(ctx)) {
+        return 0;
+    }
+    bool mirrored;
+    uint64_t key = canonical_key(k, &mirrored);
+    unsigned int tt_depth, flag;
+    int tt_score, tt_index = -1;
+    if (tt_probe(ctx->e, key, ply, &tt_depth, &flag, &tt_score, &tt_index)) {
+        if (tt_depth >= depth && (flag == TT_EXACT ||
+            (flag == TT_LOWER && tt_score >= beta) ||
+            (flag == TT_UPPER && tt_score <= alpha))) {
+            return tt_score;
+        }
+        if (tt_index >= 0 && mirrored) {
+            tt_index = move_index(ctx->width, mirror_move(
+                move_from_index(ctx->width, tt_index), ctx->width));
+        }
+        if (tt_index >= 0 && (tt_index >= (int)ctx->width + 2 ||
+            !move_is_legal(g, move_from_index(ctx->width, tt_index)))) {
+            tt_index = -1;
+        }
+    }
+    if (depth == 0 || ply >= ENGINE_MAX_PLY) {
+        return evaluate(ctx, g);
+    }
+    /* A drop that wins at once is the best move there is, and is found 
+       without playing any */
+    for (unsigned int c = 0; c < ctx->width; c++) {
+        if (drop_wins(g, c)) {
+            return ENGINE_WIN - (int)(ply + 1);
+        }
+    }
+    int best = -SCORE_INFINITY, best_index = -1, alpha0 = alpha;
+    move m;
+    for (unsigned int i = 0; candidate(ctx->width, tt_index, i, &m); i++) {
+        if (!move_is_legal(g, m)) {
+            continue;
+        }
+        int score = search_move(ctx, g, k, m, depth, ply, alpha, beta);
+        if (ctx->aborted) {
+            return 0;
+        }
+        if (score > best) {
+            best = score;
+            best_index = move_index(ctx->width, m);
+        }
+        if (score > alpha) {
+            alpha = score;
+        }
+        if (alpha >= beta) {
+            break;
+        }
+    }
+    flag = best <= alpha0 ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT;
+    int stored_index = best_index;
+    if (mirrored) {
+        stored_index = move_index(ctx->width, mirror_move(
+            move_from_index(ctx->width, best_index), ctx->width));
+    }
+    tt_store(ctx->e, key, ply, depth, flag, best, stored_index);
+    return best;
+}
+
+/* This helper function returns the table's move for a position, if it is
+   legal there */
+bool table_move(engine* e, game* g, move* out) {
+    bool mirrored;
+    uint64_t key = canonical_key(game_key_pair(g), &mirrored);
+    unsigned int depth, flag;
+    int score, index;
+    unsigned int width = g->b->width;
+    if (!tt_probe(e, key, 0, &depth, &flag, &score, &index) || index < 0 ||
+        index >= (int)width + 2) {
+        return false;
+    }
+    move m = move_from_index(width, index);
+    if (mirrored) {
+        m = mirror_move(m, width);
+    }
+    if (!move_is_legal(g, m)) {
+        return false;
+    }
+    *out = m;
+    return true;
+}
+
+/* This helper function runs the iterative deepening search of a game that
+   is not over on a copy of it, until the engine's maximum depth, a forced
+   result, or the engine's deadline or stop flag */
+void iterative_deepening(engine* e, game* root, search_result* out) {
+    search_ctx ctx = {e, root->b->width, 0, false, NULL};
+    game* g = clone_game(root);
+    if (e->net) {
+        ctx.st = ntuple_game_state(e->net, g);
+    }
+    if (e->queue) {
+        eval_queue_join(e->queue);
+    }
+    key_pair k = game_key_pair(g);
+    move m, best = make_move(MOVE_DISARRAY, 0);
+    for (unsigned int i = 0; candidate(ctx.width, -1, i, &m); i++) {
+        if (move_is_legal(g, m)) {
+            best = m;
+            break;
+        }
+    }
+    out->best = best;
+    out->score = 0;
+    out->depth = 0;
+    for (unsigned int depth = 1; depth <= e->max_depth; depth++) {
+        perf_begin(PERF_SEARCH_ITER);
+        trace_begin("search_iter");
+        int alpha = -SCORE_INFINITY, best_index = move_index(ctx.width, best);
+        bool any = false;
+        for (unsigned int i = 0; candidate(ctx.width, best_index, i, &m);
+             i++) {
+            if (!move_is_legal(g, m)) {
+                continue;
+            }
+            int score = search_move(&ctx, g, k, m, depth, 0, alpha,
+                                    SCORE_INFINITY);
+            if (ctx.aborted) {
+                break;
+            }
+            if (score > alpha) {
+                alpha = score;
+                best = m;
+                any = true;
+            }
+        }
+        if (any) {
+            out->best = best;
+            out->score = alpha;
+            bool mirrored;
+            uint64_t key = canonical_key(k, &mirrored);
+            tt_store(e, key, 0, depth, ctx.aborted ? TT_LOWER : TT_EXACT,
+                     alpha, move_index(ctx.width, mirrored ?
+                         mirror_move(best, ctx.width) : best));
+        }
+        trace_end("search_iter");
+        perf_end(PERF_SEARCH_ITER);
+        if (ctx.aborted) {
+            break;
+        }
+        out->depth = depth;
+        if (alpha > ENGINE_WIN_BOUND || alpha < -ENGINE_WIN_BOUND) {
+            break;
+        }
+    }
+    if (e->queue) {
+        eval_queue_park(e->queue);
+    }
+    out->nodes = ctx.nodes;
+    /* The expected reply is the table's move after the best move */
+    out->has_reply = false;
+    game* after = clone_game(g);
+    if (play_move(after, out->best) && game_outcome(after) == IN_PROGRESS) {
+        out->has_reply = table_move(e, after, &out->reply);
+    }
+    game_free(after);
+    if (ctx.st) {
+        ntuple_state_free(ctx.st);
+    }
+    game_free(g);
+}
+
+/* This helper function fills a result from the book or the tablebase, if
+   either has a move for the game */
+bool lookup_move(engine* e, game* g, search_result* out) {
+    move m;
+    if (e->tb && tb_best_move(e->tb, g, &m)) {
+        out->source = SOURCE_TABLEBASE;
+    } else if (e->bk && book_choose(e->bk, g, e->book_min_games, &m, NULL)) {
+        out->source = SOURCE_BOOK;
+    } else {
+        return false;
+    }
+    out->best = m;
+    out->has_reply = false;
+    out->score = 0;
+    out->depth = 0;
+    out->nodes = 0;
+    return true;
+}
+
+/* This helper function is the body of engine_search once the deadline is
+   set */
+bool search_until_deadline(engine* e, game* g, search_result* out) {
+    uint64_t start = now_ns();
+    if (game_outcome(g) != IN_PROGRESS) {
+        return false;
+    }
+    if (!lookup_move(e, g, out)) {
+        out->source = SOURCE_SEARCH;
+        iterative_deepening(e, g, out);
+    }
+    out->seconds = (now_ns() - start) / 1e9;
+    return true;
+}
+
+bool engine_search(engine* e, game* g, unsigned int time_ms,
+                   search_result* out) {
+    check_null_pointer(e);
+    check_null_pointer(g);
+    check_null_pointer(out);
+    __atomic_store_n(&e->stop, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->deadline_ns,
+                     time_ms ? now_ns() + time_ms * 1000000ull : 0,
+                     __ATOMIC_RELAXED);
+    return search_until_deadline(e, g, out);
+}
+
+/* The shared state of an analysis. depth is the depth being searched, next
+   the next candidate to claim at that depth and done the number of 
+   candidates scored at it */
+struct analysis_job {
+    engine* e;
+    game* root;
+    unsigned int num_moves, depth, next, done;
+    move_eval* evals;
+    bool finished;
+    unsigned long long nodes;
+    analysis_fn report;
+    void* arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+typedef struct analysis_job analysis_job;
+
+
+/* This is the thread routine of an analysis. Each thread searches its own 
+   copy of the root, claiming candidates at the current depth until all of 
+   them are claimed, then waits for the last one to be scored, which moves 
+   the analysis to the next depth. A thread waiting is parked from the
+   engine's queue, if it has one, so that the batches of the threads still
+   searching do not wait for it */
+void* analysis_routine(void* arg) {
+    analysis_job* job = (analysis_job*)arg;
+    search_ctx ctx = {job->e, job->root->b->width, 0, false, NULL};
+    game* g = clone_game(job->root);
+    if (job->e->net) {
+        ctx.st = ntuple_game_state(job->e->net, g);
+    }
+    key_pair k = game_key_pair(g);
+    eval_queue* q = job->e->queue;
+    if (q) {
+        eval_queue_join(q);
+    }
+    pthread_mutex_lock(&job->lock);
+    while (!job->finished) {
+        if (job->next == job->num_moves) {
+            trace_begin("depth_barrier");
+            if (q) {
+                eval_queue_park(q);
+            }
+            pthread_cond_wait(&job->cond, &job->lock);
+            if (q) {
+                eval_queue_join(q);
+            }
+            trace_end("depth_barrier");
+            continue;
+        }
+        unsigned int i = job->next++, depth = job->depth;
+        pthread_mutex_unlock(&job->lock);
+        unsigned long long before = ctx.nodes;
+        trace_begin("analysis_move");
+        int score = search_move(&ctx, g, k, job->evals[i].m, depth, 0,
+                                -SCORE_INFINITY, SCORE_INFINITY);
+        trace_end("analysis_move");
+        pthread_mutex_lock(&job->lock);
+        job->nodes += ctx.nodes - before;
+        if (ctx.aborted) {
+            job->finished = true;
+            pthread_cond_broadcast(&job->cond);
+            break;
+        }
+        job->evals[i].score = score;
+        job->evals[i].depth = depth;
+        unsigned int completed = depth - 1;
+        if (++job->done == job->num_moves) {
+            completed = depth;
+            if (depth == job->e->max_depth) {
+                job->finished = true;
+            } else {
+                job->depth++;
+                job->next = job->done = 0;
+            }
+            pthread_cond_broadcast(&job->cond);
+        }
+        if (job->report) {
+            job->report(job->evals, job->num_moves, completed, job->nodes,
+                        job->arg);
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    if (q) {
+        eval_queue_park(q);
+    }
+    if (ctx.st) {
+        ntuple_state_free(ctx.st);
+    }
+    game_free(g);
+    return NULL;
+}
+
+unsigned int engine_analyze(engine* e, game* g, unsigned int threads,
+                            unsigned int time_ms, analysis_fn report,
+                            void* arg, move_eval* out) {
+    check_null_pointer(e);
+    check_null_pointer(g);
+    check_null_pointer(out);
+    if (game_outcome(g) != IN_PROGRESS) {
+        return 0;
+    }
+    analysis_job job;
+    memset(&job, 0, sizeof(job));
+    job.e = e;
+    job.root = g;
+    job.depth = 1;
+    job.evals = out;
+    job.report = report;
+    job.arg = arg;
+    unsigned int width = g->b->width;
+    for (unsigned int i = 0; i < width + 2; i++) {
+        move m = move_from_index(width, i);
+        if (move_is_legal(g, m)) {
+            out[job.num_moves].m = m;
+            out[job.num_moves].score = 0;
+            out[job.num_moves].depth = 0;
+            job.num_moves++;
+        }
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+    __atomic_store_n(&e->stop, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->deadline_ns,
+                     time_ms ? now_ns() + time_ms * 1000000ull : 0,
+                     __ATOMIC_RELAXED);
+    if (threads == 0) {
+        threads = 1;
+    }
+    pthread_t tids[threads];
+    for (unsigned int t = 0; t < threads; t++) {
+        pthread_create(&tids[t], NULL, analysis_routine, &job);
+    }
+    for (unsigned int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.cond);
+    return job.num_moves;
+}
+
+void engine_stop(engine* e) {
+    __atomic_store_n(&e->stop, true, __ATOMIC_RELAXED);
+}
+
+/* This is the thread routine of pondering. It searches until
+   engine_ponder_finish sets a deadline or stops it */
+void* ponder_routine(void* arg) {
+    engine* e = (engine*)arg;
+    if (!search_until_deadline(e, e->ponder_game, &e->ponder_result)) {
+        memset(&e->ponder_result, 0, sizeof(search_result));
+    }
+    return NULL;
+}
+
+bool engine_ponder(engine* e, game* g, move predicted, unsigned int time_ms) {
+    check_null_pointer(e);
+    check_null_pointer(g);
+    if (e->pondering || game_outcome(g) != IN_PROGRESS) {
+        return false;
+    }
+    game* next = clone_game(g);
+    if (!move_is_legal(next, predicted) || !play_move(next, predicted) ||
+        game_outcome(next) != IN_PROGRESS) {
+        game_free(next);
+        return false;
+    }
+    e->ponder_game = next;
+    e->ponder_move = predicted;
+    e->ponder_time_ms = time_ms;
+    e->ponder_start_ns = now_ns();
+    __atomic_store_n(&e->stop, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->deadline_ns, 0, __ATOMIC_RELAXED);
+    if (pthread_create(&e->ponder_thread, NULL, ponder_routine, e) != 0) {
+        game_free(next);
+        return false;
+    }
+    e->pondering = true;
+    return true;
+}
+
+bool engine_ponder_finish(engine* e, move actual, search_result* out) {
+    check_null_pointer(e);
+    if (!e->pondering) {
+        return false;
+    }
+    bool hit = actual.kind == e->ponder_move.kind &&
+               (actual.kind != MOVE_DROP ||
+                actual.column == e->ponder_move.column);
+    if (hit && e->ponder_time_ms) {
+        /* The budget runs from when the opponent started thinking, so a
+           slow reply is answered at once */
+        uint64_t deadline = e->ponder_start_ns +
+                            e->ponder_time_ms * 1000000ull, now = now_ns();
+        __atomic_store_n(&e->deadline_ns, deadline > now ? deadline : now,
+                         __ATOMIC_RELAXED);
+    } else if (!hit) {
+        engine_stop(e);
+    }
+    pthread_join(e->ponder_thread, NULL);
+    e->pondering = false;
+    game_free(e->ponder_game);
+    e->ponder_game = NULL;
+    if (hit && out) {
+        *out = e->ponder_result;
+        out->seconds = (now_ns() - e->ponder_start_ns) / 1e9;
+    }
+    return hit;
+}
+
+void engine_free(engine* e) {
+    if (e->pondering) {
+        engine_stop(e);
+        pthread_join(e->ponder_thread, NULL);
+        game_free(e->ponder_game);
+    }
+    free(e->tt);
+    free(e);
+}
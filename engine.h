@@ -0,0 +1,310 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "book.h"
+#include "evalq.h"
+#include "ntuple.h"
+#include "tb.h"
+
+/* The engine picks moves with an iterative deepening alpha-beta search.
+ * Before searching it looks the position up in its opening book and its
+   endgame tablebase, if it has them. Otherwise it searches to depth 1, 2,
+   3 and so on until the time budget runs out, and returns the best move of
+   the deepest search, counting a deeper search that was cut short when its
+   best move so far was fully searched. The search can thus be stopped at
+   any time and still has a move.
+ * Positions are cached in a transposition table shared by every search of
+   the engine, under their canonical keys (see hash.h), so a position and
+   its mirror image share an entry. Entries are two words, the second
+   XORed into the first, so that threads can read and write them without
+   locks and detect torn entries.
+ * Searches play on copies of the game that keep the piece counts of every
+   window (see window.h), so that evaluating a position and checking it
+   for a win take constant time.
+ * While the opponent thinks, the engine can ponder: a background thread
+   searches the position after the reply it predicts. If the prediction is
+   right, the search it already did is the answer, and whatever it
+   learned is in the table either way.
+ * Analysis scores every legal move of a position rather than only the
+   best one. A pool of threads takes the moves one by one at depth 1, then
+   all of them at depth 2, and so on, each with an exact score, so every
+   candidate deepens at the same pace and the threads share what they find
+   through the table */
+
+#define ENGINE_MAX_PLY 64
+#define ENGINE_WIN 1000000
+#define ENGINE_WIN_BOUND (ENGINE_WIN - ENGINE_MAX_PLY)
+#define ENGINE_CHECK_NODES 1024
+
+enum search_source {
+    SOURCE_SEARCH,
+    SOURCE_BOOK,
+    SOURCE_TABLEBASE
+};
+
+typedef enum search_source search_source;
+
+
+struct tt_entry {
+    uint64_t check, data;
+};
+
+typedef struct tt_entry tt_entry;
+
+
+struct search_result {
+    move best, reply;
+    bool has_reply;
+    int score;
+    unsigned int depth;
+    unsigned long long nodes;
+    double seconds;
+    search_source source;
+};
+
+typedef struct search_result search_result;
+
+
+struct move_eval {
+    move m;
+    int score;
+    unsigned int depth;
+};
+
+typedef struct move_eval move_eval;
+
+
+/* An analysis callback receives the evaluations of every candidate, in 
+   the order of move_from_index, each scored at its own depth, the depth 
+   all of them have reached, the nodes searched so far and the callback's 
+   argument */
+typedef void (*analysis_fn)(const move_eval* evals, unsigned int num_evals,
+                            unsigned int depth, unsigned long long nodes,
+                            void* arg);
+
+
+struct engine {
+    tt_entry* tt;
+    size_t tt_mask;
+    book* bk;
+    tablebase* tb;
+    ntuple_net* net;
+    eval_queue* queue;
+    unsigned int book_min_games, max_depth;
+    uint64_t deadline_ns;
+    bool stop;
+    pthread_t ponder_thread;
+    bool pondering;
+    game* ponder_game;
+    move ponder_move;
+    unsigned int ponder_time_ms;
+    uint64_t ponder_start_ns;
+    search_result ponder_result;
+};
+
+typedef struct engine engine;
+
+
+/**
+ * engine_new
+ *
+ * Creates an engine with an empty transposition table.
+ *
+ * Parameters:
+ *   - tt_bytes: The size of the table, rounded down to a power of two
+ *      number of entries.
+ *
+ * Returns:
+ *   - A pointer to the new `engine`, searching up to ENGINE_MAX_PLY plies
+ *      with no book, tablebase or network.
+ *
+ * Note:
+ *   - The caller is responsible for calling `engine_free`.
+ */
+engine* engine_new(size_t tt_bytes);
+
+/**
+ * engine_use_book
+ *
+ * Makes the engine play from an opening book while the game is in it.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - bk: The book, which must outlive the engine's use of it, or NULL.
+ *   - min_games: Book positions seen in fewer games are ignored.
+ */
+void engine_use_book(engine* e, book* bk, unsigned int min_games);
+
+/**
+ * engine_use_tablebase
+ *
+ * Makes the engine play perfect moves from an endgame tablebase whenever
+ *  the position is in it.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - tb: The tablebase, which must outlive the engine's use of it, or
+ *      NULL.
+ */
+void engine_use_tablebase(engine* e, tablebase* tb);
+
+/**
+ * engine_use_ntuple
+ *
+ * Makes the engine evaluate positions with an N-tuple network (see
+ *  ntuple.h) rather than from the window counts.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - net: The network, for the configuration of the games searched,
+ *      which must outlive the engine's use of it, or NULL.
+ *
+ * Note:
+ *   - Networks are experimental: they do not yet play better than the
+ *      window counts (see ntuple.h).
+ *   - Each search keeps the state of the network for its copy of the game,
+ *      updated as it plays and takes back moves.
+ */
+void engine_use_ntuple(engine* e, ntuple_net* net);
+
+/**
+ * engine_use_eval_queue
+ *
+ * Makes the engine evaluate positions with the network of an evaluation
+ *  queue (see evalq.h), in batches with the positions of the other threads
+ *  using the queue, such as those of `engine_analyze`.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - q: The queue, whose network is for the configuration of the games
+ *      searched, which must outlive the engine's use of it, or NULL to
+ *      evaluate positions one at a time again.
+ *
+ * Note:
+ *   - Replaces the network set by `engine_use_ntuple`.
+ *   - Every thread searching joins the queue for the length of its search,
+ *      and an analysis thread parks while it waits for the others to
+ *      finish a depth (see `eval_queue_park`).
+ */
+void engine_use_eval_queue(engine* e, eval_queue* q);
+
+/**
+ * engine_search
+ *
+ * Picks a move for the player to move.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - g: A pointer to the `game` structure. It is not modified.
+ *   - time_ms: The time budget in milliseconds, 0 for no limit other than
+ *      the engine's maximum depth.
+ *   - out: Out-parameter receiving the move, its score for the player to
+ *      move, the reply the engine expects, the depth reached, the nodes
+ *      searched and where the move came from.
+ *
+ * Returns:
+ *   - `true` if a move was found, `false` if the game is over.
+ *
+ * Note:
+ *   - Scores above ENGINE_WIN_BOUND are forced wins, ENGINE_WIN minus the
+ *      plies to the win, and below -ENGINE_WIN_BOUND forced losses.
+ *   - Must not be called while the engine ponders.
+ */
+bool engine_search(engine* e, game* g, unsigned int time_ms,
+                   search_result* out);
+
+/**
+ * engine_analyze
+ *
+ * Scores every legal move of a position, deepening them together on a pool 
+ *  of threads, and reports every new score as it comes.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - g: A pointer to the `game` structure. It is not modified.
+ *   - threads: The number of threads searching.
+ *   - time_ms: The time budget in milliseconds, 0 for no limit other than 
+ *      the engine's maximum depth and `engine_stop`.
+ *   - report: Called after each candidate is scored at a new depth, from 
+ *      the searching threads but never from two at once. May be NULL.
+ *   - arg: The argument passed to report.
+ *   - out: Out-parameter of at least width + 2 evaluations, receiving the 
+ *      final ones in the order of `move_from_index`.
+ *
+ * Returns:
+ *   - The number of candidates in out, 0 if the game is over.
+ *
+ * Note:
+ *   - A candidate whose search was cut short keeps the score of its last 
+ *      completed depth.
+ *   - Must not be called while the engine ponders.
+ */
+unsigned int engine_analyze(engine* e, game* g, unsigned int threads,
+                            unsigned int time_ms, analysis_fn report,
+                            void* arg, move_eval* out);
+
+/**
+ * engine_stop
+ *
+ * Makes the running searches of the engine return as soon as possible
+ *  with the best move found so far. Safe to call from any thread.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ */
+void engine_stop(engine* e);
+
+/**
+ * engine_ponder
+ *
+ * Starts searching, in a background thread and with no time limit, the
+ *  position the game would reach after the predicted reply.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - g: A pointer to the `game` structure, with the opponent to move. It
+ *      is copied, so the caller may change it.
+ *   - predicted: The reply the engine expects.
+ *   - time_ms: The time budget of the engine's next move.
+ *
+ * Returns:
+ *   - `true` if the background search started, `false` if the predicted
+ *      reply is illegal or ends the game.
+ */
+bool engine_ponder(engine* e, game* g, move predicted, unsigned int time_ms);
+
+/**
+ * engine_ponder_finish
+ *
+ * Ends pondering once the opponent has replied. If the reply is the
+ *  predicted one, the background search is given what is left of the time
+ *  budget, counted from when pondering started, and its result is the
+ *  engine's move. Otherwise it is stopped and its work only remains in the
+ *  table.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ *   - actual: The reply that was played.
+ *   - out: Out-parameter receiving the engine's move on a correct
+ *      prediction.
+ *
+ * Returns:
+ *   - `true` if the prediction was right and out holds the move, `false`
+ *      if the caller has to search.
+ */
+bool engine_ponder_finish(engine* e, move actual, search_result* out);
+
+/**
+ * engine_free
+ *
+ * Stops pondering and frees the engine and its table. The book and
+ *  tablebase are left open.
+ *
+ * Parameters:
+ *   - e: A pointer to the `engine`.
+ */
+void engine_free(engine* e);
+
+#endif /* ENGINE_H */
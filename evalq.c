@@ -0,0 +1,243 @@
+#include <limits.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "evalq.h"
+
+/* Times a waiting thread checks its batch before sleeping */
+#define EVALQ_SPINS 256
+
+#if defined(__linux__)
+/* This helper function sleeps while a word holds a value, for at most
+   timeout_ns nanoseconds, or without limit if timeout_ns is 0 */
+void evalq_sleep(uint32_t* word, uint32_t value, uint64_t timeout_ns) {
+    struct timespec ts = {timeout_ns / 1000000000ull,
+                          timeout_ns % 1000000000ull};
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value,
+            timeout_ns ? &ts : NULL, NULL, 0);
+}
+
+/* This helper function wakes every thread sleeping on a word */
+void evalq_wake(uint32_t* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#else
+/* Longest nap of a waiting thread where there are no futexes */
+#define EVALQ_NAP_NS 50000
+
+/* This helper function naps while a word holds a value, for at most
+   timeout_ns nanoseconds and EVALQ_NAP_NS. Only Linux has futexes, so
+   elsewhere waiting threads poll, which their callers' loops do anyway */
+void evalq_sleep(uint32_t* word, uint32_t value, uint64_t timeout_ns) {
+    if (timeout_ns == 0 || timeout_ns > EVALQ_NAP_NS) {
+        timeout_ns = EVALQ_NAP_NS;
+    }
+    struct timespec ts = {0, timeout_ns};
+    if (__atomic_load_n(word, __ATOMIC_ACQUIRE) == value) {
+        nanosleep(&ts, NULL);
+    }
+}
+
+/* This helper function does nothing: threads waiting on a word nap and
+   check it again by themselves */
+void evalq_wake(uint32_t* word) {
+}
+#endif
+
+eval_queue* eval_queue_new(ntuple_net* net, unsigned int batch_size,
+                           unsigned int flush_us) {
+    check_null_pointer(net);
+    if (batch_size == 0 || batch_size >= EVALQ_CLOSED) {
+        fprintf(stderr, "Invalid batch size %u\n", batch_size);
+        exit(1);
+    }
+    eval_queue* q = (eval_queue*)calloc(1, sizeof(eval_queue));
+    check_malloc(q);
+    q->net = net;
+    q->batch_size = batch_size;
+    q->flush_ns = flush_us * 1000ull;
+    q->batches = (eval_batch*)aligned_alloc(64, EVALQ_BATCHES *
+                                                sizeof(eval_batch));
+    check_malloc(q->batches);
+    memset(q->batches, 0, EVALQ_BATCHES * sizeof(eval_batch));
+    for (unsigned int i = 0; i < EVALQ_BATCHES; i++) {
+        eval_batch* b = &q->batches[i];
+        b->state = (uint64_t)i << 32;
+        b->slots = (int32_t*)calloc((size_t)net->num_tuples * batch_size,
+                                    sizeof(int32_t));
+        b->players = (turn*)calloc(batch_size, sizeof(turn));
+        b->values = (float*)calloc(batch_size, sizeof(float));
+        check_malloc(b->slots);
+        check_malloc(b->players);
+        check_malloc(b->values);
+    }
+    return q;
+}
+
+/* This helper function evaluates a batch closed with n positions, once
+   they are all copied in, and wakes the threads waiting for it. The
+   round moves on first, so that threads stop trying to join the batch */
+void evalq_run(eval_queue* q, eval_batch* b, uint64_t round, uint32_t n,
+               bool flushed) {
+    uint64_t expected = round;
+    __atomic_compare_exchange_n(&q->round, &expected, round + 1, false,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&b->filled, __ATOMIC_ACQUIRE) != n) {
+        sched_yield();
+    }
+    b->size = n;
+    ntuple_batch_values(q->net, b->slots, q->batch_size, b->players, n,
+                        b->values);
+    __atomic_add_fetch(&q->evaluated, n, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&q->batches_run, 1, __ATOMIC_RELAXED);
+    if (flushed) {
+        __atomic_add_fetch(&q->flushed, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&b->done, 1, __ATOMIC_RELEASE);
+    evalq_wake(&b->done);
+}
+
+/* This helper function waits for the batch of a round to be evaluated,
+   closing it and evaluating it itself once the flush time has passed
+   with the batch still open */
+void evalq_wait(eval_queue* q, eval_batch* b, uint64_t round) {
+    uint64_t deadline = now_ns() + q->flush_ns;
+    for (unsigned int i = 0; i < EVALQ_SPINS && q->flush_ns; i++) {
+        if (__atomic_load_n(&b->done, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+    }
+    while (!__atomic_load_n(&b->done, __ATOMIC_ACQUIRE)) {
+        uint64_t now = now_ns();
+        uint64_t s = __atomic_load_n(&b->state, __ATOMIC_ACQUIRE);
+        if (s & EVALQ_CLOSED) {
+            evalq_sleep(&b->done, 0, 0);
+        } else if (now < deadline) {
+            evalq_sleep(&b->done, 0, deadline - now);
+        } else if (__atomic_compare_exchange_n(&b->state, &s,
+                                               s | EVALQ_CLOSED, false,
+                                               __ATOMIC_ACQ_REL,
+                                               __ATOMIC_ACQUIRE)) {
+            evalq_run(q, b, round, (uint32_t)s, true);
+        }
+    }
+}
+
+/* This helper function counts a thread out of an evaluated batch. The
+   last one out hands it to the round EVALQ_BATCHES rounds later */
+void evalq_leave(eval_batch* b, uint64_t round) {
+    /* Once counted out, the batch may already serve another round */
+    uint32_t size = b->size;
+    if (__atomic_add_fetch(&b->taken, 1, __ATOMIC_ACQ_REL) == size) {
+        b->filled = 0;
+        b->taken = 0;
+        b->done = 0;
+        __atomic_store_n(&b->state,
+                         (uint64_t)(uint32_t)(round + EVALQ_BATCHES) << 32,
+                         __ATOMIC_RELEASE);
+    }
+}
+
+/* This helper function returns the number of positions at which a batch
+   closes: one per joined thread, at least 1 and at most the batch size */
+uint32_t evalq_target(eval_queue* q) {
+    uint32_t producers = __atomic_load_n(&q->producers, __ATOMIC_SEQ_CST);
+    if (producers == 0) {
+        return 1;
+    }
+    return producers < q->batch_size ? producers : q->batch_size;
+}
+
+/* This helper function closes and evaluates the open batch if it holds as
+   many positions as there are joined threads. It is called after a
+   thread joins a batch or parks, so that whichever of the two comes last
+   sees the other */
+void evalq_try_close(eval_queue* q) {
+    uint64_t round = __atomic_load_n(&q->round, __ATOMIC_SEQ_CST);
+    eval_batch* b = &q->batches[round % EVALQ_BATCHES];
+    uint64_t s = __atomic_load_n(&b->state, __ATOMIC_SEQ_CST);
+    uint32_t n = (uint32_t)s;
+    if ((uint32_t)(s >> 32) != (uint32_t)round || (s & EVALQ_CLOSED) ||
+        n == 0 || n < evalq_target(q)) {
+        return;
+    }
+    if (__atomic_compare_exchange_n(&b->state, &s, s | EVALQ_CLOSED, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        evalq_run(q, b, round, n, false);
+    }
+}
+
+void eval_queue_join(eval_queue* q) {
+    check_null_pointer(q);
+    __atomic_add_fetch(&q->producers, 1, __ATOMIC_SEQ_CST);
+}
+
+void eval_queue_park(eval_queue* q) {
+    check_null_pointer(q);
+    __atomic_sub_fetch(&q->producers, 1, __ATOMIC_SEQ_CST);
+    evalq_try_close(q);
+}
+
+float eval_queue_evaluate(eval_queue* q, ntuple_state* st, turn player) {
+    uint64_t round;
+    eval_batch* b;
+    uint32_t j;
+    bool closer;
+    for (;;) {
+        round = __atomic_load_n(&q->round, __ATOMIC_ACQUIRE);
+        b = &q->batches[round % EVALQ_BATCHES];
+        uint64_t s = __atomic_load_n(&b->state, __ATOMIC_ACQUIRE);
+        if ((uint32_t)(s >> 32) != (uint32_t)round) {
+            /* Threads of the batch's previous round are still taking
+               their values */
+            sched_yield();
+            continue;
+        }
+        if (s & EVALQ_CLOSED) {
+            __atomic_compare_exchange_n(&q->round, &round, round + 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+            continue;
+        }
+        j = (uint32_t)s;
+        uint64_t next = s + 1;
+        if (j + 1 >= evalq_target(q)) {
+            next |= EVALQ_CLOSED;
+        }
+        if (__atomic_compare_exchange_n(&b->state, &s, next, false,
+                                        __ATOMIC_SEQ_CST,
+                                        __ATOMIC_RELAXED)) {
+            closer = next & EVALQ_CLOSED;
+            break;
+        }
+    }
+    unsigned int tuples = q->net->num_tuples, size = q->batch_size;
+    for (unsigned int t = 0; t < tuples; t++) {
+        b->slots[(size_t)t * size + j] = st->slots[t];
+    }
+    b->players[j] = player;
+    __atomic_add_fetch(&b->filled, 1, __ATOMIC_RELEASE);
+    if (closer) {
+        evalq_run(q, b, round, j + 1, false);
+    } else {
+        evalq_try_close(q);
+        evalq_wait(q, b, round);
+    }
+    float value = b->values[j];
+    evalq_leave(b, round);
+    return value;
+}
+
+void eval_queue_free(eval_queue* q) {
+    for (unsigned int i = 0; i < EVALQ_BATCHES; i++) {
+        free(q->batches[i].slots);
+        free(q->batches[i].players);
+        free(q->batches[i].values);
+    }
+    free(q->batches);
+    free(q);
+}
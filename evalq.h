@@ -0,0 +1,132 @@
+#ifndef EVALQ_H
+#define EVALQ_H
+
+#include "ntuple.h"
+
+/* An evaluation queue gathers the positions that threads searching in
+   parallel want evaluated into batches, so that the network evaluates
+   them together (see `ntuple_batch_values`): a gather then loads weights
+   for 8 positions rather than 8 tuples of one, and the weights a tuple
+   reads are still in cache for the next position.
+ * A thread joins the open batch by raising its count with a compare and
+   swap, copies its position's slots into the batch and waits. Whoever
+   takes the last place of a batch closes it, waits for the others to
+   finish copying, evaluates it and wakes them; each then takes its value
+   and the last to do so hands the batch back for reuse. Nothing is
+   locked, and a thread that has to wait sleeps on a futex, or naps and
+   checks again where there are none.
+ * Threads join the queue while they search and park while they wait on
+   anything else, such as the other threads of an analysis finishing a
+   depth. A batch closes once it holds a position of every joined thread,
+   or batch_size positions if fewer, so that the threads still searching
+   do not wait for one that will not evaluate anything soon. A thread
+   evaluating without having joined counts as joined for its own batch.
+ * A batch that does not fill within the flush time is closed by one of
+   its waiting threads and evaluated as it is, so a thread never waits
+   for others that are not coming.
+ * Each batch is stamped with the number of the round it serves, which
+   threads check when joining, so that a thread late to a batch since
+   reused cannot join the wrong round */
+
+#define EVALQ_BATCHES 64
+#define EVALQ_CLOSED (1u << 31)
+
+struct eval_batch {
+    uint64_t state;
+    uint32_t filled, taken, done, size;
+    int32_t* slots;
+    turn* players;
+    float* values;
+} __attribute__((aligned(64)));
+
+typedef struct eval_batch eval_batch;
+
+
+struct eval_queue {
+    ntuple_net* net;
+    unsigned int batch_size;
+    uint64_t flush_ns;
+    uint32_t producers;
+    uint64_t round;
+    eval_batch* batches;
+    unsigned long long evaluated, batches_run, flushed;
+};
+
+typedef struct eval_queue eval_queue;
+
+
+/**
+ * eval_queue_new
+ *
+ * Creates a queue evaluating positions with a network.
+ *
+ * Parameters:
+ *   - net: A pointer to the `ntuple_net`, which must outlive the queue.
+ *   - batch_size: The number of positions of a full batch, at least 1.
+ *   - flush_us: The time in microseconds after which a thread waiting
+ *      for its batch to fill has it evaluated as it is, 0 to have batches
+ *      evaluated as soon as no other thread is joining them.
+ *
+ * Returns:
+ *   - A pointer to the new `eval_queue`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `eval_queue_free`.
+ *   - Raises an error if memory allocation fails.
+ */
+eval_queue* eval_queue_new(ntuple_net* net, unsigned int batch_size,
+                           unsigned int flush_us);
+
+/**
+ * eval_queue_evaluate
+ *
+ * Evaluates a position in a batch with those of other threads.
+ *
+ * Parameters:
+ *   - q: A pointer to the `eval_queue`.
+ *   - st: The state of the position, for the queue's network.
+ *   - player: The player to move.
+ *
+ * Returns:
+ *   - The value of the position, as `ntuple_state_value` gives.
+ *
+ * Note:
+ *   - Safe to call from any number of threads at once. Returns once the
+ *      batch is evaluated, which takes up to the flush time.
+ */
+float eval_queue_evaluate(eval_queue* q, ntuple_state* st, turn player);
+
+/**
+ * eval_queue_join
+ *
+ * Counts the calling thread among those evaluating through a queue, whose
+ *  batches then wait for a position from it.
+ *
+ * Parameters:
+ *   - q: A pointer to the `eval_queue`.
+ */
+void eval_queue_join(eval_queue* q);
+
+/**
+ * eval_queue_park
+ *
+ * Stops counting a thread that joined a queue, until it joins again,
+ *  evaluating at once the open batch if every other joined thread is in
+ *  it.
+ *
+ * Parameters:
+ *   - q: A pointer to the `eval_queue`.
+ */
+void eval_queue_park(eval_queue* q);
+
+/**
+ * eval_queue_free
+ *
+ * Frees a queue no thread is using.
+ *
+ * Parameters:
+ *   - q: A pointer to the `eval_queue`.
+ */
+void eval_queue_free(eval_queue* q);
+
+#endif /* EVALQ_H */
@@ -0,0 +1,373 @@
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "stateset.h"
+#include "trace.h"
+
+/* Counts the distinct states reachable from the empty board of a
+   configuration by breadth-first search over drops, offsets and disarrays,
+   one level of plies at a time, with every thread expanding the same
+   level.
+ * Successors are deduplicated through a shared lock-free state set. When
+   the set gets too full for the memory bound, its keys are sorted and
+   spilled to a run file and the set starts over empty. States found after
+   that are only new if no earlier run holds them, which is checked by
+   merging each batch of sorted new states against the runs. Frontiers are
+   kept in files too, so memory only holds the set and one segment of new
+   states.
+ * Finished games are counted but not expanded. With -s, a state and its 
+   mirror image count once, which gives the number of entries caches and
+   tablebases keyed by canonical states need */
+
+/* Frontier states expanded between checks of the set's load, at most. 
+   Batches are smaller when the set is, so that one batch only fills a fifth
+   of it */
+#define EXPLORE_BATCH 65536
+#define EXPLORE_BATCH_SHARE 0.2
+#define EXPLORE_MAX_LOAD 0.7
+#define EXPLORE_IO_KEYS 4096
+
+
+struct explore_options {
+    unsigned int width, height, run, threads;
+    size_t max_memory;
+    char* tmpdir;
+    bool symmetric;
+};
+
+typedef struct explore_options explore_options;
+
+
+struct explore_worker {
+    struct explore_job* job;
+    state_key* found;
+    size_t found_len, found_cap;
+    unsigned long long terminal;
+};
+
+typedef struct explore_worker explore_worker;
+
+
+struct explore_job {
+    explore_options* opts;
+    stateset* set;
+    explore_worker* workers;
+    state_key* batch;
+    size_t batch_cap, batch_len, next;
+    FILE** runs;
+    unsigned int num_runs;
+    FILE* next_frontier;
+    unsigned long long next_len, states, terminal, expanded;
+    unsigned long long* per_pieces;
+};
+
+typedef struct explore_job explore_job;
+
+/* This helper function prints the usage line and exits */
+void explore_usage() {
+    fprintf(stderr, "Usage: explore -w <width> -h <height> -r <run> "
+                    "[-j <threads>] [-M <megabytes>] [-d <spill dir>] "
+                    "[-s]\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * By default every core is used, the memory bound is 1024 MB and runs are
+   spilled to /tmp */
+void parse_explore_arguments(int argc, char** argv, explore_options* opts) {
+    memset(opts, 0, sizeof(explore_options));
+    opts->threads = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->max_memory = (size_t)1024 << 20;
+    opts->tmpdir = "/tmp";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            opts->symmetric = true;
+            continue;
+        }
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            explore_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'w':
+                opts->width = v;
+                break;
+            case 'h':
+                opts->height = v;
+                break;
+            case 'r':
+                opts->run = v;
+                break;
+            case 'j':
+                opts->threads = v;
+                break;
+            case 'M':
+                opts->max_memory = (size_t)v << 20;
+                break;
+            case 'd':
+                opts->tmpdir = argv[i + 1];
+                break;
+            default:
+                explore_usage();
+        }
+        i++;
+    }
+    if (opts->run == 0 || opts->threads == 0 ||
+        !state_supported(opts->width, opts->height)) {
+        explore_usage();
+    }
+}
+
+/* This helper function creates an anonymous temporary file in dir */
+FILE* temp_file(const char* dir) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/exploreXXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create a spill file in %s\n", dir);
+        exit(1);
+    }
+    unlink(path);
+    FILE* f = fdopen(fd, "w+b");
+    check_malloc(f);
+    return f;
+}
+
+/* This helper function writes keys to f, exiting if the disk is full */
+void write_keys(FILE* f, const state_key* keys, size_t n) {
+    if (fwrite(keys, sizeof(state_key), n, f) != n) {
+        fprintf(stderr, "Could not write to a spill file\n");
+        exit(1);
+    }
+}
+
+/* This helper function appends a key to a worker's new states */
+void push_new_state(explore_worker* w, state_key k) {
+    if (w->found_len == w->found_cap) {
+        w->found_cap = w->found_cap ? 2 * w->found_cap : 4096;
+        w->found = (state_key*)realloc(w->found,
+                                       sizeof(state_key) * w->found_cap);
+        check_malloc(w->found);
+    }
+    w->found[w->found_len++] = k;
+}
+
+/* This is the thread routine of the expansion of a batch. Each thread
+   claims chunks of the batch and inserts every successor into the set,
+   keeping the ones the set did not hold yet */
+void* explore_routine(void* arg) {
+    explore_worker* w = (explore_worker*)arg;
+    explore_job* job = w->job;
+    explore_options* opts = job->opts;
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    size_t start;
+    while ((start = __atomic_fetch_add(&job->next, 256, __ATOMIC_RELAXED)) <
+           job->batch_len) {
+        size_t end = start + 256 < job->batch_len ? start + 256 :
+                                                    job->batch_len;
+        trace_begin("explore_chunk");
+        for (size_t i = start; i < end; i++) {
+            state_load(g, job->batch[i]);
+            if (game_outcome(g) != IN_PROGRESS) {
+                w->terminal++;
+                continue;
+            }
+            for (unsigned int m = 0; m < opts->width + 2; m++) {
+                if (!play_move(g, move_from_index(opts->width, m))) {
+                    continue;
+                }
+                state_key k = state_encode(g);
+                if (opts->symmetric) {
+                    k = state_canonical(k, opts->width, opts->height);
+                }
+                if (stateset_insert(job->set, k)) {
+                    push_new_state(w, k);
+                }
+                state_load(g, job->batch[i]);
+            }
+        }
+        trace_end("explore_chunk");
+    }
+    game_free(g);
+    return NULL;
+}
+
+/* This helper function removes from the n sorted keys those held by the
+   sorted run file, and returns how many are left */
+size_t filter_run(state_key* keys, size_t n, FILE* run) {
+    state_key buf[EXPLORE_IO_KEYS];
+    size_t buf_len = 0, buf_pos = 0, kept = 0;
+    rewind(run);
+    for (size_t i = 0; i < n; i++) {
+        bool seen = false;
+        while (true) {
+            if (buf_pos == buf_len) {
+                buf_len = fread(buf, sizeof(state_key), EXPLORE_IO_KEYS, run);
+                buf_pos = 0;
+                if (buf_len == 0) {
+                    break;
+                }
+            }
+            if (buf[buf_pos] >= keys[i]) {
+                seen = buf[buf_pos] == keys[i];
+                break;
+            }
+            buf_pos++;
+        }
+        if (!seen) {
+            keys[kept++] = keys[i];
+        }
+    }
+    fseek(run, 0, SEEK_END);
+    return kept;
+}
+
+/* This helper function orders state keys for qsort */
+int compare_explored(const void* a, const void* b) {
+    state_key x = *(const state_key*)a, y = *(const state_key*)b;
+    return (x > y) - (x < y);
+}
+
+/* This helper function takes the states the workers found since the last
+   spill, drops those that an earlier run already holds and appends the
+   others to the next frontier */
+void flush_found(explore_job* job) {
+    explore_options* opts = job->opts;
+    size_t n = 0;
+    for (unsigned int t = 0; t < opts->threads; t++) {
+        n += job->workers[t].found_len;
+    }
+    state_key* keys = (state_key*)malloc(sizeof(state_key) * (n ? n : 1));
+    check_malloc(keys);
+    n = 0;
+    for (unsigned int t = 0; t < opts->threads; t++) {
+        explore_worker* w = &job->workers[t];
+        memcpy(keys + n, w->found, sizeof(state_key) * w->found_len);
+        n += w->found_len;
+        w->found_len = 0;
+    }
+    if (job->num_runs) {
+        qsort(keys, n, sizeof(state_key), compare_explored);
+        for (unsigned int r = 0; r < job->num_runs; r++) {
+            n = filter_run(keys, n, job->runs[r]);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        job->per_pieces[state_pieces(keys[i], opts->width, opts->height)]++;
+    }
+    write_keys(job->next_frontier, keys, n);
+    job->next_len += n;
+    job->states += n;
+    free(keys);
+}
+
+/* This helper function spills the set to a new sorted run and empties it */
+void spill_set(explore_job* job) {
+    flush_found(job);
+    state_key* keys;
+    size_t n = stateset_drain(job->set, &keys);
+    job->runs = (FILE**)realloc(job->runs,
+                                sizeof(FILE*) * (job->num_runs + 1));
+    check_malloc(job->runs);
+    FILE* run = temp_file(job->opts->tmpdir);
+    write_keys(run, keys, n);
+    job->runs[job->num_runs++] = run;
+    stateset_clear(job->set);
+}
+
+/* This helper function expands one level, reading the frontier from cur */
+void explore_level(explore_job* job, FILE* cur) {
+    explore_options* opts = job->opts;
+    size_t headroom = job->batch_cap * (opts->width + 2);
+    rewind(cur);
+    while ((job->batch_len = fread(job->batch, sizeof(state_key),
+                                   job->batch_cap, cur)) > 0) {
+        if (stateset_load(job->set) + (double)headroom /
+            (job->set->mask + 1) > EXPLORE_MAX_LOAD) {
+            spill_set(job);
+        }
+        job->next = 0;
+        pthread_t tids[opts->threads];
+        for (unsigned int t = 0; t < opts->threads; t++) {
+            pthread_create(&tids[t], NULL, explore_routine,
+                           &job->workers[t]);
+        }
+        for (unsigned int t = 0; t < opts->threads; t++) {
+            pthread_join(tids[t], NULL);
+        }
+        job->expanded += job->batch_len;
+    }
+    flush_found(job);
+}
+
+int main(int argc, char** argv) {
+    explore_options opts;
+    parse_explore_arguments(argc, argv, &opts);
+    explore_job job;
+    memset(&job, 0, sizeof(job));
+    job.opts = &opts;
+    job.set = stateset_new(opts.max_memory / 2);
+    job.batch_cap = (job.set->mask + 1) * EXPLORE_BATCH_SHARE / 
+                    (opts.width + 2);
+    if (job.batch_cap > EXPLORE_BATCH) {
+        job.batch_cap = EXPLORE_BATCH;
+    }
+    job.workers = (explore_worker*)calloc(opts.threads,
+                                          sizeof(explore_worker));
+    check_malloc(job.workers);
+    for (unsigned int t = 0; t < opts.threads; t++) {
+        job.workers[t].job = &job;
+    }
+    job.batch = (state_key*)malloc(sizeof(state_key) * job.batch_cap);
+    check_malloc(job.batch);
+    job.per_pieces = (unsigned long long*)calloc(opts.width * opts.height + 1,
+                                                 sizeof(unsigned long long));
+    check_malloc(job.per_pieces);
+
+    uint64_t start = now_ns();
+    game* g = new_game(opts.run, opts.width, opts.height, BITS);
+    state_key root = state_encode(g);
+    game_free(g);
+    stateset_insert(job.set, root);
+    FILE* cur = temp_file(opts.tmpdir);
+    write_keys(cur, &root, 1);
+    job.states = 1;
+    job.per_pieces[0] = 1;
+    unsigned long long cur_len = 1;
+    for (unsigned int level = 0; cur_len; level++) {
+        job.next_frontier = temp_file(opts.tmpdir);
+        job.next_len = 0;
+        explore_level(&job, cur);
+        printf("ply %3u: %12llu states expanded, %12llu new, %u runs\n",
+               level, cur_len, job.next_len, job.num_runs);
+        fclose(cur);
+        cur = job.next_frontier;
+        cur_len = job.next_len;
+    }
+    fclose(cur);
+    double secs = (now_ns() - start) / 1e9;
+
+    for (unsigned int t = 0; t < opts.threads; t++) {
+        job.terminal += job.workers[t].terminal;
+        free(job.workers[t].found);
+    }
+    printf("\n%6s %14s\n", "pieces", "states");
+    for (unsigned int p = 0; p <= opts.width * opts.height; p++) {
+        if (job.per_pieces[p]) {
+            printf("%6u %14llu\n", p, job.per_pieces[p]);
+        }
+    }
+    printf("\n%llu distinct states, %llu of them finished games\n",
+           job.states, job.terminal);
+    printf("%u threads, %u spilled runs, %.3f s, %.0f states/s\n",
+           opts.threads, job.num_runs, secs, job.expanded / secs);
+    for (unsigned int r = 0; r < job.num_runs; r++) {
+        fclose(job.runs[r]);
+    }
+    free(job.runs);
+    free(job.per_pieces);
+    free(job.batch);
+    free(job.workers);
+    stateset_free(job.set);
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "hash.h"
+
+#define KEY_WHITES_TURN 0x9e3779b97f4a7c15ull
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t piece_key(cell color, unsigned int index, uint64_t cell_index) {
+    return mix64(mix64(cell_index + 0x2545f4914f6cdd1dull) ^ 
+                 ((uint64_t)index << 1) ^ (color == WHITE));
+}
+
+/* This helper function adds the terms of a queue to a key pair */
+void add_queue_terms(key_pair* k, posqueue* q, cell color, 
+                     unsigned int width) {
+    unsigned int i = 0;
+    for (pq_entry* e = q->head; e; e = e->next, i++) {
+        uint64_t row = (uint64_t)e->p.r * width;
+        k->key ^= piece_key(color, i, row + e->p.c);
+        k->mirror ^= piece_key(color, i, row + width - 1 - e->p.c);
+    }
+}
+
+key_pair game_key_pair(game* g) {
+    check_null_pointer(g);
+    key_pair k;
+    k.key = k.mirror = g->player == WHITES_TURN ? KEY_WHITES_TURN : 0;
+    add_queue_terms(&k, g->black_queue, BLACK, g->b->width);
+    add_queue_terms(&k, g->white_queue, WHITE, g->b->width);
+    return k;
+}
+
+uint64_t game_key(game* g) {
+    return game_key_pair(g).key;
+}
+
+void key_pair_drop(key_pair* k, game* g) {
+    check_null_pointer(k);
+    check_null_pointer(g);
+    bool black_dropped = g->player == WHITES_TURN;
+    posqueue* q = black_dropped ? g->black_queue : g->white_queue;
+    cell color = black_dropped ? BLACK : WHITE;
+    pos p = q->tail->p;
+    uint64_t row = (uint64_t)p.r * g->b->width;
+    k->key ^= KEY_WHITES_TURN ^ piece_key(color, q->len - 1, row + p.c);
+    k->mirror ^= KEY_WHITES_TURN ^ 
+                 piece_key(color, q->len - 1, row + g->b->width - 1 - p.c);
+}
+
+uint64_t canonical_key(key_pair k, bool* mirrored) {
+    if (mirrored) {
+        *mirrored = k.mirror < k.key;
+    }
+    return k.mirror < k.key ? k.mirror : k.key;
+}
+
+move mirror_move(move m, unsigned int width) {
+    if (m.kind == MOVE_DROP) {
+        m.column = width - 1 - m.column;
+    }
+    return m;
+}
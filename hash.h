@@ -0,0 +1,124 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include "logic.h"
+
+/* Position keys identify a game state for books, caches and tablebases.
+ * Offsets and disarrays depend on the order in which pieces were dropped,
+   so two boards that look the same are only the same position if their
+   queues match too. The key of a game therefore mixes in the player to move
+   and every queued piece together with its color and its place in its
+   queue. Each piece contributes an independent 64-bit term and the terms
+   are combined by XOR, so a drop only adds one term.
+ * Every rule treats columns alike, so mirroring a position left to right
+   (column c to width - 1 - c) gives a position with the same value, whose
+   good moves are the mirrored good moves. Keys are therefore computed in 
+   pairs with the key of the mirrored position, which costs a second term 
+   per piece, and caches store positions under the smaller of the two */
+
+struct key_pair {
+    uint64_t key, mirror;
+};
+
+typedef struct key_pair key_pair;
+
+/**
+ * mix64
+ *
+ * Scrambles a 64-bit value into a well spread one (the splitmix64 
+ *  finalizer). Distinct inputs give distinct outputs.
+ *
+ * Parameters:
+ *   - x: The value to scramble.
+ */
+uint64_t mix64(uint64_t x);
+
+/**
+ * piece_key
+ *
+ * Returns the term contributed to a position key by one queued piece.
+ *
+ * Parameters:
+ *   - color: BLACK or WHITE.
+ *   - index: The place of the piece in its queue, 0 for the oldest.
+ *   - cell_index: The cell of the piece, r * width + c.
+ */
+uint64_t piece_key(cell color, unsigned int index, uint64_t cell_index);
+
+/**
+ * game_key
+ *
+ * Computes the position key of a game from scratch.
+ *
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *
+ * Returns:
+ *   - The 64-bit key. Games of different sizes are not told apart, so keys
+ *      should only be compared between games of the same configuration.
+ *
+ * Note:
+ *   - Raises an error if the pointer is NULL.
+ */
+uint64_t game_key(game* g);
+
+/**
+ * game_key_pair
+ *
+ * Computes the position key of a game and that of its mirror image in one
+ *  pass over the queues.
+ *
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *
+ * Returns:
+ *   - The pair of keys; `key` equals `game_key(g)`.
+ *
+ * Note:
+ *   - Raises an error if the pointer is NULL.
+ */
+key_pair game_key_pair(game* g);
+
+/**
+ * key_pair_drop
+ *
+ * Updates a key pair after a successful `drop_piece`, by adding the terms 
+ *  of the new piece and switching the player to move. Offsets and 
+ *  disarrays move many pieces at once and call for `game_key_pair`.
+ *
+ * Parameters:
+ *   - k: A pointer to the pair of keys of the game before the drop.
+ *   - g: A pointer to the `game` structure, after the drop.
+ */
+void key_pair_drop(key_pair* k, game* g);
+
+/**
+ * canonical_key
+ *
+ * Returns the key under which a position and its mirror image are stored.
+ *
+ * Parameters:
+ *   - k: The key pair of the position.
+ *   - mirrored: Out-parameter set to `true` if the stored position is the 
+ *      mirror image, in which case moves read from or written to the cache
+ *      must go through `mirror_move`. May be NULL.
+ *
+ * Returns:
+ *   - The smaller of the two keys.
+ */
+uint64_t canonical_key(key_pair k, bool* mirrored);
+
+/**
+ * mirror_move
+ *
+ * Returns the mirror image of a move: drops change column, offsets and 
+ *  disarrays are their own mirror image.
+ *
+ * Parameters:
+ *   - m: The move.
+ *   - width: The number of columns of the board (unsigned integer).
+ */
+move mirror_move(move m, unsigned int width);
+
+#endif /* HASH_H */
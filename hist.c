@@ -0,0 +1,65 @@
+#include <string.h>
+#include "hist.h"
+
+void hist_clear(histogram* h) {
+    memset(h, 0, sizeof(histogram));
+    h->min = UINT64_MAX;
+}
+
+/* This helper function returns the bucket of a value */
+unsigned int hist_index(uint64_t v) {
+    if (v < HIST_SUB) {
+        return v;
+    }
+    unsigned int e = 63 - __builtin_clzll(v);
+    unsigned int shift = e - HIST_SUB_BITS;
+    return HIST_SUB + shift * HIST_SUB + ((v >> shift) & (HIST_SUB - 1));
+}
+
+/* This helper function returns the highest value of a bucket */
+uint64_t hist_bucket_max(unsigned int i) {
+    if (i < HIST_SUB) {
+        return i;
+    }
+    unsigned int shift = (i - HIST_SUB) / HIST_SUB;
+    uint64_t top = HIST_SUB + (i - HIST_SUB) % HIST_SUB + 1;
+    /* The top bucket ends at the largest value, which shifting would
+       overflow */
+    return shift + HIST_SUB_BITS == 63 && top == 2 * HIST_SUB
+           ? UINT64_MAX : (top << shift) - 1;
+}
+
+void hist_record(histogram* h, uint64_t v) {
+    h->counts[hist_index(v)]++;
+    h->total++;
+    h->min = v < h->min ? v : h->min;
+    h->max = v > h->max ? v : h->max;
+}
+
+void hist_merge(histogram* into, const histogram* from) {
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    into->min = from->min < into->min ? from->min : into->min;
+    into->max = from->max > into->max ? from->max : into->max;
+}
+
+uint64_t hist_percentile(const histogram* h, double p) {
+    if (h->total == 0) {
+        return 0;
+    }
+    double exact = p / 100 * h->total;
+    uint64_t rank = (uint64_t)exact;
+    rank += rank < exact;
+    rank = rank < 1 ? 1 : rank > h->total ? h->total : rank;
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t v = hist_bucket_max(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
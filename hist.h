@@ -0,0 +1,73 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+
+/* A histogram counts values, such as latencies in nanoseconds, in buckets
+   whose width grows with the values, so that it covers every 64-bit
+   value in a fixed size while keeping the error of any percentile read
+   from it within 1 / HIST_SUB of the value.
+ * Values below HIST_SUB have a bucket each. Above, every range from a
+   power of 2 to the next is split into HIST_SUB buckets of equal width.
+   Recording is an index computation and an increment, with no lock: each
+   thread records into its own histogram, and histograms are merged once
+   recording is over */
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total, min, max;
+};
+
+typedef struct histogram histogram;
+
+
+/**
+ * hist_clear
+ *
+ * Empties a histogram.
+ *
+ * Parameters:
+ *   - h: A pointer to the `histogram`.
+ */
+void hist_clear(histogram* h);
+
+/**
+ * hist_record
+ *
+ * Counts a value.
+ *
+ * Parameters:
+ *   - h: A pointer to the `histogram`.
+ *   - v: The value.
+ */
+void hist_record(histogram* h, uint64_t v);
+
+/**
+ * hist_merge
+ *
+ * Adds the counts of a histogram to another.
+ *
+ * Parameters:
+ *   - into: A pointer to the `histogram` added to.
+ *   - from: A pointer to the `histogram` added.
+ */
+void hist_merge(histogram* into, const histogram* from);
+
+/**
+ * hist_percentile
+ *
+ * Returns the value below or at which a percentage of the values fall: the
+ *  highest value of the bucket holding that rank, or the largest value
+ *  counted if it is lower. 0 if the histogram is empty.
+ *
+ * Parameters:
+ *   - h: A pointer to the `histogram`.
+ *   - p: The percentage, from 0 to 100.
+ */
+uint64_t hist_percentile(const histogram* h, double p);
+
+#endif /* HIST_H */
@@ -0,0 +1,411 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "hist.h"
+#include "server.h"
+
+/* Loads a game server (see server.h) with -c connections, on TCP port -p
+   of 127.0.0.1 or the Unix socket -u, spread over -j threads, for -d
+   seconds, and reports the requests served per second and percentiles of
+   their latency.
+ * Every connection starts a game of -w by -h with run -r, then plays it
+   with a request at a time, starting a new one whenever it ends. Its
+   requests are the lines of the script -x, from the line of the
+   connection's number onwards and round again, or else random moves:
+   about 5% offsets, 5% disarrays and otherwise a drop into a uniformly
+   chosen column, from seed -s. Errors, such as drops into full columns,
+   are counted and timed like any reply.
+ * By default a connection sends its next request as soon as it has the
+   reply. With -q, it sends -q requests per second on a fixed schedule
+   instead, and latency runs from when a request was due, so that a slow
+   server is charged for the requests it held back too.
+ * Each thread records latencies into its own histogram (see hist.h), and
+   the histograms are merged at the end */
+
+#define LOADGEN_EVENTS 256
+#define LOADGEN_BUF 2048
+#define LOADGEN_LINE 64
+#define LOADGEN_MAX_SCRIPT 65536
+#define LOADGEN_MAX_THREADS 256
+
+struct loadgen_options {
+    bool tcp;
+    unsigned short port;
+    const char* unix_path;
+    unsigned int connections, threads, seconds, rate, width, height, run;
+    unsigned int seed;
+    char (*script)[LOADGEN_LINE];
+    unsigned int script_len;
+};
+
+typedef struct loadgen_options loadgen_options;
+
+
+struct loadgen_conn {
+    int fd;
+    bool waiting, restart;
+    unsigned int seed, step, in_len;
+    uint64_t sent_ns, due_ns;
+    char in[LOADGEN_BUF];
+};
+
+typedef struct loadgen_conn loadgen_conn;
+
+
+struct loadgen_thread {
+    loadgen_options* opts;
+    pthread_barrier_t* start;
+    unsigned int first, count;
+    loadgen_conn* conns;
+    histogram* hist;
+    unsigned long long requests, errors, games, lost;
+    pthread_t tid;
+};
+
+typedef struct loadgen_thread loadgen_thread;
+
+/* This helper function prints the usage line and exits */
+void loadgen_usage() {
+    fprintf(stderr, "Usage: loadgen (-p <port> | -u <socket path>) "
+                    "[-c <connections>] [-j <threads>] [-d <seconds>]\n"
+                    "               [-q <requests per second>] "
+                    "[-x <script>] [-w <width>] [-h <height>] "
+                    "[-r <run>] [-s <seed>]\n");
+    exit(1);
+}
+
+/* This helper function reads a script, a request per line */
+void read_script(const char* path, loadgen_options* opts) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    opts->script = malloc(LOADGEN_MAX_SCRIPT * sizeof(*opts->script));
+    check_malloc(opts->script);
+    char line[LOADGEN_LINE];
+    while (opts->script_len < LOADGEN_MAX_SCRIPT &&
+           fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0]) {
+            strcpy(opts->script[opts->script_len++], line);
+        }
+    }
+    fclose(f);
+    if (opts->script_len == 0) {
+        fprintf(stderr, "The script %s has no request\n", path);
+        exit(1);
+    }
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * One of -p and -u is required. By default 1000 connections on a thread
+   per core play games of 7 by 6 with run 4 as fast as they can for 10
+   seconds, with random moves from seed 1 */
+void parse_loadgen_arguments(int argc, char** argv, loadgen_options* opts) {
+    memset(opts, 0, sizeof(loadgen_options));
+    opts->connections = 1000;
+    opts->threads = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->seconds = 10;
+    opts->width = 7;
+    opts->height = 6;
+    opts->run = 4;
+    opts->seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            loadgen_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'p':
+                if (v == 0 || v > 65535) {
+                    loadgen_usage();
+                }
+                opts->tcp = true;
+                opts->port = v;
+                break;
+            case 'u':
+                opts->unix_path = argv[i + 1];
+                break;
+            case 'c':
+                opts->connections = v;
+                break;
+            case 'j':
+                opts->threads = v;
+                break;
+            case 'd':
+                opts->seconds = v;
+                break;
+            case 'q':
+                opts->rate = v;
+                break;
+            case 'x':
+                read_script(argv[i + 1], opts);
+                break;
+            case 'w':
+                opts->width = v;
+                break;
+            case 'h':
+                opts->height = v;
+                break;
+            case 'r':
+                opts->run = v;
+                break;
+            case 's':
+                opts->seed = v;
+                break;
+            default:
+                loadgen_usage();
+        }
+        i++;
+    }
+    if (opts->tcp == (opts->unix_path != NULL) || opts->connections == 0 ||
+        opts->threads == 0 || opts->threads > LOADGEN_MAX_THREADS ||
+        opts->seconds == 0 || opts->width == 0 || opts->height == 0 ||
+        opts->run == 0) {
+        loadgen_usage();
+    }
+    if (opts->threads > opts->connections) {
+        opts->threads = opts->connections;
+    }
+}
+
+/* This helper function opens a connection to the server, made
+   non-blocking once connected. Returns it, or -1 on failure */
+int loadgen_connect(loadgen_options* opts) {
+    int fd;
+    if (opts->tcp) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opts->port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if (fd >= 0 && (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one,
+                                   sizeof(one)) ||
+                        connect(fd, (struct sockaddr*)&addr,
+                                sizeof(addr)))) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, opts->unix_path, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+/* This helper function closes a connection the server dropped */
+void loadgen_drop(loadgen_thread* t, loadgen_conn* c) {
+    close(c->fd);
+    c->fd = -1;
+    t->lost++;
+}
+
+/* This helper function sends the next request of a connection, timed from
+   when it was due */
+void loadgen_send(loadgen_thread* t, loadgen_conn* c, uint64_t due_ns) {
+    loadgen_options* o = t->opts;
+    char line[LOADGEN_LINE + 1];
+    int len;
+    if (c->restart) {
+        len = snprintf(line, sizeof(line), "new %u %u %u\n", o->width,
+                       o->height, o->run);
+    } else if (o->script) {
+        len = snprintf(line, sizeof(line), "%s\n",
+                       o->script[c->step++ % o->script_len]);
+    } else {
+        unsigned int r = rand_r(&c->seed) % 100;
+        len = r < 5 ? snprintf(line, sizeof(line), "offset\n")
+              : r < 10 ? snprintf(line, sizeof(line), "disarray\n")
+              : snprintf(line, sizeof(line), "drop %u\n",
+                         rand_r(&c->seed) % o->width);
+    }
+    /* With one request outstanding, the socket always has room for it */
+    if (write(c->fd, line, len) != len) {
+        loadgen_drop(t, c);
+        return;
+    }
+    c->sent_ns = due_ns;
+    c->waiting = true;
+}
+
+/* This helper function reads the replies a connection has, counting and
+   timing them. Returns false if the connection was dropped */
+bool loadgen_receive(loadgen_thread* t, loadgen_conn* c) {
+    ssize_t n = read(c->fd, c->in + c->in_len, LOADGEN_BUF - c->in_len);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            loadgen_drop(t, c);
+            return false;
+        }
+        return true;
+    }
+    c->in_len += n;
+    uint64_t now = now_ns();
+    char* start = c->in;
+    char* nl;
+    while ((nl = memchr(start, '\n', c->in + c->in_len - start))) {
+        *nl = '\0';
+        hist_record(t->hist, now - c->sent_ns);
+        t->requests++;
+        bool error = strncmp(start, "error", 5) == 0;
+        t->errors += error;
+        if (strstr(start, "wins") || strstr(start, "draw") ||
+            strcmp(start, "error game over") == 0) {
+            t->games++;
+            c->restart = true;
+        } else if (c->restart && !error) {
+            c->restart = false;
+        }
+        c->waiting = false;
+        start = nl + 1;
+    }
+    c->in_len -= start - c->in;
+    memmove(c->in, start, c->in_len);
+    if (c->in_len == LOADGEN_BUF) {
+        loadgen_drop(t, c);
+        return false;
+    }
+    return true;
+}
+
+/* This is the routine of a thread: it connects its share of the
+   connections and, once every thread has, drives them until the time is
+   up */
+void* loadgen_routine(void* arg) {
+    loadgen_thread* t = (loadgen_thread*)arg;
+    loadgen_options* o = t->opts;
+    int epfd = epoll_create1(0);
+    for (unsigned int i = 0; i < t->count; i++) {
+        loadgen_conn* c = &t->conns[i];
+        c->fd = loadgen_connect(o);
+        c->seed = o->seed * 2654435761u + t->first + i;
+        c->step = o->script_len ? (t->first + i) % o->script_len : 0;
+        c->restart = true;
+        if (c->fd < 0) {
+            t->lost++;
+            continue;
+        }
+        struct epoll_event ev = {EPOLLIN, {.u32 = i}};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+    }
+    pthread_barrier_wait(t->start);
+    uint64_t start = now_ns();
+    uint64_t end = start + o->seconds * 1000000000ull;
+    uint64_t interval = o->rate ? 1000000000ull / o->rate : 0;
+    for (unsigned int i = 0; i < t->count; i++) {
+        /* Scheduled connections start spread over their first interval */
+        t->conns[i].due_ns = start + interval * i / t->count;
+    }
+    struct epoll_event events[LOADGEN_EVENTS];
+    for (uint64_t now = start; now < end; now = now_ns()) {
+        for (unsigned int i = 0; i < t->count; i++) {
+            loadgen_conn* c = &t->conns[i];
+            if (c->fd >= 0 && !c->waiting && c->due_ns <= now) {
+                loadgen_send(t, c, interval ? c->due_ns : now);
+                c->due_ns += interval;
+            }
+        }
+        int n = epoll_wait(epfd, events, LOADGEN_EVENTS, interval ? 1 : 100);
+        for (int k = 0; k < n; k++) {
+            loadgen_conn* c = &t->conns[events[k].data.u32];
+            if (c->fd >= 0 && loadgen_receive(t, c) && !interval &&
+                !c->waiting) {
+                loadgen_send(t, c, now_ns());
+            }
+        }
+    }
+    for (unsigned int i = 0; i < t->count; i++) {
+        if (t->conns[i].fd >= 0) {
+            close(t->conns[i].fd);
+        }
+    }
+    close(epfd);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    loadgen_options opts;
+    parse_loadgen_arguments(argc, argv, &opts);
+    /* Thousands of connections need more descriptors than the usual soft
+       limit */
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    loadgen_thread threads[LOADGEN_MAX_THREADS];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, opts.threads + 1);
+    unsigned int first = 0;
+    for (unsigned int i = 0; i < opts.threads; i++) {
+        loadgen_thread* t = &threads[i];
+        memset(t, 0, sizeof(loadgen_thread));
+        t->opts = &opts;
+        t->start = &start;
+        t->first = first;
+        t->count = opts.connections / opts.threads +
+                   (i < opts.connections % opts.threads);
+        first += t->count;
+        t->conns = (loadgen_conn*)calloc(t->count, sizeof(loadgen_conn));
+        t->hist = (histogram*)malloc(sizeof(histogram));
+        check_malloc(t->conns);
+        check_malloc(t->hist);
+        hist_clear(t->hist);
+        if (pthread_create(&t->tid, NULL, loadgen_routine, t)) {
+            fprintf(stderr, "Could not create a thread\n");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&start);
+    uint64_t begin = now_ns();
+    histogram* all = (histogram*)malloc(sizeof(histogram));
+    check_malloc(all);
+    hist_clear(all);
+    unsigned long long requests = 0, errors = 0, games = 0, lost = 0;
+    for (unsigned int i = 0; i < opts.threads; i++) {
+        loadgen_thread* t = &threads[i];
+        pthread_join(t->tid, NULL);
+        hist_merge(all, t->hist);
+        requests += t->requests;
+        errors += t->errors;
+        games += t->games;
+        lost += t->lost;
+        free(t->conns);
+        free(t->hist);
+    }
+    double seconds = (now_ns() - begin) / 1e9;
+    printf("%u connections on %u threads for %.2f s: %llu requests "
+           "(%.0f/s), %llu errors, %llu games, %llu connections lost\n",
+           opts.connections, opts.threads, seconds, requests,
+           requests / seconds, errors, games, lost);
+    printf("latency in us: p50 %.1f, p99 %.1f, p999 %.1f, max %.1f\n",
+           hist_percentile(all, 50) / 1e3, hist_percentile(all, 99) / 1e3,
+           hist_percentile(all, 99.9) / 1e3, all->max / 1e3);
+    free(all);
+    free(opts.script);
+    pthread_barrier_destroy(&start);
+    return 0;
+}
@@ -1,5 +1,8 @@
 #include <pthread.h>
+#include <unistd.h>
 #include "logic.h"
+#include "perf.h"
+#include "trace.h"
 
 game* new_game(unsigned int run, unsigned int width,
                unsigned int height, enum type type) {
@@ -14,6 +17,7 @@ game* new_game(unsigned int run, unsigned int width,
     g->run = run;
     g->b = board_new(width, height, type);
     g->player = BLACKS_TURN;
+    g->windows = NULL;
     return g;
 }
 
@@ -21,16 +25,46 @@ void game_free(game* g) {
     posqueue_free(g->black_queue); 
     posqueue_free(g->white_queue);
     board_free(g->b);
+    if (g->windows) {
+        window_counts_free(g->windows);
+    }
     free(g);
 }
 
+void game_track_windows(game* g) {
+    check_null_pointer(g);
+    if (!g->windows) {
+        g->windows = window_counts_new(g->run, g->b);
+    }
+}
+
+/* This helper function sets a cell of the board of a game, updating the 
+    windows covering it if the game tracks them */
+void set_cell(game* g, pos p, cell c) {
+    if (g->windows) {
+        window_counts_set(g->windows, p, board_get(g->b, p), c);
+    }
+    board_set(g->b, p, c);
+}
+
+void game_reset(game* g) {
+    check_null_pointer(g);
+    while (g->black_queue->head) {
+        set_cell(g, pos_dequeue(g->black_queue), EMPTY);
+    }
+    while (g->white_queue->head) {
+        set_cell(g, pos_dequeue(g->white_queue), EMPTY);
+    }
+    g->player = BLACKS_TURN;
+}
+
 bool drop_piece(game* g, unsigned int column) {
     check_null_pointer(g);
-    cell top_cell = board_get(g->b, make_pos(0, column));  
-    if (top_cell != EMPTY) {
+    unsigned int filled = board_column_height(g->b, column);
+    if (filled == g->b->height) {
         return false;
     }
-    for (unsigned int r = g->b->height - 1; r >= 0; r--) {
+    for (unsigned int r = g->b->height - 1 - filled; r >= 0; r--) {
         pos curr_p = make_pos(r, column);
         cell curr_cell = board_get(g->b, curr_p);
         if (curr_cell == EMPTY) {
@@ -44,7 +78,7 @@ bool drop_piece(game* g, unsigned int column) {
                 pos_enqueue(g->white_queue, curr_p);
                 g->player = BLACKS_TURN;
             }
-            board_set(g->b, curr_p, cell_to_drop);
+            set_cell(g, curr_p, cell_to_drop);
             break;
         }
     }
@@ -83,90 +117,120 @@ void update_turn(game* g) {
     }
 }
 
-/* This is a helper function to disarray. It is used for both matrix and bits 
+void take_back_drop(game* g) {
+    check_null_pointer(g);
+    posqueue* q = g->player == BLACKS_TURN ? g->white_queue : 
+                                             g->black_queue;
+    set_cell(g, posqueue_remback(q), EMPTY);
+    update_turn(g);
+}
+
+/* This is a helper function to disarray. It is used for all three board 
    representations. It takes in a pointer to a board, a column, and a pointer 
    to an element in the drop_count. It only iterates over a single column 
    (specified in the parameter) and updates the drop_count out_parameter 
-   correspondingly */
+   correspondingly.
+ * Under gravity the pieces of a column are contiguous from the bottom, so 
+   only the column's own pieces are visited rather than the whole height, 
+   and as the column height does not change, columns can be processed by 
+   different threads */
 void process_column(board* b, unsigned int column, unsigned int* drop_count) {
     unsigned int height = b->height;
-    unsigned int bottom_r = height - 1;
-    *drop_count = 0; 
-    for (unsigned int r = 0; r < height; r++) {
-        if (bottom_r <= r) {
-            break;
-        }
-        pos p_top = make_pos(r, column);
-        if (board_get(b, p_top) == EMPTY) {
-            (*drop_count)++;
-            continue;
-        }
-        pos p_bottom = make_pos(bottom_r, column);
-        swap_pos(b, p_top, p_bottom);
-        bottom_r--;
+    unsigned int len = board_column_height(b, column);
+    for (unsigned int i = 0; i < len / 2; i++) {
+        swap_pos(b, make_pos(height - 1 - i, column), 
+                 make_pos(height - len + i, column));
     }
+    *drop_count = height - len;
 }
  
-/* This is a thread routine for processing a single column.
+/* This is a thread routine for processing columns.
  * It casts the argument to a pointer of type t_args, where t_args is
-   a structure that holds the game state, column index, and the drop_per_col
-   array used for gravity calculations.
+   a structure that holds the game state, the first column index, the 
+   stride between the columns of this thread, and the drop_per_col array 
+   used for gravity calculations.
  * It returns NULL to indicate that the thread has completed its work */
 void* process_column_routine(void* arg) {
     t_args* args = (t_args*)arg;
-    process_column(args->g->b, 
-                   args->column, 
-                   &args->drop_per_col[args->column]);
+    unsigned int width = args->g->b->width;
+    for (unsigned int c = args->column; c < width; c += args->stride) {
+        trace_begin("process_column");
+        process_column(args->g->b, c, &args->drop_per_col[c]);
+        trace_end("process_column");
+    }
     return NULL;
 }
 
 void disarray(game* g) {
     check_null_pointer(g);
+    perf_begin(PERF_DISARRAY);
+    trace_begin("disarray");
     unsigned int height = g->b->height, width = g->b->width, 
                  drop_per_col[width];
     if (g->b->type == MATRIX) {
-        pthread_t threads[width];
-        t_args args[width];
-        for (unsigned int c = 0; c < width; c++) {
+        /* One thread per column up to one per core, so that wide boards do 
+           not spawn thousands of threads */
+        unsigned int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (num_threads == 0 || num_threads > width) {
+            num_threads = width;
+        }
+        pthread_t threads[num_threads];
+        t_args args[num_threads];
+        for (unsigned int c = 0; c < num_threads; c++) {
             args[c].g = g;
             args[c].column = c;
+            args[c].stride = num_threads;
             args[c].drop_per_col = drop_per_col;
+            trace_begin("spawn");
             pthread_create(&threads[c], 
                            NULL, 
                            process_column_routine, 
                            &args[c]);
+            trace_end("spawn");
         }
-        for (unsigned int c = 0; c < width; c++) {
+        for (unsigned int c = 0; c < num_threads; c++) {
+            trace_begin("join");
             pthread_join(threads[c], NULL);
+            trace_end("join");
         }
     } else {
         for (unsigned int c = 0; c < width; c++) {
+            trace_begin("process_column");
             process_column(g->b, c, &drop_per_col[c]);
+            trace_end("process_column");
         }
     }
+    trace_begin("queue_update");
     update_queue_after_disarray(g->black_queue->head, drop_per_col, height);
     update_queue_after_disarray(g->white_queue->head, drop_per_col, height);
+    trace_end("queue_update");
+    if (g->windows) {
+        window_counts_rebuild(g->windows, g->b);
+    }
     update_turn(g);
+    trace_end("disarray");
+    perf_end(PERF_DISARRAY);
 }
 
-/* This helper function takes in a board and updates it after an offset move
+/* This helper function takes in a game and updates its board after an 
+    offset move
  * It only updates the pieces that were on top of the piece removed by offset
  * For this reason, the function takes in the position of the removed piece 
     through removed_piece_r and removed_piece_c.
  * This function specifically handles the case where the current player's 
     oldest piece and the opponent's latest piece are in different columns, so 
     that all pieces on top of the removed piece have to be dropped by 1 */
-void drop_by_one(board* b, unsigned int removed_piece_r,
-                           unsigned int removed_piece_c) {
+void drop_by_one(game* g, unsigned int removed_piece_r,
+                          unsigned int removed_piece_c) {
     for (int r = removed_piece_r - 1; r >= 0; r--) {
         pos curr_p = make_pos(r, removed_piece_c);
-        cell curr_cell = board_get(b, curr_p);
+        cell curr_cell = board_get(g->b, curr_p);
         if (curr_cell == EMPTY) {
             break;
         }
         pos p_below = make_pos(curr_p.r + 1, curr_p.c);
-        board_set(b, p_below, curr_cell);
-        board_set(b, curr_p, EMPTY);
+        set_cell(g, p_below, curr_cell);
+        set_cell(g, curr_p, EMPTY);
     }
 }
 
@@ -209,14 +273,15 @@ void update_queue_after_offset(pq_entry* head, pos latest_pos, pos oldest_pos,
     }
 }
 
-/* This helper function updates the board after an offset move.
+/* This helper function updates the board of a game after an offset move.
  * It uses the same concept of bottom_r and top_r found in the previous helper 
     function (please refer to previous helper definition for 
     update_queue_after_offset).
  * It specifically handles the case when both removed pieces are in the same 
     column, which is provided through the parameter col */
-void drop_by_one_or_two(board* b, unsigned int col, unsigned int bottom_r, 
-                                                    unsigned int top_r) {
+void drop_by_one_or_two(game* g, unsigned int col, unsigned int bottom_r, 
+                                                   unsigned int top_r) {
+    board* b = g->b;
     unsigned int jump_to_last_empty_r = 1;
     for (int r = bottom_r - 1; r >= 0; r--) {
         pos curr_p = make_pos(r, col);
@@ -231,8 +296,8 @@ void drop_by_one_or_two(board* b, unsigned int col, unsigned int bottom_r,
             continue;
         }
         pos p_last_empty = make_pos(r + jump_to_last_empty_r, col);
-        board_set(b, p_last_empty, curr_cell);
-        board_set(b, curr_p, EMPTY);
+        set_cell(g, p_last_empty, curr_cell);
+        set_cell(g, curr_p, EMPTY);
     }
 }
 
@@ -241,6 +306,7 @@ bool offset(game* g) {
     if (g->black_queue->head == NULL || g->white_queue->head == NULL) {
         return false;
     }
+    perf_begin(PERF_OFFSET);
     pos latest_pos, oldest_pos;
     if (g->player == BLACKS_TURN) {
         latest_pos = posqueue_remback(g->white_queue);
@@ -249,14 +315,14 @@ bool offset(game* g) {
         latest_pos = posqueue_remback(g->black_queue);
         oldest_pos = pos_dequeue(g->white_queue);
     }
-    board_set(g->b, latest_pos, EMPTY);
-    board_set(g->b, oldest_pos, EMPTY);
+    set_cell(g, latest_pos, EMPTY);
+    set_cell(g, oldest_pos, EMPTY);
     unsigned int bottom_r = 0, top_r = 0;
     unsigned int lat_r = latest_pos.r, lat_c = latest_pos.c; 
     unsigned int old_r = oldest_pos.r, old_c = oldest_pos.c;
     if (lat_c != old_c) {
-        drop_by_one(g->b, lat_r, lat_c);
-        drop_by_one(g->b, old_r, old_c);
+        drop_by_one(g, lat_r, lat_c);
+        drop_by_one(g, old_r, old_c);
     } else {
         if (lat_r < old_r) {
             bottom_r = old_r;
@@ -265,13 +331,14 @@ bool offset(game* g) {
             bottom_r = lat_r;
             top_r = old_r;
         }
-        drop_by_one_or_two(g->b, lat_c, bottom_r, top_r);
+        drop_by_one_or_two(g, lat_c, bottom_r, top_r);
     }
     update_queue_after_offset(g->black_queue->head, latest_pos, oldest_pos, 
                                                     bottom_r, top_r);
     update_queue_after_offset(g->white_queue->head, latest_pos, oldest_pos, 
                                                     bottom_r, top_r);
     update_turn(g);
+    perf_end(PERF_OFFSET);
     return true;
 }
 
@@ -342,28 +409,169 @@ void check_run(game* g, pq_entry* head, bool* out_run) {
     }
 }
 
-/* This helper function loops over all the top cells (cells of row index equal 
-    to 0) and returns true if one of them is empty to indicate that there is 
-    still an available move. If all top cells are not empty, the function 
-    returns false, indicating that the board is full and that no moves are 
-    available */
+/* This helper function returns true if one of the top cells (cells of row 
+    index equal to 0) is empty to indicate that there is still an available 
+    move. If all top cells are not empty, the function returns false, 
+    indicating that the board is full and that no moves are available. The 
+    board counts its full columns, so this takes constant time */
 bool available_move(game* g) {
-    unsigned int width = g->b->width;
-    for (unsigned int c = 0; c < width; c++) {
-        cell curr_cell = board_get(g->b, make_pos(0, c));
-        if (curr_cell == EMPTY) {
-            return true;
+    return g->b->full_columns < g->b->width;
+}
+
+/* This helper function returns word w of a row bitmap of the given number 
+   of words shifted so that its bit c is the row's bit c + shift, with zeros 
+   coming in from outside the row */
+uint64_t shifted_word(const uint64_t* row, unsigned int words, unsigned int w,
+                      int shift) {
+    long long first = (long long)w * 64 + shift;
+    long long q = first >= 0 ? first / 64 : -((63 - first) / 64);
+    unsigned int off = first - q * 64;
+    uint64_t lo = q >= 0 && q < words ? row[q] : 0;
+    uint64_t hi = q + 1 >= 0 && q + 1 < words ? row[q + 1] : 0;
+    return off ? (lo >> off) | (hi << (64 - off)) : lo;
+}
+
+/* This helper function scans the start rows [first, last) of a row scan for 
+   a run of the given color, one 64-column word at a time. A run in 
+   direction (dr, dc) starting at column c of row k is found by ANDing row 
+   k + j * dr shifted by j * dc for j below the run, so one AND checks 64 
+   starting cells at once */
+bool scan_rows(row_scan* rs, unsigned int color, unsigned int first, 
+               unsigned int last) {
+    static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    unsigned int words = rs->words, run = rs->run;
+    for (unsigned int k = first; k < last; k++) {
+        const uint64_t* row = rs->rows[color] + (size_t)k * words;
+        for (unsigned int d = 0; d < 4; d++) {
+            if (dirs[d][0] && k + run - 1 >= rs->num_rows) {
+                continue;
+            }
+            for (unsigned int w = 0; w < words; w++) {
+                uint64_t acc = row[w];
+                for (unsigned int j = 1; j < run && acc; j++) {
+                    const uint64_t* other = rs->rows[color] + 
+                        (size_t)(k + j * dirs[d][0]) * words;
+                    acc &= shifted_word(other, words, w, j * dirs[d][1]);
+                }
+                if (acc) {
+                    return true;
+                }
+            }
         }
     }
     return false;
 }
 
+/* This is the thread routine of a parallel row scan. It scans its own band 
+   of start rows for both colors, giving up on a color as soon as another 
+   thread has found a run of it */
+void* scan_rows_routine(void* arg) {
+    row_scan_band* band = (row_scan_band*)arg;
+    row_scan* rs = band->rs;
+    for (unsigned int color = 0; color < 2; color++) {
+        unsigned int step = 64;
+        for (unsigned int k = band->first; k < band->last; k += step) {
+            if (__atomic_load_n(&rs->found[color], __ATOMIC_RELAXED)) {
+                break;
+            }
+            unsigned int end = k + step < band->last ? k + step : band->last;
+            if (scan_rows(rs, color, k, end)) {
+                __atomic_store_n(&rs->found[color], true, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* This helper function adds the pieces of a queue to the row bitmaps of 
+   their color, rows being counted from the highest occupied one */
+void fill_rows(row_scan* rs, pq_entry* head, unsigned int color, 
+               unsigned int top_r) {
+    for (; head; head = head->next) {
+        uint64_t* row = rs->rows[color] + (size_t)(head->p.r - top_r) * 
+                                          rs->words;
+        row[head->p.c / 64] |= 1ull << (head->p.c % 64);
+    }
+}
+
+/* This helper function checks both colors for a run with word-parallel row 
+   scans, which on wide boards is cheaper than following every piece in 
+   four directions. Only the rows between the highest piece and the bottom 
+   are laid out, one bitmap of ceil(width / 64) words per row and color, 
+   and large scans are split into bands of rows handled by one thread per 
+   core */
+void check_runs_by_rows(game* g, unsigned int num_rows, bool* black_run, 
+                        bool* white_run) {
+    row_scan rs;
+    rs.words = (g->b->width + 63) / 64;
+    rs.run = g->run;
+    rs.num_rows = num_rows;
+    rs.found[0] = rs.found[1] = false;
+    size_t len = (size_t)num_rows * rs.words;
+    rs.rows[0] = (uint64_t*)calloc(2 * len, sizeof(uint64_t));
+    check_malloc(rs.rows[0]);
+    rs.rows[1] = rs.rows[0] + len;
+    unsigned int top_r = g->b->height - num_rows;
+    fill_rows(&rs, g->black_queue->head, 0, top_r);
+    fill_rows(&rs, g->white_queue->head, 1, top_r);
+    unsigned int num_threads = 1;
+    if (len >= OUTCOME_PARALLEL_WORDS) {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (num_threads > OUTCOME_MAX_THREADS) {
+            num_threads = OUTCOME_MAX_THREADS;
+        }
+        if (num_threads > num_rows) {
+            num_threads = num_rows;
+        }
+    }
+    if (num_threads <= 1) {
+        rs.found[0] = scan_rows(&rs, 0, 0, num_rows);
+        rs.found[1] = scan_rows(&rs, 1, 0, num_rows);
+    } else {
+        pthread_t threads[num_threads];
+        row_scan_band bands[num_threads];
+        for (unsigned int t = 0; t < num_threads; t++) {
+            bands[t].rs = &rs;
+            bands[t].first = (uint64_t)num_rows * t / num_threads;
+            bands[t].last = (uint64_t)num_rows * (t + 1) / num_threads;
+            pthread_create(&threads[t], NULL, scan_rows_routine, &bands[t]);
+        }
+        for (unsigned int t = 0; t < num_threads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+    *black_run = rs.found[0];
+    *white_run = rs.found[1];
+    free(rs.rows[0]);
+}
+
 outcome game_outcome(game* g) {
     check_null_pointer(g);
     pq_entry *head_bl = g->black_queue->head, *head_wh = g->white_queue->head;
     bool black_run = false, white_run = false;
-    check_run(g, head_bl, &black_run);
-    check_run(g, head_wh, &white_run);
+    perf_begin(PERF_WIN_CHECK);
+    if (g->windows) {
+        black_run = window_counts_has_run(g->windows, BLACK);
+        white_run = window_counts_has_run(g->windows, WHITE);
+    } else {
+        unsigned int num_rows = 0;
+        if (g->b->width >= ROW_SCAN_MIN_WIDTH) {
+            for (unsigned int c = 0; c < g->b->width; c++) {
+                unsigned int h = board_column_height(g->b, c);
+                num_rows = h > num_rows ? h : num_rows;
+            }
+        }
+        size_t pieces = g->black_queue->len + g->white_queue->len;
+        if (num_rows && 
+            (size_t)num_rows * ((g->b->width + 63) / 64) < pieces) {
+            check_runs_by_rows(g, num_rows, &black_run, &white_run);
+        } else {
+            check_run(g, head_bl, &black_run);
+            check_run(g, head_wh, &white_run);
+        }
+    }
+    perf_end(PERF_WIN_CHECK);
     if (black_run && white_run) {
         return DRAW;
     } else if (black_run) {
@@ -377,3 +585,204 @@ outcome game_outcome(game* g) {
     }
 }
 
+move make_move(move_kind kind, unsigned int column) {
+    move m;
+    m.kind = kind;
+    m.column = column;
+    return m;
+}
+
+bool play_move(game* g, move m) {
+    check_null_pointer(g);
+    switch (m.kind) {
+        case MOVE_DROP:
+            return m.column < g->b->width && drop_piece(g, m.column);
+        case MOVE_OFFSET:
+            return offset(g);
+        default:
+            disarray(g);
+            return true;
+    }
+}
+
+bool move_is_legal(game* g, move m) {
+    check_null_pointer(g);
+    if (m.kind == MOVE_DROP) {
+        return m.column < g->b->width &&
+               board_column_height(g->b, m.column) < g->b->height;
+    } else if (m.kind == MOVE_OFFSET) {
+        return g->black_queue->head && g->white_queue->head;
+    }
+    return true;
+}
+
+move move_from_index(unsigned int width, unsigned int i) {
+    if (i < width) {
+        return make_move(MOVE_DROP, i);
+    }
+    return make_move(i == width ? MOVE_OFFSET : MOVE_DISARRAY, 0);
+}
+
+/* This helper function returns a cell of a board after a move (see 
+   board_after), EMPTY outside the board */
+cell after_get(board_after* a, long long r, long long c) {
+    board* b = a->b;
+    if (r < 0 || c < 0 || r >= b->height || c >= b->width) {
+        return EMPTY;
+    }
+    if (a->kind == MOVE_DROP) {
+        if (r == a->p[0].r && c == a->p[0].c) {
+            return a->color;
+        }
+    } else if (a->kind == MOVE_DISARRAY) {
+        long long len = board_column_height(b, c);
+        if (r < b->height - len) {
+            return EMPTY;
+        }
+        r = 2 * (long long)b->height - 1 - len - r;
+    } else {
+        /* The piece landing on row r of a column comes from the row r - k 
+           that is not removed and has k removed cells below it */
+        for (unsigned int k = 0; k <= 2; k++) {
+            long long x = r - k;
+            unsigned int below = 0;
+            bool removed = false;
+            for (unsigned int i = 0; i < 2; i++) {
+                if (a->p[i].c == c) {
+                    removed |= a->p[i].r == x;
+                    below += a->p[i].r > x;
+                }
+            }
+            if (x < 0) {
+                return EMPTY;
+            } else if (!removed && below == k) {
+                r = x;
+                break;
+            } else if (k == 2) {
+                return EMPTY;
+            }
+        }
+    }
+    return board_get(b, make_pos(r, c));
+}
+
+/* This helper function tells whether the line through cell (r, c) in 
+   direction d of a board after a move holds run pieces of the cell's 
+   color in a row */
+bool after_run_through(board_after* a, unsigned int run, long long r, 
+                       long long c, unsigned int d) {
+    static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    cell color = after_get(a, r, c);
+    unsigned int count = 1;
+    for (int sign = -1; sign <= 1; sign += 2) {
+        long long dr = sign * dirs[d][0], dc = sign * dirs[d][1];
+        for (long long j = 1; count < run && 
+             after_get(a, r + j * dr, c + j * dc) == color; j++) {
+            count++;
+        }
+    }
+    return count >= run;
+}
+
+/* This helper function turns which colors have a run into an outcome */
+outcome runs_outcome(game* g, bool black_run, bool white_run) {
+    if (black_run && white_run) {
+        return DRAW;
+    } else if (black_run) {
+        return BLACK_WIN;
+    } else if (white_run) {
+        return WHITE_WIN;
+    }
+    return available_move(g) ? IN_PROGRESS : DRAW;
+}
+
+bool drop_completes_run(game* g, unsigned int column, cell color) {
+    check_null_pointer(g);
+    board* b = g->b;
+    if (column >= b->width || board_column_height(b, column) == b->height) {
+        return false;
+    }
+    board_after a;
+    a.b = b;
+    a.kind = MOVE_DROP;
+    a.p[0] = make_pos(b->height - 1 - board_column_height(b, column), column);
+    a.color = color;
+    for (unsigned int d = 0; d < 4; d++) {
+        if (after_run_through(&a, g->run, a.p[0].r, column, d)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool drop_wins(game* g, unsigned int column) {
+    check_null_pointer(g);
+    return drop_completes_run(g, column, 
+                              g->player == BLACKS_TURN ? BLACK : WHITE);
+}
+
+unsigned int immediate_threats(game* g, cell color, unsigned int* columns) {
+    check_null_pointer(g);
+    unsigned int n = 0;
+    for (unsigned int c = 0; c < g->b->width; c++) {
+        if (drop_completes_run(g, c, color)) {
+            columns[n++] = c;
+        }
+    }
+    return n;
+}
+
+outcome offset_outcome(game* g) {
+    check_null_pointer(g);
+    if (!g->black_queue->head || !g->white_queue->head) {
+        return IN_PROGRESS;
+    }
+    bool black = g->player == BLACKS_TURN;
+    board_after a;
+    a.b = g->b;
+    a.kind = MOVE_OFFSET;
+    a.p[0] = black ? g->white_queue->tail->p : g->black_queue->tail->p;
+    a.p[1] = black ? g->black_queue->head->p : g->white_queue->head->p;
+    bool runs[3] = {false, false, false};
+    unsigned int height = g->b->height;
+    for (unsigned int i = 0; i < 2; i++) {
+        unsigned int c = a.p[i].c, bottom = a.p[i].r, removed = 1;
+        if (i == 1 && c == a.p[0].c) {
+            break;
+        } else if (i == 0 && c == a.p[1].c) {
+            bottom = a.p[1].r > bottom ? a.p[1].r : bottom;
+            removed = 2;
+        }
+        unsigned int top = height - board_column_height(g->b, c) + removed;
+        for (unsigned int r = top; r <= bottom; r++) {
+            cell color = after_get(&a, r, c);
+            for (unsigned int d = 0; d < 4 && !runs[color]; d++) {
+                runs[color] = after_run_through(&a, g->run, r, c, d);
+            }
+        }
+    }
+    return runs_outcome(g, runs[BLACK], runs[WHITE]);
+}
+
+outcome disarray_outcome(game* g) {
+    check_null_pointer(g);
+    board_after a;
+    a.b = g->b;
+    a.kind = MOVE_DISARRAY;
+    bool runs[3] = {false, false, false};
+    unsigned int height = g->b->height;
+    for (unsigned int c = 0; c < g->b->width; c++) {
+        if (runs[BLACK] && runs[WHITE]) {
+            break;
+        }
+        unsigned int len = board_column_height(g->b, c);
+        for (unsigned int r = height - len; r < height; r++) {
+            cell color = after_get(&a, r, c);
+            for (unsigned int d = 0; d < 4 && !runs[color]; d++) {
+                runs[color] = d != 1 && 
+                              after_run_through(&a, g->run, r, c, d);
+            }
+        }
+    }
+    return runs_outcome(g, runs[BLACK], runs[WHITE]);
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include "board.h"
+#include "window.h"
 
 enum turn {
     BLACKS_TURN,
@@ -27,19 +28,74 @@ struct game {
     board* b;
     posqueue *black_queue, *white_queue;
     turn player;
+    window_counts* windows;
 };
 
 typedef struct game game;
 
 
+enum move_kind {
+    MOVE_DROP,
+    MOVE_OFFSET,
+    MOVE_DISARRAY
+};
+
+typedef enum move_kind move_kind;
+
+
+struct move {
+    move_kind kind;
+    unsigned int column;
+};
+
+typedef struct move move;
+
+
 struct disarray_thread_args {
     game* g;
-    unsigned int column;
+    unsigned int column, stride;
     unsigned int* drop_per_col;
 };
 
 typedef struct disarray_thread_args t_args;
 
+
+/* Boards at least ROW_SCAN_MIN_WIDTH columns wide check for runs with 
+   row bitmaps when that takes fewer words than there are pieces, and split 
+   scans of at least OUTCOME_PARALLEL_WORDS words between threads */
+#define ROW_SCAN_MIN_WIDTH 64
+#define OUTCOME_PARALLEL_WORDS (1 << 16)
+#define OUTCOME_MAX_THREADS 16
+
+struct row_scan {
+    uint64_t* rows[2];
+    unsigned int num_rows, words, run;
+    bool found[2];
+};
+
+typedef struct row_scan row_scan;
+
+
+struct row_scan_band {
+    row_scan* rs;
+    unsigned int first, last;
+};
+
+typedef struct row_scan_band row_scan_band;
+
+/* A board as a move would leave it, read without playing the move. A drop
+   reads its cell as the dropped color, an offset reads the cells of the 
+   columns it changes from where their pieces fall from, and a disarray 
+   reads every column upside down */
+struct board_after {
+    board* b;
+    move_kind kind;
+    pos p[2];
+    cell color;
+};
+
+typedef struct board_after board_after;
+
 /**
  * new_game
  * 
@@ -77,6 +133,46 @@ game* new_game(unsigned int run, unsigned int width,
  */
 void game_free(game* g);
 
+/**
+ * game_track_windows
+ * 
+ * Makes a game keep the piece counts of every window of its board (see 
+ *  window.h) as it is played, for searches that evaluate many positions 
+ *  and check them for wins.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ * 
+ * Modifies:
+ *   - Counts the windows of the current board, unless the game already 
+ *      tracks them. Drops and offsets then update the windows covering the 
+ *      cells they change, disarrays recount them, and `game_outcome` 
+ *      detects runs in constant time.
+ * 
+ * Note:
+ *   - Raises an error if the game pointer is NULL or memory allocation 
+ *      fails.
+ */
+void game_track_windows(game* g);
+
+/**
+ * game_reset
+ * 
+ * Takes a game back to its starting position, keeping its allocations so 
+ *  that many games can be played on one `game`.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ * 
+ * Modifies:
+ *   - Empties the board and both queues and gives the turn to black.
+ * 
+ * Note:
+ *   - Takes time in the number of pieces on the board, not its size.
+ *   - Raises an error if the game pointer is NULL.
+ */
+void game_reset(game* g);
+
 /**
  * drop_piece
  * 
@@ -101,6 +197,23 @@ void game_free(game* g);
  */
 bool drop_piece(game* g, unsigned int column);
 
+/**
+ * take_back_drop
+ * 
+ * Takes back the last move of the game, which must have been a successful 
+ *  `drop_piece`: the newest piece of the player who dropped it is removed 
+ *  and that player is to move again.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ * 
+ * Note:
+ *   - Searches use it to undo drops without copying the game. A disarray 
+ *      is undone by another disarray, and offsets cannot be undone.
+ *   - Raises an error if the game pointer is NULL.
+ */
+void take_back_drop(game* g);
+
 /**
  * disarray
  * 
@@ -176,5 +289,170 @@ bool offset(game* g);
  */
 outcome game_outcome(game* g);
 
+/**
+ * make_move
+ * 
+ * Creates and returns a `move` structure.
+ * 
+ * Parameters:
+ *   - kind: MOVE_DROP, MOVE_OFFSET or MOVE_DISARRAY.
+ *   - column: The column to drop into. Ignored unless kind is MOVE_DROP.
+ * 
+ * Returns:
+ *   - A `move` structure with the specified kind and column.
+ */
+move make_move(move_kind kind, unsigned int column);
+
+/**
+ * play_move
+ * 
+ * Plays a move of any kind for the current player by dispatching to 
+ *  `drop_piece`, `offset` or `disarray`.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *   - m: The move to play.
+ * 
+ * Returns:
+ *   - `true` if the move was played.
+ *   - `false` if it was illegal (full or out-of-range column, or an offset 
+ *      while a player has no pieces), in which case the game is unchanged.
+ * 
+ * Note:
+ *   - Raises an error if the game pointer is NULL.
+ */
+bool play_move(game* g, move m);
+
+/**
+ * move_is_legal
+ * 
+ * Tells whether a move can be played, without playing it.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *   - m: The move.
+ * 
+ * Returns:
+ *   - `true` for a drop into a column of the board that is not full, an 
+ *      offset when both players have a piece on the board, and a disarray.
+ * 
+ * Note:
+ *   - Raises an error if the game pointer is NULL.
+ */
+bool move_is_legal(game* g, move m);
+
+/**
+ * move_from_index
+ * 
+ * Numbers every candidate move of a board, for callers that try them all:
+ *  indices 0 to width - 1 are drops into that column, width is the offset 
+ *  and width + 1 the disarray.
+ * 
+ * Parameters:
+ *   - width: The number of columns of the board (unsigned integer).
+ *   - i: The index of the move, below width + 2.
+ * 
+ * Returns:
+ *   - The move with that index. Whether it is legal depends on the game.
+ */
+move move_from_index(unsigned int width, unsigned int i);
+
+/**
+ * drop_completes_run
+ * 
+ * Tells whether a piece of the given color dropped into a column would 
+ *  complete a run, without changing the game.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *   - column: The column (zero-based).
+ *   - color: BLACK or WHITE, whoever is to move.
+ * 
+ * Returns:
+ *   - `true` if the column is not full and the piece would be part of run 
+ *      pieces of its color in a line.
+ * 
+ * Note:
+ *   - Looks at no more than 2 * run cells in each direction.
+ *   - Raises an error if the game pointer is NULL.
+ */
+bool drop_completes_run(game* g, unsigned int column, cell color);
+
+/**
+ * drop_wins
+ * 
+ * Tells whether dropping into a column wins for the player to move, 
+ *  without changing the game.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure, whose game is not over.
+ *   - column: The column (zero-based).
+ * 
+ * Returns:
+ *   - `true` if the drop is legal and wins.
+ * 
+ * Note:
+ *   - Raises an error if the game pointer is NULL.
+ */
+bool drop_wins(game* g, unsigned int column);
+
+/**
+ * immediate_threats
+ * 
+ * Lists the columns where a drop by the given color would complete a run: 
+ *  for the player to move these are winning drops, for the opponent they 
+ *  are the drops the player to move has to deal with.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *   - color: BLACK or WHITE.
+ *   - columns: Out-parameter of at least width entries receiving the 
+ *      columns in increasing order.
+ * 
+ * Returns:
+ *   - The number of columns listed.
+ * 
+ * Note:
+ *   - Raises an error if the game pointer is NULL.
+ */
+unsigned int immediate_threats(game* g, cell color, unsigned int* columns);
+
+/**
+ * offset_outcome
+ * 
+ * Tells what an offset would lead to, without changing the game.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure, whose game is not over.
+ * 
+ * Returns:
+ *   - The outcome of the game after the offset, IN_PROGRESS if the offset 
+ *      is illegal.
+ * 
+ * Note:
+ *   - Since the game is not over, any run the offset makes goes through 
+ *      one of the cells it changes, so only those are looked at.
+ *   - Raises an error if the game pointer is NULL.
+ */
+outcome offset_outcome(game* g);
+
+/**
+ * disarray_outcome
+ * 
+ * Tells what a disarray would lead to, without changing the game.
+ * 
+ * Parameters:
+ *   - g: A pointer to the `game` structure, whose game is not over.
+ * 
+ * Returns:
+ *   - The outcome of the game after the disarray.
+ * 
+ * Note:
+ *   - Every piece is looked at, but columns stay in one piece when turned 
+ *      upside down, so only horizontal and diagonal lines are followed.
+ *   - Raises an error if the game pointer is NULL.
+ */
+outcome disarray_outcome(game* g);
+
 
 #endif /* LOGIC_H */
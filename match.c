@@ -0,0 +1,253 @@
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "match.h"
+#include "trace.h"
+
+/* The state shared by the threads of a match */
+struct match_run {
+    const match_options* opts;
+    match_event_fn event;
+    void* arg;
+    pthread_mutex_t lock;
+    unsigned int next_pair, max_plies;
+    bool stop;
+    uint64_t start_ns;
+    match_stats stats;
+};
+
+typedef struct match_run match_run;
+
+/* This helper function returns the expected score of a player an Elo
+   difference stronger than its opponent */
+double match_expected(double elo) {
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+double match_llr(const unsigned int pairs[5], double elo0, double elo1) {
+    double n = 0, score = 0;
+    for (unsigned int i = 0; i < 5; i++) {
+        n += pairs[i];
+        score += pairs[i] * (i / 4.0);
+    }
+    if (n == 0) {
+        return 0;
+    }
+    score /= n;
+    double var = 0;
+    for (unsigned int i = 0; i < 5; i++) {
+        var += pairs[i] * (i / 4.0 - score) * (i / 4.0 - score);
+    }
+    var /= n;
+    if (var <= 0) {
+        return 0;
+    }
+    double s0 = match_expected(elo0), s1 = match_expected(elo1);
+    return n * (s1 - s0) * (2 * score - s0 - s1) / (2 * var);
+}
+
+/* This helper function returns the Elo difference of an expected score */
+double match_score_elo(double score) {
+    return -400 * log10(1 / score - 1);
+}
+
+void match_elo(unsigned int wins, unsigned int losses, unsigned int draws,
+               double* elo, double* margin) {
+    double n = (double)wins + losses + draws;
+    if (n == 0) {
+        *elo = 0;
+        *margin = 0;
+        return;
+    }
+    double score = (wins + draws / 2.0) / n;
+    double var = (wins * (1 - score) * (1 - score) +
+                  losses * score * score +
+                  draws * (0.5 - score) * (0.5 - score)) / n;
+    double d = 1.959964 * sqrt(var / n);
+    double eps = 0.5 / n;
+    double lo = fmax(score - d, eps), hi = fmin(score + d, 1 - eps);
+    score = fmin(fmax(score, eps), 1 - eps);
+    *elo = match_score_elo(score);
+    *margin = (match_score_elo(hi) - match_score_elo(lo)) / 2;
+}
+
+/* This helper function makes an engine with a side's settings */
+engine* match_engine(const match_options* o, const match_side* s) {
+    engine* e = engine_new(o->tt_bytes);
+    e->max_depth = s->depth ? s->depth : ENGINE_MAX_PLY;
+    engine_use_ntuple(e, s->net);
+    engine_use_eval_queue(e, s->queue);
+    engine_use_book(e, s->bk, s->book_min_games ? s->book_min_games : 1);
+    engine_use_tablebase(e, s->tb);
+    return e;
+}
+
+/* This helper function plays the opening of a pair on a reset game and
+   records its drops in moves. Returns their number, fewer than asked if
+   every drop left would end the game */
+unsigned int match_opening(const match_options* o, unsigned int pair,
+                           game* g, unsigned int* moves) {
+    unsigned int seed = o->seed * 2654435761u + pair * 40503u + 1;
+    unsigned int n = 0;
+    while (n < o->opening_plies) {
+        cell color = g->player == BLACKS_TURN ? BLACK : WHITE;
+        unsigned int open = 0, columns[o->width];
+        for (unsigned int c = 0; c < o->width; c++) {
+            if (move_is_legal(g, make_move(MOVE_DROP, c)) &&
+                !drop_completes_run(g, c, color)) {
+                columns[open++] = c;
+            }
+        }
+        if (open == 0) {
+            break;
+        }
+        moves[n] = columns[rand_r(&seed) % open];
+        drop_piece(g, moves[n++]);
+        if (game_outcome(g) != IN_PROGRESS) {
+            break;
+        }
+    }
+    return n;
+}
+
+/* This helper function plays a game on from its opening, with A's engine
+   black if a_black. Returns its outcome, DRAW if it is stopped after
+   max_plies */
+outcome match_game(match_run* r, game* g, unsigned int plies, engine* a,
+                   engine* b, bool a_black) {
+    outcome o = game_outcome(g);
+    for (; o == IN_PROGRESS && plies < r->max_plies; plies++) {
+        bool a_moves = (g->player == BLACKS_TURN) == a_black;
+        search_result res;
+        if (!engine_search(a_moves ? a : b, g, a_moves ? r->opts->a.time_ms
+                                                       : r->opts->b.time_ms,
+                           &res)) {
+            break;
+        }
+        play_move(g, res.best);
+        o = game_outcome(g);
+    }
+    return o == IN_PROGRESS ? DRAW : o;
+}
+
+/* This helper function counts the outcome of a game for A and returns
+   the half points A scored */
+unsigned int match_count(match_stats* s, outcome o, bool a_black) {
+    if (o == DRAW) {
+        s->draws++;
+        return 1;
+    } else if ((o == BLACK_WIN) == a_black) {
+        s->wins++;
+        return 2;
+    }
+    s->losses++;
+    return 0;
+}
+
+/* This helper function takes the number of the next pair to play, or
+   returns false once the match is over */
+bool match_next_pair(match_run* r, unsigned int* pair) {
+    pthread_mutex_lock(&r->lock);
+    bool more = !r->stop && (r->opts->max_games == 0 ||
+                             2 * r->next_pair + 2 <= r->opts->max_games);
+    if (more) {
+        *pair = r->next_pair++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return more;
+}
+
+/* This helper function adds the outcomes of a pair to the results, tests
+   them and reports them */
+void match_record(match_run* r, outcome first, outcome second) {
+    const match_options* o = r->opts;
+    pthread_mutex_lock(&r->lock);
+    match_stats* s = &r->stats;
+    s->pairs[match_count(s, first, true) + match_count(s, second, false)]++;
+    s->seconds = (now_ns() - r->start_ns) / 1e9;
+    if (o->elo0 != o->elo1) {
+        s->llr = match_llr(s->pairs, o->elo0, o->elo1);
+        if (s->decision == 0 && s->llr >= s->upper) {
+            s->decision = 1;
+        } else if (s->decision == 0 && s->llr <= s->lower) {
+            s->decision = -1;
+        }
+        r->stop |= s->decision != 0;
+    }
+    if (r->event) {
+        r->event(s, r->arg);
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* This is the routine of a playing thread: it plays pairs on one game
+   with an engine for each side until the match is over */
+void* match_routine(void* arg) {
+    match_run* r = (match_run*)arg;
+    const match_options* o = r->opts;
+    game* g = new_game(o->run, o->width, o->height, BITS);
+    engine* a = match_engine(o, &o->a);
+    engine* b = match_engine(o, &o->b);
+    unsigned int moves[MATCH_MAX_OPENING], pair;
+    while (match_next_pair(r, &pair)) {
+        trace_begin("match_pair");
+        game_reset(g);
+        unsigned int n = match_opening(o, pair, g, moves);
+        outcome first = match_game(r, g, n, a, b, true);
+        game_reset(g);
+        for (unsigned int i = 0; i < n; i++) {
+            drop_piece(g, moves[i]);
+        }
+        outcome second = match_game(r, g, n, a, b, false);
+        trace_end("match_pair");
+        match_record(r, first, second);
+    }
+    engine_free(a);
+    engine_free(b);
+    game_free(g);
+    return NULL;
+}
+
+void match_play(const match_options* opts, match_event_fn event, void* arg,
+                match_stats* stats) {
+    if (opts->max_games == 0 && opts->elo0 == opts->elo1) {
+        fprintf(stderr, "A match needs a game limit or a test\n");
+        exit(1);
+    }
+    if (opts->opening_plies > MATCH_MAX_OPENING) {
+        fprintf(stderr, "Openings are at most %u plies\n",
+                MATCH_MAX_OPENING);
+        exit(1);
+    }
+    match_run r;
+    memset(&r, 0, sizeof(match_run));
+    r.opts = opts;
+    r.event = event;
+    r.arg = arg;
+    pthread_mutex_init(&r.lock, NULL);
+    r.max_plies = opts->max_plies ? opts->max_plies
+                                  : 4 * opts->width * opts->height;
+    r.stats.lower = log(opts->beta / (1 - opts->alpha));
+    r.stats.upper = log((1 - opts->beta) / opts->alpha);
+    unsigned int threads = opts->threads ? opts->threads
+                                         : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > MATCH_MAX_THREADS) {
+        threads = MATCH_MAX_THREADS;
+    }
+    pthread_t tids[MATCH_MAX_THREADS];
+    r.start_ns = now_ns();
+    for (unsigned int t = 0; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, match_routine, &r)) {
+            fprintf(stderr, "Could not create a match thread\n");
+            exit(1);
+        }
+    }
+    for (unsigned int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    r.stats.seconds = (now_ns() - r.start_ns) / 1e9;
+    pthread_mutex_destroy(&r.lock);
+    *stats = r.stats;
+}
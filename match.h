@@ -0,0 +1,135 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include "engine.h"
+#include "evalq.h"
+
+/* A match plays two engine settings, A and B, against each other to tell
+   whether a change makes the engine stronger.
+ * Games come in pairs: both games of a pair start from the same opening,
+   a few random drops that do not end the game, with A black in the first
+   and white in the second, so that neither the opening nor the first
+   move favours a side. Each pair has its own opening, drawn from the
+   seed and its number, so a match is repeatable whatever the number of
+   threads.
+ * Every thread plays whole pairs on one `game`, reset between games, and
+   with its own two engines, whose tables carry over from game to game.
+   Books, tablebases and networks are shared, as they are only read. A
+   side may also share an evaluation queue (see evalq.h), through which
+   its engines on every thread evaluate their positions together.
+ * After each pair the results so far are tested with a sequential
+   probability ratio test: the log-likelihood ratio of A being elo1
+   stronger than B rather than elo0, with the scores of pairs modelled as
+   normal, stops the match once it leaves the bounds set by the error
+   rates. The test counts pairs rather than games, as the two games of a
+   pair share their opening and so their results are not independent.
+   Pairs under way then still finish and count */
+
+#define MATCH_MAX_THREADS 256
+#define MATCH_MAX_OPENING 64
+
+struct match_side {
+    unsigned int depth, time_ms, book_min_games;
+    ntuple_net* net;
+    eval_queue* queue;
+    book* bk;
+    tablebase* tb;
+};
+
+typedef struct match_side match_side;
+
+
+struct match_options {
+    unsigned int width, height, run, threads, max_games, opening_plies;
+    unsigned int max_plies, seed;
+    size_t tt_bytes;
+    double elo0, elo1, alpha, beta;
+    match_side a, b;
+};
+
+typedef struct match_options match_options;
+
+
+/* Results are counted for A. pairs[i] is the number of pairs of which A
+   scored i half points. decision is 1 once the test finds A elo1
+   stronger, -1 once it finds it at most elo0 stronger and 0 before, and
+   stays even if the pairs still under way move llr back within bounds */
+struct match_stats {
+    unsigned int wins, losses, draws, pairs[5];
+    double llr, lower, upper, seconds;
+    int decision;
+};
+
+typedef struct match_stats match_stats;
+
+
+/* An event callback receives the results after each pair, and the
+   callback's argument. It is called from the playing threads but never
+   from two at once */
+typedef void (*match_event_fn)(const match_stats* s, void* arg);
+
+
+/**
+ * match_llr
+ *
+ * Returns the log-likelihood ratio of a player scoring as expected from
+ *  an Elo difference of elo1 rather than elo0, given the scores of its
+ *  pairs of games, or 0 if all of them are the same.
+ *
+ * Parameters:
+ *   - pairs: The number of pairs of which the player scored 0, 1, 2, 3
+ *      and 4 half points.
+ *   - elo0: The Elo difference of the null hypothesis.
+ *   - elo1: The Elo difference of the alternative hypothesis.
+ */
+double match_llr(const unsigned int pairs[5], double elo0, double elo1);
+
+/**
+ * match_elo
+ *
+ * Estimates the Elo difference a player's results show.
+ *
+ * Parameters:
+ *   - wins: The number of games won.
+ *   - losses: The number of games lost.
+ *   - draws: The number of games drawn.
+ *   - elo: Out-parameter receiving the estimate.
+ *   - margin: Out-parameter receiving half the width of its 95%
+ *      confidence interval.
+ *
+ * Note:
+ *   - Scores of 0 or 1 are taken as just above 0 or just below 1, so that
+ *      the estimate stays finite.
+ */
+void match_elo(unsigned int wins, unsigned int losses, unsigned int draws,
+               double* elo, double* margin);
+
+/**
+ * match_play
+ *
+ * Plays a match (see above) on a pool of threads.
+ *
+ * Parameters:
+ *   - opts: The configuration; the number of threads, 0 for one per core;
+ *      the most games to play, rounded down to pairs, 0 for no limit;
+ *      the random drops of the openings, at most MATCH_MAX_OPENING; the
+ *      plies after which a game is a draw, 0 for 4 * width * height; the
+ *      seed of the openings; the size of each engine's table; the
+ *      hypotheses of the test, which is off if elo0 and elo1 are equal,
+ *      and its error rates, the chance of finding A elo1 stronger when it
+ *      is elo0 stronger and the reverse;
+ *      and the settings of each side, its maximum depth, its time per
+ *      move, 0 for none, its network, book and tablebase, which may be
+ *      NULL, and the fewest games of book moves it plays.
+ *   - event: Called after each pair. May be NULL.
+ *   - arg: The argument passed to event.
+ *   - stats: Out-parameter receiving the results and the time taken.
+ *
+ * Note:
+ *   - Raises an error if the match has neither a game limit nor a test,
+ *      or memory allocation or thread creation fails.
+ */
+void match_play(const match_options* opts, match_event_fn event, void* arg,
+                match_stats* stats);
+
+#endif /* MATCH_H */
@@ -0,0 +1,236 @@
+#include <string.h>
+#include "engine.h"
+
+/* Trains an N-tuple network for a configuration by self-play and writes
+   it to a file, starting from the network of -i if given, or else from
+   zero weights. Training goes in ten rounds of -n / 10 games, each
+   reported with the results of its games.
+ * With -m, the network then plays that many games against the window
+   heuristic, both searched by the engine to depth -d, each side taking
+   black in half of them after two random opening plies, and the time of
+   an evaluation is measured, alone and in batches of NTRAIN_BATCH */
+
+#define NTRAIN_TT_BYTES (16 << 20)
+#define NTRAIN_EVALS 1000000
+#define NTRAIN_BATCH 64
+
+struct ntrain_options {
+    unsigned int width, height, run, games, seed, max_plies, match_games;
+    unsigned int depth;
+    float alpha, epsilon;
+    char *in_path, *out_path;
+};
+
+typedef struct ntrain_options ntrain_options;
+
+
+/* This helper function prints the usage line and exits */
+void ntrain_usage() {
+    fprintf(stderr, "Usage: ntrain -w <width> -h <height> -r <run> "
+                    "[-n <games>] [-a <alpha>] [-e <epsilon>]\n"
+                    "              [-l <plies>] [-s <seed>] [-i <in.net>] "
+                    "[-m <games>] [-d <depth>] <out.net>\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * -w, -h and -r are required. By default 100000 games are played from seed
+   1 with a learning rate of 0.1 and 10% of random moves, stopped after
+   4 * width * height plies, and no match is played */
+void parse_ntrain_arguments(int argc, char** argv, ntrain_options* opts) {
+    memset(opts, 0, sizeof(ntrain_options));
+    opts->games = 100000;
+    opts->seed = 1;
+    opts->alpha = 0.1;
+    opts->epsilon = 0.1;
+    opts->depth = 2;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' && i == argc - 1) {
+            opts->out_path = argv[i];
+            break;
+        }
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            ntrain_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'w':
+                opts->width = v;
+                break;
+            case 'h':
+                opts->height = v;
+                break;
+            case 'r':
+                opts->run = v;
+                break;
+            case 'n':
+                opts->games = v;
+                break;
+            case 'a':
+                opts->alpha = atof(argv[i + 1]);
+                break;
+            case 'e':
+                opts->epsilon = atof(argv[i + 1]);
+                break;
+            case 'l':
+                opts->max_plies = v;
+                break;
+            case 's':
+                opts->seed = v;
+                break;
+            case 'i':
+                opts->in_path = argv[i + 1];
+                break;
+            case 'm':
+                opts->match_games = v;
+                break;
+            case 'd':
+                opts->depth = v;
+                break;
+            default:
+                ntrain_usage();
+        }
+        i++;
+    }
+    if (opts->width == 0 || opts->height == 0 || opts->run == 0 ||
+        !opts->out_path || opts->depth == 0 ||
+        opts->depth > ENGINE_MAX_PLY) {
+        ntrain_usage();
+    }
+    if (opts->max_plies == 0) {
+        opts->max_plies = 4 * opts->width * opts->height;
+    }
+}
+
+/* This helper function plays one game between an engine with the network
+   and one without, after two random plies. Returns the outcome, DRAW for
+   a game stopped after max_plies */
+outcome play_match_game(ntrain_options* opts, engine* with, engine* without,
+                        bool net_black, unsigned int* seed) {
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    outcome o = IN_PROGRESS;
+    for (unsigned int ply = 0; ply < opts->max_plies; ply++) {
+        move m = make_move(MOVE_DROP, rand_r(seed) % opts->width);
+        if (ply >= 2 || !move_is_legal(g, m)) {
+            engine* e = (g->player == BLACKS_TURN) == net_black ? with
+                                                                 : without;
+            search_result r;
+            engine_search(e, g, 0, &r);
+            m = r.best;
+        }
+        play_move(g, m);
+        o = game_outcome(g);
+        if (o != IN_PROGRESS) {
+            break;
+        }
+    }
+    game_free(g);
+    return o == IN_PROGRESS ? DRAW : o;
+}
+
+/* This helper function plays the match and prints its result */
+void play_match(ntrain_options* opts, ntuple_net* net) {
+    engine* with = engine_new(NTRAIN_TT_BYTES);
+    engine* without = engine_new(NTRAIN_TT_BYTES);
+    with->max_depth = opts->depth;
+    without->max_depth = opts->depth;
+    engine_use_ntuple(with, net);
+    unsigned int wins = 0, losses = 0, draws = 0, seed = opts->seed;
+    for (unsigned int i = 0; i < opts->match_games; i++) {
+        bool net_black = i % 2 == 0;
+        outcome o = play_match_game(opts, with, without, net_black, &seed);
+        if (o == DRAW) {
+            draws++;
+        } else if ((o == BLACK_WIN) == net_black) {
+            wins++;
+        } else {
+            losses++;
+        }
+    }
+    printf("match at depth %u: %u wins, %u losses, %u draws for the "
+           "network\n", opts->depth, wins, losses, draws);
+    engine_free(with);
+    engine_free(without);
+}
+
+/* This helper function times evaluations of the position of a random
+   game, one at a time and in batches */
+void time_evaluations(ntrain_options* opts, ntuple_net* net) {
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    unsigned int seed = opts->seed;
+    for (unsigned int i = 0; i < opts->width * opts->height / 2; i++) {
+        drop_piece(g, rand_r(&seed) % opts->width);
+    }
+    ntuple_state* st = ntuple_game_state(net, g);
+    uint64_t start = now_ns();
+    float sum = 0;
+    for (unsigned int i = 0; i < NTRAIN_EVALS; i++) {
+        sum += ntuple_state_value(st, i % 2);
+    }
+    double ns = now_ns() - start;
+    printf("%u tuples, %.1f ns per evaluation (checksum %.3f)\n",
+           net->num_tuples, ns / NTRAIN_EVALS, sum);
+    int32_t* slots = (int32_t*)malloc((size_t)net->num_tuples *
+                                      NTRAIN_BATCH * sizeof(int32_t));
+    check_malloc(slots);
+    turn players[NTRAIN_BATCH];
+    float values[NTRAIN_BATCH];
+    for (unsigned int i = 0; i < NTRAIN_BATCH; i++) {
+        for (unsigned int t = 0; t < net->num_tuples; t++) {
+            slots[t * NTRAIN_BATCH + i] = st->slots[t];
+        }
+        players[i] = i % 2;
+    }
+    start = now_ns();
+    sum = 0;
+    for (unsigned int i = 0; i < NTRAIN_EVALS / NTRAIN_BATCH; i++) {
+        ntuple_batch_values(net, slots, NTRAIN_BATCH, players, NTRAIN_BATCH,
+                            values);
+        sum += values[i % NTRAIN_BATCH];
+    }
+    ns = now_ns() - start;
+    printf("%.1f ns per evaluation in batches of %u (checksum %.3f)\n",
+           ns / (NTRAIN_EVALS / NTRAIN_BATCH * NTRAIN_BATCH), NTRAIN_BATCH,
+           sum);
+    free(slots);
+    ntuple_state_free(st);
+    game_free(g);
+}
+
+int main(int argc, char** argv) {
+    ntrain_options opts;
+    parse_ntrain_arguments(argc, argv, &opts);
+    ntuple_net* net;
+    if (opts.in_path) {
+        net = ntuple_open(opts.in_path);
+        if (net == NULL || net->width != opts.width ||
+            net->height != opts.height || net->run != opts.run) {
+            fprintf(stderr, "Could not open network %s for this "
+                            "configuration\n", opts.in_path);
+            exit(1);
+        }
+    } else {
+        net = ntuple_new(opts.run, opts.width, opts.height);
+    }
+    for (unsigned int round = 0; round < 10; round++) {
+        ntuple_train_options t = {opts.games / 10 + (round < opts.games % 10),
+                                  opts.max_plies, opts.seed * 7919 + round,
+                                  opts.alpha, opts.epsilon};
+        ntuple_train_stats s;
+        ntuple_train(net, &t, &s);
+        printf("round %u: %u games, %llu plies, %u black wins, %u white "
+               "wins, %u draws in %.3f s\n", round + 1, t.games, s.plies,
+               s.black_wins, s.white_wins, s.draws, s.seconds);
+        fflush(stdout);
+    }
+    if (!ntuple_save(net, opts.out_path)) {
+        fprintf(stderr, "Could not write %s\n", opts.out_path);
+        exit(1);
+    }
+    time_evaluations(&opts, net);
+    if (opts.match_games) {
+        play_match(&opts, net);
+    }
+    ntuple_free(net);
+    return 0;
+}
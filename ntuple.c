@@ -0,0 +1,578 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "ntuple.h"
+#include "serial.h"
+
+/* The directions of the lines, as (row, column) steps from their first
+   cell, as in window.c */
+static const int ntuple_dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+/* The rectangles, as numbers of rows and columns */
+static const unsigned int ntuple_rects[2][2] = {{2, 3}, {3, 2}};
+
+/* Past this, the fraction of ntuple_squash exceeds 1 */
+#define NTUPLE_SQUASH_LIMIT 4.97f
+
+struct ntuple_list {
+    unsigned int (*cells)[NTUPLE_MAX_LEN];
+    unsigned int* lens;
+    unsigned int len, cap;
+};
+
+typedef struct ntuple_list ntuple_list;
+
+
+/* This helper function tells whether two tuples have the same cells, in
+   any order */
+bool ntuple_same_cells(const unsigned int* a, unsigned int a_len,
+                       const unsigned int* b, unsigned int b_len) {
+    unsigned int same = 0;
+    for (unsigned int j = 0; a_len == b_len && j < a_len; j++) {
+        for (unsigned int k = 0; k < b_len; k++) {
+            same += a[j] == b[k];
+        }
+    }
+    return a_len == b_len && same == a_len;
+}
+
+/* This helper function appends a tuple to a list, unless it is a tuple
+   already there */
+void ntuple_list_add(ntuple_list* l, const unsigned int* cells,
+                     unsigned int len) {
+    for (unsigned int i = 0; i < l->len; i++) {
+        if (ntuple_same_cells(l->cells[i], l->lens[i], cells, len)) {
+            return;
+        }
+    }
+    if (l->len == l->cap) {
+        l->cap = l->cap ? 2 * l->cap : 256;
+        l->cells = realloc(l->cells, l->cap * sizeof(*l->cells));
+        l->lens = (unsigned int*)realloc(l->lens,
+                                         l->cap * sizeof(unsigned int));
+        check_malloc(l->cells);
+        check_malloc(l->lens);
+    }
+    memcpy(l->cells[l->len], cells, len * sizeof(unsigned int));
+    l->lens[l->len++] = len;
+}
+
+/* This helper function sums the weights at the slots one at a time */
+float ntuple_sum_scalar(const float* weights, const int32_t* slots,
+                        unsigned int n) {
+    float sum = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        sum += weights[slots[i]];
+    }
+    return sum;
+}
+
+#if defined(__x86_64__)
+/* This helper function sums the weights at the slots 8 at a time, with
+   the gathers of AVX2 */
+__attribute__((target("avx2")))
+float ntuple_sum_avx2(const float* weights, const int32_t* slots,
+                      unsigned int n) {
+    __m256 acc = _mm256_setzero_ps(), acc2 = _mm256_setzero_ps();
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)(slots + i));
+        __m256i idx2 = _mm256_loadu_si256((const __m256i*)(slots + i + 8));
+        acc = _mm256_add_ps(acc, _mm256_i32gather_ps(weights, idx, 4));
+        acc2 = _mm256_add_ps(acc2, _mm256_i32gather_ps(weights, idx2, 4));
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)(slots + i));
+        acc = _mm256_add_ps(acc, _mm256_i32gather_ps(weights, idx, 4));
+    }
+    acc = _mm256_add_ps(acc, acc2);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc),
+                             _mm256_extractf128_ps(acc, 1));
+    half = _mm_hadd_ps(half, half);
+    half = _mm_hadd_ps(half, half);
+    float sum = _mm_cvtss_f32(half);
+    for (; i < n; i++) {
+        sum += weights[slots[i]];
+    }
+    return sum;
+}
+#endif
+
+/* This helper function sums the weights at the slots of a batch of
+   positions, one position at a time */
+void ntuple_sum_batch_scalar(const float* weights, const int32_t* slots,
+                             unsigned int stride, unsigned int tuples,
+                             unsigned int n, float* sums) {
+    for (unsigned int i = 0; i < n; i++) {
+        sums[i] = 0;
+    }
+    for (unsigned int t = 0; t < tuples; t++) {
+        const int32_t* row = slots + (size_t)t * stride;
+        for (unsigned int i = 0; i < n; i++) {
+            sums[i] += weights[row[i]];
+        }
+    }
+}
+
+#if defined(__x86_64__)
+/* This helper function sums the weights at the slots of a batch of
+   positions 8 positions at a time, each lane of the gathers following a
+   position through the tuples */
+__attribute__((target("avx2")))
+void ntuple_sum_batch_avx2(const float* weights, const int32_t* slots,
+                           unsigned int stride, unsigned int tuples,
+                           unsigned int n, float* sums) {
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (unsigned int t = 0; t < tuples; t++) {
+            __m256i idx = _mm256_loadu_si256(
+                (const __m256i*)(slots + (size_t)t * stride + i));
+            acc = _mm256_add_ps(acc, _mm256_i32gather_ps(weights, idx, 4));
+        }
+        _mm256_storeu_ps(sums + i, acc);
+    }
+    if (i < n) {
+        ntuple_sum_batch_scalar(weights, slots + i, stride, tuples, n - i,
+                                sums + i);
+    }
+}
+#endif
+
+/* This helper function makes a network with its tuples and their tables
+   laid out, but no weights. Lines of every direction and rectangles of
+   both shapes are listed, then each tuple not yet paired makes a table
+   with its mirror image, whose cells are read in the mirrored order */
+ntuple_net* ntuple_layout(unsigned int run, unsigned int width,
+                          unsigned int height) {
+    if (width * height > NTUPLE_MAX_CELLS || width == 0 || height == 0) {
+        fprintf(stderr, "Boards of %u by %u are too large for a network\n",
+                width, height);
+        exit(1);
+    }
+    unsigned int len = run < NTUPLE_MAX_LEN ? run : NTUPLE_MAX_LEN;
+    unsigned int cells[NTUPLE_MAX_LEN];
+    ntuple_list l = {NULL, NULL, 0, 0};
+    for (unsigned int d = 0; d < 4; d++) {
+        int dr = ntuple_dirs[d][0], dc = ntuple_dirs[d][1];
+        for (int r = 0; r < (int)height; r++) {
+            for (int c = 0; c < (int)width; c++) {
+                int last_r = r + (int)(len - 1) * dr,
+                    last_c = c + (int)(len - 1) * dc;
+                if (last_r >= (int)height || last_c < 0 ||
+                    last_c >= (int)width) {
+                    continue;
+                }
+                for (unsigned int j = 0; j < len; j++) {
+                    cells[j] = (r + j * dr) * width + c + j * dc;
+                }
+                ntuple_list_add(&l, cells, len);
+            }
+        }
+    }
+    for (unsigned int s = 0; s < 2; s++) {
+        unsigned int rows = ntuple_rects[s][0], cols = ntuple_rects[s][1];
+        for (unsigned int r = 0; r + rows <= height; r++) {
+            for (unsigned int c = 0; c + cols <= width; c++) {
+                for (unsigned int j = 0; j < rows * cols; j++) {
+                    cells[j] = (r + j / cols) * width + c + j % cols;
+                }
+                ntuple_list_add(&l, cells, rows * cols);
+            }
+        }
+    }
+    ntuple_net* net = (ntuple_net*)calloc(1, sizeof(ntuple_net));
+    check_malloc(net);
+    net->width = width;
+    net->height = height;
+    net->run = run;
+    net->tuple_base = (uint32_t*)malloc(2 * l.len * sizeof(uint32_t));
+    unsigned int (*tuples)[NTUPLE_MAX_LEN] = malloc(2 * l.len *
+                                                    sizeof(*tuples));
+    unsigned int* lens = (unsigned int*)malloc(2 * l.len *
+                                               sizeof(unsigned int));
+    bool* paired = (bool*)calloc(l.len, sizeof(bool));
+    check_malloc(net->tuple_base);
+    check_malloc(tuples);
+    check_malloc(lens);
+    check_malloc(paired);
+    unsigned int n = 0;
+    size_t base = 0;
+    for (unsigned int i = 0; i < l.len; i++) {
+        if (paired[i]) {
+            continue;
+        }
+        unsigned int size = 1;
+        for (unsigned int j = 0; j < l.lens[i]; j++) {
+            unsigned int cell = l.cells[i][j];
+            tuples[n][j] = cell;
+            tuples[n + 1][j] = cell - cell % width + width - 1 -
+                               cell % width;
+            size *= 3;
+        }
+        /* The mirror image is in the list, which holds every line and
+           rectangle: it is paired so as not to make a table of its own */
+        for (unsigned int k = i; k < l.len; k++) {
+            if (ntuple_same_cells(l.cells[k], l.lens[k], tuples[n + 1],
+                                  l.lens[i])) {
+                paired[k] = true;
+                break;
+            }
+        }
+        lens[n] = lens[n + 1] = l.lens[i];
+        net->tuple_base[n] = net->tuple_base[n + 1] = base;
+        base += size;
+        n += 2;
+    }
+    net->num_tuples = n;
+    net->num_weights = base + 2;
+    /* Cell incidences, grouped by cell */
+    unsigned int num_cells = width * height;
+    net->cell_start = (uint32_t*)calloc(num_cells + 1, sizeof(uint32_t));
+    check_malloc(net->cell_start);
+    for (unsigned int t = 0; t < n; t++) {
+        for (unsigned int j = 0; j < lens[t]; j++) {
+            net->cell_start[tuples[t][j] + 1]++;
+        }
+    }
+    for (unsigned int c = 0; c < num_cells; c++) {
+        net->cell_start[c + 1] += net->cell_start[c];
+    }
+    unsigned int total = net->cell_start[num_cells];
+    net->cell_tuple = (uint32_t*)malloc(total * sizeof(uint32_t));
+    net->cell_power = (uint32_t*)malloc(total * sizeof(uint32_t));
+    uint32_t* fill = (uint32_t*)malloc(num_cells * sizeof(uint32_t));
+    check_malloc(net->cell_tuple);
+    check_malloc(net->cell_power);
+    check_malloc(fill);
+    memcpy(fill, net->cell_start, num_cells * sizeof(uint32_t));
+    for (unsigned int t = 0; t < n; t++) {
+        unsigned int power = 1;
+        for (unsigned int j = 0; j < lens[t]; j++, power *= 3) {
+            uint32_t at = fill[tuples[t][j]]++;
+            net->cell_tuple[at] = t;
+            net->cell_power[at] = power;
+        }
+    }
+    free(fill);
+    free(paired);
+    free(lens);
+    free(tuples);
+    free(l.cells);
+    free(l.lens);
+    net->sum = ntuple_sum_scalar;
+    net->sum_batch = ntuple_sum_batch_scalar;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        net->sum = ntuple_sum_avx2;
+        net->sum_batch = ntuple_sum_batch_avx2;
+    }
+#endif
+    return net;
+}
+
+ntuple_net* ntuple_new(unsigned int run, unsigned int width,
+                       unsigned int height) {
+    ntuple_net* net = ntuple_layout(run, width, height);
+    net->weights = (float*)calloc(net->num_weights, sizeof(float));
+    check_malloc(net->weights);
+    return net;
+}
+
+ntuple_net* ntuple_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ntuple_header)) {
+        close(fd);
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const ntuple_header* h = (const ntuple_header*)map;
+    if (memcmp(h->magic, NTUPLE_MAGIC, 4) != 0 ||
+        h->version != NTUPLE_VERSION || h->width == 0 || h->height == 0 ||
+        h->run == 0 || h->width * h->height > NTUPLE_MAX_CELLS ||
+        h->num_weights != (st.st_size - sizeof(ntuple_header)) /
+                          sizeof(float)) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    ntuple_net* net = ntuple_layout(h->run, h->width, h->height);
+    if (net->num_weights != h->num_weights) {
+        munmap(map, st.st_size);
+        net->map = NULL;
+        net->weights = NULL;
+        ntuple_free(net);
+        return NULL;
+    }
+    net->weights = (float*)(h + 1);
+    net->map = map;
+    net->map_len = st.st_size;
+    return net;
+}
+
+bool ntuple_save(ntuple_net* net, const char* path) {
+    check_null_pointer(net);
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    ntuple_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, NTUPLE_MAGIC, 4);
+    h.version = NTUPLE_VERSION;
+    h.width = net->width;
+    h.height = net->height;
+    h.run = net->run;
+    h.num_weights = net->num_weights;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(net->weights, sizeof(float), net->num_weights, f) ==
+              net->num_weights;
+    return fclose(f) == 0 && ok;
+}
+
+void ntuple_free(ntuple_net* net) {
+    if (net->map) {
+        munmap(net->map, net->map_len);
+    } else {
+        free(net->weights);
+    }
+    free(net->tuple_base);
+    free(net->cell_start);
+    free(net->cell_tuple);
+    free(net->cell_power);
+    free(net);
+}
+
+ntuple_state* ntuple_state_new(ntuple_net* net, board* b) {
+    ntuple_state* st = (ntuple_state*)malloc(sizeof(ntuple_state));
+    check_malloc(st);
+    st->net = net;
+    st->slots = (int32_t*)malloc(net->num_tuples * sizeof(int32_t));
+    check_malloc(st->slots);
+    ntuple_state_rebuild(st, b);
+    return st;
+}
+
+void ntuple_state_free(ntuple_state* st) {
+    free(st->slots);
+    free(st);
+}
+
+void ntuple_state_set(ntuple_state* st, pos p, cell old, cell new) {
+    if (old == new) {
+        return;
+    }
+    ntuple_net* net = st->net;
+    int d = (int)new - (int)old;
+    unsigned int c = p.r * net->width + p.c;
+    for (uint32_t k = net->cell_start[c]; k < net->cell_start[c + 1]; k++) {
+        st->slots[net->cell_tuple[k]] += d * (int32_t)net->cell_power[k];
+    }
+}
+
+void ntuple_state_rebuild(ntuple_state* st, board* b) {
+    ntuple_net* net = st->net;
+    for (unsigned int t = 0; t < net->num_tuples; t++) {
+        st->slots[t] = net->tuple_base[t];
+    }
+    for (unsigned int r = 0; r < net->height; r++) {
+        for (unsigned int c = 0; c < net->width; c++) {
+            pos p = make_pos(r, c);
+            ntuple_state_set(st, p, EMPTY, board_get(b, p));
+        }
+    }
+}
+
+/* This helper function returns tanh(x), within 1e-4, from a continued
+   fraction, which is several times faster than tanhf */
+float ntuple_squash(float x) {
+    if (x >= NTUPLE_SQUASH_LIMIT || x <= -NTUPLE_SQUASH_LIMIT) {
+        return x > 0 ? 1 : -1;
+    }
+    float x2 = x * x;
+    return x * (135135 + x2 * (17325 + x2 * (378 + x2))) /
+           (135135 + x2 * (62370 + x2 * (3150 + 28 * x2)));
+}
+
+float ntuple_state_value(ntuple_state* st, turn player) {
+    ntuple_net* net = st->net;
+    float sum = net->sum(net->weights, st->slots, net->num_tuples);
+    return ntuple_squash(sum + net->weights[net->num_weights - 2 + player]);
+}
+
+void ntuple_batch_values(ntuple_net* net, const int32_t* slots,
+                         unsigned int stride, const turn* players,
+                         unsigned int n, float* values) {
+    net->sum_batch(net->weights, slots, stride, net->num_tuples, n, values);
+    const float* bias = net->weights + net->num_weights - 2;
+    for (unsigned int i = 0; i < n; i++) {
+        values[i] = ntuple_squash(values[i] + bias[players[i]]);
+    }
+}
+
+ntuple_state* ntuple_game_state(ntuple_net* net, game* g) {
+    check_null_pointer(net);
+    check_null_pointer(g);
+    if (g->run != net->run || g->b->width != net->width ||
+        g->b->height != net->height) {
+        fprintf(stderr, "The network is for another configuration\n");
+        exit(1);
+    }
+    return ntuple_state_new(net, g->b);
+}
+
+void ntuple_state_play(ntuple_state* st, board* b, move m) {
+    if (m.kind != MOVE_DROP) {
+        ntuple_state_rebuild(st, b);
+        return;
+    }
+    pos p = make_pos(b->height - board_column_height(b, m.column), m.column);
+    ntuple_state_set(st, p, EMPTY, board_get(b, p));
+}
+
+void ntuple_state_take_back(ntuple_state* st, board* b,
+                            unsigned int column) {
+    pos p = make_pos(b->height - board_column_height(b, column), column);
+    ntuple_state_set(st, p, board_get(b, p), EMPTY);
+}
+
+/* This helper function returns the value of a finished game for black */
+float ntuple_reward(outcome o) {
+    return o == BLACK_WIN ? 1 : o == WHITE_WIN ? -1 : 0;
+}
+
+/* This helper function returns the value for black of the position after
+   a legal move of a game that is not over, leaving the game and the state
+   of its board as they were. Drops are taken back and disarrays played
+   twice, while offsets, which cannot be undone, are played on a copy */
+float ntuple_try_move(game* g, ntuple_state* st, move m) {
+    float mover = g->player == BLACKS_TURN ? 1 : -1;
+    float value;
+    outcome o;
+    if (m.kind == MOVE_DROP) {
+        if (drop_wins(g, m.column)) {
+            return mover;
+        }
+        drop_piece(g, m.column);
+        o = game_outcome(g);
+        if (o == IN_PROGRESS) {
+            ntuple_state_play(st, g->b, m);
+            value = ntuple_state_value(st, g->player);
+            ntuple_state_take_back(st, g->b, m.column);
+        } else {
+            value = ntuple_reward(o);
+        }
+        take_back_drop(g);
+    } else if (m.kind == MOVE_DISARRAY) {
+        disarray(g);
+        o = game_outcome(g);
+        if (o == IN_PROGRESS) {
+            ntuple_state_play(st, g->b, m);
+            value = ntuple_state_value(st, g->player);
+        } else {
+            value = ntuple_reward(o);
+        }
+        disarray(g);
+        ntuple_state_rebuild(st, g->b);
+    } else {
+        o = offset_outcome(g);
+        if (o != IN_PROGRESS) {
+            return ntuple_reward(o);
+        }
+        size_t size = game_serialized_size(g);
+        unsigned char* buf = (unsigned char*)malloc(size);
+        check_malloc(buf);
+        game_serialize(g, buf, size);
+        game* copy = game_deserialize(buf, size, BITS);
+        free(buf);
+        offset(copy);
+        ntuple_state* after = ntuple_state_new(st->net, copy->b);
+        value = ntuple_state_value(after, copy->player);
+        ntuple_state_free(after);
+        game_free(copy);
+    }
+    return value;
+}
+
+/* This helper function moves the value of the position of a game towards
+   a target, by a step of the gradient of the cross-entropy between the
+   two, seen as chances of a black win, shared among the weights taking
+   part. Unlike that of the squared error, this gradient does not vanish
+   when the value saturates */
+void ntuple_learn(game* g, ntuple_state* st, float target, float alpha) {
+    ntuple_net* net = st->net;
+    float v = ntuple_state_value(st, g->player);
+    float step = alpha * (target - v) / (net->num_tuples + 1);
+    for (unsigned int t = 0; t < net->num_tuples; t++) {
+        net->weights[st->slots[t]] += step;
+    }
+    net->weights[net->num_weights - 2 + g->player] += step;
+}
+
+void ntuple_train(ntuple_net* net, const ntuple_train_options* opts,
+                  ntuple_train_stats* stats) {
+    check_null_pointer(net);
+    uint64_t start = now_ns();
+    ntuple_train_stats s;
+    memset(&s, 0, sizeof(s));
+    unsigned int width = net->width, seed = opts->seed;
+    game* g = new_game(net->run, width, net->height, BITS);
+    game_track_windows(g);
+    ntuple_state* st = ntuple_game_state(net, g);
+    move moves[width + 2];
+    float values[width + 2];
+    for (unsigned int i = 0; i < opts->games; i++) {
+        game_reset(g);
+        ntuple_state_rebuild(st, g->b);
+        outcome o = IN_PROGRESS;
+        for (unsigned int ply = 0; ply < opts->max_plies; ply++) {
+            float mover = g->player == BLACKS_TURN ? 1 : -1;
+            unsigned int n = 0, best = 0;
+            for (unsigned int j = 0; j < width + 2; j++) {
+                move m = move_from_index(width, j);
+                if (!move_is_legal(g, m)) {
+                    continue;
+                }
+                moves[n] = m;
+                values[n] = ntuple_try_move(g, st, m);
+                if (mover * values[n] > mover * values[best]) {
+                    best = n;
+                }
+                n++;
+            }
+            if ((float)rand_r(&seed) / RAND_MAX < opts->epsilon) {
+                best = rand_r(&seed) % n;
+            }
+            ntuple_learn(g, st, values[best], opts->alpha);
+            play_move(g, moves[best]);
+            ntuple_state_play(st, g->b, moves[best]);
+            s.plies++;
+            o = game_outcome(g);
+            if (o != IN_PROGRESS) {
+                break;
+            }
+        }
+        s.black_wins += o == BLACK_WIN;
+        s.white_wins += o == WHITE_WIN;
+        s.draws += o == DRAW || o == IN_PROGRESS;
+    }
+    ntuple_state_free(st);
+    game_free(g);
+    s.seconds = (now_ns() - start) / 1e9;
+    if (stats) {
+        *stats = s;
+    }
+}
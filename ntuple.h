@@ -0,0 +1,316 @@
+#ifndef NTUPLE_H
+#define NTUPLE_H
+
+#include <stdint.h>
+#include "logic.h"
+
+/* An N-tuple network evaluates positions of one configuration from
+   patterns of cells. A tuple is a list of cells; the contents of its
+   cells, read as the digits of a number in base 3 (empty, black, white),
+   index a table of weights. The value of a position is the sum of the
+   weights its tuples index and of a bias for the player to move, squashed
+   into [-1, 1] by a close approximation of tanh, positive when black is
+   ahead.
+ * The tuples are every line of min(run, NTUPLE_MAX_LEN) cells in the four
+   directions of the windows (see window.h) and every 2 by 3 and 3 by 2
+   rectangle. Each tuple has a twin, the same cells mirrored left to
+   right, reading the same table, so that mirror images have the same
+   value.
+ * A state keeps, for every tuple of a position, the slot of the weight
+   it indexes. A changed cell moves the slots of the tuples covering it
+   by a multiple of a power of 3, so a search keeps its state up to date
+   as it plays and takes back moves, and a value is a gather of the
+   weights at the slots and a sum, done 8 at a time with AVX2 on
+   processors that have it. Batches of positions are evaluated 8
+   positions at a time instead, a tuple at a time, which needs no sum
+   across a vector.
+ * Weights are learned by temporal difference from self-play, and saved to
+   a file of a header and the weights, which is mapped rather than read,
+   so that processes using the same network share its pages
+ * The networks are experimental: they do not yet play better than the
+   window counts. On 7 by 6 with run 4, depth 2 against depth 2, a
+   network of 500000 self-play games scored 141 wins and 118 losses in 400
+   games, and one of 2000000 games 129 wins and 129 losses */
+
+#define NTUPLE_MAGIC "TTNT"
+#define NTUPLE_VERSION 1
+#define NTUPLE_MAX_LEN 6
+#define NTUPLE_MAX_CELLS 256
+#define NTUPLE_SCALE 10000
+
+struct ntuple_header {
+    char magic[4];
+    uint32_t version, width, height, run, reserved;
+    uint64_t num_weights;
+};
+
+typedef struct ntuple_header ntuple_header;
+
+
+struct ntuple_net {
+    unsigned int width, height, run, num_tuples;
+    size_t num_weights;
+    float* weights;
+    uint32_t *tuple_base, *cell_start, *cell_tuple, *cell_power;
+    void* map;
+    size_t map_len;
+    float (*sum)(const float* weights, const int32_t* slots,
+                 unsigned int n);
+    void (*sum_batch)(const float* weights, const int32_t* slots,
+                      unsigned int stride, unsigned int tuples,
+                      unsigned int n, float* sums);
+};
+
+typedef struct ntuple_net ntuple_net;
+
+
+struct ntuple_state {
+    ntuple_net* net;
+    int32_t* slots;
+};
+
+typedef struct ntuple_state ntuple_state;
+
+
+struct ntuple_train_options {
+    unsigned int games, max_plies, seed;
+    float alpha, epsilon;
+};
+
+typedef struct ntuple_train_options ntuple_train_options;
+
+
+struct ntuple_train_stats {
+    unsigned long long plies;
+    unsigned int black_wins, white_wins, draws;
+    double seconds;
+};
+
+typedef struct ntuple_train_stats ntuple_train_stats;
+
+
+/**
+ * ntuple_new
+ *
+ * Creates a network for a configuration with every weight at 0.
+ *
+ * Parameters:
+ *   - run: The run of the configuration.
+ *   - width: The number of columns of its boards.
+ *   - height: The number of rows of its boards.
+ *
+ * Returns:
+ *   - A pointer to the new `ntuple_net`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `ntuple_free`.
+ *   - Raises an error if the boards have more than NTUPLE_MAX_CELLS cells
+ *      or memory allocation fails.
+ */
+ntuple_net* ntuple_new(unsigned int run, unsigned int width,
+                       unsigned int height);
+
+/**
+ * ntuple_open
+ *
+ * Maps a network from a file written by `ntuple_save`.
+ *
+ * Parameters:
+ *   - path: The path of the file.
+ *
+ * Returns:
+ *   - A pointer to the `ntuple_net`, or NULL if the file cannot be mapped
+ *      or is not a network.
+ *
+ * Note:
+ *   - The mapping is private: training the network changes the weights in
+ *      memory only, and pages are copied as they are first written.
+ *   - The caller is responsible for calling `ntuple_free`.
+ */
+ntuple_net* ntuple_open(const char* path);
+
+/**
+ * ntuple_save
+ *
+ * Writes a network to a file.
+ *
+ * Parameters:
+ *   - net: A pointer to the `ntuple_net`.
+ *   - path: The path of the file, which is replaced.
+ *
+ * Returns:
+ *   - `true` on success, `false` if the file could not be written.
+ */
+bool ntuple_save(ntuple_net* net, const char* path);
+
+/**
+ * ntuple_free
+ *
+ * Frees a network, or unmaps it if it was opened from a file.
+ *
+ * Parameters:
+ *   - net: A pointer to the `ntuple_net`.
+ *
+ * Note:
+ *   - States using the network must be freed first.
+ */
+void ntuple_free(ntuple_net* net);
+
+/**
+ * ntuple_state_new
+ *
+ * Computes the slots of every tuple of a board.
+ *
+ * Parameters:
+ *   - net: A pointer to the `ntuple_net`, which must outlive the state.
+ *   - b: A pointer to the board, of the network's size.
+ *
+ * Returns:
+ *   - A pointer to the new `ntuple_state`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `ntuple_state_free`.
+ *   - Raises an error if memory allocation fails.
+ */
+ntuple_state* ntuple_state_new(ntuple_net* net, board* b);
+
+/**
+ * ntuple_state_free
+ *
+ * Frees a state.
+ *
+ * Parameters:
+ *   - st: A pointer to the `ntuple_state`.
+ */
+void ntuple_state_free(ntuple_state* st);
+
+/**
+ * ntuple_state_set
+ *
+ * Updates the slots of the tuples covering a cell whose content changes.
+ *
+ * Parameters:
+ *   - st: A pointer to the `ntuple_state`.
+ *   - p: The position of the cell.
+ *   - old: What the cell held.
+ *   - new: What the cell holds now.
+ */
+void ntuple_state_set(ntuple_state* st, pos p, cell old, cell new);
+
+/**
+ * ntuple_state_rebuild
+ *
+ * Computes every slot again from a board whose cells changed wholesale.
+ *
+ * Parameters:
+ *   - st: A pointer to the `ntuple_state`.
+ *   - b: A pointer to the board.
+ */
+void ntuple_state_rebuild(ntuple_state* st, board* b);
+
+/**
+ * ntuple_state_value
+ *
+ * Returns the value of a position, in [-1, 1] and positive when black is
+ *  ahead.
+ *
+ * Parameters:
+ *   - st: A pointer to the `ntuple_state` of its board.
+ *   - player: The player to move.
+ */
+float ntuple_state_value(ntuple_state* st, turn player);
+
+/**
+ * ntuple_batch_values
+ *
+ * Evaluates a batch of positions at once.
+ *
+ * Parameters:
+ *   - net: A pointer to the `ntuple_net`.
+ *   - slots: The slots of the positions' states, tuple by tuple: the slot
+ *      of tuple t of position i is at t * stride + i.
+ *   - stride: The distance between the slots of a position's tuples, at
+ *      least n.
+ *   - players: The players to move in the positions.
+ *   - n: The number of positions.
+ *   - values: Out-parameter of n values, as `ntuple_state_value` gives.
+ */
+void ntuple_batch_values(ntuple_net* net, const int32_t* slots,
+                         unsigned int stride, const turn* players,
+                         unsigned int n, float* values);
+
+/**
+ * ntuple_game_state
+ *
+ * Computes the state of the board of a game, for a network that must be
+ *  for the game's configuration.
+ *
+ * Parameters:
+ *   - net: A pointer to the `ntuple_net`, which must outlive the state.
+ *   - g: A pointer to the `game` structure.
+ *
+ * Returns:
+ *   - A pointer to the new `ntuple_state`, which the game does not keep:
+ *      whoever plays moves on it updates the state with
+ *      `ntuple_state_play` and `ntuple_state_take_back`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `ntuple_state_free`.
+ *   - Raises an error if the network is for another configuration.
+ */
+ntuple_state* ntuple_game_state(ntuple_net* net, game* g);
+
+/**
+ * ntuple_state_play
+ *
+ * Updates a state after a move was played on its board.
+ *
+ * Parameters:
+ *   - st: A pointer to the `ntuple_state`.
+ *   - b: A pointer to the board, as the move left it.
+ *   - m: The move.
+ *
+ * Modifies:
+ *   - Moves the slots covering the cell a drop filled, or computes every
+ *      slot again after an offset or a disarray, which change many cells.
+ */
+void ntuple_state_play(ntuple_state* st, board* b, move m);
+
+/**
+ * ntuple_state_take_back
+ *
+ * Updates a state for a drop about to be taken back.
+ *
+ * Parameters:
+ *   - st: A pointer to the `ntuple_state`.
+ *   - b: A pointer to the board, before the drop is taken back.
+ *   - column: The column of the drop.
+ */
+void ntuple_state_take_back(ntuple_state* st, board* b, unsigned int column);
+
+/**
+ * ntuple_train
+ *
+ * Improves a network by playing games against itself and learning from
+ *  them by temporal difference: after every move, the value of the
+ *  position before it is moved towards the value of the position after
+ *  it, or towards the result if the game is over.
+ *
+ * Parameters:
+ *   - net: A pointer to the `ntuple_net`.
+ *   - opts: The number of games, the number of plies after which a game
+ *      is stopped, unfinished, the seed of the random moves, the learning
+ *      rate and the share of moves played at random rather than to the
+ *      position of best value for the player to move.
+ *   - stats: Out-parameter receiving the plies played, the results of the
+ *      games, stopped games counting as draws, and the time taken.
+ *      May be NULL.
+ *
+ * Note:
+ *   - Every kind of move is played: winning drops are found without
+ *      playing them, and offsets are tried on copies.
+ */
+void ntuple_train(ntuple_net* net, const ntuple_train_options* opts,
+                  ntuple_train_stats* stats);
+
+#endif /* NTUPLE_H */
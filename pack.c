@@ -0,0 +1,69 @@
+#include <string.h>
+#include "archive.h"
+#include "record.h"
+
+/* Converts game record files into a columnar archive.
+ * Usage: pack [-p <ply>,<ply>,...] <out.tca> <games.rec>...
+ * Positions are kept at plies 8 and 16 unless -p says otherwise */
+
+/* This helper function parses a comma-separated list of plies into plies
+   and returns how many there are */
+unsigned int parse_plies(char* s, unsigned int* plies) {
+    unsigned int n = 0;
+    for (char* tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        if (n == ARCHIVE_MAX_PLIES) {
+            fprintf(stderr, "At most %d plies can be kept\n",
+                    ARCHIVE_MAX_PLIES);
+            exit(1);
+        }
+        plies[n++] = atoi(tok);
+    }
+    return n;
+}
+
+int main(int argc, char** argv) {
+    unsigned int plies[ARCHIVE_MAX_PLIES] = {8, 16}, num_plies = 2;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-p") == 0) {
+        num_plies = parse_plies(argv[2], plies);
+        first = 3;
+    }
+    if (argc - first < 2) {
+        fprintf(stderr, "Usage: pack [-p <ply>,<ply>,...] <out.tca> "
+                        "<games.rec>...\n");
+        exit(1);
+    }
+    archive_writer* w = archive_writer_new(argv[first], plies, num_plies);
+    size_t cap = 1024;
+    move* moves = (move*)malloc(sizeof(move) * cap);
+    check_malloc(moves);
+    unsigned long long games = 0;
+    for (int i = first + 1; i < argc; i++) {
+        FILE* f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            fprintf(stderr, "Could not open %s\n", argv[i]);
+            exit(1);
+        }
+        record_reader* r = record_reader_new(f);
+        game* g;
+        while ((g = record_next_game(r))) {
+            size_t n = 0;
+            while (record_next_move(r, &moves[n])) {
+                if (++n == cap) {
+                    cap *= 2;
+                    moves = (move*)realloc(moves, sizeof(move) * cap);
+                    check_malloc(moves);
+                }
+            }
+            archive_add_game(w, g, moves, n);
+            game_free(g);
+            games++;
+        }
+        record_reader_free(r);
+        fclose(f);
+    }
+    archive_writer_finish(w);
+    free(moves);
+    printf("%llu games archived\n", games);
+    return 0;
+}
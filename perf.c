@@ -0,0 +1,292 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "perf.h"
+#include "pos.h"
+
+bool perf_on = false;
+
+/* Whether the kernel gave perf_enable its counters, so that other threads
+   may open theirs, and a count of the perf_enable and perf_disable calls,
+   by which threads tell that the counters they hold are stale */
+static bool counters_available = false;
+static unsigned int counters_generation = 0;
+
+static perf_thread* threads = NULL;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static __thread perf_thread* local_thread = NULL;
+
+static const char* region_names[PERF_NUM_REGIONS] = {
+    "disarray", "offset", "win_check", "board_scan", "search_iter"
+};
+
+#if defined(__linux__)
+static const unsigned long long counter_configs[PERF_NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/* This helper function opens one hardware counter for the calling thread.
+ * inherit is set so that the threads created by disarray are counted too;
+   their counts are added to ours when they exit */
+int perf_open_counter(unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/* This helper function closes the counters of the calling thread */
+void perf_close_counters(perf_thread* t) {
+    if (!t->counters_open) {
+        return;
+    }
+    for (unsigned int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        close(t->fds[i]);
+    }
+    t->counters_open = false;
+}
+
+/* This helper function opens the counters of the calling thread.
+ * Returns false, leaving none open, if the kernel refused one. Only
+   Linux has perf_event_open: elsewhere every counter is refused */
+bool perf_open_counters(perf_thread* t) {
+#if defined(__linux__)
+    for (unsigned int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        t->fds[i] = perf_open_counter(counter_configs[i]);
+        if (t->fds[i] < 0) {
+            for (unsigned int j = 0; j < i; j++) {
+                close(t->fds[j]);
+            }
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        ioctl(t->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(t->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    t->counters_open = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* This helper function is the destructor of thread_key. It runs when a
+   thread that entered a region exits, closes its counters and hands its
+   state back for reuse; the statistics already in it are kept */
+void perf_release_thread(void* arg) {
+    perf_thread* t = (perf_thread*)arg;
+    perf_close_counters(t);
+    pthread_mutex_lock(&threads_lock);
+    t->in_use = false;
+    pthread_mutex_unlock(&threads_lock);
+}
+
+/* This helper function creates thread_key, once */
+void perf_make_thread_key() {
+    pthread_key_create(&thread_key, perf_release_thread);
+}
+
+/* This helper function gives the calling thread its state, reusing the
+   state of an exited thread when there is one */
+perf_thread* perf_acquire_thread() {
+    pthread_once(&thread_key_once, perf_make_thread_key);
+    pthread_mutex_lock(&threads_lock);
+    perf_thread* t = threads;
+    while (t && t->in_use) {
+        t = t->next;
+    }
+    if (t == NULL) {
+        t = (perf_thread*)calloc(1, sizeof(perf_thread));
+        check_malloc(t);
+        t->next = threads;
+        threads = t;
+    }
+    t->in_use = true;
+    t->counters_open = false;
+    t->generation = counters_generation - 1;
+    pthread_mutex_unlock(&threads_lock);
+    pthread_setspecific(thread_key, t);
+    return t;
+}
+
+/* This helper function returns the state of the calling thread, with its
+   counters opened or closed to match the last perf_enable or perf_disable
+   call */
+perf_thread* perf_current_thread() {
+    perf_thread* t = local_thread;
+    if (t == NULL) {
+        t = local_thread = perf_acquire_thread();
+    }
+    unsigned int generation = __atomic_load_n(&counters_generation,
+                                              __ATOMIC_ACQUIRE);
+    if (t->generation != generation) {
+        perf_close_counters(t);
+        if (perf_on &&
+            __atomic_load_n(&counters_available, __ATOMIC_RELAXED)) {
+            perf_open_counters(t);
+        }
+        t->generation = generation;
+    }
+    return t;
+}
+
+/* This helper function takes a snapshot of the wall clock and of every open
+   counter of the calling thread into the out-parameter snap */
+void perf_take_snapshot(perf_thread* t, perf_stats* snap) {
+    snap->nanos = now_ns();
+    for (unsigned int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        uint64_t v = 0;
+        if (t->counters_open &&
+            read(t->fds[i], &v, sizeof(v)) != sizeof(v)) {
+            v = 0;
+        }
+        snap->counts[i] = v;
+    }
+}
+
+bool perf_enable() {
+    /* The calling thread opens its counters at once, to learn whether the
+       kernel allows them */
+    pthread_mutex_lock(&threads_lock);
+    perf_on = true;
+    __atomic_store_n(&counters_available, true, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counters_generation, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&threads_lock);
+    perf_thread* t = perf_current_thread();
+    if (!t->counters_open) {
+        __atomic_store_n(&counters_available, false, __ATOMIC_RELAXED);
+        fprintf(stderr, "Hardware counters unavailable, timing regions "
+                        "with the wall clock only\n");
+        return false;
+    }
+    return true;
+}
+
+void perf_disable() {
+    pthread_mutex_lock(&threads_lock);
+    perf_on = false;
+    __atomic_add_fetch(&counters_generation, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&threads_lock);
+    perf_current_thread();
+}
+
+void perf_reset() {
+    pthread_mutex_lock(&threads_lock);
+    for (perf_thread* t = threads; t; t = t->next) {
+        for (unsigned int r = 0; r < PERF_NUM_REGIONS; r++) {
+            perf_stats* s = &t->stats[r];
+            __atomic_store_n(&s->calls, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&s->nanos, 0, __ATOMIC_RELAXED);
+            for (unsigned int i = 0; i < PERF_NUM_COUNTERS; i++) {
+                __atomic_store_n(&s->counts[i], 0, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    pthread_mutex_unlock(&threads_lock);
+}
+
+void perf_begin(perf_region r) {
+    if (!perf_on) {
+        return;
+    }
+    perf_thread* t = perf_current_thread();
+    perf_take_snapshot(t, &t->starts[r]);
+}
+
+void perf_end(perf_region r) {
+    if (!perf_on) {
+        return;
+    }
+    perf_thread* t = perf_current_thread();
+    perf_stats end;
+    perf_take_snapshot(t, &end);
+    /* Only this thread adds to its statistics, but perf_get may be reading
+       them from another */
+    perf_stats* s = &t->stats[r];
+    perf_stats* start = &t->starts[r];
+    __atomic_add_fetch(&s->calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->nanos, end.nanos - start->nanos,
+                       __ATOMIC_RELAXED);
+    for (unsigned int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        __atomic_add_fetch(&s->counts[i], end.counts[i] - start->counts[i],
+                           __ATOMIC_RELAXED);
+    }
+}
+
+perf_stats perf_get(perf_region r) {
+    perf_stats sum;
+    memset(&sum, 0, sizeof(sum));
+    pthread_mutex_lock(&threads_lock);
+    for (perf_thread* t = threads; t; t = t->next) {
+        perf_stats* s = &t->stats[r];
+        sum.calls += __atomic_load_n(&s->calls, __ATOMIC_RELAXED);
+        sum.nanos += __atomic_load_n(&s->nanos, __ATOMIC_RELAXED);
+        for (unsigned int i = 0; i < PERF_NUM_COUNTERS; i++) {
+            sum.counts[i] += __atomic_load_n(&s->counts[i],
+                                             __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&threads_lock);
+    return sum;
+}
+
+/* This helper function returns a count per thousand instructions */
+double perf_per_kilo_instruction(const perf_stats* s, perf_counter c) {
+    if (s->counts[PERF_INSTRUCTIONS] == 0) {
+        return 0.0;
+    }
+    return 1000.0 * s->counts[c] / s->counts[PERF_INSTRUCTIONS];
+}
+
+void perf_report(FILE* f) {
+    fprintf(f, "%-12s %10s %12s %14s %14s %12s %12s %6s %6s %6s\n",
+            "region", "calls", "ns/call", "cycles", "instructions",
+            "cache-miss", "branch-miss", "IPC", "CMPKI", "BMPKI");
+    for (unsigned int r = 0; r < PERF_NUM_REGIONS; r++) {
+        perf_stats s = perf_get(r);
+        if (s.calls == 0) {
+            continue;
+        } else if (!__atomic_load_n(&counters_available, __ATOMIC_RELAXED)) {
+            fprintf(f, "%-12s %10llu %12.1f %14s\n", region_names[r],
+                    (unsigned long long)s.calls, (double)s.nanos / s.calls,
+                    "unsupported");
+            continue;
+        }
+        double ipc = 0.0;
+        if (s.counts[PERF_CYCLES]) {
+            ipc = (double)s.counts[PERF_INSTRUCTIONS] /
+                  s.counts[PERF_CYCLES];
+        }
+        fprintf(f, "%-12s %10llu %12.1f %14llu %14llu %12llu %12llu "
+                   "%6.2f %6.2f %6.2f\n",
+                region_names[r], (unsigned long long)s.calls,
+                (double)s.nanos / s.calls,
+                (unsigned long long)s.counts[PERF_CYCLES],
+                (unsigned long long)s.counts[PERF_INSTRUCTIONS],
+                (unsigned long long)s.counts[PERF_CACHE_MISSES],
+                (unsigned long long)s.counts[PERF_BRANCH_MISSES], ipc,
+                perf_per_kilo_instruction(&s, PERF_CACHE_MISSES),
+                perf_per_kilo_instruction(&s, PERF_BRANCH_MISSES));
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum perf_region {
+    PERF_DISARRAY,
+    PERF_OFFSET,
+    PERF_WIN_CHECK,
+    PERF_BOARD_SCAN,
+    PERF_SEARCH_ITER,
+    PERF_NUM_REGIONS
+};
+
+typedef enum perf_region perf_region;
+
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NUM_COUNTERS
+};
+
+typedef enum perf_counter perf_counter;
+
+
+struct perf_stats {
+    uint64_t calls, nanos;
+    uint64_t counts[PERF_NUM_COUNTERS];
+};
+
+typedef struct perf_stats perf_stats;
+
+
+typedef struct perf_thread perf_thread;
+
+struct perf_thread {
+    int fds[PERF_NUM_COUNTERS];
+    bool counters_open, in_use;
+    unsigned int generation;
+    perf_stats starts[PERF_NUM_REGIONS];
+    perf_stats stats[PERF_NUM_REGIONS];
+    perf_thread* next;
+};
+
+
+/**
+ * perf_enable
+ *
+ * Turns on measurement mode by opening the Linux hardware counters (cycles,
+ *  instructions, cache misses, branch misses) for the calling thread. Any
+ *  other thread opens its own counters when it first enters a region.
+ *
+ * Returns:
+ *   - `true` if the hardware counters were opened.
+ *   - `false` if the kernel refused them (unsupported platform, container,
+ *      perf_event_paranoid). Regions are still timed with the wall clock in
+ *      that case.
+ *
+ * Note:
+ *   - Each thread counts its regions with its own counters and adds them
+ *      to its own statistics, which `perf_get` and `perf_report` sum over
+ *      all threads. A thread's counters are closed when it exits; its
+ *      statistics are kept.
+ *   - Counts of threads spawned inside a region (e.g. the disarray column
+ *      threads) are folded into the region once those threads are joined.
+ */
+bool perf_enable();
+
+/**
+ * perf_disable
+ *
+ * Turns measurement mode off and closes the hardware counters of the
+ *  calling thread. Other threads close theirs when they next enter a
+ *  region or exit. Accumulated statistics are kept until `perf_reset` is
+ *  called.
+ */
+void perf_disable();
+
+/**
+ * perf_reset
+ *
+ * Clears the statistics accumulated for every region, on every thread.
+ */
+void perf_reset();
+
+/**
+ * perf_begin
+ *
+ * Marks the start of a region. Does nothing unless measurement mode is on.
+ *
+ * Parameters:
+ *   - r: The region being entered.
+ *
+ * Note:
+ *   - Regions may nest, in which case counts are inclusive, but a region
+ *      must not be entered again before it is left.
+ */
+void perf_begin(perf_region r);
+
+/**
+ * perf_end
+ *
+ * Marks the end of a region and adds the counter deltas since the matching
+ *  `perf_begin` to the region's statistics. Does nothing unless measurement
+ *  mode is on.
+ *
+ * Parameters:
+ *   - r: The region being left.
+ */
+void perf_end(perf_region r);
+
+/**
+ * perf_get
+ *
+ * Returns the statistics accumulated for a region, summed over all
+ *  threads.
+ *
+ * Parameters:
+ *   - r: The region.
+ */
+perf_stats perf_get(perf_region r);
+
+/**
+ * perf_report
+ *
+ * Prints one line per region that was entered at least once, summed over
+ *  all threads: call count, wall-clock time per call, the four counters,
+ *  the IPC, and the cache and branch misses per thousand instructions
+ *  (CMPKI, BMPKI). The counters are shown as "unsupported" if the last
+ *  `perf_enable` could not open them.
+ *
+ * Parameters:
+ *   - f: The stream to print to.
+ */
+void perf_report(FILE* f);
+
+/* Set by perf_enable and cleared by perf_disable. Read directly by the
+   region hooks so that they cost a single branch when measurement is off */
+extern bool perf_on;
+
+#endif /* PERF_H */
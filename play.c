@@ -1,8 +1,16 @@
+#include <string.h>
+#include <unistd.h>
+#include "book.h"
+#include "engine.h"
+#include "evalq.h"
 #include "logic.h"
+#include "perf.h"
+#include "tb.h"
 
 /* This helper to the function check_arguments is given a pointer to a string 
     and checks if the string is a valid option. A valid option contains two 
-    elements: a '-', followed by either h, w, r, m, or b */
+    elements: a '-', followed by either h, w, r, m, b, s, p, k, e, n, x, 
+    f, c, t, a, or q */
 bool is_valid_option(char* s) {
     unsigned char i = 0;
     while (s[i]) {
@@ -15,7 +23,11 @@ bool is_valid_option(char* s) {
         return false;
     }
     return s[0] == '-' && (s[1] == 'h' || s[1] == 'w' || s[1] == 'r' || 
-                            s[1] == 'm' || s[1] == 'b'); 
+                            s[1] == 'm' || s[1] == 'b' || s[1] == 'p' ||
+                            s[1] == 'k' || s[1] == 'e' || s[1] == 's' ||
+                            s[1] == 'x' || s[1] == 'f' || s[1] == 'c' ||
+                            s[1] == 't' || s[1] == 'a' || s[1] == 'n' ||
+                            s[1] == 'q'); 
 }
 
 /* This helper to the function is_valid_nonnegative_number is given a 
@@ -42,28 +54,110 @@ bool is_valid_nonnegative_number(char* s) {
     return true;
 }
 
+#define PLAY_TT_BYTES (64 << 20)
+#define PLAY_DEFAULT_TIME_MS 1000
+#define PLAY_QUEUE_FLUSH_US 50
+
+/* The optional settings of play, from the command line. engine_sides has 
+   bit 0 set if the engine plays black and bit 1 if it plays white */
+struct play_options {
+    bool perf, final_boards, queue;
+    char *book_path, *tb_path, *net_path, *script_path;
+    unsigned int engine_sides, time_ms, analysis_ms;
+};
+
+typedef struct play_options play_options;
+
 /* This function checks if all command-line arguments are valid.
  * It takes in the argument count argc, the array of strings argv, and 
-    out-parameters -type, height, width, run- to update based on the what the 
-    command-line arguments are.
+    out-parameters -type, height, width, run, opts- to update based on the 
+    what the command-line arguments are.
  * The user is able to specify any valid values on the command line, and in 
     any order, as long as each option from -h -w -r is directly followed by 
-    its value, and that exactly one of -b and -m is specified.
- * Widths that would result in ? column label(s) are unplayable 
+    its value, and that exactly one of -b, -m and -s is specified.
+ * -s selects the sparse board, which only stores each column's pieces and 
+    so allows very tall boards
+ * The optional -p turns on hardware counter measurement of the game logic
+ * The optional -k is followed by the path of an opening book, whose move is
+    suggested on every turn while the game is in book
+ * The optional -e is followed by the path of an endgame tablebase, whose 
+    result and move are shown on every turn the position is in it
+ * The optional -n is followed by the path of an N-tuple network, with 
+    which the engine evaluates positions. Networks are experimental and 
+    do not yet play better than the default evaluation (see ntuple.h)
+ * The optional -x is followed by the path of a move script, or - for 
+    standard input, whose games are played in batch instead of 
+    interactively, and the optional -f then prints every final board
+ * The optional -c is followed by 1, 2 or 3 to have the engine play black, 
+    white or both, and the optional -t by the engine's time per move in 
+    milliseconds
+ * The optional -a is followed by a number of milliseconds for which every 
+    position the player is to move in is analysed before the prompt
+ * The optional -q has the analysis threads evaluate positions with the 
+    network of -n in batches, through an evaluation queue (see evalq.h)
  * Prints out error messages if not given all required command-line arguments, 
     or unplayable ones */
 void check_arguments(int argc, char** argv, enum type* type, 
                      unsigned int* height, 
                      unsigned int* width, 
-                     unsigned int* run) {
-    if (argc != 8) {
+                     unsigned int* run,
+                     play_options* opts) {
+    memset(opts, 0, sizeof(play_options));
+    opts->time_ms = PLAY_DEFAULT_TIME_MS;
+    bool c_found = false, t_found = false, a_found = false;
+    for (unsigned char i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0') {
+            continue;
+        }
+        if (argv[i][1] == 'p') {
+            opts->perf = true;
+        } else if (argv[i][1] == 'f') {
+            opts->final_boards = true;
+        } else if (argv[i][1] == 'q') {
+            opts->queue = true;
+        } else if (i < argc - 1 && argv[i][1] == 'k') {
+            opts->book_path = argv[i + 1];
+        } else if (i < argc - 1 && argv[i][1] == 'e') {
+            opts->tb_path = argv[i + 1];
+        } else if (i < argc - 1 && argv[i][1] == 'n') {
+            opts->net_path = argv[i + 1];
+        } else if (i < argc - 1 && argv[i][1] == 'x') {
+            opts->script_path = argv[i + 1];
+        } else if (argv[i][1] == 'c') {
+            c_found = true;
+        } else if (argv[i][1] == 't') {
+            t_found = true;
+        } else if (argv[i][1] == 'a') {
+            a_found = true;
+        }
+    }
+    if (argc != 8 + opts->perf + opts->final_boards + opts->queue +
+                2 * (opts->book_path != NULL) + 2 * (opts->tb_path != NULL) +
+                2 * (opts->net_path != NULL) + 
+                2 * (opts->script_path != NULL) + 2 * c_found + 
+                2 * t_found + 2 * a_found) {
         fprintf(stderr, "Invalid number of command-line arguments. "
-                        "The required number is 8.\n");
+                        "The required number is 8, plus 1 with each of -p, "
+                        "-f and -q and 2 with each of -k, -e, -n, -x, -c, "
+                        "-t and -a.\n");
+        exit(1);
+    }
+    if (opts->queue && (opts->net_path == NULL || !a_found)) {
+        fprintf(stderr, "Option -q needs a network given with -n and an "
+                        "analysis time given with -a.\n");
+        exit(1);
+    }
+    if (opts->final_boards && opts->script_path == NULL) {
+        fprintf(stderr, "Option -f needs a script given with -x.\n");
         exit(1);
     }
     bool h_found = false, w_found = false, r_found = false, m_found = false, 
-         b_found = false;
+         b_found = false, s_found = false;
     for (unsigned char i = 1; i < argc; i++) {
+        if (argv[i] == opts->book_path || argv[i] == opts->tb_path || 
+            argv[i] == opts->net_path || argv[i] == opts->script_path) {
+            continue;
+        }
         if (!is_valid_option(argv[i]) && 
             !is_valid_nonnegative_number(argv[i])) {
             fprintf(stderr, "Argument %hhu is neither a valid option "
@@ -79,10 +173,19 @@ void check_arguments(int argc, char** argv, enum type* type,
                 *type = BITS;
                 b_found = true;
                 continue;
+            } else if (argv[i][1] == 's') {
+                *type = SPARSE;
+                s_found = true;
+                continue;
+            } else if (argv[i][1] == 'p' || argv[i][1] == 'k' || 
+                       argv[i][1] == 'q' ||
+                       argv[i][1] == 'e' || argv[i][1] == 'n' ||
+                       argv[i][1] == 'x' || argv[i][1] == 'f') {
+                continue;
             }
             if (i == argc - 1) {
-                fprintf(stderr, "Option -h, -w, or -r cannot be the last "
-                                "argument.\n");
+                fprintf(stderr, "Option -h, -w, -r, -c, -t, or -a cannot be "
+                                "the last argument.\n");
                 exit(1);
             }
             if (!is_valid_nonnegative_number(argv[i+1])) {
@@ -97,22 +200,36 @@ void check_arguments(int argc, char** argv, enum type* type,
                     break;
                 case 'w':
                     *width = atoi(argv[i + 1]);
-                    if (*width > 62) {
-                        fprintf(stderr, "Invalid width. Width has to be less "
-                                        "than or equal to 62 for the game to "
-                                        "be playable.\n");
-                        exit(1);
-                    }
                     w_found = true;
                     break;
                 case 'r':
                     *run = atoi(argv[i + 1]);
                     r_found = true;
                     break;
+                case 'c':
+                    opts->engine_sides = atoi(argv[i + 1]);
+                    if (opts->engine_sides < 1 || opts->engine_sides > 3) {
+                        fprintf(stderr, "Option -c takes 1 for black, 2 "
+                                        "for white or 3 for both.\n");
+                        exit(1);
+                    }
+                    break;
+                case 't':
+                    opts->time_ms = atoi(argv[i + 1]);
+                    if (opts->time_ms == 0) {
+                        fprintf(stderr, "Option -t takes a positive number "
+                                        "of milliseconds.\n");
+                        exit(1);
+                    }
+                    break;
+                case 'a':
+                    opts->analysis_ms = atoi(argv[i + 1]);
+                    break;
             }
         }
     }
-    if (!h_found || !w_found || !r_found || (!m_found && !b_found)) {
+    if (!h_found || !w_found || !r_found || 
+        (!m_found && !b_found && !s_found)) {
         fprintf(stderr, "One or more options are missing.\n");
         exit(1);
     }
@@ -140,82 +257,392 @@ bool is_lowcase(char c) {
     return c >= 'a' && c <= 'z';
 }
 
-/* Checks if the character input during gameplay is valid. It is valid if it 
-    is either '!' for offset, '^' for disarray, a digit, uppercase, or 
-    lowercase letter for a drop */
+/* Checks if a character is a digit of a column label, that is a digit, 
+    uppercase, or lowercase letter */
 bool is_valid_character(char c) {
-    return c == '!' || c == '^' || is_digit(c) || is_uppcase(c) || 
-                                                  is_lowcase(c);
+    return is_digit(c) || is_uppcase(c) || is_lowcase(c);
 }
 
-/* Converts the character input of the player during gameplay into a number 
-    which will correspond to the column in which to drop. It returns this 
-    column */
+/* Converts one character of a column label into its value in base 62 */
 unsigned int convert_char_to_num(char c) {
     if (is_digit(c)) {
         return c - '0';
     } else if (is_uppcase(c)) {
         return (c - 'A') + 10;
     } else {
-        return (c - 'a') + 32;
+        return (c - 'a') + 36;
     }
 }
 
+/* Converts the column label typed in by the player during gameplay into the 
+    column in which to drop, the way board_show labels columns. Leading 
+    zeros may be left out, so on boards of at most 62 columns a label is a 
+    single character. Returns false if the label is not made of label 
+    characters or is past the given width */
+bool convert_label_to_num(const char* s, unsigned int width, 
+                          unsigned int* column) {
+    unsigned long long value = 0;
+    if (*s == '\0') {
+        return false;
+    }
+    for (; *s; s++) {
+        if (!is_valid_character(*s)) {
+            return false;
+        }
+        value = value * 62 + convert_char_to_num(*s);
+        if (value >= width) {
+            return false;
+        }
+    }
+    *column = value;
+    return true;
+}
+
 /* Takes in the outcome and prints it */
 void print_outcome(outcome o) {
     if (o == BLACK_WIN) {
         printf("Black wins.\n");
     } else if (o == WHITE_WIN) {
         printf("White wins.\n");
-    } else {
+    } else if (o == DRAW) {
         printf("It is a draw.\n");
+    } else {
+        printf("The game is unfinished.\n");
+    }
+}
+
+/* Plays one move as typed in: '!' for offset, '^' for disarray, or the 
+    label of the column to drop in, and stores it in the out-parameter 
+    played. Returns false if the input is not a move or the move is 
+    illegal */
+bool play_input(game* g, const char* input, move* played) {
+    if (strcmp(input, "!") == 0) {
+        *played = make_move(MOVE_OFFSET, 0);
+    } else if (strcmp(input, "^") == 0) {
+        *played = make_move(MOVE_DISARRAY, 0);
+    } else {
+        unsigned int col;
+        if (!convert_label_to_num(input, g->b->width, &col)) {
+            return false;
+        }
+        *played = make_move(MOVE_DROP, col);
+    }
+    return play_move(g, *played);
+}
+
+/* Prints a move the way it is typed in */
+void print_move(move m) {
+    if (m.kind == MOVE_OFFSET) {
+        printf("!");
+    } else if (m.kind == MOVE_DISARRAY) {
+        printf("^");
+    } else {
+        print_from_ind(m.column);
+    }
+}
+
+/* Prints the book move for the player to move, if the game is still in the 
+    opening book, with the number of book games that went through the 
+    resulting position and how the mover fared in them */
+void print_book_move(book* bk, game* g) {
+    move m;
+    const book_entry* e;
+    if (!book_choose(bk, g, 1, &m, &e)) {
+        return;
     }
+    printf("Book: ");
+    print_move(m);
+    printf(" (%u games, %.1f%%)\n", e->games, 100 * book_score(e, g->player));
 }
 
-/* The main function implements the overall gameplay interface.
+/* Prints the perfect-play result of the position for the player to move and
+    a move that achieves it, if the position is in the tablebase */
+void print_tablebase_move(tablebase* tb, game* g) {
+    unsigned int plies;
+    tb_result r = tb_probe(tb, g, &plies);
+    move m;
+    if (r == TB_UNKNOWN || !tb_best_move(tb, g, &m)) {
+        return;
+    }
+    if (r == TB_DRAW) {
+        printf("Tablebase: draw, ");
+    } else {
+        printf("Tablebase: %s in %u plies, ", r == TB_WIN ? "win" : "loss", 
+               plies);
+    }
+    print_move(m);
+    printf("\n");
+}
+
+/* This function plays the games of a move script back to back on one game, 
+    which is reset between them.
+ * Every line of the script is one game: its moves as typed in interactive 
+    play, separated by spaces. Empty lines and lines starting with # are 
+    skipped. A game stops at its first illegal move or once it is over, 
+    and the moves left on its line are ignored.
+ * Input and output are fully buffered and each game prints a single line 
+    with its outcome, followed by its final board if final_boards is set. 
+    Totals and throughput go to standard error */
+void play_script(FILE* f, game* g, bool final_boards) {
+    static char in_buf[1 << 16], out_buf[1 << 16];
+    setvbuf(f, in_buf, _IOFBF, sizeof(in_buf));
+    setvbuf(stdout, out_buf, _IOFBF, sizeof(out_buf));
+    char *line = NULL, *render = NULL;
+    size_t line_cap = 0, render_len = board_render_size(g->b);
+    if (final_boards) {
+        render = (char*)malloc(render_len);
+        check_malloc(render);
+    }
+    unsigned long long games = 0, moves = 0, outcomes[4] = {0, 0, 0, 0}, 
+                       illegal = 0;
+    uint64_t start = now_ns();
+    while (getline(&line, &line_cap, f) != -1) {
+        char *save, *token = strtok_r(line, " \t\r\n", &save);
+        if (token == NULL || token[0] == '#') {
+            continue;
+        }
+        game_reset(g);
+        outcome o = IN_PROGRESS;
+        unsigned long long ply = 0;
+        bool legal = true;
+        move m;
+        for (; token && o == IN_PROGRESS; 
+             token = strtok_r(NULL, " \t\r\n", &save)) {
+            if (!play_input(g, token, &m)) {
+                legal = false;
+                break;
+            }
+            ply++;
+            o = game_outcome(g);
+        }
+        moves += ply;
+        printf("%llu: ", ++games);
+        if (legal) {
+            outcomes[o]++;
+            print_outcome(o);
+        } else {
+            illegal++;
+            printf("Illegal move %llu (%s).\n", ply + 1, token);
+        }
+        if (final_boards) {
+            board_render(g->b, render, render_len);
+            fwrite(render, 1, render_len, stdout);
+        }
+    }
+    double secs = (now_ns() - start) / 1e9;
+    fflush(stdout);
+    fprintf(stderr, "%llu games, %llu moves, %.3f s, %.0f games/s: black "
+                    "wins %llu, white wins %llu, draws %llu, unfinished "
+                    "%llu, illegal %llu\n", games, moves, secs, 
+            secs > 0 ? games / secs : 0.0, outcomes[BLACK_WIN], 
+            outcomes[WHITE_WIN], outcomes[DRAW], outcomes[IN_PROGRESS], 
+            illegal);
+    free(line);
+    free(render);
+}
+
+/* Prints the move the engine chose and how it found it */
+void print_engine_move(search_result* res, bool pondered) {
+    printf("Engine: ");
+    print_move(res->best);
+    if (res->source == SOURCE_BOOK) {
+        printf(" (book)\n");
+    } else if (res->source == SOURCE_TABLEBASE) {
+        printf(" (tablebase)\n");
+    } else {
+        printf(" (depth %u, score %d, %llu nodes, %.3f s%s)\n", res->depth, 
+               res->score, res->nodes, res->seconds, 
+               pondered ? ", pondered" : "");
+    }
+}
+
+/* This is the analysis callback of play. It prints the score of every 
+    candidate each time all of them reach a new depth. arg points to the 
+    last depth printed */
+void print_analysis(const move_eval* evals, unsigned int num_evals, 
+                    unsigned int depth, unsigned long long nodes, 
+                    void* arg) {
+    unsigned int* printed = (unsigned int*)arg;
+    if (depth == *printed) {
+        return;
+    }
+    *printed = depth;
+    printf("Depth %u, %llu nodes:", depth, nodes);
+    for (unsigned int i = 0; i < num_evals; i++) {
+        printf(i ? ", " : " ");
+        print_move(evals[i].m);
+        printf(" %+d", evals[i].score);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+/* This helper function analyses the position for the player to move for 
+    the given time, on one thread per core, streaming the scores */
+void analyse(engine* analyser, game* g, unsigned int time_ms) {
+    move_eval evals[g->b->width + 2];
+    unsigned int printed = 0;
+    engine_analyze(analyser, g, sysconf(_SC_NPROCESSORS_ONLN), time_ms, 
+                   print_analysis, &printed, evals);
+}
+
+/* This function implements the interactive gameplay interface.
  * It takes input from the player and prints out the corresponding move on the 
-    board */
-int main(int argc, char** argv) {
-    unsigned int height, width, run;
-    enum type type;
-    check_arguments(argc, argv, &type, &height, &width, &run);
-    game* g = new_game(run, width, height, type);
+    board, until the game is over or standard input ends. A move is typed as 
+    '!' for offset, '^' for disarray, or the label of the column to drop in
+ * The engine, if given, plays the sides in engine_sides within time_ms 
+    milliseconds a move. After each of its moves it ponders the reply it 
+    expects while the player types, so that when the player plays that 
+    reply its answer is mostly ready
+ * The analyser, if given, scores every move of the player for analysis_ms 
+    milliseconds before the prompt */
+void play_interactive(game* g, book* bk, tablebase* tb, engine* e, 
+                      unsigned int engine_sides, unsigned int time_ms,
+                      engine* analyser, unsigned int analysis_ms) {
     board_show(g->b);
     bool is_move_successful = false;
-    char ch;
+    char input[16];
+    move m = make_move(MOVE_DISARRAY, 0);
     while (1) {
         if (is_move_successful) {
             board_show(g->b);
         }
         print_turn(g);
-        scanf("%c%*c", &ch);
-        if (!is_valid_character(ch)) {
-            is_move_successful = false;
-            continue;
-        }
-        if (ch == '!') {
-            if (!offset(g)) {
-                is_move_successful = false;
-                continue;
+        bool engine_turn = e && (engine_sides & (1u << g->player));
+        if (engine_turn) {
+            search_result res;
+            bool pondered = engine_ponder_finish(e, m, &res);
+            if (!pondered) {
+                engine_search(e, g, time_ms, &res);
+            }
+            print_engine_move(&res, pondered);
+            m = res.best;
+            play_move(g, m);
+            if (res.has_reply && game_outcome(g) == IN_PROGRESS && 
+                !(engine_sides & (1u << g->player))) {
+                engine_ponder(e, g, res.reply, time_ms);
             }
-        } else if (ch == '^') {
-            disarray(g);
         } else {
-            unsigned int col = convert_char_to_num(ch);
-            if (col >= width || !drop_piece(g, col)) {
+            if (bk) {
+                print_book_move(bk, g);
+            }
+            if (tb) {
+                print_tablebase_move(tb, g);
+            }
+            if (analyser) {
+                analyse(analyser, g, analysis_ms);
+            }
+            if (scanf("%15s", input) != 1) {
+                return;
+            }
+            if (!play_input(g, input, &m)) {
                 is_move_successful = false;
                 continue;
             }
         }
         outcome o = game_outcome(g);
         if (o != IN_PROGRESS) {
-           board_show(g->b);    
-           print_outcome(o);
-           game_free(g);
-           exit(1);
+            board_show(g->b);    
+            print_outcome(o);
+            return;
         }
         is_move_successful = true;
     }
-    return 0;   
 }
 
+/* The main function sets up the game from the command line and plays it 
+    interactively, or plays the games of a script in batch */
+int main(int argc, char** argv) {
+    unsigned int height, width, run;
+    enum type type;
+    play_options opts;
+    check_arguments(argc, argv, &type, &height, &width, &run, &opts);
+    if (opts.perf) {
+        perf_enable();
+    }
+    book* bk = NULL;
+    if (opts.book_path) {
+        bk = book_open(opts.book_path);
+        if (bk == NULL) {
+            fprintf(stderr, "Could not open book %s\n", opts.book_path);
+            exit(1);
+        }
+    }
+    tablebase* tb = NULL;
+    if (opts.tb_path) {
+        tb = tb_open(opts.tb_path);
+        if (tb == NULL) {
+            fprintf(stderr, "Could not open tablebase %s\n", opts.tb_path);
+            exit(1);
+        }
+    }
+    ntuple_net* net = NULL;
+    if (opts.net_path) {
+        net = ntuple_open(opts.net_path);
+        if (net == NULL || net->width != width || net->height != height ||
+            net->run != run) {
+            fprintf(stderr, "Could not open network %s for this game\n",
+                    opts.net_path);
+            exit(1);
+        }
+        fprintf(stderr, "Note: N-tuple networks are experimental and do "
+                        "not yet play better than the default evaluation.\n");
+    }
+    engine* e = NULL;
+    if (opts.engine_sides) {
+        e = engine_new(PLAY_TT_BYTES);
+        engine_use_book(e, bk, 1);
+        engine_use_tablebase(e, tb);
+        engine_use_ntuple(e, net);
+    }
+    engine* analyser = NULL;
+    eval_queue* queue = NULL;
+    if (opts.analysis_ms) {
+        analyser = engine_new(PLAY_TT_BYTES);
+        engine_use_ntuple(analyser, net);
+        if (opts.queue) {
+            queue = eval_queue_new(net, sysconf(_SC_NPROCESSORS_ONLN),
+                                   PLAY_QUEUE_FLUSH_US);
+            engine_use_eval_queue(analyser, queue);
+        }
+    }
+    game* g = new_game(run, width, height, type);
+    if (opts.script_path) {
+        bool from_stdin = strcmp(opts.script_path, "-") == 0;
+        FILE* f = from_stdin ? stdin : fopen(opts.script_path, "r");
+        if (f == NULL) {
+            fprintf(stderr, "Could not open script %s\n", opts.script_path);
+            exit(1);
+        }
+        play_script(f, g, opts.final_boards);
+        if (!from_stdin) {
+            fclose(f);
+        }
+    } else {
+        play_interactive(g, bk, tb, e, opts.engine_sides, opts.time_ms,
+                         analyser, opts.analysis_ms);
+    }
+    if (opts.perf) {
+        perf_report(stderr);
+    }
+    game_free(g);
+    if (e) {
+        engine_free(e);
+    }
+    if (analyser) {
+        engine_free(analyser);
+    }
+    if (queue) {
+        eval_queue_free(queue);
+    }
+    if (bk) {
+        book_close(bk);
+    }
+    if (tb) {
+        tb_close(tb);
+    }
+    if (net) {
+        ntuple_free(net);
+    }
+    return 0;   
+}
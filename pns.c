@@ -0,0 +1,680 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pns.h"
+#include "serial.h"
+#include "trace.h"
+
+/* The loop of a result that does not depend on the current line */
+#define PNS_NO_LOOP UINT32_MAX
+
+/* The values of proved and disproved positions in a shared table */
+#define PNS_SHARED_PROVED 1
+#define PNS_SHARED_DISPROVED 2
+
+/* A move of a position being searched, with the key of the position it
+   leads to, that position's numbers and the depth of its entry */
+struct pns_child {
+    move m;
+    key_pair k;
+    uint64_t key;
+    uint32_t pn, dn, loop, depth;
+};
+
+typedef struct pns_child pns_child;
+
+
+/* The numbers a search of a position ends with. A position solved because 
+   a position of the current line repeats has as loop the ply of the 
+   shallowest such position, PNS_NO_LOOP otherwise. depth is the least
+   depth of the entries the numbers were computed from */
+struct pns_value {
+    uint32_t pn, dn, loop, depth;
+};
+
+typedef struct pns_value pns_value;
+
+
+struct pns_thread {
+    pns_solver* s;
+    game* g;
+    unsigned int id;
+    cell attacker;
+    bool draw_ok, aborted;
+    uint64_t salt;
+    unsigned long long nodes, counted;
+    uint64_t path[PNS_MAX_PLY];
+};
+
+typedef struct pns_thread pns_thread;
+
+pns_solver* pns_new(size_t tt_bytes) {
+    size_t buckets = 1;
+    while (buckets * 2 * PNS_BUCKET * sizeof(pns_entry) <= tt_bytes) {
+        buckets *= 2;
+    }
+    pns_solver* s = (pns_solver*)malloc(sizeof(pns_solver));
+    check_malloc(s);
+    s->entries = (pns_entry*)calloc(buckets * PNS_BUCKET, sizeof(pns_entry));
+    check_malloc(s->entries);
+    s->bucket_mask = buckets - 1;
+    s->count = 0;
+    s->capacity = buckets * PNS_BUCKET;
+    for (unsigned int i = 0; i < PNS_LOCKS; i++) {
+        pthread_mutex_init(&s->locks[i], NULL);
+    }
+    pthread_mutex_init(&s->gc_lock, NULL);
+    s->gc_runs = 0;
+    s->threads = 1;
+    s->stop = false;
+    s->shared = NULL;
+    return s;
+}
+
+/* This helper function returns a + b, PNS_INFINITY if either is and just
+   below it if the sum is not */
+uint32_t pns_add(uint32_t a, uint32_t b) {
+    if (a >= PNS_INFINITY || b >= PNS_INFINITY) {
+        return PNS_INFINITY;
+    }
+    uint64_t sum = (uint64_t)a + b;
+    return sum >= PNS_INFINITY ? PNS_INFINITY - 1 : (uint32_t)sum;
+}
+
+/* This helper function locks the bucket of a key and returns its first
+   entry */
+pns_entry* pns_lock(pns_solver* s, uint64_t key) {
+    size_t b = key & s->bucket_mask;
+    pthread_mutex_lock(&s->locks[b % PNS_LOCKS]);
+    return s->entries + b * PNS_BUCKET;
+}
+
+/* This helper function unlocks the bucket of a key */
+void pns_unlock(pns_solver* s, uint64_t key) {
+    pthread_mutex_unlock(&s->locks[(key & s->bucket_mask) % PNS_LOCKS]);
+}
+
+/* This helper function returns the entry of a key in its locked bucket.
+   If there is none and create is set, it takes an empty entry, or else
+   the one with the least work, preferably with no thread inside, and
+   gives it numbers of 1. The depth of an entry is one more than the
+   least ply its position was searched at, or less if its numbers come
+   from a position searched shallower, UINT16_MAX until it is searched,
+   and 0 for an empty entry */
+pns_entry* pns_find(pns_solver* s, pns_entry* bucket, uint64_t key,
+                    bool create) {
+    pns_entry* victim = NULL;
+    for (unsigned int i = 0; i < PNS_BUCKET; i++) {
+        pns_entry* e = &bucket[i];
+        if (e->depth && e->key == key) {
+            return e;
+        } else if (!e->depth) {
+            victim = victim && !victim->depth ? victim : e;
+        } else if (!victim || (victim->depth &&
+                   ((e->busy > 0) < (victim->busy > 0) ||
+                    ((e->busy > 0) == (victim->busy > 0) &&
+                     e->work < victim->work)))) {
+            victim = e;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    if (!victim->depth) {
+        __atomic_add_fetch(&s->count, 1, __ATOMIC_RELAXED);
+    }
+    victim->key = key;
+    victim->pn = victim->dn = 1;
+    victim->work = 0;
+    victim->busy = 0;
+    victim->depth = UINT16_MAX;
+    return victim;
+}
+
+/* This helper function looks up the numbers and the depth of a position,
+   leaving them as they are if the table does not have it, and returns the
+   number of threads inside it */
+unsigned int pns_lookup(pns_solver* s, uint64_t key, uint32_t* pn,
+                        uint32_t* dn, uint32_t* depth) {
+    pns_entry* e = pns_find(s, pns_lock(s, key), key, false);
+    unsigned int busy = 0;
+    if (e) {
+        *pn = e->pn;
+        *dn = e->dn;
+        *depth = e->depth;
+        busy = e->busy;
+    }
+    pns_unlock(s, key);
+    return busy;
+}
+
+/* This helper function orders sampled work counts */
+int pns_compare_work(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* This helper function is the garbage collection of the table. It
+   samples the work of the entries to find the amount below which about
+   PNS_GC_SHARE of them fall, then clears every entry with at most that
+   much work and no thread inside, one bucket lock at a time so that the
+   other threads keep searching. Only one thread collects at a time */
+void pns_gc(pns_solver* s) {
+    if (pthread_mutex_trylock(&s->gc_lock)) {
+        return;
+    }
+    if (__atomic_load_n(&s->count, __ATOMIC_RELAXED) <
+        PNS_GC_LOAD * s->capacity) {
+        pthread_mutex_unlock(&s->gc_lock);
+        return;
+    }
+    uint32_t samples[PNS_GC_SAMPLES];
+    size_t n = 0, step = s->capacity / PNS_GC_SAMPLES;
+    step = step ? step : 1;
+    for (size_t i = 0; i < s->capacity && n < PNS_GC_SAMPLES; i += step) {
+        pns_entry* e = &s->entries[i];
+        if (__atomic_load_n(&e->depth, __ATOMIC_RELAXED)) {
+            samples[n++] = __atomic_load_n(&e->work, __ATOMIC_RELAXED);
+        }
+    }
+    qsort(samples, n, sizeof(uint32_t), pns_compare_work);
+    uint32_t threshold = n ? samples[(size_t)(n * PNS_GC_SHARE)] : 0;
+    for (size_t b = 0; b <= s->bucket_mask; b++) {
+        pthread_mutex_lock(&s->locks[b % PNS_LOCKS]);
+        for (unsigned int i = 0; i < PNS_BUCKET; i++) {
+            pns_entry* e = &s->entries[b * PNS_BUCKET + i];
+            if (e->depth && e->busy == 0 && e->work <= threshold) {
+                e->depth = 0;
+                __atomic_sub_fetch(&s->count, 1, __ATOMIC_RELAXED);
+            }
+        }
+        pthread_mutex_unlock(&s->locks[b % PNS_LOCKS]);
+    }
+    __atomic_add_fetch(&s->gc_runs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&s->gc_lock);
+}
+
+/* This helper function counts a thread into a position searched at the
+   given ply */
+void pns_enter(pns_solver* s, uint64_t key, unsigned int ply) {
+    pns_entry* e = pns_find(s, pns_lock(s, key), key, true);
+    e->busy++;
+    e->depth = ply + 1 < e->depth ? ply + 1 : e->depth;
+    pns_unlock(s, key);
+}
+
+/* This helper function stores the numbers of a position, unless keep is
+   set, lowers the depth of its entry to that of the numbers, adds the
+   work done below it and counts the thread out of it if it was counted
+   in. Collects garbage once the table is nearly full. A position solved
+   for good is also published to the shared table, unless the ply limit
+   was reached, which only a result at the root can depend on */
+void pns_store(pns_solver* s, uint64_t key, pns_value v, bool keep,
+               unsigned long long work, bool leave) {
+    pns_entry* e = pns_find(s, pns_lock(s, key), key, true);
+    if (!keep) {
+        e->pn = v.pn;
+        e->dn = v.dn;
+    }
+    e->depth = v.depth < e->depth ? v.depth : e->depth;
+    work += e->work;
+    e->work = work > UINT32_MAX ? UINT32_MAX : (uint32_t)work;
+    if (leave && e->busy > 0) {
+        e->busy--;
+    }
+    pns_unlock(s, key);
+    if (s->shared && !keep && (v.pn == 0 || v.dn == 0) &&
+        !__atomic_load_n(&s->ply_limit, __ATOMIC_RELAXED)) {
+        shared_table_store(s->shared, key, v.pn == 0 ? PNS_SHARED_PROVED
+                                                     : PNS_SHARED_DISPROVED);
+    }
+    if (__atomic_load_n(&s->count, __ATOMIC_RELAXED) >=
+        PNS_GC_LOAD * s->capacity) {
+        trace_begin("pns_gc");
+        pns_gc(s);
+        trace_end("pns_gc");
+    }
+}
+
+/* This helper function copies a game. MATRIX boards are copied as BITS
+   boards, whose disarrays do not spawn threads */
+game* pns_copy_game(game* g) {
+    size_t size = game_serialized_size(g);
+    unsigned char* buf = (unsigned char*)malloc(size);
+    check_malloc(buf);
+    game_serialize(g, buf, size);
+    game* copy = game_deserialize(buf, size,
+                                  g->b->type == MATRIX ? BITS : g->b->type);
+    free(buf);
+    return copy;
+}
+
+/* This helper function tells whether a finished game reached the goal of
+   the search */
+bool pns_success(pns_thread* t, outcome o) {
+    outcome won = t->attacker == BLACK ? BLACK_WIN : WHITE_WIN;
+    return o == won || (t->draw_ok && o == DRAW);
+}
+
+/* This helper function gives a child the numbers of a solved position */
+void pns_solved(pns_child* c, bool success) {
+    c->pn = success ? 0 : PNS_INFINITY;
+    c->dn = success ? PNS_INFINITY : 0;
+}
+
+/* This helper function tells what a move leads to without playing it,
+   IN_PROGRESS unless it ends the game */
+outcome pns_move_outcome(game* g, move m) {
+    board* b = g->b;
+    if (m.kind == MOVE_OFFSET) {
+        return offset_outcome(g);
+    } else if (m.kind == MOVE_DISARRAY) {
+        return disarray_outcome(g);
+    } else if (drop_wins(g, m.column)) {
+        return g->player == BLACKS_TURN ? BLACK_WIN : WHITE_WIN;
+    } else if (b->full_columns == b->width - 1 &&
+               board_column_height(b, m.column) == b->height - 1) {
+        return DRAW;
+    }
+    return IN_PROGRESS;
+}
+
+/* This helper function lists the legal moves of the position being
+   searched with the numbers of the positions they lead to: those of the
+   finished game if the move ends it, those of a draw if the position is
+   already on the current line, with the ply where it is as loop, and 
+   otherwise those of the table, of the shared table if it solved the
+   position, or 1 and 1. Returns the number of moves */
+unsigned int pns_children(pns_thread* t, key_pair k, unsigned int ply,
+                          pns_child* children) {
+    game* g = t->g;
+    unsigned int width = g->b->width, n = 0;
+    for (unsigned int i = 0; i < width + 2; i++) {
+        move m = move_from_index(width, i);
+        if (!move_is_legal(g, m)) {
+            continue;
+        }
+        pns_child* c = &children[n++];
+        c->m = m;
+        c->loop = PNS_NO_LOOP;
+        c->depth = UINT16_MAX;
+        outcome o = pns_move_outcome(g, m);
+        if (o != IN_PROGRESS) {
+            pns_solved(c, pns_success(t, o));
+            continue;
+        }
+        c->k = k;
+        if (m.kind == MOVE_DROP) {
+            drop_piece(g, m.column);
+            key_pair_drop(&c->k, g);
+            take_back_drop(g);
+        } else if (m.kind == MOVE_DISARRAY) {
+            disarray(g);
+            c->k = game_key_pair(g);
+            disarray(g);
+        } else {
+            game* after = pns_copy_game(g);
+            offset(after);
+            c->k = game_key_pair(after);
+            game_free(after);
+        }
+        bool mirrored;
+        c->key = canonical_key(c->k, &mirrored) ^ t->salt;
+        for (unsigned int j = 0; j <= ply; j++) {
+            if (t->path[j] == c->key) {
+                pns_solved(c, t->draw_ok);
+                c->loop = j;
+                break;
+            }
+        }
+        if (c->loop != PNS_NO_LOOP) {
+            continue;
+        }
+        c->pn = c->dn = 1;
+        pns_lookup(t->s, c->key, &c->pn, &c->dn, &c->depth);
+        uint64_t shared;
+        if (t->s->shared && c->pn != 0 && c->dn != 0 &&
+            shared_table_probe(t->s->shared, c->key, &shared)) {
+            pns_solved(c, shared == PNS_SHARED_PROVED);
+        }
+    }
+    return n;
+}
+
+/* This helper function computes the numbers of a position from those of
+   its children: where the attacker moves, the least proof number and the
+   sum of the disproof numbers, and the other way round where the defender
+   does. Children whose numbers come from a position searched at the ply
+   of the position or shallower, perhaps the position itself, count in the
+   sum only through the largest of them, so that numbers going round a
+   cycle of the table do not grow at each turn. A solved position inherits
+   the loop of the least dependent child solving it, or if every child is
+   needed, the shallowest loop of all. A loop at the position itself or
+   below no longer depends on the line: the position is then solved the
+   way the root would be */
+pns_value pns_numbers(pns_child* c, unsigned int n, bool attacker_moves,
+                      unsigned int ply) {
+    pns_value v;
+    uint32_t least = PNS_INFINITY, sum = 0, shallow = 0, loop_least = 0,
+             loop_all = PNS_NO_LOOP;
+    v.depth = ply + 1;
+    for (unsigned int i = 0; i < n; i++) {
+        uint32_t x = attacker_moves ? c[i].pn : c[i].dn,
+                 y = attacker_moves ? c[i].dn : c[i].pn;
+        if (x < least) {
+            least = x;
+            loop_least = c[i].loop;
+        } else if (x == least && c[i].loop > loop_least) {
+            loop_least = c[i].loop;
+        }
+        if (c[i].depth <= ply + 1) {
+            shallow = y > shallow ? y : shallow;
+        } else {
+            sum = pns_add(sum, y);
+        }
+        if (x != 0 && y != 0 && c[i].depth < v.depth) {
+            v.depth = c[i].depth;
+        }
+        loop_all = c[i].loop < loop_all ? c[i].loop : loop_all;
+    }
+    sum = shallow > sum ? shallow : sum;
+    v.pn = attacker_moves ? least : sum;
+    v.dn = attacker_moves ? sum : least;
+    v.loop = least == 0 ? loop_least : sum == 0 ? loop_all : PNS_NO_LOOP;
+    if (v.loop != PNS_NO_LOOP && v.loop >= ply) {
+        v.loop = PNS_NO_LOOP;
+    }
+    return v;
+}
+
+/* This helper function picks the child to search: the one with the least
+   proof number where the attacker moves, the least disproof number where
+   the defender does. With several threads, up to PNS_SPREAD_PLY, a
+   child's number counts (1 + t) times for t threads inside it. second
+   receives the next least number */
+unsigned int pns_select(pns_thread* t, pns_child* c, unsigned int n,
+                        bool attacker_moves, unsigned int ply,
+                        uint32_t* second) {
+    unsigned int best = 0;
+    uint64_t best_v = UINT64_MAX, second_v = PNS_INFINITY;
+    for (unsigned int i = 0; i < n; i++) {
+        uint64_t v = attacker_moves ? c[i].pn : c[i].dn;
+        if (v == 0 || v >= PNS_INFINITY) {
+            continue;
+        }
+        if (t->s->threads > 1 && ply < PNS_SPREAD_PLY) {
+            uint32_t pn, dn, depth;
+            v *= 1 + pns_lookup(t->s, c[i].key, &pn, &dn, &depth);
+        }
+        if (v < best_v) {
+            second_v = best_v;
+            best_v = v;
+            best = i;
+        } else if (v < second_v) {
+            second_v = v;
+        }
+    }
+    *second = second_v >= PNS_INFINITY ? PNS_INFINITY : (uint32_t)second_v;
+    return best;
+}
+
+/* This helper function returns the threshold of the child searched for
+   the number that sums over the children: the position's own threshold
+   less what the other children add up to */
+uint32_t pns_sum_threshold(uint32_t threshold, uint32_t sum, uint32_t child) {
+    if (threshold >= PNS_INFINITY) {
+        return PNS_INFINITY;
+    }
+    uint64_t v = (uint64_t)threshold - sum + child;
+    return v >= PNS_INFINITY ? PNS_INFINITY : (uint32_t)v;
+}
+
+/* This helper function publishes the nodes a thread searched, stops it
+   if the search is over, stopped or out of time, and has the first thread
+   report progress once a second */
+void pns_check(pns_thread* t) {
+    pns_solver* s = t->s;
+    __atomic_add_fetch(&s->nodes, t->nodes - t->counted, __ATOMIC_RELAXED);
+    t->counted = t->nodes;
+    uint64_t now = now_ns();
+    if (__atomic_load_n(&s->stop, __ATOMIC_RELAXED) ||
+        __atomic_load_n(&s->done, __ATOMIC_RELAXED) ||
+        (s->deadline_ns && now >= s->deadline_ns)) {
+        t->aborted = true;
+    }
+    if (t->id == 0 && s->report && now >= s->report_ns) {
+        s->report_ns = now + 1000000000ull;
+        pns_progress p;
+        p.draw_search = s->draw_search;
+        p.pn = __atomic_load_n(&s->root_pn, __ATOMIC_RELAXED);
+        p.dn = __atomic_load_n(&s->root_dn, __ATOMIC_RELAXED);
+        p.nodes = __atomic_load_n(&s->nodes, __ATOMIC_RELAXED);
+        p.seconds = (now - s->start_ns) / 1e9;
+        p.entries = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+        p.gc_runs = __atomic_load_n(&s->gc_runs, __ATOMIC_RELAXED);
+        s->report(&p, s->arg);
+    }
+}
+
+pns_value pns_mid(pns_thread* t, key_pair k, uint64_t key, unsigned int ply,
+                  uint32_t thpn, uint32_t thdn);
+
+/* This helper function plays a child's move, searches the position it
+   leads to within the given thresholds and takes the move back. Offsets
+   cannot be taken back, so they are played on a copy */
+pns_value pns_search_child(pns_thread* t, pns_child* c, unsigned int ply,
+                           uint32_t thpn, uint32_t thdn) {
+    game* g = t->g;
+    pns_value v;
+    if (c->m.kind == MOVE_DROP) {
+        drop_piece(g, c->m.column);
+        v = pns_mid(t, c->k, c->key, ply + 1, thpn, thdn);
+        take_back_drop(g);
+    } else if (c->m.kind == MOVE_DISARRAY) {
+        disarray(g);
+        v = pns_mid(t, c->k, c->key, ply + 1, thpn, thdn);
+        disarray(g);
+    } else {
+        t->g = pns_copy_game(g);
+        offset(t->g);
+        v = pns_mid(t, c->k, c->key, ply + 1, thpn, thdn);
+        game_free(t->g);
+        t->g = g;
+    }
+    return v;
+}
+
+/* This is the df-pn search of a position that is not over and not on the
+   current line. It searches the most proving child until the numbers of
+   the position pass the thresholds or it is solved, giving the child
+   thresholds such that it returns as soon as another child becomes more
+   proving, and returns the numbers it ends with */
+pns_value pns_mid(pns_thread* t, key_pair k, uint64_t key, unsigned int ply,
+                  uint32_t thpn, uint32_t thdn) {
+    pns_solver* s = t->s;
+    pns_value v;
+    if (++t->nodes % PNS_CHECK_NODES == 0) {
+        pns_check(t);
+    }
+    if (ply >= PNS_MAX_PLY) {
+        __atomic_store_n(&s->ply_limit, true, __ATOMIC_RELAXED);
+        v.pn = t->draw_ok ? 0 : PNS_INFINITY;
+        v.dn = t->draw_ok ? PNS_INFINITY : 0;
+        v.loop = 0;
+        v.depth = ply + 1;
+        return v;
+    }
+    unsigned long long start = t->nodes;
+    t->path[ply] = key;
+    bool attacker_moves = (t->g->player == BLACKS_TURN) ==
+                          (t->attacker == BLACK);
+    pns_child children[t->g->b->width + 2];
+    unsigned int n = pns_children(t, k, ply, children);
+    if (s->threads > 1) {
+        pns_enter(s, key, ply);
+    }
+    for (;;) {
+        v = pns_numbers(children, n, attacker_moves, ply);
+        if (ply == 0) {
+            __atomic_store_n(&s->root_pn, v.pn, __ATOMIC_RELAXED);
+            __atomic_store_n(&s->root_dn, v.dn, __ATOMIC_RELAXED);
+        }
+        if (v.pn == 0 || v.dn == 0 || v.pn >= thpn || v.dn >= thdn ||
+            t->aborted) {
+            break;
+        }
+        uint32_t second;
+        unsigned int i = pns_select(t, children, n, attacker_moves, ply,
+                                    &second);
+        pns_child* c = &children[i];
+        uint32_t cthpn, cthdn;
+        if (attacker_moves) {
+            cthpn = thpn < pns_add(second, 1) ? thpn : pns_add(second, 1);
+            cthpn = cthpn > c->pn ? cthpn : pns_add(c->pn, 1);
+            cthdn = pns_sum_threshold(thdn, v.dn, c->dn);
+        } else {
+            cthdn = thdn < pns_add(second, 1) ? thdn : pns_add(second, 1);
+            cthdn = cthdn > c->dn ? cthdn : pns_add(c->dn, 1);
+            cthpn = pns_sum_threshold(thpn, v.pn, c->pn);
+        }
+        pns_value cv = pns_search_child(t, c, ply, cthpn, cthdn);
+        c->pn = cv.pn;
+        c->dn = cv.dn;
+        c->loop = cv.loop;
+        c->depth = cv.depth;
+    }
+    bool solved = v.pn == 0 || v.dn == 0;
+    pns_store(s, key, v, solved && v.loop != PNS_NO_LOOP,
+              t->nodes - start + 1, s->threads > 1);
+    return v;
+}
+
+/* This is the thread routine of a solve. Every thread searches the root
+   until it is solved or the search is stopped, and the first to solve it
+   stops the others and records whether the goal was proved, as the
+   numbers of the root may still be overwritten by threads finishing */
+void* pns_routine(void* arg) {
+    pns_thread* t = (pns_thread*)arg;
+    pns_solver* s = t->s;
+    key_pair k = game_key_pair(t->g);
+    bool mirrored;
+    uint64_t key = canonical_key(k, &mirrored) ^ t->salt;
+    trace_begin("pns_search");
+    pns_value v = pns_mid(t, k, key, 0, PNS_INFINITY, PNS_INFINITY);
+    pns_check(t);
+    trace_end("pns_search");
+    bool expected = false;
+    if (!t->aborted && (v.pn == 0 || v.dn == 0) &&
+        __atomic_compare_exchange_n(&s->done, &expected, true, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        s->proved = v.pn == 0;
+    }
+    return NULL;
+}
+
+/* This helper function forgets the plies the positions of the table were
+   searched at, which only mean something for the root they were searched
+   from */
+void pns_reset_depths(pns_solver* s) {
+    for (size_t i = 0; i < s->capacity; i++) {
+        if (s->entries[i].depth) {
+            s->entries[i].depth = UINT16_MAX;
+        }
+    }
+}
+
+/* This helper function runs one search of a solve on every thread: for a
+   win of the player to move, or with draw_ok for at least a draw */
+void pns_run(pns_solver* s, game* g, bool draw_ok) {
+    pns_reset_depths(s);
+    unsigned int threads = s->threads;
+    pthread_t ids[threads];
+    pns_thread* ts = (pns_thread*)malloc(threads * sizeof(pns_thread));
+    check_malloc(ts);
+    s->done = false;
+    s->draw_search = draw_ok;
+    cell attacker = g->player == BLACKS_TURN ? BLACK : WHITE;
+    for (unsigned int i = 0; i < threads; i++) {
+        pns_thread* t = &ts[i];
+        t->s = s;
+        t->g = pns_copy_game(g);
+        t->id = i;
+        t->attacker = attacker;
+        t->draw_ok = draw_ok;
+        t->aborted = false;
+        t->salt = mix64(1 + (attacker == WHITE) + 2 * draw_ok);
+        t->nodes = t->counted = 0;
+        pthread_create(&ids[i], NULL, pns_routine, t);
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        game_free(ts[i].g);
+    }
+    free(ts);
+}
+
+tb_result pns_solve(pns_solver* s, game* g, unsigned int threads,
+                    unsigned int time_ms, pns_report_fn report, void* arg,
+                    pns_stats* out) {
+    check_null_pointer(g);
+    s->start_ns = now_ns();
+    s->deadline_ns = time_ms ? s->start_ns + time_ms * 1000000ull : 0;
+    s->report_ns = s->start_ns + 1000000000ull;
+    s->report = report;
+    s->arg = arg;
+    s->threads = threads ? threads : 1;
+    s->stop = false;
+    s->ply_limit = false;
+    s->nodes = 0;
+    s->root_pn = s->root_dn = 1;
+    tb_result r = TB_UNKNOWN;
+    outcome o = game_outcome(g);
+    if (o != IN_PROGRESS) {
+        outcome won = g->player == BLACKS_TURN ? BLACK_WIN : WHITE_WIN;
+        r = o == DRAW ? TB_DRAW : o == won ? TB_WIN : TB_LOSS;
+        s->root_pn = 0;
+        s->root_dn = PNS_INFINITY;
+    } else {
+        for (unsigned int draw_ok = 0; draw_ok < 2; draw_ok++) {
+            pns_run(s, g, draw_ok);
+            if (!s->done) {
+                break;
+            }
+            s->root_pn = s->proved ? 0 : PNS_INFINITY;
+            s->root_dn = s->proved ? PNS_INFINITY : 0;
+            if (s->proved) {
+                r = draw_ok ? TB_DRAW : TB_WIN;
+                break;
+            } else if (draw_ok) {
+                r = TB_LOSS;
+            }
+        }
+    }
+    if (out) {
+        out->result = r;
+        out->pn = s->root_pn;
+        out->dn = s->root_dn;
+        out->nodes = s->nodes;
+        out->seconds = (now_ns() - s->start_ns) / 1e9;
+        out->gc_runs = s->gc_runs;
+        out->ply_limit = s->ply_limit;
+    }
+    return r;
+}
+
+void pns_share(pns_solver* s, shared_table* t) {
+    s->shared = t;
+}
+
+void pns_stop(pns_solver* s) {
+    __atomic_store_n(&s->stop, true, __ATOMIC_RELAXED);
+}
+
+void pns_free(pns_solver* s) {
+    for (unsigned int i = 0; i < PNS_LOCKS; i++) {
+        pthread_mutex_destroy(&s->locks[i]);
+    }
+    pthread_mutex_destroy(&s->gc_lock);
+    free(s->entries);
+    free(s);
+}
@@ -0,0 +1,213 @@
+#ifndef PNS_H
+#define PNS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "hash.h"
+#include "shared.h"
+#include "tb.h"
+
+/* The proof-number solver finds the exact result of a position, for boards
+   too large for a tablebase and games too long for alpha-beta, with a
+   depth-first proof-number search (df-pn).
+ * A search tries to prove a goal for the player to move at the root, the
+   attacker. The proof number of a position is the least number of
+   positions still to be solved to prove the goal there, the disproof
+   number the least number to show that it cannot be reached. Positions
+   where the attacker moves need one move to succeed and all of them to
+   fail, positions where the defender moves the other way round. The
+   search always follows the most proving position, and only comes back up
+   once its numbers pass thresholds set by its siblings, so that it keeps
+   nothing but the current line in memory.
+ * Results are relative to the player to move, as in the tablebase: a first
+   search proves a win or not, and if not a second one proves a draw or a
+   loss. Endless games, which disarray makes possible, are draws, so a
+   position repeating one on the current line counts as a draw. Such a
+   result depends on the line it was found on, so it is passed up until
+   the search is back at the repeated position, where it no longer does,
+   and only stored from there.
+ * The table turns the tree into a graph with cycles, around which the
+   sums of numbers could grow without end while nothing new is searched.
+   Entries remember the least ply their position was searched at, and a
+   child first met shallower than its parent, maybe one of its ancestors,
+   counts in the sum only through the largest such child.
+ * Numbers are cached in a table of fixed size shared by every thread,
+   under canonical keys (see hash.h) salted with the goal. Entries
+   remember how many positions were searched below them. A new position
+   replaces the entry of its bucket with the least work, and when the
+   table is nearly full, garbage collection clears every entry with less
+   work than about half of them, so that what is kept is what would take
+   longest to search again.
+ * Threads search the same root. Each position counts the threads inside
+   it, and a thread choosing where to go within PNS_SPREAD_PLY plies of
+   the root counts a position's numbers as many times larger as there are
+   other threads in it, so that threads spread over the most proving
+   positions rather than all following the same line. Deeper down they
+   follow the numbers alone: threads steering around each other there can
+   keep each other from ever finishing the positions they share.
+ * Results that depend on a repetition of the current line are never
+   stored, so nothing tells a thread that another has already searched
+   such a subtree: two threads can each search it in full, even within
+   PNS_SPREAD_PLY plies of the root.
+ * Solvers in different processes can also share the positions they
+   solve through a shared table (see shared.h) */
+
+#define PNS_INFINITY 0x7FFFFFFFu
+#define PNS_BUCKET 4
+#define PNS_LOCKS 4096
+#define PNS_GC_LOAD 0.9
+#define PNS_GC_SHARE 0.5
+#define PNS_GC_SAMPLES 4096
+#define PNS_MAX_PLY 1024
+#define PNS_CHECK_NODES 4096
+#define PNS_SPREAD_PLY 4
+
+struct pns_entry {
+    uint64_t key;
+    uint32_t pn, dn, work;
+    uint16_t busy, depth;
+};
+
+typedef struct pns_entry pns_entry;
+
+
+struct pns_progress {
+    bool draw_search;
+    uint32_t pn, dn;
+    unsigned long long nodes;
+    double seconds;
+    size_t entries;
+    unsigned int gc_runs;
+};
+
+typedef struct pns_progress pns_progress;
+
+
+/* A progress callback receives the numbers of the root in the running
+   search, whether it is the second, draw or loss, search, the positions
+   searched so far, the time taken, the number of entries in the table and
+   the number of garbage collections, and the callback's argument */
+typedef void (*pns_report_fn)(const pns_progress* p, void* arg);
+
+
+struct pns_stats {
+    tb_result result;
+    uint32_t pn, dn;
+    unsigned long long nodes;
+    double seconds;
+    unsigned int gc_runs;
+    bool ply_limit;
+};
+
+typedef struct pns_stats pns_stats;
+
+
+struct pns_solver {
+    pns_entry* entries;
+    size_t bucket_mask, count, capacity;
+    pthread_mutex_t locks[PNS_LOCKS];
+    pthread_mutex_t gc_lock;
+    unsigned int gc_runs, threads;
+    uint64_t start_ns, deadline_ns, report_ns;
+    bool stop, done, proved, ply_limit;
+    unsigned long long nodes;
+    uint32_t root_pn, root_dn;
+    bool draw_search;
+    pns_report_fn report;
+    void* arg;
+    shared_table* shared;
+};
+
+typedef struct pns_solver pns_solver;
+
+
+/**
+ * pns_new
+ *
+ * Creates a solver with an empty table.
+ *
+ * Parameters:
+ *   - tt_bytes: The size of the table, rounded down to a power of two
+ *      number of buckets.
+ *
+ * Returns:
+ *   - A pointer to the new `pns_solver`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `pns_free`.
+ *   - Raises an error if memory allocation fails.
+ */
+pns_solver* pns_new(size_t tt_bytes);
+
+/**
+ * pns_solve
+ *
+ * Finds the result of a position for the player to move.
+ *
+ * Parameters:
+ *   - s: A pointer to the `pns_solver`. Its table is kept between solves,
+ *      so positions of the same configuration benefit from earlier ones.
+ *   - g: A pointer to the `game` structure. It is not modified.
+ *   - threads: The number of threads searching.
+ *   - time_ms: The time budget in milliseconds, 0 for no limit other than
+ *      `pns_stop`.
+ *   - report: Called about once a second with the progress of the search,
+ *      from one of the searching threads. May be NULL.
+ *   - arg: The argument passed to report.
+ *   - out: Out-parameter receiving the result, the final numbers of the
+ *      root, the positions searched and the time taken. May be NULL.
+ *
+ * Returns:
+ *   - TB_WIN, TB_LOSS or TB_DRAW, TB_UNKNOWN if the search was stopped.
+ *      A finished game gets its outcome for the player to move.
+ *
+ * Note:
+ *   - Lines are followed PNS_MAX_PLY plies deep at most, past which a
+ *      position counts as a draw, like a repetition; `ply_limit` in out
+ *      tells whether that happened, in which case a win may have been 
+ *      missed or a loss taken for a draw.
+ */
+tb_result pns_solve(pns_solver* s, game* g, unsigned int threads,
+                    unsigned int time_ms, pns_report_fn report, void* arg,
+                    pns_stats* out);
+
+/**
+ * pns_share
+ *
+ * Makes a solver publish the positions it solves to a shared table, and
+ *  look up there those it does not know.
+ *
+ * Parameters:
+ *   - s: A pointer to the `pns_solver`.
+ *   - t: A pointer to the `shared_table`, or NULL to stop sharing. It must
+ *      outlive the solves.
+ *
+ * Note:
+ *   - Only results that do not depend on the line they were found on are
+ *      shared, under the same keys as in the solver's own table, so the
+ *      solvers sharing a table must solve positions of one configuration.
+ */
+void pns_share(pns_solver* s, shared_table* t);
+
+/**
+ * pns_stop
+ *
+ * Makes a running solve return as soon as possible. Safe to call from any
+ *  thread.
+ *
+ * Parameters:
+ *   - s: A pointer to the `pns_solver`.
+ */
+void pns_stop(pns_solver* s);
+
+/**
+ * pns_free
+ *
+ * Frees the solver and its table.
+ *
+ * Parameters:
+ *   - s: A pointer to the `pns_solver`.
+ */
+void pns_free(pns_solver* s);
+
+#endif /* PNS_H */
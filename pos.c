@@ -1,3 +1,4 @@
+#include <time.h>
 #include "pos.h"
 
 void check_malloc(void* p) {
@@ -14,6 +15,12 @@ void check_null_pointer(void* p) {
     }
 }
 
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 pos make_pos(unsigned int r, unsigned int c) {
     pos p;
     p.r = r;
@@ -27,9 +34,38 @@ posqueue* posqueue_new() {
     q->head = NULL;
     q->tail = NULL;
     q->len = 0;
+    q->slab = NULL;
+    q->slab_len = 0;
+    return q;
+}
+
+posqueue* posqueue_from_array(const pos* ps, unsigned int len) {
+    posqueue* q = posqueue_new();
+    if (len == 0) {
+        return q;
+    }
+    pq_entry* slab = (pq_entry*)malloc(sizeof(pq_entry) * len);
+    check_malloc(slab);
+    for (unsigned int i = 0; i < len; i++) {
+        slab[i].p = ps[i];
+        slab[i].prev = i ? &slab[i - 1] : NULL;
+        slab[i].next = i + 1 < len ? &slab[i + 1] : NULL;
+    }
+    q->head = slab;
+    q->tail = &slab[len - 1];
+    q->len = len;
+    q->slab = slab;
+    q->slab_len = len;
     return q;
 }
 
+/* This helper function frees an entry unless it lives in the queue's slab */
+void free_entry(posqueue* q, pq_entry* e) {
+    if (q->slab == NULL || e < q->slab || e >= q->slab + q->slab_len) {
+        free(e);
+    }
+}
+
 void pos_enqueue(posqueue* q, pos p) {
     check_null_pointer(q);
     pq_entry* added_pos = (pq_entry*)malloc(sizeof(pq_entry));
@@ -53,7 +89,7 @@ pos pos_dequeue(posqueue* q) {
     pos res = q->head->p;
     pq_entry* tmp = q->head;
     q->head = q->head->next;
-    free(tmp);
+    free_entry(q, tmp);
     if (q->head == NULL) {
         q->tail = NULL;
     } else {
@@ -69,7 +105,7 @@ pos posqueue_remback(posqueue* q) {
     pos res = q->tail->p;
     pq_entry* tmp = q->tail;
     q->tail = q->tail->prev;
-    free(tmp);
+    free_entry(q, tmp);
     if (q->tail == NULL) {
         q->head = NULL;
     } else {
@@ -84,8 +120,9 @@ void posqueue_free(posqueue* q) {
     while(q->head) {
         tmp = q->head;
         q->head = q->head->next;
-        free(tmp);
+        free_entry(q, tmp);
     }
+    free(q->slab);
     free(q);
 }
 
@@ -1,6 +1,7 @@
 #ifndef POS_H
 #define POS_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -19,9 +20,14 @@ struct pq_entry {
 };
 
 
+/* Entries normally come from one malloc each. A queue built by 
+   posqueue_from_array instead keeps its initial entries in the single block 
+   slab, which is only released by posqueue_free */
 struct posqueue {
     pq_entry *head, *tail;
     unsigned int len;
+    pq_entry* slab;
+    unsigned int slab_len;
 };
 
 typedef struct posqueue posqueue;
@@ -59,6 +65,26 @@ pos make_pos(unsigned int r, unsigned int c);
 posqueue* posqueue_new();
 
 
+/**
+ * posqueue_from_array
+ * 
+ * Creates a position queue holding the given positions, with a single 
+ *  allocation for all of their entries.
+ * 
+ * Parameters:
+ *   - ps: The positions, front of the queue first.
+ *   - len: The number of positions.
+ * 
+ * Returns:
+ *   - A pointer to the newly created `posqueue` structure.
+ * 
+ * Note:
+ *   - The queue behaves exactly like one filled with `pos_enqueue`, and the 
+ *      caller is responsible for freeing it using `posqueue_free`.
+ */
+posqueue* posqueue_from_array(const pos* ps, unsigned int len);
+
+
 /**
  * pos_enqueue
  * 
@@ -147,4 +173,9 @@ void check_malloc(void* p);
 void check_null_pointer(void* p);
 
 
+/* General-purpose function to be used across files
+   It returns the time of the monotonic clock in nanoseconds */
+uint64_t now_ns();
+
+
 #endif /* POS_H */
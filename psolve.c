@@ -0,0 +1,122 @@
+#include <string.h>
+#include <unistd.h>
+#include "split.h"
+
+/* Solves a position of a configuration with worker processes, one per
+   core by default, sharing their results through shared memory. The
+   position is the empty board, or the one reached by the moves given
+   with -p, as for solve. -d sets the number of plies from the position to
+   the jobs, -M the size of the table of each worker and -S that of the
+   shared table, in megabytes. With -f, results are kept in a progress
+   file, from which a solve that was interrupted carries on */
+
+struct psolve_options {
+    split_options split;
+    unsigned int table_mb, shared_mb;
+};
+
+typedef struct psolve_options psolve_options;
+
+/* This helper function prints the usage line and exits */
+void psolve_usage() {
+    fprintf(stderr, "Usage: psolve -w <width> -h <height> -r <run> "
+                    "[-j <workers>] [-d <depth>] [-M <megabytes>] "
+                    "[-S <megabytes>] [-p \"<moves>\"] [-f <progress>]\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+   By default there is a worker per core, with a table of 256 MB each, and
+   the shared table takes 1024 MB */
+void parse_psolve_arguments(int argc, char** argv, psolve_options* opts) {
+    memset(opts, 0, sizeof(psolve_options));
+    split_options* s = &opts->split;
+    s->workers = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->table_mb = 256;
+    opts->shared_mb = 1024;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            psolve_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'w':
+                s->width = v;
+                break;
+            case 'h':
+                s->height = v;
+                break;
+            case 'r':
+                s->run = v;
+                break;
+            case 'j':
+                s->workers = v;
+                break;
+            case 'd':
+                s->depth = v;
+                break;
+            case 'M':
+                opts->table_mb = v;
+                break;
+            case 'S':
+                opts->shared_mb = v;
+                break;
+            case 'p':
+                s->moves = argv[i + 1];
+                break;
+            case 'f':
+                s->progress = argv[i + 1];
+                break;
+            default:
+                psolve_usage();
+        }
+        i++;
+    }
+    if (s->run == 0 || s->width == 0 || s->height == 0 ||
+        s->workers == 0 || s->depth > SPLIT_MAX_DEPTH) {
+        psolve_usage();
+    }
+    s->table_bytes = (size_t)opts->table_mb << 20;
+    s->shared_bytes = (size_t)opts->shared_mb << 20;
+}
+
+static const char* psolve_names[] = {"unknown", "a win", "a loss", "a draw"};
+
+/* This is the event callback of the solve */
+void print_event(const split_event* e, void* arg) {
+    (void)arg;
+    if (e->crashed) {
+        printf("[%u/%u] %s: worker died\n", e->finished, e->jobs, e->path);
+    } else if (e->resumed) {
+        printf("[%u/%u] %s: %s, from the progress file\n", e->finished,
+               e->jobs, e->path, psolve_names[e->result]);
+    } else {
+        printf("[%u/%u] %s: %s, %llu nodes in %.3f s\n", e->finished,
+               e->jobs, e->path, psolve_names[e->result], e->nodes,
+               e->seconds);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    psolve_options opts;
+    parse_psolve_arguments(argc, argv, &opts);
+    split_stats stats;
+    if (!split_solve(&opts.split, print_event, NULL, &stats)) {
+        fprintf(stderr, "Illegal moves, or a progress file that cannot be "
+                        "opened or belongs to another solve\n");
+        return 1;
+    }
+    game* g = new_game(opts.split.run, opts.split.width, opts.split.height,
+                       BITS);
+    split_play(g, opts.split.moves ? opts.split.moves : "");
+    printf("%s to move: %s\n", g->player == BLACKS_TURN ? "Black" : "White",
+           psolve_names[stats.result]);
+    printf("%u jobs at depth %u: %u solved, %u resumed, %u skipped, "
+           "%u failed, %u workers died\n", stats.jobs, stats.depth,
+           stats.solved, stats.resumed, stats.skipped, stats.failed,
+           stats.crashes);
+    printf("%llu nodes in %.3f s\n", stats.nodes, stats.seconds);
+    game_free(g);
+    return 0;
+}
@@ -0,0 +1,433 @@
+#include "record.h"
+
+/* Size of the little-endian index offset at the end of the header */
+#define RECORD_INDEX_SLOT 8
+
+/* This helper function returns the number of bits needed per move on a board
+   of the given width, that is the smallest b such that 2^b >= width + 3 */
+unsigned int record_bits_for_width(unsigned int width) {
+    unsigned int bits = 1;
+    while (((uint64_t)1 << bits) < (uint64_t)width + RECORD_DROP) {
+        bits++;
+    }
+    return bits;
+}
+
+/* This helper function makes room for n more bytes in the writer's buffer */
+void record_reserve(record_writer* w, size_t n) {
+    if (w->buf_len + n <= w->buf_cap) {
+        return;
+    }
+    while (w->buf_len + n > w->buf_cap) {
+        w->buf_cap *= 2;
+    }
+    w->buf = (unsigned char*)realloc(w->buf, w->buf_cap);
+    check_malloc(w->buf);
+}
+
+/* This helper function appends v to the writer's buffer as a LEB128
+   varint: seven bits per byte, high bit set on every byte but the last */
+void record_put_varint(record_writer* w, uint64_t v) {
+    record_reserve(w, 10);
+    while (v >= 0x80) {
+        w->buf[w->buf_len++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    w->buf[w->buf_len++] = v;
+}
+
+/* This helper function appends the n low bits of value to the stream,
+   least significant bit first */
+void record_put_bits(record_writer* w, uint64_t value, unsigned int n) {
+    w->acc |= value << w->acc_bits;
+    w->acc_bits += n;
+    record_reserve(w, 8);
+    while (w->acc_bits >= 8) {
+        w->buf[w->buf_len++] = w->acc & 0xFF;
+        w->acc >>= 8;
+        w->acc_bits -= 8;
+    }
+}
+
+/* This helper function pads the move stream with zero bits up to the next
+   byte boundary */
+void record_align_bits(record_writer* w) {
+    if (w->acc_bits) {
+        record_put_bits(w, 0, 8 - w->acc_bits);
+    }
+}
+
+/* This helper function appends the positions of a queue as varints */
+void record_put_queue(record_writer* w, posqueue* q) {
+    unsigned int width = w->g->b->width;
+    for (pq_entry* e = q->head; e; e = e->next) {
+        record_put_varint(w, (uint64_t)e->p.r * width + e->p.c);
+    }
+}
+
+/* This helper function appends a keyframe of the attached game and adds its
+   offset to the index */
+void record_put_keyframe(record_writer* w) {
+    record_align_bits(w);
+    if (w->num_keyframes == w->keyframes_cap) {
+        w->keyframes_cap *= 2;
+        w->keyframes = (uint64_t*)realloc(w->keyframes,
+                                          sizeof(uint64_t) * w->keyframes_cap);
+        check_malloc(w->keyframes);
+    }
+    w->keyframes[w->num_keyframes++] = w->buf_len;
+    game* g = w->g;
+    record_put_varint(w, g->player);
+    record_put_varint(w, g->black_queue->len);
+    record_put_varint(w, g->white_queue->len);
+    record_put_queue(w, g->black_queue);
+    record_put_queue(w, g->white_queue);
+}
+
+record_writer* record_writer_new(FILE* f, game* g,
+                                 unsigned int keyframe_interval) {
+    check_null_pointer(f);
+    check_null_pointer(g);
+    if (g->black_queue->len || g->white_queue->len ||
+        g->player != BLACKS_TURN) {
+        fprintf(stderr, "Only new games can be recorded\n");
+        exit(1);
+    }
+    record_writer* w = (record_writer*)malloc(sizeof(record_writer));
+    check_malloc(w);
+    w->f = f;
+    w->g = g;
+    w->bits_per_move = record_bits_for_width(g->b->width);
+    w->keyframe_interval = keyframe_interval;
+    w->acc = 0;
+    w->acc_bits = 0;
+    w->buf_cap = 256;
+    w->buf_len = 0;
+    w->buf = (unsigned char*)malloc(w->buf_cap);
+    check_malloc(w->buf);
+    w->keyframes_cap = 16;
+    w->num_keyframes = 0;
+    w->keyframes = (uint64_t*)malloc(sizeof(uint64_t) * w->keyframes_cap);
+    check_malloc(w->keyframes);
+    w->moves = 0;
+    w->buf[w->buf_len++] = RECORD_MAGIC;
+    w->buf[w->buf_len++] = (RECORD_VERSION << 4) | g->b->type;
+    record_put_varint(w, g->b->width);
+    record_put_varint(w, g->b->height);
+    record_put_varint(w, g->run);
+    record_put_varint(w, keyframe_interval);
+    record_reserve(w, RECORD_INDEX_SLOT);
+    w->index_slot = w->buf_len;
+    w->buf_len += RECORD_INDEX_SLOT;
+    return w;
+}
+
+bool record_play(record_writer* w, move m) {
+    check_null_pointer(w);
+    if (!play_move(w->g, m)) {
+        return false;
+    }
+    uint64_t code;
+    if (m.kind == MOVE_OFFSET) {
+        code = RECORD_OFFSET;
+    } else if (m.kind == MOVE_DISARRAY) {
+        code = RECORD_DISARRAY;
+    } else {
+        code = (uint64_t)RECORD_DROP + m.column;
+    }
+    record_put_bits(w, code, w->bits_per_move);
+    w->moves++;
+    if (w->keyframe_interval && w->moves % w->keyframe_interval == 0) {
+        record_put_keyframe(w);
+    }
+    return true;
+}
+
+void record_writer_finish(record_writer* w) {
+    check_null_pointer(w);
+    record_put_bits(w, RECORD_END, w->bits_per_move);
+    record_align_bits(w);
+    uint64_t index_offset = w->buf_len, prev = 0;
+    record_put_varint(w, w->num_keyframes);
+    for (size_t i = 0; i < w->num_keyframes; i++) {
+        record_put_varint(w, w->keyframes[i] - prev);
+        prev = w->keyframes[i];
+    }
+    for (unsigned int i = 0; i < RECORD_INDEX_SLOT; i++) {
+        w->buf[w->index_slot + i] = index_offset >> (8 * i);
+    }
+    if (fwrite(w->buf, 1, w->buf_len, w->f) != w->buf_len) {
+        fprintf(stderr, "Could not write game record\n");
+        exit(1);
+    }
+    fflush(w->f);
+    free(w->keyframes);
+    free(w->buf);
+    free(w);
+}
+
+/* This helper function discards the reader's buffered state and moves its
+   stream to the given offset */
+void record_reposition(record_reader* r, long offset) {
+    if (fseek(r->f, offset, SEEK_SET) != 0) {
+        fprintf(stderr, "Could not seek in game record\n");
+        exit(1);
+    }
+    r->buf_start = offset;
+    r->buf_len = 0;
+    r->buf_pos = 0;
+    r->acc = 0;
+    r->acc_bits = 0;
+    r->in_game = false;
+}
+
+record_reader* record_reader_new(FILE* f) {
+    check_null_pointer(f);
+    record_reader* r = (record_reader*)malloc(sizeof(record_reader));
+    check_malloc(r);
+    r->f = f;
+    r->version = 0;
+    r->bits_per_move = 0;
+    r->width = 0;
+    r->keyframe_interval = 0;
+    r->acc = 0;
+    r->acc_bits = 0;
+    r->buf_len = 0;
+    r->buf_pos = 0;
+    r->buf_start = ftell(f);
+    r->game_start = r->buf_start;
+    r->index_offset = 0;
+    r->moves = 0;
+    r->in_game = false;
+    return r;
+}
+
+/* This helper function returns the next byte of the stream, refilling the
+   buffer when it runs out, or -1 at the end of the stream */
+int record_next_byte(record_reader* r) {
+    if (r->buf_pos == r->buf_len) {
+        r->buf_start += r->buf_len;
+        r->buf_len = fread(r->buf, 1, RECORD_BUF_SIZE, r->f);
+        r->buf_pos = 0;
+        if (r->buf_len == 0) {
+            return -1;
+        }
+    }
+    return r->buf[r->buf_pos++];
+}
+
+/* This helper function returns the next byte of the stream and raises an
+   error if there is none */
+unsigned char record_need_byte(record_reader* r) {
+    int byte = record_next_byte(r);
+    if (byte < 0) {
+        fprintf(stderr, "Truncated game record\n");
+        exit(1);
+    }
+    return byte;
+}
+
+/* This helper function reads the next n bits of the move stream */
+uint64_t record_get_bits(record_reader* r, unsigned int n) {
+    while (r->acc_bits < n) {
+        r->acc |= (uint64_t)record_need_byte(r) << r->acc_bits;
+        r->acc_bits += 8;
+    }
+    uint64_t v = r->acc & (((uint64_t)1 << n) - 1);
+    r->acc >>= n;
+    r->acc_bits -= n;
+    return v;
+}
+
+/* This helper function reads a LEB128 varint written by record_put_varint */
+uint64_t record_get_varint(record_reader* r) {
+    uint64_t v = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = record_need_byte(r);
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return v;
+        }
+    }
+    fprintf(stderr, "Corrupt game record\n");
+    exit(1);
+}
+
+/* This helper function reads the queues of a keyframe into an empty game,
+   placing the pieces on the board as it goes */
+void record_get_keyframe(record_reader* r, game* g) {
+    g->player = record_get_varint(r) ? WHITES_TURN : BLACKS_TURN;
+    uint64_t black_len = record_get_varint(r), white_len = record_get_varint(r);
+    for (uint64_t i = 0; i < black_len + white_len; i++) {
+        uint64_t index = record_get_varint(r);
+        pos p = make_pos(index / r->width, index % r->width);
+        if (i < black_len) {
+            pos_enqueue(g->black_queue, p);
+            board_set(g->b, p, BLACK);
+        } else {
+            pos_enqueue(g->white_queue, p);
+            board_set(g->b, p, WHITE);
+        }
+    }
+}
+
+/* This helper function skips over a keyframe in the move stream */
+void record_skip_keyframe(record_reader* r) {
+    record_get_varint(r);
+    uint64_t len = record_get_varint(r) + record_get_varint(r);
+    for (uint64_t i = 0; i < len; i++) {
+        record_get_varint(r);
+    }
+}
+
+/* This helper function moves the reader to the given offset, within its
+   buffer when the offset is in it */
+void record_skip_to(record_reader* r, long offset) {
+    if (offset >= r->buf_start && offset <= r->buf_start + (long)r->buf_len) {
+        r->buf_pos = offset - r->buf_start;
+        r->acc = 0;
+        r->acc_bits = 0;
+        r->in_game = false;
+    } else {
+        record_reposition(r, offset);
+    }
+}
+
+game* record_next_game(record_reader* r) {
+    check_null_pointer(r);
+    move m;
+    if (r->in_game && r->version >= 2) {
+        record_skip_to(r, r->game_start + r->index_offset);
+    }
+    while (r->in_game) {
+        record_next_move(r, &m);
+    }
+    if (r->version >= 2) {
+        uint64_t num_keyframes = record_get_varint(r);
+        for (uint64_t i = 0; i < num_keyframes; i++) {
+            record_get_varint(r);
+        }
+    }
+    r->game_start = r->buf_start + r->buf_pos;
+    int magic = record_next_byte(r);
+    if (magic < 0) {
+        return NULL;
+    }
+    unsigned char version = record_need_byte(r);
+    r->version = version >> 4;
+    if (magic != RECORD_MAGIC || r->version < 1 ||
+        r->version > RECORD_VERSION || (version & 0xF) > SPARSE) {
+        fprintf(stderr, "Corrupt game record header\n");
+        exit(1);
+    }
+    r->width = record_get_varint(r);
+    unsigned int height = record_get_varint(r), run = record_get_varint(r);
+    r->keyframe_interval = 0;
+    r->index_offset = 0;
+    if (r->version >= 2) {
+        r->keyframe_interval = record_get_varint(r);
+        for (unsigned int i = 0; i < RECORD_INDEX_SLOT; i++) {
+            r->index_offset |= (uint64_t)record_need_byte(r) << (8 * i);
+        }
+    }
+    r->bits_per_move = record_bits_for_width(r->width);
+    r->moves = 0;
+    r->in_game = true;
+    return new_game(run, r->width, height, version & 0xF);
+}
+
+bool record_next_move(record_reader* r, move* out) {
+    check_null_pointer(r);
+    if (!r->in_game) {
+        return false;
+    }
+    uint64_t code = record_get_bits(r, r->bits_per_move);
+    switch (code) {
+        case RECORD_END:
+            r->in_game = false;
+            r->acc = 0;
+            r->acc_bits = 0;
+            return false;
+        case RECORD_OFFSET:
+            *out = make_move(MOVE_OFFSET, 0);
+            break;
+        case RECORD_DISARRAY:
+            *out = make_move(MOVE_DISARRAY, 0);
+            break;
+        default:
+            *out = make_move(MOVE_DROP, code - RECORD_DROP);
+    }
+    r->moves++;
+    if (r->keyframe_interval && r->moves % r->keyframe_interval == 0) {
+        r->acc = 0;
+        r->acc_bits = 0;
+        record_skip_keyframe(r);
+    }
+    return true;
+}
+
+unsigned long long record_replay(record_reader* r, game* g) {
+    check_null_pointer(g);
+    unsigned long long n = 0;
+    move m;
+    while (record_next_move(r, &m)) {
+        if (!play_move(g, m)) {
+            fprintf(stderr, "Game record does not match the game\n");
+            exit(1);
+        }
+        n++;
+    }
+    return n;
+}
+
+long record_game_offset(record_reader* r) {
+    check_null_pointer(r);
+    return r->game_start;
+}
+
+game* record_seek(record_reader* r, long game_offset,
+                  unsigned long long move_number) {
+    check_null_pointer(r);
+    record_reposition(r, game_offset);
+    r->version = 0;
+    game* g = record_next_game(r);
+    if (g == NULL) {
+        fprintf(stderr, "No game at this offset of the game record\n");
+        exit(1);
+    }
+    unsigned long long keyframe = 0;
+    if (r->keyframe_interval) {
+        keyframe = move_number / r->keyframe_interval;
+    }
+    if (keyframe > 0) {
+        long moves_start = r->buf_start + r->buf_pos;
+        record_reposition(r, game_offset + r->index_offset);
+        uint64_t num_keyframes = record_get_varint(r), offset = 0;
+        if (keyframe > num_keyframes) {
+            keyframe = num_keyframes;
+        }
+        for (uint64_t i = 0; i < keyframe; i++) {
+            offset += record_get_varint(r);
+        }
+        if (keyframe > 0) {
+            record_reposition(r, game_offset + offset);
+            record_get_keyframe(r, g);
+        } else {
+            record_reposition(r, moves_start);
+        }
+        r->moves = keyframe * r->keyframe_interval;
+        r->in_game = true;
+    }
+    move m;
+    while (r->moves < move_number && record_next_move(r, &m)) {
+        if (!play_move(g, m)) {
+            fprintf(stderr, "Game record does not match the game\n");
+            exit(1);
+        }
+    }
+    return g;
+}
+
+void record_reader_free(record_reader* r) {
+    free(r);
+}
@@ -0,0 +1,240 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include "logic.h"
+
+/* A record file is a sequence of games. Each game starts with a short
+   header: the magic byte 'T', a byte holding the version in its high four
+   bits and the representation in its low four, then width, height, run and
+   the keyframe interval as LEB128 varints, and finally the offset of the
+   game's keyframe index from the start of the game as a little-endian 
+   64-bit value. It is followed by a bit-packed move stream.
+ * Every move takes ceil(log2(width + 3)) bits: 0 ends the game, 1 is an
+   offset, 2 a disarray and 3 + c a drop into column c. A 7-wide board thus
+   costs 4 bits per move.
+ * With a keyframe interval k > 0, the stream is padded to a byte boundary
+   after every k moves and a keyframe is inserted: the player to move, the 
+   lengths of both queues, then every queued position as the varint 
+   r * width + c, black queue first, oldest first. The board is implied by 
+   the queues.
+ * After the end code the stream is padded again and the keyframe index 
+   follows: the number of keyframes, then the offset of each one from the 
+   start of the game as varint deltas. The index also marks the end of the 
+   game, so whole games can be skipped without decoding them.
+ * Version 1 records, which have neither keyframes nor an index, can still 
+   be read sequentially */
+
+#define RECORD_MAGIC 'T'
+#define RECORD_VERSION 2
+#define RECORD_BUF_SIZE 65536
+
+enum record_code {
+    RECORD_END,
+    RECORD_OFFSET,
+    RECORD_DISARRAY,
+    RECORD_DROP
+};
+
+
+struct record_writer {
+    FILE* f;
+    game* g;
+    unsigned int bits_per_move, keyframe_interval;
+    uint64_t acc;
+    unsigned int acc_bits;
+    unsigned char* buf;
+    size_t buf_len, buf_cap, index_slot;
+    uint64_t* keyframes;
+    size_t num_keyframes, keyframes_cap;
+    unsigned long long moves;
+};
+
+typedef struct record_writer record_writer;
+
+
+struct record_reader {
+    FILE* f;
+    unsigned int version, bits_per_move, width, keyframe_interval;
+    uint64_t acc;
+    unsigned int acc_bits;
+    unsigned char buf[RECORD_BUF_SIZE];
+    size_t buf_len, buf_pos;
+    long buf_start, game_start;
+    uint64_t index_offset;
+    unsigned long long moves;
+    bool in_game;
+};
+
+typedef struct record_reader record_reader;
+
+
+/**
+ * record_writer_new
+ *
+ * Attaches a writer to a freshly created game. The game's record is built 
+ *  in memory as moves are played and written to the stream in one piece by 
+ *  `record_writer_finish`, so that the header can point at the index.
+ *
+ * Parameters:
+ *   - f: The stream to append the record to, opened for binary writing. It 
+ *      does not need to be seekable.
+ *   - g: A pointer to the game to record. It must not have had any move
+ *      played yet, since the header only holds its configuration.
+ *   - keyframe_interval: Number of moves between keyframes, or 0 for none. 
+ *      Smaller intervals make `record_seek` replay fewer moves at the cost 
+ *      of a larger record.
+ *
+ * Returns:
+ *   - A pointer to the new `record_writer`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `record_writer_finish`.
+ *   - Raises an error if a pointer is NULL or the game already has pieces.
+ */
+record_writer* record_writer_new(FILE* f, game* g,
+                                 unsigned int keyframe_interval);
+
+/**
+ * record_play
+ *
+ * Plays a move on the attached game and, if it was legal, appends it to the
+ *  record.
+ *
+ * Parameters:
+ *   - w: A pointer to the `record_writer`.
+ *   - m: The move to play.
+ *
+ * Returns:
+ *   - The result of `play_move`; illegal moves are not recorded.
+ */
+bool record_play(record_writer* w, move m);
+
+/**
+ * record_writer_finish
+ *
+ * Writes the end code and the keyframe index, writes the game's record to 
+ *  the stream and frees the writer. The attached game is left untouched.
+ *
+ * Parameters:
+ *   - w: A pointer to the `record_writer`.
+ */
+void record_writer_finish(record_writer* w);
+
+/**
+ * record_reader_new
+ *
+ * Creates a reader over a stream of concatenated game records.
+ *
+ * Parameters:
+ *   - f: The stream to read from, opened for binary reading.
+ *
+ * Returns:
+ *   - A pointer to the new `record_reader`.
+ *
+ * Note:
+ *   - The caller is responsible for freeing the reader with
+ *      `record_reader_free`. The stream is not closed.
+ */
+record_reader* record_reader_new(FILE* f);
+
+/**
+ * record_next_game
+ *
+ * Reads the next game header and creates a matching empty game. Any moves
+ *  left unread in the previous game are skipped.
+ *
+ * Parameters:
+ *   - r: A pointer to the `record_reader`.
+ *
+ * Returns:
+ *   - A pointer to a new `game`, owned by the caller.
+ *   - NULL at the end of the stream.
+ *
+ * Note:
+ *   - Raises an error if the header is corrupt.
+ */
+game* record_next_game(record_reader* r);
+
+/**
+ * record_next_move
+ *
+ * Decodes the next move of the current game without playing it.
+ *
+ * Parameters:
+ *   - r: A pointer to the `record_reader`.
+ *   - out: Out-parameter receiving the move.
+ *
+ * Returns:
+ *   - `true` if a move was decoded.
+ *   - `false` at the end of the current game.
+ */
+bool record_next_move(record_reader* r, move* out);
+
+/**
+ * record_replay
+ *
+ * Plays every remaining move of the current game on g.
+ *
+ * Parameters:
+ *   - r: A pointer to the `record_reader`.
+ *   - g: The game returned by `record_next_game`, or one in the same state.
+ *
+ * Returns:
+ *   - The number of moves played.
+ *
+ * Note:
+ *   - Raises an error if a recorded move is illegal, which means the record
+ *      does not belong to this game.
+ */
+unsigned long long record_replay(record_reader* r, game* g);
+
+/**
+ * record_game_offset
+ *
+ * Returns the offset in the stream of the game last returned by
+ *  `record_next_game` or `record_seek`, for use with `record_seek`.
+ *
+ * Parameters:
+ *   - r: A pointer to the `record_reader`.
+ */
+long record_game_offset(record_reader* r);
+
+/**
+ * record_seek
+ *
+ * Restores the state of a recorded game after a given number of moves by
+ *  jumping to the nearest keyframe at or before it and replaying only the
+ *  moves that follow.
+ *
+ * Parameters:
+ *   - r: A pointer to the `record_reader`. Its stream must be seekable.
+ *   - game_offset: The offset of the game in the stream, as returned by
+ *      `record_game_offset`.
+ *   - move_number: The number of moves to restore. If the game is shorter,
+ *      its final state is returned.
+ *
+ * Returns:
+ *   - A pointer to a new `game`, owned by the caller. The reader is left
+ *      positioned after move_number, so `record_next_move` continues the
+ *      game from there.
+ *
+ * Note:
+ *   - Games without keyframes are replayed from the start.
+ *   - Raises an error if the stream cannot be repositioned or the record is
+ *      corrupt.
+ */
+game* record_seek(record_reader* r, long game_offset,
+                  unsigned long long move_number);
+
+/**
+ * record_reader_free
+ *
+ * Frees the reader. The underlying stream is not closed.
+ *
+ * Parameters:
+ *   - r: A pointer to the `record_reader`.
+ */
+void record_reader_free(record_reader* r);
+
+#endif /* RECORD_H */
@@ -0,0 +1,104 @@
+#include <string.h>
+#include <unistd.h>
+#include "record.h"
+
+/* Replays every game of a game record file through the game logic at full 
+   speed and prints how the games ended, along with the replay throughput.
+ * Given a game number and a move number as well, it instead shows the board
+   of that game after that move, restored from the nearest keyframe
+ * Given a game number and -l, it plays that game back in the terminal one 
+   move every REPLAY_LIVE_DELAY_MS milliseconds, redrawing only the rows 
+   each move changes */
+
+#define REPLAY_LIVE_DELAY_MS 200
+
+/* This helper function shows the board of the given game (counted from 0) 
+   after the given move. Earlier games are skipped through their indexes */
+void show_position(record_reader* r, unsigned long long game_number, 
+                   unsigned long long move_number) {
+    for (unsigned long long i = 0; i <= game_number; i++) {
+        game* g = record_next_game(r);
+        if (g == NULL) {
+            fprintf(stderr, "The record holds only %llu games\n", i);
+            exit(1);
+        }
+        game_free(g);
+    }
+    game* g = record_seek(r, record_game_offset(r), move_number);
+    board_show(g->b);
+    printf("%s to move\n", g->player == BLACKS_TURN ? "Black" : "White");
+    game_free(g);
+}
+
+/* This helper function plays the given game (counted from 0) back move by 
+   move through a board view */
+void show_live(record_reader* r, unsigned long long game_number) {
+    game* g = NULL;
+    for (unsigned long long i = 0; i <= game_number; i++) {
+        if (g) {
+            game_free(g);
+        }
+        g = record_next_game(r);
+        if (g == NULL) {
+            fprintf(stderr, "The record holds only %llu games\n", i);
+            exit(1);
+        }
+    }
+    board_view* v = board_view_new();
+    board_show_diff(v, g->b);
+    move m;
+    unsigned long long moves = 0;
+    while (record_next_move(r, &m)) {
+        usleep(REPLAY_LIVE_DELAY_MS * 1000);
+        play_move(g, m);
+        board_show_diff(v, g->b);
+        printf("move %llu\x1b[K\n", ++moves);
+    }
+    board_view_free(v);
+    game_free(g);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2 && argc != 4) {
+        fprintf(stderr, "Usage: replay <games.rec> [<game> <move> | "
+                        "<game> -l]\n");
+        exit(1);
+    }
+    FILE* f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        exit(1);
+    }
+    record_reader* r = record_reader_new(f);
+    if (argc == 4 && strcmp(argv[3], "-l") == 0) {
+        show_live(r, strtoull(argv[2], NULL, 10));
+        record_reader_free(r);
+        fclose(f);
+        return 0;
+    }
+    if (argc == 4) {
+        show_position(r, strtoull(argv[2], NULL, 10), 
+                         strtoull(argv[3], NULL, 10));
+        record_reader_free(r);
+        fclose(f);
+        return 0;
+    }
+    unsigned long long games = 0, moves = 0, outcomes[4] = {0, 0, 0, 0};
+    uint64_t start = now_ns();
+    game* g;
+    while ((g = record_next_game(r))) {
+        moves += record_replay(r, g);
+        outcomes[game_outcome(g)]++;
+        games++;
+        game_free(g);
+    }
+    double secs = (now_ns() - start) / 1e9;
+    printf("%llu games, %llu moves, %.3f s, %.0f moves/s\n", games, moves,
+           secs, moves / secs);
+    printf("black wins %llu, white wins %llu, draws %llu, unfinished %llu\n",
+           outcomes[BLACK_WIN], outcomes[WHITE_WIN], outcomes[DRAW],
+           outcomes[IN_PROGRESS]);
+    record_reader_free(r);
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "archive.h"
+
+/* Runs aggregate queries over a columnar archive with one thread per core.
+ * Row groups are handed out to threads one at a time, and each query reads
+   only the columns it needs:
+     outcomes           result counts per board size     width height run
+                                                         outcome
+     offsets            offsets per move per board size  width height
+                                                         length moves
+     early-disarray N   win rate of the player making a  length moves
+                        disarray within the first N      outcome
+                        plies
+     occupancy I        average pieces on the board at   position I
+                        the I-th archived ply */
+
+#define MAX_SIZES 256
+
+enum query {
+    Q_OUTCOMES,
+    Q_OFFSETS,
+    Q_EARLY_DISARRAY,
+    Q_OCCUPANCY
+};
+
+
+struct size_stats {
+    unsigned int width, height, run;
+    unsigned long long games, moves, offsets, outcomes[4];
+};
+
+typedef struct size_stats size_stats;
+
+
+struct scan_result {
+    size_stats sizes[MAX_SIZES];
+    unsigned int num_sizes;
+    unsigned long long games, disarray_games, disarrayer_wins,
+                       disarrayer_losses, positions, pieces, black_pieces;
+};
+
+typedef struct scan_result scan_result;
+
+
+struct scan_job {
+    archive* a;
+    enum query q;
+    unsigned int arg;
+    unsigned int next_group;
+    pthread_mutex_t lock;
+    scan_result total;
+};
+
+typedef struct scan_job scan_job;
+
+/* This helper function returns the statistics of a board size in res,
+   adding them if this is the first game of that size */
+size_stats* find_size(scan_result* res, unsigned int width,
+                      unsigned int height, unsigned int run) {
+    for (unsigned int i = 0; i < res->num_sizes; i++) {
+        size_stats* s = &res->sizes[i];
+        if (s->width == width && s->height == height && s->run == run) {
+            return s;
+        }
+    }
+    if (res->num_sizes == MAX_SIZES) {
+        fprintf(stderr, "Too many board sizes in the archive\n");
+        exit(1);
+    }
+    size_stats* s = &res->sizes[res->num_sizes++];
+    memset(s, 0, sizeof(size_stats));
+    s->width = width;
+    s->height = height;
+    s->run = run;
+    return s;
+}
+
+/* This helper function answers the outcomes and offsets queries for one
+   row group */
+void scan_sizes(scan_job* job, unsigned int group, scan_result* res) {
+    uint64_t *width, *height, *run = NULL, *results = NULL, *length = NULL,
+             *moves = NULL;
+    size_t n = archive_read_column(job->a, group, COL_WIDTH, &width);
+    archive_read_column(job->a, group, COL_HEIGHT, &height);
+    if (job->q == Q_OUTCOMES) {
+        archive_read_column(job->a, group, COL_RUN, &run);
+        archive_read_column(job->a, group, COL_OUTCOME, &results);
+    } else {
+        archive_read_column(job->a, group, COL_LENGTH, &length);
+        archive_read_column(job->a, group, COL_MOVES, &moves);
+    }
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_stats* s = find_size(res, width[i], height[i], run ? run[i] : 0);
+        s->games++;
+        if (results) {
+            s->outcomes[results[i]]++;
+            continue;
+        }
+        for (uint64_t j = 0; j < length[i]; j++, m++) {
+            s->offsets += moves[m] == 0;
+        }
+        s->moves += length[i];
+    }
+    free(width);
+    free(height);
+    free(run);
+    free(results);
+    free(length);
+    free(moves);
+}
+
+/* This helper function answers the early-disarray query for one row group.
+ * The player making the first disarray is black if it is played at an even
+   ply and white otherwise */
+void scan_early_disarray(scan_job* job, unsigned int group,
+                         scan_result* res) {
+    uint64_t *length, *moves, *results;
+    size_t n = archive_read_column(job->a, group, COL_LENGTH, &length);
+    archive_read_column(job->a, group, COL_MOVES, &moves);
+    archive_read_column(job->a, group, COL_OUTCOME, &results);
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        res->games++;
+        for (uint64_t j = 0; j < length[i] && j < job->arg; j++) {
+            if (moves[m + j] != 1) {
+                continue;
+            }
+            outcome winner = j % 2 == 0 ? BLACK_WIN : WHITE_WIN;
+            outcome loser = j % 2 == 0 ? WHITE_WIN : BLACK_WIN;
+            res->disarray_games++;
+            res->disarrayer_wins += results[i] == winner;
+            res->disarrayer_losses += results[i] == loser;
+            break;
+        }
+        m += length[i];
+    }
+    free(length);
+    free(moves);
+    free(results);
+}
+
+/* This helper function answers the occupancy query for one row group */
+void scan_occupancy(scan_job* job, unsigned int group, scan_result* res) {
+    uint64_t* words;
+    size_t n = archive_read_column(job->a, group, COL_POSITIONS + job->arg,
+                                   &words);
+    for (size_t i = 0; i < n; i += words[i] + 1) {
+        if (words[i] == 0) {
+            continue;
+        }
+        res->positions++;
+        for (uint64_t j = 1; j <= words[i]; j++) {
+            uint64_t w = words[i + j];
+            uint64_t black = w & ~(w >> 1) & 0x5555555555555555ull;
+            uint64_t white = (w >> 1) & 0x5555555555555555ull;
+            res->black_pieces += __builtin_popcountll(black);
+            res->pieces += __builtin_popcountll(black) +
+                           __builtin_popcountll(white);
+        }
+    }
+    free(words);
+}
+
+/* This helper function adds the partial result of a thread to the total */
+void merge_result(scan_result* total, scan_result* part) {
+    for (unsigned int i = 0; i < part->num_sizes; i++) {
+        size_stats* p = &part->sizes[i];
+        size_stats* t = find_size(total, p->width, p->height, p->run);
+        t->games += p->games;
+        t->moves += p->moves;
+        t->offsets += p->offsets;
+        for (unsigned int o = 0; o < 4; o++) {
+            t->outcomes[o] += p->outcomes[o];
+        }
+    }
+    total->games += part->games;
+    total->disarray_games += part->disarray_games;
+    total->disarrayer_wins += part->disarrayer_wins;
+    total->disarrayer_losses += part->disarrayer_losses;
+    total->positions += part->positions;
+    total->pieces += part->pieces;
+    total->black_pieces += part->black_pieces;
+}
+
+/* This is the thread routine of the scan. Each thread claims row groups
+   until none are left, aggregating into a private result that is merged
+   into the job's total at the end */
+void* scan_routine(void* arg) {
+    scan_job* job = (scan_job*)arg;
+    scan_result* res = (scan_result*)calloc(1, sizeof(scan_result));
+    check_malloc(res);
+    unsigned int group;
+    while ((group = __atomic_fetch_add(&job->next_group, 1,
+                                       __ATOMIC_RELAXED)) <
+           job->a->num_groups) {
+        if (job->q == Q_EARLY_DISARRAY) {
+            scan_early_disarray(job, group, res);
+        } else if (job->q == Q_OCCUPANCY) {
+            scan_occupancy(job, group, res);
+        } else {
+            scan_sizes(job, group, res);
+        }
+    }
+    pthread_mutex_lock(&job->lock);
+    merge_result(&job->total, res);
+    pthread_mutex_unlock(&job->lock);
+    free(res);
+    return NULL;
+}
+
+/* This helper function prints the result of a query */
+void print_result(scan_job* job) {
+    scan_result* t = &job->total;
+    if (job->q == Q_OUTCOMES) {
+        printf("%9s %4s %12s %8s %8s %8s\n", "size", "run", "games",
+               "black%", "white%", "draw%");
+        for (unsigned int i = 0; i < t->num_sizes; i++) {
+            size_stats* s = &t->sizes[i];
+            printf("%4ux%-4u %4u %12llu %8.2f %8.2f %8.2f\n", s->width,
+                   s->height, s->run, s->games,
+                   100.0 * s->outcomes[BLACK_WIN] / s->games,
+                   100.0 * s->outcomes[WHITE_WIN] / s->games,
+                   100.0 * s->outcomes[DRAW] / s->games);
+        }
+    } else if (job->q == Q_OFFSETS) {
+        printf("%9s %12s %14s %10s\n", "size", "games", "moves", "offset%");
+        for (unsigned int i = 0; i < t->num_sizes; i++) {
+            size_stats* s = &t->sizes[i];
+            printf("%4ux%-4u %12llu %14llu %10.3f\n", s->width, s->height,
+                   s->games, s->moves,
+                   s->moves ? 100.0 * s->offsets / s->moves : 0.0);
+        }
+    } else if (job->q == Q_EARLY_DISARRAY) {
+        unsigned long long d = t->disarray_games;
+        printf("%llu of %llu games have a disarray in the first %u plies\n",
+               d, t->games, job->arg);
+        if (d) {
+            printf("disarraying player wins %.2f%%, loses %.2f%%\n",
+                   100.0 * t->disarrayer_wins / d,
+                   100.0 * t->disarrayer_losses / d);
+        }
+    } else {
+        printf("%llu positions at ply %u\n", t->positions,
+               job->a->plies[job->arg]);
+        if (t->positions) {
+            printf("average pieces %.2f, black share %.2f%%\n",
+                   (double)t->pieces / t->positions,
+                   t->pieces ? 100.0 * t->black_pieces / t->pieces : 0.0);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        threads = atoi(argv[2]);
+        first = 3;
+    }
+    if (argc - first < 2 || threads == 0) {
+        fprintf(stderr, "Usage: scan [-j <threads>] <archive.tca> "
+                        "outcomes | offsets | early-disarray <plies> | "
+                        "occupancy <ply index>\n");
+        exit(1);
+    }
+    scan_job job;
+    memset(&job, 0, sizeof(job));
+    char* q = argv[first + 1];
+    if (strcmp(q, "outcomes") == 0) {
+        job.q = Q_OUTCOMES;
+    } else if (strcmp(q, "offsets") == 0) {
+        job.q = Q_OFFSETS;
+    } else if (strcmp(q, "early-disarray") == 0 && argc - first == 3) {
+        job.q = Q_EARLY_DISARRAY;
+        job.arg = atoi(argv[first + 2]);
+    } else if (strcmp(q, "occupancy") == 0 && argc - first == 3) {
+        job.q = Q_OCCUPANCY;
+        job.arg = atoi(argv[first + 2]);
+    } else {
+        fprintf(stderr, "Unknown query %s\n", q);
+        exit(1);
+    }
+    job.a = archive_open(argv[first]);
+    if (job.a == NULL) {
+        fprintf(stderr, "Could not open archive %s\n", argv[first]);
+        exit(1);
+    }
+    if (job.q == Q_OCCUPANCY && job.arg >= job.a->num_plies) {
+        fprintf(stderr, "The archive keeps only %u plies\n",
+                job.a->num_plies);
+        exit(1);
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    uint64_t start = now_ns();
+    pthread_t tids[threads];
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, scan_routine, &job);
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double secs = (now_ns() - start) / 1e9;
+    print_result(&job);
+    printf("%llu games in %u groups scanned by %u threads in %.3f s\n",
+           job.a->num_games, job.a->num_groups, threads, secs);
+    pthread_mutex_destroy(&job.lock);
+    archive_close(job.a);
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include <string.h>
+#include "serial.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SERIAL_NATIVE 1
+#else
+#define SERIAL_NATIVE 0
+#endif
+
+/* This helper function writes a little-endian 32-bit word */
+void put_word(unsigned char* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/* This helper function reads a little-endian 32-bit word */
+uint32_t get_word(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+size_t game_serialized_size(game* g) {
+    check_null_pointer(g);
+    size_t pieces = g->black_queue->len + g->white_queue->len;
+    return 4 * (SERIAL_HEADER_WORDS + 
+                board_packed_words(g->b->width, g->b->height) + 2 * pieces);
+}
+
+/* This helper function writes a queue as (r, c) pairs and returns the end
+   of what it wrote */
+unsigned char* put_queue(unsigned char* p, posqueue* q) {
+    for (pq_entry* e = q->head; e; e = e->next, p += 8) {
+        if (SERIAL_NATIVE) {
+            memcpy(p, &e->p, 8);
+        } else {
+            put_word(p, e->p.r);
+            put_word(p + 4, e->p.c);
+        }
+    }
+    return p;
+}
+
+size_t game_serialize(game* g, unsigned char* buf, size_t cap) {
+    check_null_pointer(buf);
+    size_t size = game_serialized_size(g);
+    if (cap < size) {
+        return 0;
+    }
+    board* b = g->b;
+    memcpy(buf, SERIAL_MAGIC, 4);
+    uint32_t header[] = {SERIAL_VERSION, b->type, g->player, b->width,
+                         b->height, g->run, g->black_queue->len,
+                         g->white_queue->len};
+    for (unsigned int i = 0; i < SERIAL_HEADER_WORDS - 1; i++) {
+        put_word(buf + 4 * (i + 1), header[i]);
+    }
+    unsigned char* p = buf + 4 * SERIAL_HEADER_WORDS;
+    size_t words = board_packed_words(b->width, b->height);
+    if (SERIAL_NATIVE && b->type == BITS) {
+        memcpy(p, b->u.bits, 4 * words);
+    } else {
+        unsigned int* packed = (unsigned int*)malloc(4 * words);
+        check_malloc(packed);
+        board_pack(b, packed);
+        for (size_t i = 0; i < words; i++) {
+            put_word(p + 4 * i, packed[i]);
+        }
+        free(packed);
+    }
+    p = put_queue(p + 4 * words, g->black_queue);
+    put_queue(p, g->white_queue);
+    return size;
+}
+
+/* This helper function restores a queue of len pairs. On little-endian
+   hosts with an aligned buffer the pairs are handed to the queue as they
+   are, otherwise they are decoded into a scratch array first */
+posqueue* get_queue(const unsigned char* p, unsigned int len) {
+    if (SERIAL_NATIVE && (uintptr_t)p % _Alignof(pos) == 0) {
+        return posqueue_from_array((const pos*)p, len);
+    }
+    pos* ps = (pos*)malloc(sizeof(pos) * (len ? len : 1));
+    check_malloc(ps);
+    for (unsigned int i = 0; i < len; i++) {
+        ps[i] = make_pos(get_word(p + 8 * i), get_word(p + 8 * i + 4));
+    }
+    posqueue* q = posqueue_from_array(ps, len);
+    free(ps);
+    return q;
+}
+
+/* This helper function checks that the len pairs of a queue are cells of
+   the board holding the queue's colour, appending them to cells */
+bool queue_matches_board(const unsigned char* p, unsigned int len,
+                         board* b, cell colour, pos* cells) {
+    for (unsigned int i = 0; i < len; i++) {
+        uint32_t r = get_word(p + 8 * i), c = get_word(p + 8 * i + 4);
+        if (r >= b->height || c >= b->width ||
+            board_get(b, make_pos(r, c)) != colour) {
+            return false;
+        }
+        cells[i] = make_pos(r, c);
+    }
+    return true;
+}
+
+/* This helper function orders positions by column, then by row */
+int compare_cells(const void* x, const void* y) {
+    const pos *a = (const pos*)x, *b = (const pos*)y;
+    if (a->c != b->c) {
+        return a->c < b->c ? -1 : 1;
+    }
+    return a->r < b->r ? -1 : a->r > b->r;
+}
+
+/* This helper function checks that the n queued cells are exactly the
+   pieces of a board, each queued once: in every column, the cells from
+   its top piece down to the bottom row. It sorts cells */
+bool board_matches_queues(board* b, pos* cells, size_t n) {
+    qsort(cells, n, sizeof(pos), compare_cells);
+    size_t i = 0;
+    for (unsigned int c = 0; c < b->width; c++) {
+        for (unsigned int r = b->height - board_column_height(b, c);
+             r < b->height; r++, i++) {
+            if (i == n || cells[i].c != c || cells[i].r != r) {
+                return false;
+            }
+        }
+    }
+    return i == n;
+}
+
+game* game_deserialize(const unsigned char* buf, size_t len, int type) {
+    if (buf == NULL || len < 4 * SERIAL_HEADER_WORDS || 
+        memcmp(buf, SERIAL_MAGIC, 4) != 0 || 
+        get_word(buf + 4) != SERIAL_VERSION) {
+        return NULL;
+    }
+    uint32_t saved_type = get_word(buf + 8), player = get_word(buf + 12),
+             width = get_word(buf + 16), height = get_word(buf + 20),
+             run = get_word(buf + 24), black_len = get_word(buf + 28),
+             white_len = get_word(buf + 32);
+    if (saved_type > SPARSE || player > WHITES_TURN || width == 0 || 
+        height == 0 || run == 0 || (run > width && run > height)) {
+        return NULL;
+    }
+    size_t words = board_packed_words(width, height);
+    size_t pieces = (size_t)black_len + white_len;
+    if (pieces > (size_t)width * height || 
+        len < 4 * (SERIAL_HEADER_WORDS + words + 2 * pieces)) {
+        return NULL;
+    }
+    const unsigned char* p = buf + 4 * SERIAL_HEADER_WORDS;
+    enum type t = type < 0 ? (enum type)saved_type : (enum type)type;
+    board* b;
+    if (SERIAL_NATIVE && (uintptr_t)p % _Alignof(unsigned int) == 0) {
+        b = board_unpack(width, height, t, (const unsigned int*)p);
+    } else {
+        unsigned int* packed = (unsigned int*)malloc(4 * words);
+        check_malloc(packed);
+        for (size_t i = 0; i < words; i++) {
+            packed[i] = get_word(p + 4 * i);
+        }
+        b = board_unpack(width, height, t, packed);
+        free(packed);
+    }
+    p += 4 * words;
+    const unsigned char* white = p + 8 * (size_t)black_len;
+    pos* cells = (pos*)malloc(sizeof(pos) * (pieces ? pieces : 1));
+    check_malloc(cells);
+    bool valid = queue_matches_board(p, black_len, b, BLACK, cells) &&
+                 queue_matches_board(white, white_len, b, WHITE,
+                                     cells + black_len) &&
+                 board_matches_queues(b, cells, pieces);
+    free(cells);
+    if (!valid) {
+        board_free(b);
+        return NULL;
+    }
+    game* g = (game*)malloc(sizeof(game));
+    check_malloc(g);
+    g->run = run;
+    g->b = b;
+    g->player = player;
+    g->black_queue = get_queue(p, black_len);
+    g->white_queue = get_queue(white, white_len);
+    g->windows = NULL;
+    return g;
+}
@@ -0,0 +1,81 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include "logic.h"
+
+/* A serialized game is a single flat buffer meant for checkpoints, so that
+   a game can be written out and restored with a few copies rather than one
+   allocation per piece. Every field is a little-endian 32-bit word:
+     - the magic "TTGS", the version and the board representation
+     - the player to move, width, height and run
+     - the lengths of the black and white queues
+     - the packed board, as written by `board_pack`
+     - the black queue then the white queue, oldest first, as (r, c) pairs
+ * The layout does not depend on the representation, so a game saved with
+   one representation can be restored with another by overriding the type.
+   On little-endian hosts the board and queue sections are copied as they
+   are */
+
+#define SERIAL_MAGIC "TTGS"
+#define SERIAL_VERSION 1
+#define SERIAL_HEADER_WORDS 9
+
+/**
+ * game_serialized_size
+ *
+ * Returns the number of bytes taken by the serialized form of a game.
+ *
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ */
+size_t game_serialized_size(game* g);
+
+/**
+ * game_serialize
+ *
+ * Writes the serialized form of a game into a caller-supplied buffer.
+ *
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *   - buf: The buffer to write to.
+ *   - cap: The size of the buffer in bytes.
+ *
+ * Returns:
+ *   - The number of bytes written.
+ *   - 0 if the buffer is smaller than `game_serialized_size`, in which case
+ *      nothing is written.
+ *
+ * Note:
+ *   - Raises an error if a pointer is NULL.
+ */
+size_t game_serialize(game* g, unsigned char* buf, size_t cap);
+
+/**
+ * game_deserialize
+ *
+ * Restores a game from its serialized form. The board takes one allocation
+ *  for its cells and each queue takes one for all of its entries.
+ *
+ * Parameters:
+ *   - buf: The serialized game.
+ *   - len: The size of the buffer in bytes.
+ *   - type: The representation of the restored board, or -1 to keep the
+ *      one that was saved.
+ *
+ * Returns:
+ *   - A pointer to a new `game`, owned by the caller.
+ *   - NULL if the buffer is truncated, has another version or is not a
+ *      serialized game, if its run is longer than both sides of the board
+ *      (see `new_game`), or if its queues do not match its board: every
+ *      queued position must be a cell of the board holding the queue's
+ *      colour, queued once, and the pieces must be exactly the queued
+ *      cells, standing in columns from the bottom row up.
+ *
+ * Note:
+ *   - The queues are checked against the board with memory for the
+ *      queued positions only, so a sparse board stays small.
+ */
+game* game_deserialize(const unsigned char* buf, size_t len, int type);
+
+#endif /* SERIAL_H */
@@ -0,0 +1,92 @@
+#include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "server.h"
+
+/* Serves games (see server.h) on TCP port -p of 127.0.0.1, on the Unix
+   socket -u, or both, with -j event loops of at most -n sessions each,
+   until interrupted. It then prints the connections accepted and the
+   requests served */
+
+/* This helper function prints the usage line and exits */
+void serve_usage() {
+    fprintf(stderr, "Usage: serve [-p <port>] [-u <socket path>] "
+                    "[-j <loops>] [-n <sessions>]\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * At least one of -p and -u is required. By default there is a loop per
+   core with SERVER_SESSIONS sessions each */
+void parse_serve_arguments(int argc, char** argv, server_options* opts) {
+    memset(opts, 0, sizeof(server_options));
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            serve_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'p':
+                if (v > 65535) {
+                    serve_usage();
+                }
+                opts->tcp = true;
+                opts->port = v;
+                break;
+            case 'u':
+                opts->unix_path = argv[i + 1];
+                break;
+            case 'j':
+                opts->loops = v;
+                break;
+            case 'n':
+                opts->sessions = v;
+                break;
+            default:
+                serve_usage();
+        }
+        i++;
+    }
+    if (!opts->tcp && !opts->unix_path) {
+        serve_usage();
+    }
+}
+
+int main(int argc, char** argv) {
+    server_options opts;
+    parse_serve_arguments(argc, argv, &opts);
+    /* The loops inherit the blocked signals, so that only sigwait below
+       receives them */
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    /* Thousands of sessions need more descriptors than the usual soft
+       limit */
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    server* s = server_start(&opts);
+    if (s == NULL) {
+        fprintf(stderr, "Could not listen\n");
+        exit(1);
+    }
+    if (opts.tcp) {
+        printf("listening on 127.0.0.1:%u\n", server_port(s));
+    }
+    if (opts.unix_path) {
+        printf("listening on %s\n", opts.unix_path);
+    }
+    fflush(stdout);
+    int sig;
+    sigwait(&stop, &sig);
+    server_stats stats;
+    server_stop(s, &stats);
+    printf("%llu connections, %llu requests\n", stats.accepted,
+           stats.requests);
+    return 0;
+}
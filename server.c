@@ -0,0 +1,538 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+
+#define SERVER_EVENTS 256
+/* The most arguments of a request, those of new */
+#define SERVER_MAX_ARGS 3
+/* Room a reply may need, the longest being a board of the largest size */
+#define SERVER_MAX_REPLY (SERVER_MAX_SIDE * (SERVER_MAX_SIDE + 1) + 16)
+/* Tags of the epoll events that are not sessions */
+#define SERVER_TCP UINT32_MAX
+#define SERVER_UNIX (UINT32_MAX - 1)
+#define SERVER_WAKE (UINT32_MAX - 2)
+
+/* This helper function makes a TCP socket listening on a port of the
+   loopback interface, which other sockets may listen on too. Returns it,
+   or -1 on failure */
+int server_tcp_socket(unsigned short port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) ||
+        bind(fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+        listen(fd, SOMAXCONN)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* This helper function makes a Unix socket listening at a path, replacing
+   whatever is there. Returns it, or -1 on failure */
+int server_unix_socket(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+        listen(fd, SOMAXCONN)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* This helper function appends a line to the output of a session */
+void server_reply(server_session* ss, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(ss->out + ss->out_len, SERVER_BUF - ss->out_len - 1,
+                      fmt, args);
+    va_end(args);
+    ss->out_len += n;
+    ss->out[ss->out_len++] = '\n';
+}
+
+/* This helper function returns the name of the state of a session's game */
+const char* server_state(server_session* ss) {
+    switch (ss->state) {
+        case BLACK_WIN:
+            return "black-wins";
+        case WHITE_WIN:
+            return "white-wins";
+        case DRAW:
+            return "draw";
+        default:
+            return ss->g->player == BLACKS_TURN ? "black" : "white";
+    }
+}
+
+/* This helper function starts a game of a size, reusing the session's
+   game if it has that size */
+void server_new_game(server_session* ss, unsigned int width,
+                     unsigned int height, unsigned int run) {
+    if (ss->g && ss->width == width && ss->height == height &&
+        ss->run == run) {
+        game_reset(ss->g);
+    } else {
+        if (ss->g) {
+            game_free(ss->g);
+        }
+        ss->g = new_game(run, width, height, BITS);
+        game_track_windows(ss->g);
+        ss->width = width;
+        ss->height = height;
+        ss->run = run;
+    }
+    ss->playing = true;
+    ss->state = IN_PROGRESS;
+}
+
+/* This helper function replies with the rows of a session's board */
+void server_board(server_session* ss) {
+    char* out = ss->out + ss->out_len;
+    memcpy(out, "ok ", 3);
+    out += 3;
+    static const char symbols[3] = {'.', '*', 'o'};
+    for (unsigned int r = 0; r < ss->height; r++) {
+        for (unsigned int c = 0; c < ss->width; c++) {
+            *out++ = symbols[board_get(ss->g->b, make_pos(r, c))];
+        }
+        *out++ = r + 1 < ss->height ? '/' : '\n';
+    }
+    ss->out_len = out - ss->out;
+}
+
+/* This helper function parses the rest of a request being split by
+   strtok_r, its arguments, into args. Each must be a decimal number in
+   range and nothing else. It returns the number of arguments, or -1 if
+   one is not such a number or there are more than SERVER_MAX_ARGS */
+int server_arguments(char** save, unsigned int* args) {
+    int n = 0;
+    for (char* tok = strtok_r(NULL, " \t", save); tok;
+         tok = strtok_r(NULL, " \t", save)) {
+        if (n == SERVER_MAX_ARGS || *tok < '0' || *tok > '9') {
+            return -1;
+        }
+        char* end;
+        errno = 0;
+        unsigned long value = strtoul(tok, &end, 10);
+        if (*end != '\0' || errno == ERANGE || value > UINT_MAX) {
+            return -1;
+        }
+        args[n++] = value;
+    }
+    return n;
+}
+
+/* This helper function serves a request of a session, given as a line
+   without its newline */
+void server_request(server_session* ss, char* line) {
+    char* save;
+    char* word = strtok_r(line, " \t", &save);
+    unsigned int args[SERVER_MAX_ARGS] = {0};
+    int n = word ? server_arguments(&save, args) : 0;
+    bool moving = word && (strcmp(word, "drop") == 0 ||
+                           strcmp(word, "offset") == 0 ||
+                           strcmp(word, "disarray") == 0);
+    if (!word) {
+        server_reply(ss, "error empty request");
+    } else if (!moving && strcmp(word, "new") != 0 &&
+               strcmp(word, "quit") != 0 && strcmp(word, "state") != 0 &&
+               strcmp(word, "board") != 0 && strcmp(word, "reset") != 0) {
+        server_reply(ss, "error unknown request");
+    } else if (n < 0 || (n > 0 && !moving && strcmp(word, "new") != 0)) {
+        server_reply(ss, "error bad arguments");
+    } else if (strcmp(word, "new") == 0) {
+        unsigned int a = args[0], b = args[1], c = args[2];
+        if (n != 3 || a == 0 || b == 0 || c == 0 || a > SERVER_MAX_SIDE ||
+            b > SERVER_MAX_SIDE || (c > a && c > b)) {
+            server_reply(ss, "error unplayable game");
+        } else {
+            server_new_game(ss, a, b, c);
+            server_reply(ss, "ok");
+        }
+    } else if (strcmp(word, "quit") == 0) {
+        server_reply(ss, "ok");
+        ss->closing = true;
+    } else if (!ss->playing) {
+        server_reply(ss, "error no game");
+    } else if (strcmp(word, "state") == 0) {
+        server_reply(ss, "ok %s", server_state(ss));
+    } else if (strcmp(word, "board") == 0) {
+        server_board(ss);
+    } else if (strcmp(word, "reset") == 0) {
+        game_reset(ss->g);
+        ss->state = IN_PROGRESS;
+        server_reply(ss, "ok");
+    } else if (ss->state != IN_PROGRESS) {
+        server_reply(ss, "error game over");
+    } else {
+        move_kind kind = strcmp(word, "drop") == 0 ? MOVE_DROP
+                         : strcmp(word, "offset") == 0 ? MOVE_OFFSET
+                                                       : MOVE_DISARRAY;
+        move m = make_move(kind, args[0]);
+        if (n != (m.kind == MOVE_DROP) || !move_is_legal(ss->g, m)) {
+            server_reply(ss, "error illegal move");
+        } else {
+            play_move(ss->g, m);
+            ss->state = game_outcome(ss->g);
+            server_reply(ss, "ok %s", server_state(ss));
+        }
+    }
+}
+
+/* This helper function serves the complete requests a session has sent,
+   as long as its output has room for their replies */
+void server_process(server_loop* l, server_session* ss) {
+    unsigned int start = 0;
+    while (!ss->closing && SERVER_BUF - ss->out_len >= SERVER_MAX_REPLY) {
+        char* nl = memchr(ss->in + start, '\n', ss->in_len - start);
+        if (!nl) {
+            break;
+        }
+        *nl = '\0';
+        if (nl > ss->in + start && nl[-1] == '\r') {
+            nl[-1] = '\0';
+        }
+        server_request(ss, ss->in + start);
+        l->requests++;
+        start = nl + 1 - ss->in;
+    }
+    memmove(ss->in, ss->in + start, ss->in_len - start);
+    ss->in_len -= start;
+    if (ss->in_len == SERVER_BUF && !ss->closing &&
+        !memchr(ss->in, '\n', ss->in_len)) {
+        if (SERVER_BUF - ss->out_len >= SERVER_MAX_REPLY) {
+            server_reply(ss, "error request too long");
+        }
+        ss->closing = true;
+    }
+    if (ss->eof && !memchr(ss->in, '\n', ss->in_len)) {
+        ss->closing = true;
+    }
+}
+
+/* This helper function closes a session and frees its slot */
+void server_close(server_loop* l, unsigned int slot) {
+    server_session* ss = &l->sessions[slot];
+    close(ss->fd);
+    ss->open = false;
+    l->free[l->num_free++] = slot;
+}
+
+/* This helper function writes what it can of a session's output, then
+   closes the session if it is done, or else waits for what it needs:
+   more room to write into, input, or both */
+void server_flush(server_loop* l, unsigned int slot) {
+    server_session* ss = &l->sessions[slot];
+    while (ss->out_pos < ss->out_len) {
+        ssize_t n = write(ss->fd, ss->out + ss->out_pos,
+                          ss->out_len - ss->out_pos);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN) {
+            server_close(l, slot);
+            return;
+        }
+        if (n < 0) {
+            break;
+        }
+        ss->out_pos += n;
+    }
+    if (ss->out_pos == ss->out_len) {
+        ss->out_pos = ss->out_len = 0;
+        if (ss->closing) {
+            server_close(l, slot);
+            return;
+        }
+    }
+    bool blocked = ss->closing || ss->eof ||
+                   SERVER_BUF - ss->out_len < SERVER_MAX_REPLY;
+    uint32_t events = (blocked ? 0 : EPOLLIN) |
+                      (ss->out_len ? EPOLLOUT : 0);
+    if (events != ss->events) {
+        struct epoll_event ev = {events, {.u32 = slot}};
+        epoll_ctl(l->epfd, EPOLL_CTL_MOD, ss->fd, &ev);
+        ss->events = events;
+    }
+}
+
+/* This helper function handles the readiness of a session's socket */
+void server_serve(server_loop* l, unsigned int slot, uint32_t events) {
+    server_session* ss = &l->sessions[slot];
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        server_close(l, slot);
+        return;
+    }
+    if ((events & EPOLLIN) && ss->in_len < SERVER_BUF) {
+        ssize_t n = read(ss->fd, ss->in + ss->in_len,
+                         SERVER_BUF - ss->in_len);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            server_close(l, slot);
+            return;
+        }
+        if (n > 0) {
+            ss->in_len += n;
+        }
+        /* A client done sending still gets the replies to what it sent */
+        ss->eof = n == 0;
+    }
+    if ((events & EPOLLOUT) && ss->out_pos < ss->out_len) {
+        /* Make room before serving the requests that waited for it */
+        server_flush(l, slot);
+        if (!ss->open) {
+            return;
+        }
+    }
+    /* Requests left waiting for room are served once the output is
+       written, as no more input may come to wake the loop for them */
+    do {
+        server_process(l, ss);
+        server_flush(l, slot);
+    } while (ss->open && !ss->closing && ss->out_len == 0 &&
+             memchr(ss->in, '\n', ss->in_len));
+}
+
+/* This helper function accepts every pending connection of a listening
+   socket into a free session, or closes it if there is none */
+void server_accept(server_loop* l, int fd, bool tcp) {
+    for (;;) {
+        int cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        if (l->num_free == 0) {
+            close(cfd);
+            continue;
+        }
+        if (tcp) {
+            int one = 1;
+            setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        unsigned int slot = l->free[--l->num_free];
+        server_session* ss = &l->sessions[slot];
+        ss->fd = cfd;
+        ss->open = true;
+        ss->playing = ss->closing = ss->eof = false;
+        ss->in_len = ss->out_len = ss->out_pos = 0;
+        ss->events = EPOLLIN;
+        struct epoll_event ev = {EPOLLIN, {.u32 = slot}};
+        epoll_ctl(l->epfd, EPOLL_CTL_ADD, cfd, &ev);
+        l->accepted++;
+    }
+}
+
+/* This helper function pins the calling thread to the CPU of a loop, the
+   index-th of those it may run on, counting round */
+void server_pin(unsigned int index) {
+    cpu_set_t allowed, one;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return;
+    }
+    unsigned int count = CPU_COUNT(&allowed), seen = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && count; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && seen++ == index % count) {
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+            return;
+        }
+    }
+}
+
+/* This is the routine of an event loop: it serves its sessions until it
+   is woken to stop, then closes them */
+void* server_routine(void* arg) {
+    server_loop* l = (server_loop*)arg;
+    server_pin(l->index);
+    struct epoll_event events[SERVER_EVENTS];
+    bool stop = false;
+    while (!stop) {
+        int n = epoll_wait(l->epfd, events, SERVER_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == SERVER_WAKE) {
+                stop = true;
+            } else if (tag == SERVER_TCP) {
+                server_accept(l, l->tcp_fd, true);
+            } else if (tag == SERVER_UNIX) {
+                server_accept(l, l->s->unix_fd, false);
+            } else if (l->sessions[tag].open) {
+                server_serve(l, tag, events[i].events);
+            }
+        }
+    }
+    for (unsigned int i = 0; i < l->s->opts.sessions; i++) {
+        if (l->sessions[i].open) {
+            server_close(l, i);
+        }
+    }
+    return NULL;
+}
+
+/* This helper function closes the sockets of a server and frees it and
+   its loops, once their threads have stopped */
+void server_free(server* s) {
+    for (unsigned int i = 0; i < s->opts.loops; i++) {
+        server_loop* l = &s->loops[i];
+        for (unsigned int j = 0; j < s->opts.sessions; j++) {
+            if (l->sessions[j].g) {
+                game_free(l->sessions[j].g);
+            }
+        }
+        free(l->sessions);
+        free(l->free);
+        close(l->epfd);
+        close(l->wake_fd);
+        if (l->tcp_fd >= 0) {
+            close(l->tcp_fd);
+        }
+    }
+    if (s->unix_fd >= 0) {
+        close(s->unix_fd);
+        unlink(s->unix_path);
+    }
+    free(s->unix_path);
+    free(s->loops);
+    free(s);
+}
+
+server* server_start(const server_options* opts) {
+    if (!opts->tcp && !opts->unix_path) {
+        return NULL;
+    }
+    server* s = (server*)calloc(1, sizeof(server));
+    check_malloc(s);
+    s->opts = *opts;
+    if (s->opts.loops == 0) {
+        s->opts.loops = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (s->opts.loops > SERVER_MAX_LOOPS) {
+        s->opts.loops = SERVER_MAX_LOOPS;
+    }
+    if (s->opts.sessions == 0) {
+        s->opts.sessions = SERVER_SESSIONS;
+    }
+    s->unix_fd = -1;
+    s->loops = (server_loop*)calloc(s->opts.loops, sizeof(server_loop));
+    check_malloc(s->loops);
+    bool ok = true;
+    for (unsigned int i = 0; i < s->opts.loops; i++) {
+        server_loop* l = &s->loops[i];
+        l->s = s;
+        l->index = i;
+        l->tcp_fd = -1;
+        l->epfd = epoll_create1(EPOLL_CLOEXEC);
+        l->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        l->sessions = (server_session*)calloc(s->opts.sessions,
+                                              sizeof(server_session));
+        l->free = (unsigned int*)malloc(s->opts.sessions *
+                                        sizeof(unsigned int));
+        check_malloc(l->sessions);
+        check_malloc(l->free);
+        for (unsigned int j = 0; j < s->opts.sessions; j++) {
+            l->free[j] = s->opts.sessions - 1 - j;
+        }
+        l->num_free = s->opts.sessions;
+        struct epoll_event ev = {EPOLLIN, {.u32 = SERVER_WAKE}};
+        ok = ok && l->epfd >= 0 && l->wake_fd >= 0 &&
+             !epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->wake_fd, &ev);
+        if (ok && opts->tcp) {
+            /* The first socket takes the port, which the others share */
+            l->tcp_fd = server_tcp_socket(i ? s->port : opts->port);
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            ok = l->tcp_fd >= 0 && (i || !getsockname(
+                     l->tcp_fd, (struct sockaddr*)&addr, &len));
+            if (ok && i == 0) {
+                s->port = ntohs(addr.sin_port);
+            }
+            ev.data.u32 = SERVER_TCP;
+            ok = ok && !epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->tcp_fd, &ev);
+        }
+    }
+    if (ok && opts->unix_path) {
+        s->unix_path = strdup(opts->unix_path);
+        check_malloc(s->unix_path);
+        s->unix_fd = server_unix_socket(opts->unix_path);
+        ok = s->unix_fd >= 0;
+        struct epoll_event ev = {EPOLLIN | EPOLLEXCLUSIVE,
+                                 {.u32 = SERVER_UNIX}};
+        for (unsigned int i = 0; ok && i < s->opts.loops; i++) {
+            ok = !epoll_ctl(s->loops[i].epfd, EPOLL_CTL_ADD, s->unix_fd,
+                            &ev);
+        }
+    }
+    if (!ok) {
+        server_free(s);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < s->opts.loops; i++) {
+        if (pthread_create(&s->loops[i].tid, NULL, server_routine,
+                           &s->loops[i])) {
+            fprintf(stderr, "Could not create a server thread\n");
+            exit(1);
+        }
+    }
+    return s;
+}
+
+unsigned short server_port(server* s) {
+    check_null_pointer(s);
+    return s->port;
+}
+
+void server_stop(server* s, server_stats* stats) {
+    check_null_pointer(s);
+    server_stats total = {0, 0};
+    for (unsigned int i = 0; i < s->opts.loops; i++) {
+        uint64_t one = 1;
+        if (write(s->loops[i].wake_fd, &one, sizeof(one)) < 0) {
+            fprintf(stderr, "Could not stop a server thread\n");
+            exit(1);
+        }
+    }
+    for (unsigned int i = 0; i < s->opts.loops; i++) {
+        pthread_join(s->loops[i].tid, NULL);
+        total.accepted += s->loops[i].accepted;
+        total.requests += s->loops[i].requests;
+    }
+    if (stats) {
+        *stats = total;
+    }
+    server_free(s);
+}
@@ -0,0 +1,144 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "logic.h"
+
+/* The game server hosts many games at once over TCP on the loopback
+   interface, a Unix socket, or both. Every connection is a session that
+   plays one game at a time with a line protocol: each request is a line
+   and gets a one-line reply.
+ *   new <width> <height> <run>  starts a game, replying "ok"
+ *   drop <column> | offset | disarray  plays a move for the player to move,
+ *      replying "ok " and the state after it: "black" or "white" for the
+ *      player to move, or "black-wins", "white-wins" or "draw"
+ *   state  replies "ok " and the state
+ *   board  replies "ok " and the rows from the top, as '.', '*' (black)
+ *      and 'o' (white), separated by '/'
+ *   reset  takes the game back to its start, replying "ok"
+ *   quit  replies "ok" and closes the session
+ * A request that cannot be served gets "error " and the reason instead.
+   Arguments are decimal numbers; a request with any other argument, or
+   with arguments it does not take, gets "error bad arguments".
+ * Each core runs an event loop on its own thread, pinned to it, waiting
+   on its sockets with epoll. For TCP every loop listens on its own socket
+   bound to the same port with SO_REUSEPORT, and the kernel spreads the
+   connections among them; a Unix socket is shared by the loops, which
+   take turns accepting from it. A session stays on the loop that
+   accepted it, so no game is ever touched by two threads and no lock is
+   taken while serving.
+ * Every loop allocates its sessions up front, each with fixed input and
+   output buffers, and a session's game is kept for the next connection
+   of its slot, reset rather than allocated again when the size matches.
+   A client that stops reading its replies is not read from until its
+   output buffer has drained */
+
+#define SERVER_MAX_LOOPS 256
+#define SERVER_MAX_SIDE 32
+#define SERVER_BUF 4096
+#define SERVER_SESSIONS 1024
+
+struct server_options {
+    bool tcp;
+    unsigned short port;
+    const char* unix_path;
+    unsigned int loops, sessions;
+};
+
+typedef struct server_options server_options;
+
+
+struct server_session {
+    int fd;
+    bool open, playing, closing, eof;
+    uint32_t events;
+    game* g;
+    unsigned int width, height, run;
+    outcome state;
+    unsigned int in_len, out_len, out_pos;
+    char in[SERVER_BUF], out[SERVER_BUF];
+};
+
+typedef struct server_session server_session;
+
+
+struct server_loop {
+    struct server* s;
+    unsigned int index;
+    int epfd, tcp_fd, wake_fd;
+    pthread_t tid;
+    server_session* sessions;
+    unsigned int* free;
+    unsigned int num_free;
+    unsigned long long accepted, requests;
+};
+
+typedef struct server_loop server_loop;
+
+
+struct server {
+    server_options opts;
+    unsigned short port;
+    int unix_fd;
+    char* unix_path;
+    server_loop* loops;
+};
+
+typedef struct server server;
+
+
+struct server_stats {
+    unsigned long long accepted, requests;
+};
+
+typedef struct server_stats server_stats;
+
+
+/**
+ * server_start
+ *
+ * Starts a server (see above) on its own threads.
+ *
+ * Parameters:
+ *   - opts: Whether to listen on TCP and on which port of 127.0.0.1, 0 for
+ *      one the system picks; the path of the Unix socket, which is
+ *      replaced, or NULL for none; the number of event loops, 0 for one
+ *      per core, at most SERVER_MAX_LOOPS; and the most sessions of each
+ *      loop, 0 for SERVER_SESSIONS, connections beyond them being closed
+ *      at once.
+ *
+ * Returns:
+ *   - A pointer to the running `server`, or NULL if it has no socket or
+ *      a socket could not be set up.
+ *
+ * Note:
+ *   - The caller is responsible for calling `server_stop`.
+ *   - Raises an error if memory allocation or thread creation fails.
+ */
+server* server_start(const server_options* opts);
+
+/**
+ * server_port
+ *
+ * Returns the TCP port a server listens on, 0 if none.
+ *
+ * Parameters:
+ *   - s: A pointer to the `server`.
+ */
+unsigned short server_port(server* s);
+
+/**
+ * server_stop
+ *
+ * Stops a server, closing its sessions and sockets, removing its Unix
+ *  socket and freeing it.
+ *
+ * Parameters:
+ *   - s: A pointer to the `server`.
+ *   - stats: Out-parameter receiving the connections accepted and the
+ *      requests served. May be NULL.
+ */
+void server_stop(server* s, server_stats* stats);
+
+#endif /* SERVER_H */
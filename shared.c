@@ -0,0 +1,80 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "pos.h"
+#include "shared.h"
+
+shared_table* shared_table_new(size_t bytes) {
+    size_t buckets = 1;
+    while (buckets * 2 * SHARED_BUCKET * sizeof(shared_entry) <= bytes) {
+        buckets *= 2;
+    }
+    size_t len = buckets * SHARED_BUCKET * sizeof(shared_entry);
+    static unsigned int made = 0;
+    char name[32];
+    snprintf(name, sizeof(name), "/tt-%d-%u", (int)getpid(),
+             __atomic_fetch_add(&made, 1, __ATOMIC_RELAXED));
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create shared memory %s\n", name);
+        exit(1);
+    }
+    shm_unlink(name);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, len) == 0) {
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %zu bytes of shared memory\n", len);
+        exit(1);
+    }
+    shared_table* t = (shared_table*)malloc(sizeof(shared_table));
+    check_malloc(t);
+    t->entries = (shared_entry*)map;
+    t->bucket_mask = buckets - 1;
+    t->bytes = len;
+    return t;
+}
+
+/* This helper function reads an entry, giving its key, or 0 and 0 if the
+   entry is empty */
+void shared_read(shared_entry* e, uint64_t* key, uint64_t* value) {
+    *value = __atomic_load_n(&e->value, __ATOMIC_ACQUIRE);
+    *key = __atomic_load_n(&e->check, __ATOMIC_RELAXED) ^ *value;
+}
+
+void shared_table_store(shared_table* t, uint64_t key, uint64_t value) {
+    shared_entry* bucket = t->entries + (key & t->bucket_mask) * SHARED_BUCKET;
+    shared_entry* e = &bucket[(key >> 32) % SHARED_BUCKET];
+    for (unsigned int i = 0; i < SHARED_BUCKET; i++) {
+        uint64_t k, v;
+        shared_read(&bucket[i], &k, &v);
+        if (k == key || v == 0) {
+            e = &bucket[i];
+            break;
+        }
+    }
+    __atomic_store_n(&e->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->check, key ^ value, __ATOMIC_RELEASE);
+}
+
+bool shared_table_probe(shared_table* t, uint64_t key, uint64_t* value) {
+    shared_entry* bucket = t->entries + (key & t->bucket_mask) * SHARED_BUCKET;
+    for (unsigned int i = 0; i < SHARED_BUCKET; i++) {
+        uint64_t k, v;
+        shared_read(&bucket[i], &k, &v);
+        if (v != 0 && k == key) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+void shared_table_free(shared_table* t) {
+    munmap(t->entries, t->bytes);
+    free(t);
+}
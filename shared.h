@@ -0,0 +1,102 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A shared table maps 64-bit keys to 64-bit values in a POSIX shared
+   memory segment, so that processes forked after it is made all read and
+   write the same entries.
+ * Entries are written and read without locks: an entry holds its value
+   and the value XORed with its key, and a read only returns a value if
+   the two agree with the key it looks for. Writes racing on an entry, or
+   left halfway by a process dying, make it miss rather than return a
+   wrong value, and nothing is ever held that could block the others.
+ * Keys go to buckets of SHARED_BUCKET entries, a cache line. A new key
+   takes an empty entry of its bucket, or else replaces one picked by its
+   key, so the table never fills up but forgets old keys.
+ * The segment is unlinked as soon as it is mapped: it has no name left
+   for other processes to open, and goes away with the last process using
+   it, however that process ends */
+
+#define SHARED_BUCKET 4
+
+struct shared_entry {
+    uint64_t check, value;
+};
+
+typedef struct shared_entry shared_entry;
+
+
+struct shared_table {
+    shared_entry* entries;
+    size_t bucket_mask, bytes;
+};
+
+typedef struct shared_table shared_table;
+
+
+/**
+ * shared_table_new
+ *
+ * Creates an empty table in a new shared memory segment.
+ *
+ * Parameters:
+ *   - bytes: The size of the table, rounded down to a power of two number
+ *      of buckets.
+ *
+ * Returns:
+ *   - A pointer to the new `shared_table`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `shared_table_free`.
+ *   - Raises an error if the segment cannot be created or mapped.
+ *   - On Linux the segment lives in /dev/shm, which must have room for it.
+ */
+shared_table* shared_table_new(size_t bytes);
+
+/**
+ * shared_table_store
+ *
+ * Sets the value of a key.
+ *
+ * Parameters:
+ *   - t: A pointer to the `shared_table`.
+ *   - key: The key.
+ *   - value: The value, not 0, which marks empty entries.
+ *
+ * Note:
+ *   - Safe to call from any thread of any process sharing the table.
+ */
+void shared_table_store(shared_table* t, uint64_t key, uint64_t value);
+
+/**
+ * shared_table_probe
+ *
+ * Looks up the value of a key.
+ *
+ * Parameters:
+ *   - t: A pointer to the `shared_table`.
+ *   - key: The key.
+ *   - value: Out-parameter receiving the value if the key is found.
+ *
+ * Returns:
+ *   - `true` if the table holds the key.
+ *
+ * Note:
+ *   - Safe to call from any thread of any process sharing the table.
+ */
+bool shared_table_probe(shared_table* t, uint64_t key, uint64_t* value);
+
+/**
+ * shared_table_free
+ *
+ * Unmaps the table. Other processes sharing it keep their mapping.
+ *
+ * Parameters:
+ *   - t: A pointer to the `shared_table`.
+ */
+void shared_table_free(shared_table* t);
+
+#endif /* SHARED_H */
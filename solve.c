@@ -0,0 +1,138 @@
+#include <string.h>
+#include <unistd.h>
+#include "pns.h"
+#include "trace.h"
+
+/* Solves a position of a configuration with the proof-number solver, with
+   one thread per core by default, printing the proof and disproof numbers
+   of the root every second. The position is the empty board, or the one
+   reached by the moves given with -p, separated by spaces: column numbers
+   counted from 0 for drops, '!' for offset and '^' for disarray. -M sets
+   the size of the table in megabytes and -t a time limit in seconds.
+   With -T, a Chrome trace of the solver threads is written to the given
+   file */
+
+struct solve_options {
+    unsigned int width, height, run, threads, seconds;
+    size_t table_bytes;
+    char* moves;
+    char* trace_path;
+};
+
+typedef struct solve_options solve_options;
+
+/* This helper function prints the usage line and exits */
+void solve_usage() {
+    fprintf(stderr, "Usage: solve -w <width> -h <height> -r <run> "
+                    "[-j <threads>] [-M <megabytes>] [-t <seconds>] "
+                    "[-p \"<moves>\"]\n"
+                    "             [-T <trace.json>]\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * By default every core is used and the table takes 1024 MB */
+void parse_solve_arguments(int argc, char** argv, solve_options* opts) {
+    memset(opts, 0, sizeof(solve_options));
+    opts->threads = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->table_bytes = (size_t)1024 << 20;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            solve_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'w':
+                opts->width = v;
+                break;
+            case 'h':
+                opts->height = v;
+                break;
+            case 'r':
+                opts->run = v;
+                break;
+            case 'j':
+                opts->threads = v;
+                break;
+            case 'M':
+                opts->table_bytes = (size_t)v << 20;
+                break;
+            case 't':
+                opts->seconds = v;
+                break;
+            case 'p':
+                opts->moves = argv[i + 1];
+                break;
+            case 'T':
+                opts->trace_path = argv[i + 1];
+                break;
+            default:
+                solve_usage();
+        }
+        i++;
+    }
+    if (opts->run == 0 || opts->width == 0 || opts->height == 0 ||
+        opts->threads == 0) {
+        solve_usage();
+    }
+}
+
+/* This helper function plays the moves of -p, exiting on an illegal one
+   or one played after the end of the game */
+void play_moves(game* g, char* moves) {
+    char* save;
+    for (char* tok = strtok_r(moves, " ", &save); tok;
+         tok = strtok_r(NULL, " ", &save)) {
+        move m;
+        if (strcmp(tok, "!") == 0) {
+            m = make_move(MOVE_OFFSET, 0);
+        } else if (strcmp(tok, "^") == 0) {
+            m = make_move(MOVE_DISARRAY, 0);
+        } else {
+            m = make_move(MOVE_DROP, atoi(tok));
+        }
+        if (game_outcome(g) != IN_PROGRESS || !play_move(g, m)) {
+            fprintf(stderr, "Illegal move %s\n", tok);
+            exit(1);
+        }
+    }
+}
+
+/* This is the progress callback of the solver */
+void print_progress(const pns_progress* p, void* arg) {
+    (void)arg;
+    printf("%s search: pn %u dn %u, %llu nodes, %.0f nodes/s, %zu entries, "
+           "%u collections\n", p->draw_search ? "Draw" : "Win", p->pn, p->dn,
+           p->nodes, p->nodes / p->seconds, p->entries, p->gc_runs);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    solve_options opts;
+    parse_solve_arguments(argc, argv, &opts);
+    game* g = new_game(opts.run, opts.width, opts.height, BITS);
+    if (opts.moves) {
+        play_moves(g, opts.moves);
+    }
+    if (opts.trace_path) {
+        trace_enable();
+    }
+    pns_solver* s = pns_new(opts.table_bytes);
+    pns_stats stats;
+    tb_result r = pns_solve(s, g, opts.threads, opts.seconds * 1000,
+                            print_progress, NULL, &stats);
+    static const char* names[] = {"unknown", "a win", "a loss", "a draw"};
+    printf("%s to move: %s%s\n",
+           g->player == BLACKS_TURN ? "Black" : "White", names[r],
+           stats.ply_limit && r != TB_WIN ? " (ply limit reached)" : "");
+    printf("%llu nodes in %.3f s, %.0f nodes/s, %u collections\n",
+           stats.nodes, stats.seconds,
+           stats.seconds > 0 ? stats.nodes / stats.seconds : 0.0,
+           stats.gc_runs);
+    if (opts.trace_path && !trace_flush(opts.trace_path)) {
+        fprintf(stderr, "Could not write trace to %s\n", opts.trace_path);
+    }
+    pns_free(s);
+    game_free(g);
+    return 0;
+}
@@ -0,0 +1,578 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+#include "split.h"
+
+/* The names of results in progress files */
+static const char* split_names[] = {"unknown", "win", "loss", "draw"};
+
+/* What a worker sends back once it has solved a job */
+struct split_reply {
+    uint32_t job;
+    tb_result result;
+    unsigned long long nodes;
+    double seconds;
+};
+
+typedef struct split_reply split_reply;
+
+
+/* A worker process with the pipes to and from it. pid is 0 while there
+   is no process, and job -1 while the worker waits for one */
+struct split_worker {
+    pid_t pid;
+    int to, from, job;
+};
+
+typedef struct split_worker split_worker;
+
+
+/* A solve as the parent process sees it */
+struct split_run {
+    const split_options* opts;
+    split_node* nodes;
+    unsigned int n, cap, jobs;
+    shared_table* shared;
+    split_worker* workers;
+    FILE* progress;
+    split_event_fn event;
+    void* arg;
+    split_stats* stats;
+};
+
+typedef struct split_run split_run;
+
+bool split_play(game* g, const char* moves) {
+    size_t len = strlen(moves);
+    char* copy = (char*)malloc(len + 1);
+    check_malloc(copy);
+    memcpy(copy, moves, len + 1);
+    bool ok = true;
+    char* save;
+    for (char* tok = strtok_r(copy, " ", &save); tok && ok;
+         tok = strtok_r(NULL, " ", &save)) {
+        move m;
+        if (strcmp(tok, "!") == 0) {
+            m = make_move(MOVE_OFFSET, 0);
+        } else if (strcmp(tok, "^") == 0) {
+            m = make_move(MOVE_DISARRAY, 0);
+        } else {
+            char* end;
+            unsigned long column = strtoul(tok, &end, 10);
+            if (*end != '\0' || column >= g->b->width) {
+                ok = false;
+                break;
+            }
+            m = make_move(MOVE_DROP, column);
+        }
+        ok = game_outcome(g) == IN_PROGRESS && play_move(g, m);
+    }
+    free(copy);
+    return ok;
+}
+
+/* This helper function sets up the position of a node: the root, then
+   the moves of its path */
+game* split_position(split_run* r, unsigned int i) {
+    const split_options* o = r->opts;
+    game* g = new_game(o->run, o->width, o->height, BITS);
+    split_play(g, o->moves ? o->moves : "");
+    split_play(g, r->nodes[i].path);
+    return g;
+}
+
+/* This helper function appends the token of a move to a path */
+void split_append(char* path, move m) {
+    size_t len = strlen(path);
+    const char* sep = len ? " " : "";
+    if (m.kind == MOVE_OFFSET) {
+        snprintf(path + len, SPLIT_PATH_LEN - len, "%s!", sep);
+    } else if (m.kind == MOVE_DISARRAY) {
+        snprintf(path + len, SPLIT_PATH_LEN - len, "%s^", sep);
+    } else {
+        snprintf(path + len, SPLIT_PATH_LEN - len, "%s%u", sep, m.column);
+    }
+}
+
+/* This helper function adds a node below a parent, -1 for the root, and
+   returns its index */
+unsigned int split_add(split_run* r, int parent) {
+    if (r->n == r->cap) {
+        r->cap = r->cap ? 2 * r->cap : 64;
+        r->nodes = (split_node*)realloc(r->nodes,
+                                        r->cap * sizeof(split_node));
+        check_malloc(r->nodes);
+    }
+    split_node* node = &r->nodes[r->n];
+    memset(node, 0, sizeof(split_node));
+    node->parent = parent;
+    node->result = TB_UNKNOWN;
+    if (parent >= 0) {
+        node->depth = r->nodes[parent].depth + 1;
+        strcpy(node->path, r->nodes[parent].path);
+    }
+    return r->n++;
+}
+
+/* This helper function gives a node the result of its position if the
+   game is over there, or a draw if the position repeats one above it */
+void split_settle_early(split_run* r, unsigned int i, game* g) {
+    split_node* node = &r->nodes[i];
+    node->key = game_key(g);
+    outcome o = game_outcome(g);
+    if (o != IN_PROGRESS) {
+        outcome won = g->player == BLACKS_TURN ? BLACK_WIN : WHITE_WIN;
+        node->result = o == DRAW ? TB_DRAW : o == won ? TB_WIN : TB_LOSS;
+        return;
+    }
+    for (int p = node->parent; p >= 0; p = r->nodes[p].parent) {
+        if (r->nodes[p].key == node->key) {
+            node->result = TB_DRAW;
+            return;
+        }
+    }
+}
+
+/* This helper function returns the result of a node from those of its
+   children: a win if one of them is lost, and otherwise, once they are
+   all known, a draw if one is drawn and a loss if not */
+tb_result split_combine(split_run* r, unsigned int i) {
+    bool unknown = false, draw = false;
+    split_node* node = &r->nodes[i];
+    for (unsigned int c = node->first; c < node->first + node->count; c++) {
+        tb_result result = r->nodes[c].result;
+        if (result == TB_LOSS) {
+            return TB_WIN;
+        }
+        unknown = unknown || result == TB_UNKNOWN;
+        draw = draw || result == TB_DRAW;
+    }
+    return unknown ? TB_UNKNOWN : draw ? TB_DRAW : TB_LOSS;
+}
+
+/* This helper function builds the tree from the root down to the jobs,
+   depth plies below it, and works out the results known without solving
+   anything. Returns the number of jobs */
+unsigned int split_build(split_run* r, unsigned int depth) {
+    r->n = 0;
+    unsigned int jobs = 0, root = split_add(r, -1);
+    game* g = split_position(r, root);
+    split_settle_early(r, root, g);
+    game_free(g);
+    for (unsigned int i = 0; i < r->n; i++) {
+        if (r->nodes[i].result != TB_UNKNOWN || r->nodes[i].depth == depth) {
+            continue;
+        }
+        g = split_position(r, i);
+        unsigned int width = g->b->width;
+        r->nodes[i].first = r->n;
+        for (unsigned int k = 0; k < width + 2; k++) {
+            move m = move_from_index(width, k);
+            if (!move_is_legal(g, m)) {
+                continue;
+            }
+            unsigned int c = split_add(r, i);
+            split_append(r->nodes[c].path, m);
+            game* after = split_position(r, c);
+            split_settle_early(r, c, after);
+            game_free(after);
+            if (r->nodes[c].result == TB_UNKNOWN && depth ==
+                r->nodes[c].depth) {
+                r->nodes[c].job = true;
+                jobs++;
+            }
+        }
+        r->nodes[i].count = r->n - r->nodes[i].first;
+        game_free(g);
+    }
+    for (unsigned int i = r->n; i-- > 0;) {
+        if (r->nodes[i].count > 0 && r->nodes[i].result == TB_UNKNOWN) {
+            r->nodes[i].result = split_combine(r, i);
+        }
+    }
+    return jobs;
+}
+
+/* This helper function records the result of a node and works out those
+   of the nodes above it that follow */
+void split_settle(split_run* r, unsigned int i, tb_result result) {
+    r->nodes[i].result = result;
+    for (int p = r->nodes[i].parent;
+         p >= 0 && r->nodes[p].result == TB_UNKNOWN;
+         p = r->nodes[p].parent) {
+        tb_result pr = split_combine(r, p);
+        if (pr == TB_UNKNOWN) {
+            break;
+        }
+        r->nodes[p].result = pr;
+    }
+}
+
+/* This helper function tells whether the result of a node could still
+   change that of the root */
+bool split_needed(split_run* r, unsigned int i) {
+    for (int p = i; p >= 0; p = r->nodes[p].parent) {
+        if (r->nodes[p].result != TB_UNKNOWN) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* This helper function counts the jobs with a result */
+unsigned int split_finished(split_run* r) {
+    unsigned int finished = 0;
+    for (unsigned int i = 0; i < r->n; i++) {
+        finished += r->nodes[i].job && r->nodes[i].result != TB_UNKNOWN;
+    }
+    return finished;
+}
+
+/* This helper function reports an event, if there is a callback */
+void split_report(split_run* r, unsigned int i, bool resumed, bool crashed,
+                  unsigned long long nodes, double seconds) {
+    if (!r->event) {
+        return;
+    }
+    split_event e;
+    e.path = r->nodes[i].path;
+    e.result = r->nodes[i].result;
+    e.resumed = resumed;
+    e.crashed = crashed;
+    e.nodes = nodes;
+    e.seconds = seconds;
+    e.finished = split_finished(r);
+    e.jobs = r->jobs;
+    r->event(&e, r->arg);
+}
+
+/* This helper function takes the result of a line of a progress file, a
+   path and a result name separated by a tab, if the path is that of a
+   node whose result is not yet known. Lines cut short by a crash are
+   skipped */
+void split_resume(split_run* r, char* line) {
+    char* tab = strrchr(line, '\t');
+    if (!tab) {
+        return;
+    }
+    *tab = '\0';
+    tab[1 + strcspn(tab + 1, "\n")] = '\0';
+    for (tb_result result = TB_WIN; result <= TB_DRAW; result++) {
+        if (strcmp(tab + 1, split_names[result]) != 0) {
+            continue;
+        }
+        for (unsigned int i = 0; i < r->n; i++) {
+            if (strcmp(r->nodes[i].path, line) == 0 &&
+                split_needed(r, i)) {
+                split_settle(r, i, result);
+                r->stats->resumed++;
+                split_report(r, i, true, false, 0, 0);
+                break;
+            }
+        }
+    }
+}
+
+/* This helper function opens the progress file for appending, after
+   reading back the results it holds, or writing its header if it is new.
+   Returns false if it cannot be opened or holds another solve */
+bool split_open_progress(split_run* r) {
+    const split_options* o = r->opts;
+    const char* moves = o->moves ? o->moves : "";
+    size_t cap = strlen(moves) + 64, at = 0;
+    char* header = (char*)malloc(cap);
+    check_malloc(header);
+    snprintf(header, cap, "# split %u %u %u\n# root %s\n", o->width,
+             o->height, o->run, moves);
+    bool ok = true, empty = true;
+    FILE* f = fopen(o->progress, "r");
+    if (f) {
+        char* line = NULL;
+        size_t size = 0;
+        ssize_t got;
+        while (ok && (got = getline(&line, &size, f)) > 0) {
+            empty = false;
+            if (at < strlen(header)) {
+                ok = strncmp(header + at, line, got) == 0;
+                at += got;
+            } else {
+                split_resume(r, line);
+            }
+        }
+        ok = ok && (empty || at == strlen(header));
+        free(line);
+        fclose(f);
+    }
+    if (ok) {
+        r->progress = fopen(o->progress, "a");
+        ok = r->progress != NULL;
+    }
+    if (ok && empty) {
+        fputs(header, r->progress);
+        fflush(r->progress);
+        fsync(fileno(r->progress));
+    }
+    free(header);
+    return ok;
+}
+
+/* This helper function appends the result of a job to the progress file
+   and makes sure it reaches the disk */
+void split_record(split_run* r, unsigned int i) {
+    if (!r->progress) {
+        return;
+    }
+    fprintf(r->progress, "%s\t%s\n", r->nodes[i].path,
+            split_names[r->nodes[i].result]);
+    fflush(r->progress);
+    fsync(fileno(r->progress));
+}
+
+/* This helper function is the life of a worker process: it solves the
+   jobs it is sent, with a solver of its own sharing the shared table,
+   until its pipe is closed */
+void split_work(split_run* r, int in, int out) {
+    pns_solver* s = pns_new(r->opts->table_bytes);
+    pns_share(s, r->shared);
+    uint32_t job;
+    while (read(in, &job, sizeof(job)) == sizeof(job)) {
+        game* g = split_position(r, job);
+        pns_stats ps;
+        split_reply reply;
+        reply.job = job;
+        reply.result = pns_solve(s, g, 1, 0, NULL, NULL, &ps);
+        reply.nodes = ps.nodes;
+        reply.seconds = ps.seconds;
+        game_free(g);
+        if (write(out, &reply, sizeof(reply)) != sizeof(reply)) {
+            break;
+        }
+    }
+    pns_free(s);
+    _exit(0);
+}
+
+/* This helper function starts the process of a worker. The process keeps
+   none of the pipes of the other workers, so that each one sees its pipe
+   close when the parent closes it, and is killed if the parent dies, so
+   that it does not go on with a job nobody waits for */
+void split_spawn(split_run* r, unsigned int w) {
+    int down[2], up[2];
+    if (pipe(down) != 0 || pipe(up) != 0) {
+        fprintf(stderr, "Cannot create the pipes of a worker\n");
+        exit(1);
+    }
+    fflush(NULL);
+    pid_t parent = getpid(), pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Cannot start a worker\n");
+        exit(1);
+    } else if (pid == 0) {
+        /* Elsewhere than on Linux a worker whose parent died only quits
+           once its job is done and its pipe found closed */
+#if defined(__linux__)
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+        if (getppid() != parent) {
+            _exit(1);
+        }
+        for (unsigned int i = 0; i < r->opts->workers; i++) {
+            if (r->workers[i].pid) {
+                close(r->workers[i].to);
+                close(r->workers[i].from);
+            }
+        }
+        close(down[1]);
+        close(up[0]);
+        split_work(r, down[0], up[1]);
+    }
+    close(down[0]);
+    close(up[1]);
+    r->workers[w].pid = pid;
+    r->workers[w].to = down[1];
+    r->workers[w].from = up[0];
+    r->workers[w].job = -1;
+}
+
+/* This helper function closes the pipes of a worker, killing it first if
+   kill_it is set, and waits for its process to end */
+void split_reap(split_run* r, split_worker* w, bool kill_it) {
+    if (kill_it) {
+        kill(w->pid, SIGKILL);
+    }
+    close(w->to);
+    close(w->from);
+    while (waitpid(w->pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    if (w->job >= 0) {
+        r->nodes[w->job].running = false;
+    }
+    w->pid = 0;
+    w->job = -1;
+}
+
+/* This helper function returns the first job still needed that is not
+   being solved and has not failed, -1 if there is none */
+int split_next_job(split_run* r) {
+    for (unsigned int i = 0; i < r->n; i++) {
+        split_node* node = &r->nodes[i];
+        if (node->job && !node->running && !node->failed &&
+            split_needed(r, i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* This helper function hands a job to every idle worker while there are
+   jobs, starting the processes of workers that have none. A worker that
+   died while idle is started again */
+void split_dispatch(split_run* r) {
+    for (unsigned int w = 0; w < r->opts->workers; w++) {
+        split_worker* wk = &r->workers[w];
+        int job = wk->job < 0 ? split_next_job(r) : -1;
+        if (job < 0) {
+            continue;
+        }
+        uint32_t j = job;
+        for (unsigned int tries = 0;; tries++) {
+            if (!wk->pid) {
+                split_spawn(r, w);
+            }
+            if (write(wk->to, &j, sizeof(j)) == sizeof(j)) {
+                break;
+            } else if (tries == 1) {
+                fprintf(stderr, "Cannot reach a new worker\n");
+                exit(1);
+            }
+            split_reap(r, wk, true);
+        }
+        wk->job = job;
+        r->nodes[job].running = true;
+    }
+}
+
+/* This helper function takes the reply of a worker, or if it died, hands
+   its job back, unless the job failed SPLIT_RETRIES times. A result that
+   is no longer needed, as a sibling settled the parent meanwhile, is
+   neither counted nor recorded, just as it would not be resumed */
+void split_receive(split_run* r, split_worker* w) {
+    unsigned int job = w->job;
+    split_node* node = &r->nodes[job];
+    split_reply reply;
+    if (read(w->from, &reply, sizeof(reply)) == sizeof(reply) &&
+        reply.job == job && reply.result != TB_UNKNOWN) {
+        w->job = -1;
+        node->running = false;
+        r->stats->nodes += reply.nodes;
+        if (split_needed(r, job)) {
+            r->stats->solved++;
+            split_settle(r, job, reply.result);
+            split_record(r, job);
+        }
+        split_report(r, job, false, false, reply.nodes, reply.seconds);
+    } else {
+        r->stats->crashes++;
+        node->attempts++;
+        node->failed = node->attempts >= SPLIT_RETRIES;
+        split_reap(r, w, true);
+        split_report(r, job, false, true, 0, 0);
+    }
+}
+
+bool split_solve(const split_options* opts, split_event_fn event, void* arg,
+                 split_stats* stats) {
+    check_null_pointer((void*)opts);
+    uint64_t start = now_ns();
+    memset(stats, 0, sizeof(split_stats));
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    bool legal = split_play(g, opts->moves ? opts->moves : "");
+    game_free(g);
+    if (!legal) {
+        return false;
+    }
+    split_run r;
+    memset(&r, 0, sizeof(split_run));
+    r.opts = opts;
+    r.event = event;
+    r.arg = arg;
+    r.stats = stats;
+    unsigned int depth = opts->depth ? opts->depth : 1;
+    r.jobs = split_build(&r, depth);
+    while (!opts->depth && depth < SPLIT_MAX_DEPTH &&
+           r.jobs < opts->workers && r.nodes[0].result == TB_UNKNOWN) {
+        r.jobs = split_build(&r, ++depth);
+    }
+    stats->depth = depth;
+    stats->jobs = r.jobs;
+    if (opts->progress && !split_open_progress(&r)) {
+        free(r.nodes);
+        return false;
+    }
+    r.shared = shared_table_new(opts->shared_bytes);
+    r.workers = (split_worker*)calloc(opts->workers, sizeof(split_worker));
+    check_malloc(r.workers);
+    for (unsigned int w = 0; w < opts->workers; w++) {
+        r.workers[w].job = -1;
+    }
+    struct sigaction ignore, old_pipe;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &old_pipe);
+    struct pollfd fds[opts->workers];
+    split_worker* owners[opts->workers];
+    while (r.nodes[0].result == TB_UNKNOWN) {
+        split_dispatch(&r);
+        unsigned int n = 0;
+        for (unsigned int w = 0; w < opts->workers; w++) {
+            if (r.workers[w].job >= 0) {
+                fds[n].fd = r.workers[w].from;
+                fds[n].events = POLLIN;
+                owners[n++] = &r.workers[w];
+            }
+        }
+        if (n == 0) {
+            break;
+        } else if (poll(fds, n, -1) < 0) {
+            continue;
+        }
+        for (unsigned int k = 0; k < n; k++) {
+            if (fds[k].revents) {
+                split_receive(&r, owners[k]);
+            }
+        }
+        for (unsigned int w = 0; w < opts->workers; w++) {
+            if (r.workers[w].job >= 0 && !split_needed(&r, r.workers[w].job)) {
+                split_reap(&r, &r.workers[w], true);
+            }
+        }
+    }
+    for (unsigned int w = 0; w < opts->workers; w++) {
+        if (r.workers[w].pid) {
+            split_reap(&r, &r.workers[w], r.workers[w].job >= 0);
+        }
+    }
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    for (unsigned int i = 0; i < r.n; i++) {
+        if (r.nodes[i].job && r.nodes[i].result == TB_UNKNOWN) {
+            stats->failed += r.nodes[i].failed;
+            stats->skipped += !r.nodes[i].failed;
+        }
+    }
+    stats->result = r.nodes[0].result;
+    stats->seconds = (now_ns() - start) / 1e9;
+    if (r.progress) {
+        fclose(r.progress);
+    }
+    shared_table_free(r.shared);
+    free(r.workers);
+    free(r.nodes);
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include "pns.h"
+
+/* The split solver shares the solve of a position between processes, for
+   solves that take days and should use every core of a large machine
+   while a fault only costs the job it happens in.
+ * The positions a few plies below the root are the jobs. The parent
+   process forks workers and hands them jobs over pipes. Each worker
+   solves its job with the proof-number solver (see pns.h) and sends back
+   the result. The result of the root follows from those of the jobs, and
+   a job that can no longer change it is dropped, or its worker killed if
+   it is being solved. Moves ending the game, or repeating a position
+   above, give results directly, as in the solver.
+ * Workers publish the positions they solve in a table in a POSIX shared
+   memory segment (see shared.h), whose entries are written and read
+   without locks, so that a worker dying halfway through a write can
+   neither block the others nor feed them a wrong result.
+ * A worker that dies, from a crash or a signal, is replaced and its job
+   handed out again, up to SPLIT_RETRIES times.
+ * Each result is appended to a progress file as soon as it arrives,
+   after a header naming the configuration and the root. A solve started
+   again with the same file does not redo the jobs it holds, whatever
+   split they were found with */
+
+#define SPLIT_RETRIES 3
+#define SPLIT_MAX_DEPTH 4
+#define SPLIT_PATH_LEN 32
+
+struct split_options {
+    unsigned int width, height, run, workers, depth;
+    size_t table_bytes, shared_bytes;
+    const char* moves;
+    const char* progress;
+};
+
+typedef struct split_options split_options;
+
+
+struct split_node {
+    int parent;
+    unsigned int first, count, depth, attempts;
+    uint64_t key;
+    tb_result result;
+    bool job, running, failed;
+    char path[SPLIT_PATH_LEN];
+};
+
+typedef struct split_node split_node;
+
+
+struct split_event {
+    const char* path;
+    tb_result result;
+    bool resumed, crashed;
+    unsigned long long nodes;
+    double seconds;
+    unsigned int finished, jobs;
+};
+
+typedef struct split_event split_event;
+
+
+/* An event callback receives each job result, read from the progress file
+   or sent by a worker, and each worker death, with the path of the job
+   from the root, the result for the player to move there, TB_UNKNOWN for
+   a death, the positions searched and the time taken by the worker, the
+   number of jobs with a result and the number of jobs, and the callback's
+   argument */
+typedef void (*split_event_fn)(const split_event* e, void* arg);
+
+
+/* solved counts the jobs whose result a worker found while it was still
+   needed, which are those written to the progress file, and resumed the
+   jobs whose result was read back from it. skipped counts the jobs left
+   without a result as they were not needed */
+struct split_stats {
+    tb_result result;
+    unsigned int depth, jobs, solved, resumed, skipped, crashes, failed;
+    unsigned long long nodes;
+    double seconds;
+};
+
+typedef struct split_stats split_stats;
+
+
+/**
+ * split_play
+ *
+ * Plays a list of moves separated by spaces: column numbers counted from
+ *  0 for drops, '!' for offset and '^' for disarray.
+ *
+ * Parameters:
+ *   - g: A pointer to the `game` structure.
+ *   - moves: The moves.
+ *
+ * Returns:
+ *   - `true` if every move was legal and played before the game ended.
+ *      Otherwise the moves before the faulty one are played.
+ */
+bool split_play(game* g, const char* moves);
+
+/**
+ * split_solve
+ *
+ * Solves a position with worker processes.
+ *
+ * Parameters:
+ *   - opts: The configuration and the root, as moves for `split_play` from
+ *      the empty board, or NULL for the empty board. workers is the number
+ *      of worker processes, each with a table of table_bytes for its
+ *      solver, and shared_bytes is the size of the shared table. depth is
+ *      the number of plies from the root to the jobs, from 1 to
+ *      SPLIT_MAX_DEPTH, or 0 for the least giving a job to every worker.
+ *      progress is the path of the progress file, or NULL for none.
+ *   - event: Called in the parent process with every result and worker
+ *      death. May be NULL.
+ *   - arg: The argument passed to event.
+ *   - stats: Out-parameter receiving the result for the player to move at
+ *      the root, TB_UNKNOWN if jobs it needed failed too often, the depth
+ *      of the jobs and the counts of the solve.
+ *
+ * Returns:
+ *   - `true` on success.
+ *   - `false` if the moves of the root are illegal, or the progress file
+ *      cannot be opened or belongs to another solve.
+ *
+ * Note:
+ *   - Raises an error if processes, pipes or the shared table cannot be
+ *      created.
+ */
+bool split_solve(const split_options* opts, split_event_fn event, void* arg,
+                 split_stats* stats);
+
+#endif /* SPLIT_H */
@@ -0,0 +1,103 @@
+#include "state.h"
+
+/* This helper function returns the number of bits needed to write every
+   value up to n */
+unsigned int bits_for(unsigned int n) {
+    unsigned int bits = 1;
+    while (bits < 32 && (n >> bits) != 0) {
+        bits++;
+    }
+    return bits;
+}
+
+bool state_supported(unsigned int width, unsigned int height) {
+    if (width == 0 || height == 0 || width > 64 || height > 64) {
+        return false;
+    }
+    unsigned int cells = width * height;
+    return 1 + 2 * bits_for(cells) + cells * bits_for(cells - 1) <= 128;
+}
+
+/* This helper function packs the cells of a queue into k at bit *at */
+void encode_queue(state_key* k, unsigned int* at, posqueue* q, 
+                  unsigned int width, unsigned int cell_bits) {
+    for (pq_entry* e = q->head; e; e = e->next) {
+        *k |= (state_key)(e->p.r * width + e->p.c) << *at;
+        *at += cell_bits;
+    }
+}
+
+state_key state_encode(game* g) {
+    check_null_pointer(g);
+    unsigned int cells = g->b->width * g->b->height;
+    unsigned int count_bits = bits_for(cells), cell_bits = bits_for(cells - 1);
+    state_key k = g->player == WHITES_TURN;
+    unsigned int at = 1;
+    k |= (state_key)(g->black_queue->len + g->white_queue->len) << at;
+    at += count_bits;
+    k |= (state_key)g->black_queue->len << at;
+    at += count_bits;
+    encode_queue(&k, &at, g->black_queue, g->b->width, cell_bits);
+    encode_queue(&k, &at, g->white_queue, g->b->width, cell_bits);
+    return k;
+}
+
+unsigned int state_pieces(state_key k, unsigned int width, 
+                          unsigned int height) {
+    unsigned int count_bits = bits_for(width * height);
+    return (unsigned int)(k >> 1) & ((1u << count_bits) - 1);
+}
+
+void state_load(game* g, state_key k) {
+    check_null_pointer(g);
+    board* b = g->b;
+    unsigned int width = b->width, cells = width * b->height;
+    unsigned int count_bits = bits_for(cells), cell_bits = bits_for(cells - 1);
+    unsigned int count_mask = (1u << count_bits) - 1, 
+                 cell_mask = (1u << cell_bits) - 1;
+    posqueue* queues[] = {g->black_queue, g->white_queue};
+    for (unsigned int i = 0; i < 2; i++) {
+        for (pq_entry* e = queues[i]->head; e; e = e->next) {
+            board_set(b, e->p, EMPTY);
+        }
+        posqueue_free(queues[i]);
+    }
+    g->player = (k & 1) ? WHITES_TURN : BLACKS_TURN;
+    unsigned int pieces = (unsigned int)(k >> 1) & count_mask;
+    unsigned int black_len = (unsigned int)(k >> (1 + count_bits)) & 
+                             count_mask;
+    unsigned int at = 1 + 2 * count_bits;
+    pos ps[pieces ? pieces : 1];
+    for (unsigned int i = 0; i < pieces; i++, at += cell_bits) {
+        unsigned int cell_index = (unsigned int)(k >> at) & cell_mask;
+        ps[i] = make_pos(cell_index / width, cell_index % width);
+        board_set(b, ps[i], i < black_len ? BLACK : WHITE);
+    }
+    g->black_queue = posqueue_from_array(ps, black_len);
+    g->white_queue = posqueue_from_array(ps + black_len, pieces - black_len);
+    if (g->windows) {
+        window_counts_rebuild(g->windows, b);
+    }
+}
+
+state_key state_mirror(state_key k, unsigned int width, unsigned int height) {
+    unsigned int cells = width * height;
+    unsigned int count_bits = bits_for(cells), cell_bits = bits_for(cells - 1);
+    unsigned int pieces = (unsigned int)(k >> 1) & ((1u << count_bits) - 1);
+    state_key cell_mask = (1u << cell_bits) - 1;
+    state_key m = k;
+    for (unsigned int i = 0, at = 1 + 2 * count_bits; i < pieces; 
+         i++, at += cell_bits) {
+        unsigned int cell_index = (unsigned int)((k >> at) & cell_mask);
+        unsigned int c = cell_index % width;
+        m &= ~(cell_mask << at);
+        m |= (state_key)(cell_index - c + width - 1 - c) << at;
+    }
+    return m;
+}
+
+state_key state_canonical(state_key k, unsigned int width, 
+                          unsigned int height) {
+    state_key m = state_mirror(k, width, height);
+    return m < k ? m : k;
+}
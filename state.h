@@ -0,0 +1,97 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include "logic.h"
+
+/* A state key packs a whole game state of a small board into 128 bits, for
+   exhaustive searches that have to store every position they visit.
+ * From the low bits up it holds the player to move, the number of pieces,
+   the length of the black queue and then the cell r * width + c of every
+   queued piece, black queue first, oldest first. The board is implied by
+   the queues and the white queue length by the two counts.
+ * Counts take just enough bits to hold width * height and cells enough to
+   hold width * height - 1, so boards up to 5x4 (and a few slightly larger
+   ones, see `state_supported`) fit. Keys of the same configuration compare
+   as plain integers */
+
+typedef unsigned __int128 state_key;
+
+/**
+ * state_supported
+ *
+ * Tells whether every state of a board size fits in a state key.
+ *
+ * Parameters:
+ *   - width: The number of columns (unsigned integer).
+ *   - height: The number of rows (unsigned integer).
+ */
+bool state_supported(unsigned int width, unsigned int height);
+
+/**
+ * state_encode
+ *
+ * Packs the state of a game into a key.
+ *
+ * Parameters:
+ *   - g: A pointer to the `game` structure, of a supported size.
+ *
+ * Returns:
+ *   - The key of the game's state.
+ */
+state_key state_encode(game* g);
+
+/**
+ * state_pieces
+ *
+ * Returns the number of pieces on the board of the state a key encodes.
+ *
+ * Parameters:
+ *   - k: The state key.
+ *   - width: The number of columns (unsigned integer).
+ *   - height: The number of rows (unsigned integer).
+ */
+unsigned int state_pieces(state_key k, unsigned int width, 
+                          unsigned int height);
+
+/**
+ * state_load
+ *
+ * Puts a game in the state a key encodes, reusing the game's board. Each 
+ *  queue is rebuilt with a single allocation.
+ *
+ * Parameters:
+ *   - g: A pointer to a `game` of the key's size, in any state.
+ *   - k: The state key.
+ */
+void state_load(game* g, state_key k);
+
+/**
+ * state_mirror
+ *
+ * Returns the key of the mirror image of a state, with every piece moved 
+ *  from column c to column width - 1 - c and the queues kept in order.
+ *
+ * Parameters:
+ *   - k: The state key.
+ *   - width: The number of columns (unsigned integer).
+ *   - height: The number of rows (unsigned integer).
+ */
+state_key state_mirror(state_key k, unsigned int width, unsigned int height);
+
+/**
+ * state_canonical
+ *
+ * Returns the smaller of a state key and the key of its mirror image. A 
+ *  state and its mirror image have the same value under perfect play, so 
+ *  exhaustive tables only need to store one of them.
+ *
+ * Parameters:
+ *   - k: The state key.
+ *   - width: The number of columns (unsigned integer).
+ *   - height: The number of rows (unsigned integer).
+ */
+state_key state_canonical(state_key k, unsigned int width, 
+                          unsigned int height);
+
+#endif /* STATE_H */
@@ -0,0 +1,93 @@
+#include <string.h>
+#include "hash.h"
+#include "stateset.h"
+
+stateset* stateset_new(size_t max_bytes) {
+    size_t slots = 1024;
+    while (slots * 2 * sizeof(state_slot) <= max_bytes) {
+        slots *= 2;
+    }
+    stateset* s = (stateset*)malloc(sizeof(stateset));
+    check_malloc(s);
+    s->slots = (state_slot*)calloc(slots, sizeof(state_slot));
+    check_malloc(s->slots);
+    s->mask = slots - 1;
+    s->count = 0;
+    return s;
+}
+
+/* This helper function hashes a key. Tags are the hash with its two low 
+   bits replaced, so that they never equal STATESET_EMPTY or STATESET_BUSY */
+uint64_t hash_state(state_key k) {
+    return mix64((uint64_t)k ^ mix64((uint64_t)(k >> 64)));
+}
+
+bool stateset_insert(stateset* s, state_key k) {
+    uint64_t h = hash_state(k), tag = (h & ~(uint64_t)3) | 2;
+    uint64_t lo = (uint64_t)k, hi = (uint64_t)(k >> 64);
+    for (size_t probes = 0, i = h & s->mask; probes <= s->mask; 
+         probes++, i = (i + 1) & s->mask) {
+        state_slot* slot = &s->slots[i];
+        uint64_t t = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+        if (t == STATESET_EMPTY) {
+            uint64_t expected = STATESET_EMPTY;
+            if (__atomic_compare_exchange_n(&slot->tag, &expected, 
+                                            STATESET_BUSY, false, 
+                                            __ATOMIC_ACQUIRE, 
+                                            __ATOMIC_ACQUIRE)) {
+                slot->lo = lo;
+                slot->hi = hi;
+                __atomic_store_n(&slot->tag, tag, __ATOMIC_RELEASE);
+                __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+                return true;
+            }
+            t = expected;
+        }
+        while (t == STATESET_BUSY) {
+            t = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+        }
+        if (t == tag && slot->lo == lo && slot->hi == hi) {
+            return false;
+        }
+    }
+    fprintf(stderr, "State set is full\n");
+    exit(1);
+}
+
+double stateset_load(stateset* s) {
+    return (double)__atomic_load_n(&s->count, __ATOMIC_RELAXED) / 
+           (s->mask + 1);
+}
+
+/* This helper function orders state keys for qsort */
+int compare_state_keys(const void* a, const void* b) {
+    state_key x = *(const state_key*)a, y = *(const state_key*)b;
+    return (x > y) - (x < y);
+}
+
+size_t stateset_drain(stateset* s, state_key** out) {
+    check_null_pointer(s);
+    state_key* keys = (state_key*)s->slots;
+    size_t n = 0;
+    for (size_t i = 0; i <= s->mask; i++) {
+        state_slot slot = s->slots[i];
+        if (slot.tag != STATESET_EMPTY) {
+            keys[n++] = (state_key)slot.hi << 64 | slot.lo;
+        }
+    }
+    qsort(keys, n, sizeof(state_key), compare_state_keys);
+    *out = keys;
+    return n;
+}
+
+void stateset_clear(stateset* s) {
+    check_null_pointer(s);
+    memset(s->slots, 0, sizeof(state_slot) * (s->mask + 1));
+    s->count = 0;
+}
+
+void stateset_free(stateset* s) {
+    check_null_pointer(s);
+    free(s->slots);
+    free(s);
+}
@@ -0,0 +1,117 @@
+#ifndef STATESET_H
+#define STATESET_H
+
+#include <stdint.h>
+#include "state.h"
+
+/* A state set is a fixed-size open-addressing hash set of state keys that 
+   many threads can insert into at once without locks.
+ * A slot is claimed by a compare-and-swap of its tag from empty to busy, 
+   after which the claiming thread writes the key and publishes the tag, a
+   fingerprint of the key's hash. Threads probing past a slot only wait if
+   they find it busy, for the few stores it takes to fill it. Keys are never
+   removed one by one; the whole set is drained at once instead */
+
+#define STATESET_EMPTY 0
+#define STATESET_BUSY 1
+
+struct state_slot {
+    uint64_t tag, lo, hi;
+};
+
+typedef struct state_slot state_slot;
+
+
+struct stateset {
+    state_slot* slots;
+    size_t mask, count;
+};
+
+typedef struct stateset stateset;
+
+
+/**
+ * stateset_new
+ *
+ * Creates an empty set as large as fits in a memory budget.
+ *
+ * Parameters:
+ *   - max_bytes: The memory the slots may take.
+ *
+ * Returns:
+ *   - A pointer to the new `stateset`. Its number of slots is the largest 
+ *      power of two that fits, and at least 1024.
+ *
+ * Note:
+ *   - The caller is responsible for calling `stateset_free`.
+ */
+stateset* stateset_new(size_t max_bytes);
+
+/**
+ * stateset_insert
+ *
+ * Adds a key to the set. Safe to call from several threads at once.
+ *
+ * Parameters:
+ *   - s: A pointer to the `stateset`.
+ *   - k: The key.
+ *
+ * Returns:
+ *   - `true` if the key was not in the set yet, `false` otherwise.
+ *
+ * Note:
+ *   - Raises an error if the set is full. Callers are expected to drain it
+ *      well before that, see `stateset_load`.
+ */
+bool stateset_insert(stateset* s, state_key k);
+
+/**
+ * stateset_load
+ *
+ * Returns the share of slots in use, between 0 and 1.
+ *
+ * Parameters:
+ *   - s: A pointer to the `stateset`.
+ */
+double stateset_load(stateset* s);
+
+/**
+ * stateset_drain
+ *
+ * Sorts every key of the set in increasing order inside the set's own 
+ *  memory, so that spilling a full set needs no allocation.
+ *
+ * Parameters:
+ *   - s: A pointer to the `stateset`. No insertion may run concurrently.
+ *   - out: Out-parameter receiving the sorted keys.
+ *
+ * Returns:
+ *   - The number of keys.
+ *
+ * Note:
+ *   - The set must be emptied with `stateset_clear` before it is used 
+ *      again, which also invalidates the keys.
+ */
+size_t stateset_drain(stateset* s, state_key** out);
+
+/**
+ * stateset_clear
+ *
+ * Removes every key from the set.
+ *
+ * Parameters:
+ *   - s: A pointer to the `stateset`. No insertion may run concurrently.
+ */
+void stateset_clear(stateset* s);
+
+/**
+ * stateset_free
+ *
+ * Frees the set.
+ *
+ * Parameters:
+ *   - s: A pointer to the `stateset`.
+ */
+void stateset_free(stateset* s);
+
+#endif /* STATESET_H */
@@ -0,0 +1,535 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tb.h"
+#include "trace.h"
+
+/* States handed to a thread at a time during generation */
+#define TB_CHUNK 1024
+
+#define TB_VALUE(result, plies) ((uint16_t)((result) | ((plies) << 2)))
+#define TB_RESULT(value) ((tb_result)((value) & 0x3))
+#define TB_PLIES(value) ((unsigned int)((value) >> 2))
+
+
+struct tb_shard {
+    state_key* keys;
+    uint16_t* values;
+    size_t len;
+};
+
+typedef struct tb_shard tb_shard;
+
+
+struct tb_job {
+    tb_options* opts;
+    tb_shard* shards;
+    unsigned int num_shards;
+    size_t* starts;
+    size_t total, next;
+    state_key* frontier;
+    size_t frontier_len;
+    unsigned int round;
+    unsigned long long changed;
+};
+
+typedef struct tb_job tb_job;
+
+
+struct tb_worker {
+    tb_job* job;
+    state_key* found;
+    size_t found_len, found_cap;
+};
+
+typedef struct tb_worker tb_worker;
+
+/* This helper function orders state keys for qsort */
+int compare_keys(const void* a, const void* b) {
+    state_key x = *(const state_key*)a, y = *(const state_key*)b;
+    return (x > y) - (x < y);
+}
+
+/* This helper function returns the index of key among the len sorted keys,
+   or len if it is missing */
+size_t find_key(const state_key* keys, size_t len, state_key key) {
+    size_t lo = 0, hi = len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keys[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < len && keys[lo] == key ? lo : len;
+}
+
+/* This helper function runs routine on every worker, one thread each */
+void run_workers(tb_worker* workers, unsigned int n,
+                 void* (*routine)(void*)) {
+    pthread_t tids[n];
+    for (unsigned int i = 0; i < n; i++) {
+        pthread_create(&tids[i], NULL, routine, &workers[i]);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        pthread_join(tids[i], NULL);
+    }
+}
+
+/* This helper function appends a key to a worker's output */
+void push_found(tb_worker* w, state_key k) {
+    if (w->found_len == w->found_cap) {
+        w->found_cap = w->found_cap ? 2 * w->found_cap : 4096;
+        w->found = (state_key*)realloc(w->found,
+                                       sizeof(state_key) * w->found_cap);
+        check_malloc(w->found);
+    }
+    w->found[w->found_len++] = k;
+}
+
+/* This is the thread routine of the enumeration. Each thread claims chunks
+   of the frontier and writes out every successor of the states that are
+   not over. A move only needs the state reloaded if it changed the game */
+void* expand_routine(void* arg) {
+    tb_worker* w = (tb_worker*)arg;
+    tb_job* job = w->job;
+    tb_options* opts = job->opts;
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    size_t start;
+    while ((start = __atomic_fetch_add(&job->next, TB_CHUNK,
+                                       __ATOMIC_RELAXED)) <
+           job->frontier_len) {
+        size_t end = start + TB_CHUNK < job->frontier_len ?
+                     start + TB_CHUNK : job->frontier_len;
+        trace_begin("tb_expand_chunk");
+        for (size_t i = start; i < end; i++) {
+            state_load(g, job->frontier[i]);
+            if (game_outcome(g) != IN_PROGRESS) {
+                continue;
+            }
+            for (unsigned int m = 0; m < opts->width + 2; m++) {
+                if (play_move(g, move_from_index(opts->width, m))) {
+                    push_found(w, state_canonical(state_encode(g), 
+                                                  opts->width, opts->height));
+                    state_load(g, job->frontier[i]);
+                }
+            }
+        }
+        trace_end("tb_expand_chunk");
+    }
+    game_free(g);
+    return NULL;
+}
+
+/* This helper function adds the sorted, distinct candidates of one piece
+   count to its shard and appends the ones that were not there yet to the
+   new frontier, whose length is *frontier_len */
+void merge_shard(tb_shard* s, state_key* cand, size_t n,
+                 state_key* frontier, size_t* frontier_len) {
+    state_key* keys = (state_key*)malloc(sizeof(state_key) *
+                                         (s->len + n ? s->len + n : 1));
+    check_malloc(keys);
+    size_t i = 0, j = 0, len = 0;
+    while (i < s->len || j < n) {
+        if (j == n || (i < s->len && s->keys[i] < cand[j])) {
+            keys[len++] = s->keys[i++];
+        } else if (i < s->len && s->keys[i] == cand[j]) {
+            keys[len++] = s->keys[i++];
+            j++;
+        } else {
+            frontier[(*frontier_len)++] = cand[j];
+            keys[len++] = cand[j++];
+        }
+    }
+    free(s->keys);
+    s->keys = keys;
+    s->len = len;
+}
+
+/* This helper function enumerates every reachable state into the shards.
+ * It returns false if they outgrow the memory bound */
+bool enumerate_states(tb_job* job, tb_worker* workers) {
+    tb_options* opts = job->opts;
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    state_key root = state_encode(g);
+    game_free(g);
+    job->shards[0].keys = (state_key*)malloc(sizeof(state_key));
+    check_malloc(job->shards[0].keys);
+    job->shards[0].keys[0] = root;
+    job->shards[0].len = 1;
+    job->total = 1;
+    job->frontier = (state_key*)malloc(sizeof(state_key));
+    check_malloc(job->frontier);
+    job->frontier[0] = root;
+    job->frontier_len = 1;
+    while (job->frontier_len) {
+        job->next = 0;
+        run_workers(workers, opts->threads, expand_routine);
+        size_t found = 0;
+        for (unsigned int t = 0; t < opts->threads; t++) {
+            found += workers[t].found_len;
+        }
+        if ((job->total * 2 + found * 3) * sizeof(state_key) >
+            opts->max_memory) {
+            return false;
+        }
+        size_t counts[job->num_shards + 1];
+        memset(counts, 0, sizeof(counts));
+        for (unsigned int t = 0; t < opts->threads; t++) {
+            for (size_t i = 0; i < workers[t].found_len; i++) {
+                counts[state_pieces(workers[t].found[i], opts->width,
+                                    opts->height) + 1]++;
+            }
+        }
+        for (unsigned int s = 0; s < job->num_shards; s++) {
+            counts[s + 1] += counts[s];
+        }
+        state_key* cand = (state_key*)malloc(sizeof(state_key) *
+                                             (found ? found : 1));
+        check_malloc(cand);
+        size_t fill[job->num_shards];
+        memcpy(fill, counts, sizeof(fill));
+        for (unsigned int t = 0; t < opts->threads; t++) {
+            for (size_t i = 0; i < workers[t].found_len; i++) {
+                state_key k = workers[t].found[i];
+                cand[fill[state_pieces(k, opts->width, opts->height)]++] = k;
+            }
+            workers[t].found_len = 0;
+        }
+        free(job->frontier);
+        job->frontier = (state_key*)malloc(sizeof(state_key) *
+                                           (found ? found : 1));
+        check_malloc(job->frontier);
+        job->frontier_len = 0;
+        for (unsigned int s = 0; s < job->num_shards; s++) {
+            state_key* part = cand + counts[s];
+            size_t n = counts[s + 1] - counts[s], distinct = 0;
+            qsort(part, n, sizeof(state_key), compare_keys);
+            for (size_t i = 0; i < n; i++) {
+                if (distinct == 0 || part[i] != part[distinct - 1]) {
+                    part[distinct++] = part[i];
+                }
+            }
+            size_t before = job->frontier_len;
+            merge_shard(&job->shards[s], part, distinct, job->frontier,
+                        &job->frontier_len);
+            job->total += job->frontier_len - before;
+        }
+        free(cand);
+    }
+    free(job->frontier);
+    job->frontier = NULL;
+    return true;
+}
+
+/* This helper function returns the value of a state, which must be in the
+   tables. The value is read atomically since other threads may be writing
+   values of the same round */
+uint16_t lookup_value(tb_job* job, state_key k) {
+    tb_shard* s = &job->shards[state_pieces(k, job->opts->width,
+                                            job->opts->height)];
+    size_t i = find_key(s->keys, s->len, k);
+    if (i == s->len) {
+        fprintf(stderr, "Tablebase state missing from its shard\n");
+        exit(1);
+    }
+    return __atomic_load_n(&s->values[i], __ATOMIC_RELAXED);
+}
+
+/* This helper function returns the value a still unknown state gets in the
+   current round, 0 if it stays unknown. Round 0 only scores finished
+   games. A value is only trusted if it was set in an earlier round, which
+   keeps the ply counts exact while threads update the tables */
+uint16_t round_value(tb_job* job, game* g, state_key k) {
+    unsigned int round = job->round, width = job->opts->width;
+    if (round == 0) {
+        outcome o = game_outcome(g);
+        if (o == IN_PROGRESS) {
+            return 0;
+        } else if (o == DRAW) {
+            return TB_VALUE(TB_DRAW, 0);
+        }
+        bool mover_won = (o == BLACK_WIN) == (g->player == BLACKS_TURN);
+        return TB_VALUE(mover_won ? TB_WIN : TB_LOSS, 0);
+    }
+    bool all_lost = true;
+    for (unsigned int m = 0; m < width + 2; m++) {
+        if (!play_move(g, move_from_index(width, m))) {
+            continue;
+        }
+        uint16_t v = lookup_value(job, state_canonical(state_encode(g), width,
+                                                       job->opts->height));
+        state_load(g, k);
+        bool known = v != 0 && TB_PLIES(v) < round;
+        if (known && TB_RESULT(v) == TB_LOSS) {
+            return TB_VALUE(TB_WIN, round);
+        }
+        all_lost = all_lost && known && TB_RESULT(v) == TB_WIN;
+    }
+    return all_lost ? TB_VALUE(TB_LOSS, round) : 0;
+}
+
+/* This is the thread routine of a retrograde round. Threads claim chunks of
+   states across all shards and give a value to those that can be decided
+   this round */
+void* round_routine(void* arg) {
+    tb_worker* w = (tb_worker*)arg;
+    tb_job* job = w->job;
+    tb_options* opts = job->opts;
+    game* g = new_game(opts->run, opts->width, opts->height, BITS);
+    unsigned long long changed = 0;
+    size_t start;
+    while ((start = __atomic_fetch_add(&job->next, TB_CHUNK,
+                                       __ATOMIC_RELAXED)) < job->total) {
+        size_t end = start + TB_CHUNK < job->total ? start + TB_CHUNK :
+                                                     job->total;
+        unsigned int s = 0;
+        trace_begin("tb_round_chunk");
+        for (size_t i = start; i < end; i++) {
+            while (i >= job->starts[s + 1]) {
+                s++;
+            }
+            tb_shard* shard = &job->shards[s];
+            size_t j = i - job->starts[s];
+            if (__atomic_load_n(&shard->values[j], __ATOMIC_RELAXED)) {
+                continue;
+            }
+            state_load(g, shard->keys[j]);
+            uint16_t v = round_value(job, g, shard->keys[j]);
+            if (v) {
+                __atomic_store_n(&shard->values[j], v, __ATOMIC_RELAXED);
+                changed++;
+            }
+        }
+        trace_end("tb_round_chunk");
+    }
+    game_free(g);
+    __atomic_fetch_add(&job->changed, changed, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/* This helper function runs retrograde rounds until one changes nothing,
+   then makes draws of the states left */
+void solve_states(tb_job* job, tb_worker* workers, tb_stats* stats) {
+    job->starts = (size_t*)malloc(sizeof(size_t) * (job->num_shards + 1));
+    check_malloc(job->starts);
+    job->starts[0] = 0;
+    for (unsigned int s = 0; s < job->num_shards; s++) {
+        tb_shard* shard = &job->shards[s];
+        shard->values = (uint16_t*)calloc(shard->len ? shard->len : 1,
+                                          sizeof(uint16_t));
+        check_malloc(shard->values);
+        job->starts[s + 1] = job->starts[s] + shard->len;
+    }
+    job->round = 0;
+    do {
+        job->next = 0;
+        job->changed = 0;
+        run_workers(workers, job->opts->threads, round_routine);
+        job->round++;
+    } while (job->changed);
+    stats->rounds = job->round;
+    for (unsigned int s = 0; s < job->num_shards; s++) {
+        tb_shard* shard = &job->shards[s];
+        for (size_t i = 0; i < shard->len; i++) {
+            if (shard->values[i] == 0) {
+                shard->values[i] = TB_VALUE(TB_DRAW, 0);
+            }
+            tb_result r = TB_RESULT(shard->values[i]);
+            stats->wins += r == TB_WIN;
+            stats->losses += r == TB_LOSS;
+            stats->draws += r == TB_DRAW;
+        }
+    }
+}
+
+/* This helper function writes the shards to path */
+bool write_tablebase(tb_job* job, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    tb_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TB_MAGIC, 4);
+    h.version = TB_VERSION;
+    h.width = job->opts->width;
+    h.height = job->opts->height;
+    h.run = job->opts->run;
+    h.num_shards = job->num_shards;
+    h.num_states = job->total;
+    tb_shard_info info[job->num_shards];
+    uint64_t offset = sizeof(h) + sizeof(info);
+    for (unsigned int s = 0; s < job->num_shards; s++) {
+        info[s].offset = offset;
+        info[s].count = job->shards[s].len;
+        offset += job->shards[s].len * (sizeof(state_key) + sizeof(uint16_t));
+        offset = (offset + 15) & ~(uint64_t)15;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(info, sizeof(info), 1, f) == 1;
+    static const char padding[16];
+    for (unsigned int s = 0; ok && s < job->num_shards; s++) {
+        tb_shard* shard = &job->shards[s];
+        size_t bytes = shard->len * (sizeof(state_key) + sizeof(uint16_t));
+        ok = fwrite(shard->keys, sizeof(state_key), shard->len, f) ==
+             shard->len &&
+             fwrite(shard->values, sizeof(uint16_t), shard->len, f) ==
+             shard->len &&
+             fwrite(padding, 1, (16 - bytes % 16) % 16, f) ==
+             (16 - bytes % 16) % 16;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+bool tb_generate(tb_options* opts, const char* path, tb_stats* stats) {
+    check_null_pointer(opts);
+    check_null_pointer(stats);
+    if (!state_supported(opts->width, opts->height) || opts->threads == 0) {
+        fprintf(stderr, "Tablebases are limited to small boards\n");
+        exit(1);
+    }
+    memset(stats, 0, sizeof(tb_stats));
+    tb_job job;
+    memset(&job, 0, sizeof(job));
+    job.opts = opts;
+    job.num_shards = opts->width * opts->height + 1;
+    job.shards = (tb_shard*)calloc(job.num_shards, sizeof(tb_shard));
+    check_malloc(job.shards);
+    tb_worker* workers = (tb_worker*)calloc(opts->threads, sizeof(tb_worker));
+    check_malloc(workers);
+    for (unsigned int t = 0; t < opts->threads; t++) {
+        workers[t].job = &job;
+    }
+    bool ok = enumerate_states(&job, workers);
+    stats->states = job.total;
+    for (unsigned int t = 0; t < opts->threads; t++) {
+        free(workers[t].found);
+    }
+    if (ok && job.total * (sizeof(state_key) + sizeof(uint16_t)) >
+              opts->max_memory) {
+        ok = false;
+    }
+    stats->out_of_memory = !ok;
+    if (ok) {
+        solve_states(&job, workers, stats);
+        ok = write_tablebase(&job, path);
+    }
+    for (unsigned int s = 0; s < job.num_shards; s++) {
+        free(job.shards[s].keys);
+        free(job.shards[s].values);
+    }
+    free(job.shards);
+    free(job.starts);
+    free(job.frontier);
+    free(workers);
+    return ok;
+}
+
+tablebase* tb_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(tb_header)) {
+        close(fd);
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const tb_header* h = (const tb_header*)map;
+    const tb_shard_info* shards = (const tb_shard_info*)(h + 1);
+    bool valid = memcmp(h->magic, TB_MAGIC, 4) == 0 &&
+                 (h->version == TB_VERSION || h->version == 1) &&
+                 state_supported(h->width, h->height) &&
+                 h->num_shards == h->width * h->height + 1 &&
+                 sizeof(tb_header) + h->num_shards * sizeof(tb_shard_info) <=
+                 (size_t)st.st_size;
+    for (unsigned int s = 0; valid && s < h->num_shards; s++) {
+        valid = shards[s].offset % 16 == 0 &&
+                shards[s].offset + shards[s].count *
+                (sizeof(state_key) + sizeof(uint16_t)) <= (size_t)st.st_size;
+    }
+    if (!valid) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    madvise(map, st.st_size, MADV_RANDOM);
+    tablebase* tb = (tablebase*)malloc(sizeof(tablebase));
+    check_malloc(tb);
+    tb->map = map;
+    tb->map_len = st.st_size;
+    tb->header = h;
+    tb->shards = shards;
+    return tb;
+}
+
+tb_result tb_probe(tablebase* tb, game* g, unsigned int* plies) {
+    check_null_pointer(tb);
+    check_null_pointer(g);
+    const tb_header* h = tb->header;
+    if (h->width != g->b->width || h->height != g->b->height ||
+        h->run != g->run) {
+        return TB_UNKNOWN;
+    }
+    state_key k = state_canonical(state_encode(g), h->width, h->height);
+    const tb_shard_info* info = &tb->shards[state_pieces(k, h->width,
+                                                          h->height)];
+    const state_key* keys = (const state_key*)((const char*)tb->map +
+                                               info->offset);
+    size_t i = find_key(keys, info->count, k);
+    if (i == info->count) {
+        return TB_UNKNOWN;
+    }
+    uint16_t v = ((const uint16_t*)(keys + info->count))[i];
+    if (plies) {
+        *plies = TB_PLIES(v);
+    }
+    return TB_RESULT(v);
+}
+
+bool tb_best_move(tablebase* tb, game* g, move* out) {
+    check_null_pointer(out);
+    tb_result r = tb_probe(tb, g, NULL);
+    if (r == TB_UNKNOWN) {
+        return false;
+    }
+    state_key k = state_encode(g);
+    game* child = new_game(g->run, g->b->width, g->b->height, BITS);
+    bool found = false;
+    unsigned int best_plies = 0;
+    for (unsigned int m = 0; m < g->b->width + 2; m++) {
+        state_load(child, k);
+        if (!play_move(child, move_from_index(g->b->width, m))) {
+            continue;
+        }
+        unsigned int plies;
+        tb_result cr = tb_probe(tb, child, &plies);
+        bool better = (r == TB_WIN && cr == TB_LOSS &&
+                       (!found || plies < best_plies)) ||
+                      (r == TB_LOSS && cr == TB_WIN &&
+                       (!found || plies > best_plies)) ||
+                      (r == TB_DRAW && cr == TB_DRAW && !found);
+        if (better) {
+            found = true;
+            best_plies = plies;
+            *out = move_from_index(g->b->width, m);
+        }
+    }
+    game_free(child);
+    return found;
+}
+
+void tb_close(tablebase* tb) {
+    check_null_pointer(tb);
+    munmap(tb->map, tb->map_len);
+    free(tb);
+}
@@ -0,0 +1,176 @@
+#ifndef TB_H
+#define TB_H
+
+#include <stdint.h>
+#include "state.h"
+
+/* An endgame tablebase holds the exact result of every state reachable from
+   the empty board of a small configuration, under perfect play.
+ * Results are relative to the player to move, together with the number of
+   plies to the end of the game when both sides play perfectly: the winner
+   as fast as possible, the loser as slowly. States from which neither side
+   can force a win, which includes the endless cycles disarray makes
+   possible, are draws.
+ * Only one of each state and its mirror image is stored, the one with the 
+   smaller key (see `state_canonical`). Version 1 files, which hold both, 
+   can still be probed.
+ * The file is a 32-byte header, then one directory entry per piece count 
+   from 0 to width * height, then one shard per piece count: its state keys
+   (see state.h) in increasing order followed by a 16-bit value per key.
+   Values hold the result in their low 2 bits and the number of plies above
+   them. Shards start on 16-byte boundaries and everything is in the host's
+   byte order, so the file is used in place through mmap */
+
+#define TB_MAGIC "TTTB"
+#define TB_VERSION 2
+
+enum tb_result {
+    TB_UNKNOWN,
+    TB_WIN,
+    TB_LOSS,
+    TB_DRAW
+};
+
+typedef enum tb_result tb_result;
+
+
+struct tb_header {
+    char magic[4];
+    uint32_t version, width, height, run, num_shards;
+    uint64_t num_states;
+};
+
+typedef struct tb_header tb_header;
+
+
+struct tb_shard_info {
+    uint64_t offset, count;
+};
+
+typedef struct tb_shard_info tb_shard_info;
+
+
+struct tb_options {
+    unsigned int width, height, run, threads;
+    size_t max_memory;
+};
+
+typedef struct tb_options tb_options;
+
+
+struct tb_stats {
+    unsigned long long states, wins, losses, draws;
+    unsigned int rounds;
+    bool out_of_memory;
+};
+
+typedef struct tb_stats tb_stats;
+
+
+struct tablebase {
+    void* map;
+    size_t map_len;
+    const tb_header* header;
+    const tb_shard_info* shards;
+};
+
+typedef struct tablebase tablebase;
+
+
+/**
+ * tb_generate
+ *
+ * Builds the tablebase of a configuration and writes it to a file.
+ * All states reachable from the empty board are enumerated breadth first,
+ *  and kept sorted in one shard per piece count. The results are then 
+ *  found by retrograde rounds over every shard: round k marks as won the
+ *  states with a move to a state lost before round k, and as lost those 
+ *  whose every move leads to a state won before round k. Rounds stop once 
+ *  one changes nothing, and the states left are draws. Each stage splits 
+ *  its states between the threads.
+ * The states left are draws: at that point none of them has a move to a
+ *  lost state, and each has a move to a state that is not won, so the
+ *  player to move can always avoid losing, and never force a win, as in
+ *  the endless cycles of disarray.
+ *
+ * Parameters:
+ *   - opts: The configuration, thread count and memory bound in bytes. The
+ *      board size must be supported by `state_supported`.
+ *   - path: The file to create.
+ *   - stats: Out-parameter receiving the counts of the run.
+ *
+ * Returns:
+ *   - `true` on success.
+ *   - `false` if the states do not fit in the memory bound, in which case
+ *      stats->out_of_memory is set, or if the file could not be written.
+ *
+ * Note:
+ *   - Every state is kept in memory, with its value, until the file is
+ *      written. Nothing is spilled to disk, so a configuration whose
+ *      states outgrow the memory bound cannot be generated.
+ */
+bool tb_generate(tb_options* opts, const char* path, tb_stats* stats);
+
+/**
+ * tb_open
+ *
+ * Maps a tablebase file into memory. Nothing is read beyond the header and
+ *  the directory.
+ *
+ * Parameters:
+ *   - path: The tablebase file.
+ *
+ * Returns:
+ *   - A pointer to the `tablebase`, or NULL if the file is missing,
+ *      truncated or is not a tablebase.
+ *
+ * Note:
+ *   - The caller is responsible for calling `tb_close`.
+ */
+tablebase* tb_open(const char* path);
+
+/**
+ * tb_probe
+ *
+ * Looks the state of a game up in the tablebase.
+ *
+ * Parameters:
+ *   - tb: A pointer to the `tablebase`.
+ *   - g: A pointer to the `game` structure.
+ *   - plies: Out-parameter receiving the number of plies to the end of the 
+ *      game under perfect play, 0 for draws. May be NULL.
+ *
+ * Returns:
+ *   - The result for the player to move, or TB_UNKNOWN if the game's 
+ *      configuration differs from the tablebase's or its state cannot be
+ *      reached from the empty board.
+ */
+tb_result tb_probe(tablebase* tb, game* g, unsigned int* plies);
+
+/**
+ * tb_best_move
+ *
+ * Picks a perfect move: the fastest win, a draw, or the slowest loss.
+ *
+ * Parameters:
+ *   - tb: A pointer to the `tablebase`.
+ *   - g: A pointer to the `game` structure. It is not modified.
+ *   - out: Out-parameter receiving the move.
+ *
+ * Returns:
+ *   - `true` if a move was found, `false` if the state is not in the 
+ *      tablebase or the game is over.
+ */
+bool tb_best_move(tablebase* tb, game* g, move* out);
+
+/**
+ * tb_close
+ *
+ * Unmaps the tablebase and frees it.
+ *
+ * Parameters:
+ *   - tb: A pointer to the `tablebase`.
+ */
+void tb_close(tablebase* tb);
+
+#endif /* TB_H */
@@ -0,0 +1,73 @@
+#include <string.h>
+#include <unistd.h>
+#include "tb.h"
+
+/* Generates the endgame tablebase of a small configuration, such as 4x4 or
+   5x4 with a run of 3 or 4, with one thread per core by default. -M bounds
+   the memory used for the states, in megabytes; generation stops with an
+   error rather than going past it */
+
+/* This helper function prints the usage line and exits */
+void tbgen_usage() {
+    fprintf(stderr, "Usage: tbgen -w <width> -h <height> -r <run> "
+                    "[-j <threads>] [-M <megabytes>] <out.tb>\n");
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    tb_options opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    opts.max_memory = (size_t)4096 << 20;
+    char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' && i == argc - 1) {
+            path = argv[i];
+            break;
+        }
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            tbgen_usage();
+        }
+        unsigned int v = atoi(argv[i + 1]);
+        switch (argv[i][1]) {
+            case 'w':
+                opts.width = v;
+                break;
+            case 'h':
+                opts.height = v;
+                break;
+            case 'r':
+                opts.run = v;
+                break;
+            case 'j':
+                opts.threads = v;
+                break;
+            case 'M':
+                opts.max_memory = (size_t)v << 20;
+                break;
+            default:
+                tbgen_usage();
+        }
+        i++;
+    }
+    if (!path || opts.run == 0 || opts.threads == 0 || 
+        !state_supported(opts.width, opts.height)) {
+        tbgen_usage();
+    }
+    uint64_t start = now_ns();
+    tb_stats stats;
+    if (!tb_generate(&opts, path, &stats)) {
+        if (stats.out_of_memory) {
+            fprintf(stderr, "More than %llu states, over the memory bound\n",
+                    stats.states);
+        } else {
+            fprintf(stderr, "Could not write %s\n", path);
+        }
+        exit(1);
+    }
+    printf("%llu states: %llu wins, %llu losses, %llu draws for the player "
+           "to move\n", stats.states, stats.wins, stats.losses, stats.draws);
+    printf("%u rounds on %u threads in %.3f s\n", stats.rounds, opts.threads,
+           (now_ns() - start) / 1e9);
+    return 0;
+}
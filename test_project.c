@@ -1,6 +1,30 @@
 #include <criterion/criterion.h>
+#include <arpa/inet.h>
 #include <limits.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "archive.h"
+#include "book.h"
+#include "engine.h"
+#include "evalq.h"
+#include "hash.h"
+#include "hist.h"
 #include "logic.h"
+#include "match.h"
+#include "ntuple.h"
+#include "perf.h"
+#include "pns.h"
+#include "record.h"
+#include "serial.h"
+#include "server.h"
+#include "split.h"
+#include "stateset.h"
+#include "tb.h"
+#include "trace.h"
 
 /* Tests for pos.c */
 
@@ -397,6 +421,44 @@ Test(board_show, display_empty_board) {
     board_free(b);
 }
 
+Test(board_show, labels_past_62_columns) {
+    cr_assert_eq(label_digits(1), 1);
+    cr_assert_eq(label_digits(62), 1);
+    cr_assert_eq(label_digits(63), 2);
+    cr_assert_eq(label_digits(3844), 2);
+    cr_assert_eq(label_digits(3845), 3);
+    board *b = board_new(100, 3, MATRIX);
+    board_show(b);
+    board_free(b);
+}
+
+Test(board_show, render_and_diff) {
+    game *g = new_game(3, 3, 2, SPARSE);
+    cr_assert(drop_piece(g, 1));
+    cr_assert(drop_piece(g, 1));
+    const char *expected = "\n  0 1 2 \n0 . o . \n1 . * . \n\n";
+    size_t size = board_render_size(g->b);
+    cr_assert_eq(size, strlen(expected));
+    char buf[64];
+    cr_assert_eq(board_render(g->b, buf, size - 1), 0);
+    cr_assert_eq(board_render(g->b, buf, sizeof(buf)), size);
+    cr_assert(memcmp(buf, expected, size) == 0);
+
+    board_view *v = board_view_new();
+    size_t len;
+    const char *out = board_view_update(v, g->b, &len);
+    cr_assert_eq(len, 7 + size);
+    cr_assert(drop_piece(g, 2));
+    out = board_view_update(v, g->b, &len);
+    const char *diff = "\x1b[4;1H1 . * * \n\x1b[6;1H";
+    cr_assert_eq(len, strlen(diff));
+    cr_assert(memcmp(out, diff, len) == 0);
+    out = board_view_update(v, g->b, &len);
+    cr_assert_eq(len, strlen("\x1b[6;1H"));
+    board_view_free(v);
+    game_free(g);
+}
+
 /** board_get **/
 Test(board_get, get_valid_cell) {
     board *b = board_new(4, 4, BITS);
@@ -1055,3 +1117,1361 @@ Test(game_outcome, test_draw_after_offset) {
     game_free(g);
 }
 
+/* This helper checks every cell of the board in four directions for runs, 
+   as a reference for game_outcome */
+outcome reference_outcome(game *g) {
+    static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    bool found[3] = {false, false, false};
+    board *b = g->b;
+    for (int r = 0; r < (int)b->height; r++) {
+        for (int c = 0; c < (int)b->width; c++) {
+            cell ce = board_get(b, make_pos(r, c));
+            for (unsigned int d = 0; d < 4 && ce != EMPTY; d++) {
+                unsigned int j = 1;
+                for (; j < g->run; j++) {
+                    int rr = r + j * dirs[d][0], cc = c + j * dirs[d][1];
+                    if (rr >= (int)b->height || cc < 0 || 
+                        cc >= (int)b->width || 
+                        board_get(b, make_pos(rr, cc)) != ce) {
+                        break;
+                    }
+                }
+                found[ce] |= j == g->run;
+            }
+        }
+    }
+    if (found[BLACK] && found[WHITE]) {
+        return DRAW;
+    } else if (found[BLACK] || found[WHITE]) {
+        return found[BLACK] ? BLACK_WIN : WHITE_WIN;
+    }
+    for (unsigned int c = 0; c < b->width; c++) {
+        if (board_get(b, make_pos(0, c)) == EMPTY) {
+            return IN_PROGRESS;
+        }
+    }
+    return DRAW;
+}
+
+Test(game_outcome, wide_boards_match_reference) {
+    srand(11);
+    for (unsigned int k = 0; k < 40; k++) {
+        game *g = new_game(4, 150, 5, k % 2 ? BITS : MATRIX);
+        outcome o = IN_PROGRESS;
+        while (o == IN_PROGRESS) {
+            play_move(g, move_from_index(150, rand() % 152));
+            o = game_outcome(g);
+            cr_assert_eq(o, reference_outcome(g));
+        }
+        game_free(g);
+    }
+
+    game *tall = new_game(7000, 640, 7000, SPARSE);
+    for (unsigned int c = 0; c < 11; c++) {
+        for (unsigned int r = 0; r < 7000; r++) {
+            cr_assert(drop_piece(tall, c));
+        }
+    }
+    cr_assert_eq(game_outcome(tall), IN_PROGRESS);
+    tall->run = 3;
+    cr_assert_eq(game_outcome(tall), DRAW);
+    game_free(tall);
+}
+
+/** game_reset **/
+Test(game_reset, replays_on_the_same_game) {
+    game *g = new_game(3, 3, 3, SPARSE);
+    for (unsigned int k = 0; k < 2; k++) {
+        cr_assert(drop_piece(g, 0));
+        cr_assert(drop_piece(g, 1));
+        cr_assert(drop_piece(g, 0));
+        cr_assert(drop_piece(g, 1));
+        cr_assert(drop_piece(g, 0));
+        cr_assert_eq(game_outcome(g), BLACK_WIN);
+        game_reset(g);
+        cr_assert_eq(g->player, BLACKS_TURN);
+        cr_assert_eq(g->black_queue->len + g->white_queue->len, 0);
+        cr_assert_eq(board_column_height(g->b, 0), 0);
+        cr_assert_eq(board_column_height(g->b, 1), 0);
+        cr_assert_eq(game_outcome(g), IN_PROGRESS);
+    }
+    game_free(g);
+}
+
+/** play_move **/
+Test(play_move, dispatches_each_kind) {
+    game *g = new_game(3, 3, 3, BITS);
+    cr_assert(play_move(g, make_move(MOVE_DROP, 0)));
+    cr_assert(play_move(g, make_move(MOVE_DROP, 0)));
+    cr_assert_not(play_move(g, make_move(MOVE_DROP, 3)));
+    cr_assert(play_move(g, make_move(MOVE_DISARRAY, 0)));
+    cr_assert_eq(board_get(g->b, make_pos(2, 0)), WHITE);
+    cr_assert(play_move(g, make_move(MOVE_OFFSET, 0)));
+    cr_assert_eq(g->black_queue->len, 0);
+    cr_assert_eq(g->white_queue->len, 0);
+    game_free(g);
+}
+
+/* Tests for perf.c */
+
+/* This helper function plays the same moves on a new game, checking the
+   outcome after each, as one of the threads of the perf test */
+void* perf_moves_routine(void* arg) {
+    (void)arg;
+    game *g = new_game(3, 4, 4, BITS);
+    move moves[] = {make_move(MOVE_DROP, 0), make_move(MOVE_DROP, 1),
+                    make_move(MOVE_OFFSET, 0), make_move(MOVE_DISARRAY, 0),
+                    make_move(MOVE_DROP, 2), make_move(MOVE_DISARRAY, 0)};
+    for (unsigned int i = 0; i < 6; i++) {
+        cr_assert(play_move(g, moves[i]));
+        cr_assert_eq(game_outcome(g), IN_PROGRESS);
+    }
+    game_free(g);
+    return NULL;
+}
+
+Test(perf, regions_count_the_moves_of_every_thread) {
+    bool counters = perf_enable();
+    pthread_t threads[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        pthread_create(&threads[i], NULL, perf_moves_routine, NULL);
+    }
+    for (unsigned int i = 0; i < 3; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    cr_assert_eq(perf_get(PERF_DISARRAY).calls, 6);
+    cr_assert_eq(perf_get(PERF_OFFSET).calls, 3);
+    cr_assert_eq(perf_get(PERF_WIN_CHECK).calls, 18);
+    cr_assert_eq(perf_get(PERF_SEARCH_ITER).calls, 0);
+    engine *e = engine_new(1 << 16);
+    e->max_depth = 3;
+    game *g = new_game(3, 4, 4, BITS);
+    search_result r;
+    cr_assert(engine_search(e, g, 0, &r));
+    cr_assert_eq(perf_get(PERF_SEARCH_ITER).calls, r.depth);
+    /* Without hardware counters, such as in a container, regions are
+       still timed and the report says the counters are unsupported */
+    char *report = NULL;
+    size_t size = 0;
+    FILE *f = open_memstream(&report, &size);
+    perf_report(f);
+    fclose(f);
+    cr_assert_not_null(strstr(report, "disarray"));
+    if (counters) {
+        cr_assert(perf_get(PERF_DISARRAY).counts[PERF_INSTRUCTIONS] > 0);
+        cr_assert_null(strstr(report, "unsupported"));
+    } else {
+        cr_assert_not_null(strstr(report, "unsupported"));
+    }
+    perf_disable();
+    perf_reset();
+    cr_assert_eq(perf_get(PERF_DISARRAY).calls, 0);
+    free(report);
+    game_free(g);
+    engine_free(e);
+}
+
+/* Tests for trace.c */
+
+/* The arguments of a thread of the trace test: the number of nested pairs
+   of spans it records and a barrier it waits at before exiting */
+struct trace_spans_args {
+    unsigned int pairs;
+    pthread_barrier_t *barrier;
+};
+
+/* This helper function records spans as one of the threads of the trace
+   test: nested pairs of spans between two single spans, which leave the
+   wrap point of a full ring inside a pair */
+void* trace_spans_routine(void* arg) {
+    struct trace_spans_args *a = (struct trace_spans_args*)arg;
+    trace_begin("single");
+    trace_end("single");
+    for (unsigned int i = 0; i < a->pairs; i++) {
+        trace_begin("outer");
+        trace_begin("inner");
+        trace_end("inner");
+        trace_end("outer");
+    }
+    trace_begin("single");
+    trace_end("single");
+    pthread_barrier_wait(a->barrier);
+    return NULL;
+}
+
+Test(trace, flush_writes_balanced_spans_of_every_thread) {
+    char path[] = "/tmp/traceXXXXXX";
+    close(mkstemp(path));
+    trace_enable();
+    /* The first threads, alive together, wrap their own rings; the second
+       reuse them once the first have exited */
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, 4);
+    struct trace_spans_args args[2] = {{TRACE_RING_SIZE, &barrier},
+                                       {10, &barrier}};
+    for (unsigned int round = 0; round < 2; round++) {
+        pthread_t threads[4];
+        for (unsigned int i = 0; i < 4; i++) {
+            pthread_create(&threads[i], NULL, trace_spans_routine,
+                           &args[round]);
+        }
+        for (unsigned int i = 0; i < 4; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    pthread_barrier_destroy(&barrier);
+    trace_disable();
+    cr_assert(trace_flush(path));
+    FILE *f = fopen(path, "r");
+    char line[256], name[32], phase;
+    cr_assert_not_null(fgets(line, sizeof(line), f));
+    cr_assert_eq(strcmp(line, "{\"traceEvents\":[\n"), 0);
+    int tids[8], depths[8] = {0}, pid;
+    unsigned int num_tids = 0, events = 0, singles = 0;
+    double ts;
+    bool closed = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (strcmp(line, "],\"displayTimeUnit\":\"ns\"}\n") == 0) {
+            closed = true;
+            break;
+        }
+        int tid, end = 0;
+        cr_assert_eq(sscanf(line, "{\"name\":\"%31[a-z]\",\"ph\":\"%c\","
+                                  "\"ts\":%lf,\"pid\":%d,\"tid\":%d}%n",
+                            name, &phase, &ts, &pid, &tid, &end), 5);
+        cr_assert(strcmp(line + end, ",\n") == 0 ||
+                  strcmp(line + end, "\n") == 0);
+        unsigned int t = 0;
+        while (t < num_tids && tids[t] != tid) {
+            t++;
+        }
+        if (t == num_tids) {
+            cr_assert(num_tids < 8);
+            tids[num_tids++] = tid;
+        }
+        cr_assert(phase == 'B' || phase == 'E');
+        depths[t] += phase == 'B' ? 1 : -1;
+        cr_assert(depths[t] >= 0);
+        singles += strcmp(name, "single") == 0;
+        events++;
+    }
+    fclose(f);
+    cr_assert(closed);
+    cr_assert_eq(num_tids, 8);
+    for (unsigned int t = 0; t < num_tids; t++) {
+        cr_assert_eq(depths[t], 0);
+    }
+    /* Four rings hold the last events of every thread, the ends of the
+       pairs whose beginnings were overwritten left out */
+    cr_assert_eq(singles, 4 * 2 + 4 * 4);
+    cr_assert_eq(events, 4 * (TRACE_RING_SIZE - 2));
+    cr_assert(trace_flush(path));
+    f = fopen(path, "r");
+    unsigned int lines = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lines++;
+    }
+    fclose(f);
+    cr_assert_eq(lines, 3);
+    unlink(path);
+}
+
+/* Tests for record.c */
+
+Test(record, round_trip_two_games) {
+    FILE *f = tmpfile();
+    game *g = new_game(3, 4, 4, MATRIX);
+    record_writer *w = record_writer_new(f, g, 0);
+    cr_assert(record_play(w, make_move(MOVE_DROP, 3)));
+    cr_assert(record_play(w, make_move(MOVE_DROP, 0)));
+    cr_assert_not(record_play(w, make_move(MOVE_DROP, 4)));
+    cr_assert(record_play(w, make_move(MOVE_DISARRAY, 0)));
+    cr_assert(record_play(w, make_move(MOVE_OFFSET, 0)));
+    cr_assert(record_play(w, make_move(MOVE_DROP, 1)));
+    record_writer_finish(w);
+    game *g2 = new_game(2, 9, 2, BITS);
+    w = record_writer_new(f, g2, 2);
+    cr_assert(record_play(w, make_move(MOVE_DROP, 8)));
+    record_writer_finish(w);
+    rewind(f);
+
+    record_reader *r = record_reader_new(f);
+    game *copy = record_next_game(r);
+    cr_assert_not_null(copy);
+    cr_assert_eq(copy->b->type, MATRIX);
+    cr_assert_eq(copy->run, 3);
+    cr_assert_eq(record_replay(r, copy), 5);
+    for (unsigned int row = 0; row < 4; row++) {
+        for (unsigned int c = 0; c < 4; c++) {
+            pos p = make_pos(row, c);
+            cr_assert_eq(board_get(copy->b, p), board_get(g->b, p));
+        }
+    }
+    cr_assert_eq(copy->player, g->player);
+    game *copy2 = record_next_game(r);
+    cr_assert_not_null(copy2);
+    cr_assert_eq(copy2->b->width, 9);
+    move m;
+    cr_assert(record_next_move(r, &m));
+    cr_assert_eq(m.kind, MOVE_DROP);
+    cr_assert_eq(m.column, 8);
+    cr_assert_not(record_next_move(r, &m));
+    cr_assert_null(record_next_game(r));
+
+    record_reader_free(r);
+    game_free(copy);
+    game_free(copy2);
+    game_free(g);
+    game_free(g2);
+    fclose(f);
+}
+
+Test(record, seek_through_keyframes) {
+    FILE *f = tmpfile();
+    game *g = new_game(4, 5, 6, BITS);
+    record_writer *w = record_writer_new(f, g, 3);
+    game *states[12];
+    unsigned int cols[] = {0, 1, 2, 2, 4, 3, 3, 1};
+    for (unsigned int i = 0; i < 12; i++) {
+        if (i == 5) {
+            cr_assert(record_play(w, make_move(MOVE_DISARRAY, 0)));
+        } else if (i == 9) {
+            cr_assert(record_play(w, make_move(MOVE_OFFSET, 0)));
+        } else {
+            cr_assert(record_play(w, make_move(MOVE_DROP, cols[i % 8])));
+        }
+        states[i] = new_game(4, 5, 6, BITS);
+        for (unsigned int row = 0; row < 6; row++) {
+            for (unsigned int c = 0; c < 5; c++) {
+                pos p = make_pos(row, c);
+                board_set(states[i]->b, p, board_get(g->b, p));
+            }
+        }
+        states[i]->player = g->player;
+    }
+    record_writer_finish(w);
+    game *next = new_game(3, 4, 4, MATRIX);
+    w = record_writer_new(f, next, 0);
+    cr_assert(record_play(w, make_move(MOVE_DROP, 1)));
+    record_writer_finish(w);
+    rewind(f);
+
+    record_reader *r = record_reader_new(f);
+    for (unsigned int n = 1; n <= 12; n++) {
+        game *copy = record_seek(r, 0, n);
+        for (unsigned int row = 0; row < 6; row++) {
+            for (unsigned int c = 0; c < 5; c++) {
+                pos p = make_pos(row, c);
+                cr_assert_eq(board_get(copy->b, p),
+                             board_get(states[n - 1]->b, p));
+            }
+        }
+        cr_assert_eq(copy->player, states[n - 1]->player);
+        game_free(copy);
+    }
+    game *copy = record_seek(r, 0, 7);
+    cr_assert_eq(record_replay(r, copy), 5);
+    cr_assert_eq(game_outcome(copy), game_outcome(g));
+    game_free(copy);
+    // The rest of a game is skipped through its index
+    copy = record_seek(r, 0, 7);
+    game_free(copy);
+    copy = record_next_game(r);
+    cr_assert_eq(copy->b->width, 4);
+    cr_assert_eq(record_replay(r, copy), 1);
+    cr_assert_null(record_next_game(r));
+    game_free(copy);
+    game_free(next);
+
+    record_reader_free(r);
+    for (unsigned int i = 0; i < 12; i++) {
+        game_free(states[i]);
+    }
+    game_free(g);
+    fclose(f);
+}
+
+/* Tests for archive.c */
+
+Test(archive, columns_round_trip) {
+    char path[] = "/tmp/test_archive_XXXXXX";
+    int fd = mkstemp(path);
+    cr_assert(fd >= 0);
+    unsigned int plies[] = {2, 40};
+    archive_writer *w = archive_writer_new(path, plies, 2);
+    move moves[] = {
+        make_move(MOVE_DROP, 0), make_move(MOVE_DROP, 1),
+        make_move(MOVE_DISARRAY, 0), make_move(MOVE_OFFSET, 0),
+        make_move(MOVE_DROP, 2)
+    };
+    for (unsigned int i = 0; i < ARCHIVE_GROUP_GAMES + 3; i++) {
+        game *g = new_game(3, 4 + i % 2, 4, BITS);
+        archive_add_game(w, g, moves, 2 + i % 4);
+        game_free(g);
+    }
+    archive_writer_finish(w);
+
+    archive *a = archive_open(path);
+    cr_assert_not_null(a);
+    cr_assert_eq(a->num_groups, 2);
+    cr_assert_eq(a->num_games, ARCHIVE_GROUP_GAMES + 3);
+    uint64_t *width, *length, *moves_col, *position;
+    size_t n = archive_read_column(a, 1, COL_WIDTH, &width);
+    cr_assert_eq(n, 3);
+    cr_assert_eq(width[0], 4 + ARCHIVE_GROUP_GAMES % 2);
+    cr_assert_eq(width[1], 5 - ARCHIVE_GROUP_GAMES % 2);
+    archive_read_column(a, 0, COL_LENGTH, &length);
+    cr_assert_eq(length[3], 5);
+    n = archive_read_column(a, 0, COL_MOVES, &moves_col);
+    cr_assert_eq(moves_col[4], 1);
+    cr_assert_eq(moves_col[2 + 3 + 3], 0);
+    n = archive_read_column(a, 0, COL_POSITIONS, &position);
+    cr_assert_eq(position[0], 1);
+    cr_assert_eq(position[1], (1ull << (2 * 12)) | (2ull << (2 * 13)));
+    cr_assert_eq(position[3], (1ull << (2 * 15)) | (2ull << (2 * 16)));
+    free(position);
+    n = archive_read_column(a, 0, COL_POSITIONS + 1, &position);
+    cr_assert_eq(n, ARCHIVE_GROUP_GAMES);
+    cr_assert_eq(position[0], 0);
+
+    free(width);
+    free(length);
+    free(moves_col);
+    free(position);
+    archive_close(a);
+    close(fd);
+    unlink(path);
+}
+
+Test(board_new, sparse_matches_bits) {
+    game *sparse = new_game(4, 5, 6, SPARSE);
+    game *bits = new_game(4, 5, 6, BITS);
+    srand(7);
+    for (unsigned int i = 0; i < 200; i++) {
+        move m = move_from_index(5, rand() % 7);
+        cr_assert_eq(play_move(sparse, m), play_move(bits, m));
+        for (unsigned int r = 0; r < 6; r++) {
+            for (unsigned int c = 0; c < 5; c++) {
+                cr_assert_eq(board_get(sparse->b, make_pos(r, c)),
+                             board_get(bits->b, make_pos(r, c)));
+            }
+        }
+        cr_assert_eq(game_outcome(sparse), game_outcome(bits));
+    }
+    game_free(sparse);
+    game_free(bits);
+
+    game *tall = new_game(3, 3, 100000, SPARSE);
+    for (unsigned int i = 0; i < 5; i++) {
+        cr_assert(drop_piece(tall, 1));
+    }
+    cr_assert_eq(board_column_height(tall->b, 1), 5);
+    cr_assert_eq(board_get(tall->b, make_pos(99999, 1)), BLACK);
+    cr_assert_eq(board_get(tall->b, make_pos(99995, 1)), BLACK);
+    cr_assert_eq(board_get(tall->b, make_pos(99994, 1)), EMPTY);
+    disarray(tall);
+    cr_assert_eq(board_get(tall->b, make_pos(99999, 1)), BLACK);
+    cr_assert_eq(board_get(tall->b, make_pos(99998, 1)), WHITE);
+    cr_assert(offset(tall));
+    cr_assert_eq(board_column_height(tall->b, 1), 3);
+    cr_assert_eq(board_column_height(tall->b, 0), 0);
+    game_free(tall);
+}
+
+Test(serial, round_trip_across_representations) {
+    game *g = new_game(3, 5, 4, MATRIX);
+    unsigned int cols[] = {0, 1, 1, 4, 2, 2, 3};
+    for (unsigned int i = 0; i < sizeof(cols) / sizeof(cols[0]); i++) {
+        cr_assert(drop_piece(g, cols[i]));
+    }
+    size_t size = game_serialized_size(g);
+    unsigned char *buf = (unsigned char*)malloc(size + 1);
+    cr_assert_eq(game_serialize(g, buf, size - 1), 0);
+    cr_assert_eq(game_serialize(g, buf, size), size);
+    cr_assert_null(game_deserialize(buf, size - 1, -1));
+
+    game *restored[3];
+    restored[0] = game_deserialize(buf, size, -1);
+    restored[1] = game_deserialize(buf, size, BITS);
+    memmove(buf + 1, buf, size);
+    restored[2] = game_deserialize(buf + 1, size, -1);
+    cr_assert_eq(restored[0]->b->type, MATRIX);
+    cr_assert_eq(restored[1]->b->type, BITS);
+    cr_assert_not_null(restored[2]);
+
+    cr_assert(offset(g));
+    cr_assert(drop_piece(g, 0));
+    for (unsigned int k = 0; k < 3; k++) {
+        game *h = restored[k];
+        cr_assert_eq(h->run, 3);
+        cr_assert_eq(h->black_queue->len, 4);
+        cr_assert_eq(h->white_queue->len, 3);
+        cr_assert(offset(h));
+        cr_assert(drop_piece(h, 0));
+        cr_assert_eq(h->player, g->player);
+        cr_assert_eq(h->black_queue->len, g->black_queue->len);
+        cr_assert_eq(h->white_queue->len, g->white_queue->len);
+        for (unsigned int r = 0; r < 4; r++) {
+            for (unsigned int c = 0; c < 5; c++) {
+                cr_assert_eq(board_get(h->b, make_pos(r, c)),
+                             board_get(g->b, make_pos(r, c)));
+            }
+        }
+        pq_entry *e = h->white_queue->head, *f = g->white_queue->head;
+        for (; e && f; e = e->next, f = f->next) {
+            cr_assert_eq(e->p.r, f->p.r);
+            cr_assert_eq(e->p.c, f->p.c);
+        }
+        pos_dequeue(h->white_queue);
+        game_free(h);
+    }
+    // Queues that do not match the board are rejected
+    unsigned char *q = buf + 1 + 4 * (SERIAL_HEADER_WORDS +
+                                      board_packed_words(5, 4));
+    unsigned char saved[8];
+    memcpy(saved, q, 8);
+    q[0] = 99;
+    cr_assert_null(game_deserialize(buf + 1, size, -1));
+    memcpy(q, q + 8, 8);
+    cr_assert_null(game_deserialize(buf + 1, size, -1));
+    memcpy(q, q + 8 * 4, 8);
+    cr_assert_null(game_deserialize(buf + 1, size, -1));
+    memcpy(q, saved, 8);
+    // So is a run no game of the board could make, as new_game does
+    buf[1 + 24] = 6;
+    cr_assert_null(game_deserialize(buf + 1, size, -1));
+    buf[1 + 24] = 3;
+    game *h = game_deserialize(buf + 1, size, SPARSE);
+    cr_assert_not_null(h);
+    game_free(h);
+    free(buf);
+    game_free(g);
+}
+
+Test(book, probe_and_choose) {
+    game *g = new_game(3, 4, 4, BITS);
+    book_entry entries[64];
+    unsigned int n = 0;
+    for (unsigned int c = 0; c < 2; c++) {
+        cr_assert(drop_piece(g, c));
+        entries[n].key = canonical_key(game_key_pair(g), NULL);
+        entries[n].games = 10;
+        entries[n].black_wins = c;
+        entries[n].white_wins = 10 - c;
+        entries[n].draws = 0;
+        n++;
+        game_free(g);
+        g = new_game(3, 4, 4, BITS);
+    }
+    for (; n < 64; n++) {
+        entries[n].key = piece_key(BLACK, n, n * 7919);
+        entries[n].games = 1;
+    }
+    for (unsigned int i = 1; i < n; i++) {
+        for (unsigned int j = i; j > 0 && entries[j - 1].key > entries[j].key;
+             j--) {
+            book_entry t = entries[j];
+            entries[j] = entries[j - 1];
+            entries[j - 1] = t;
+        }
+    }
+    char path[] = "/tmp/book_testXXXXXX";
+    int fd = mkstemp(path);
+    cr_assert(book_write(path, entries, n, 4, 4, 3));
+
+    book *bk = book_open(path);
+    cr_assert_not_null(bk);
+    for (unsigned int i = 0; i < n; i++) {
+        cr_assert_eq(book_probe(bk, entries[i].key), &bk->entries[i]);
+    }
+    cr_assert_null(book_probe(bk, entries[0].key - 1));
+    cr_assert_null(book_probe(bk, entries[n - 1].key + 1));
+    move m;
+    const book_entry *e;
+    cr_assert(book_choose(bk, g, 1, &m, &e));
+    cr_assert_eq(m.kind, MOVE_DROP);
+    cr_assert_eq(m.column, 1);
+    cr_assert_eq(e->black_wins, 1);
+    cr_assert_not(book_choose(bk, g, 11, &m, &e));
+    game *other = new_game(3, 5, 4, BITS);
+    cr_assert_not(book_choose(bk, other, 1, &m, &e));
+
+    game_free(other);
+    game_free(g);
+    book_close(bk);
+    close(fd);
+    unlink(path);
+}
+
+Test(tb, perfect_play_follows_the_plies) {
+    char path[] = "/tmp/tb_testXXXXXX";
+    int fd = mkstemp(path);
+    tb_options opts = {3, 2, 2, 2, 1 << 20};
+    tb_stats stats;
+    cr_assert(tb_generate(&opts, path, &stats));
+    cr_assert_eq(stats.states, stats.wins + stats.losses + stats.draws);
+
+    tablebase *tb = tb_open(path);
+    cr_assert_not_null(tb);
+    game *g = new_game(2, 3, 2, BITS);
+    unsigned int plies, next_plies;
+    tb_result r = tb_probe(tb, g, &plies);
+    cr_assert_neq(r, TB_UNKNOWN);
+    while (game_outcome(g) == IN_PROGRESS && r != TB_DRAW) {
+        move m;
+        cr_assert(tb_best_move(tb, g, &m));
+        cr_assert(play_move(g, m));
+        tb_result next = tb_probe(tb, g, &next_plies);
+        cr_assert_eq(next, r == TB_WIN ? TB_LOSS : TB_WIN);
+        cr_assert_eq(next_plies, plies - 1);
+        r = next;
+        plies = next_plies;
+    }
+    cr_assert_eq(plies, 0);
+    game *other = new_game(2, 2, 3, BITS);
+    cr_assert_eq(tb_probe(tb, other, NULL), TB_UNKNOWN);
+
+    game_free(other);
+    game_free(g);
+    tb_close(tb);
+    close(fd);
+    unlink(path);
+}
+
+Test(tb, draws_held_by_disarray_cycles) {
+    char path[] = "/tmp/tb_testXXXXXX";
+    int fd = mkstemp(path);
+    tb_options opts = {3, 3, 3, 2, 64 << 20};
+    tb_stats stats;
+    cr_assert(tb_generate(&opts, path, &stats));
+    tablebase *tb = tb_open(path);
+    cr_assert_not_null(tb);
+    /* Here every move but disarray loses, and two disarrays give the same
+       state back, so the player to move draws by disarraying for ever */
+    game *g = new_game(3, 3, 3, BITS);
+    move moves[] = {make_move(MOVE_DROP, 0), make_move(MOVE_DROP, 2),
+                    make_move(MOVE_DISARRAY, 0), make_move(MOVE_DROP, 1),
+                    make_move(MOVE_DROP, 2), make_move(MOVE_DISARRAY, 0),
+                    make_move(MOVE_DROP, 1)};
+    for (unsigned int i = 0; i < 7; i++) {
+        cr_assert(play_move(g, moves[i]));
+    }
+    cr_assert_eq(game_outcome(g), IN_PROGRESS);
+    cr_assert_eq(tb_probe(tb, g, NULL), TB_DRAW);
+    state_key k = state_encode(g);
+    game *child = new_game(3, 3, 3, BITS);
+    for (unsigned int m = 0; m < 4; m++) {
+        state_load(child, k);
+        if (play_move(child, move_from_index(3, m))) {
+            cr_assert_eq(tb_probe(tb, child, NULL), TB_WIN);
+        }
+    }
+    move best;
+    cr_assert(tb_best_move(tb, g, &best));
+    cr_assert_eq(best.kind, MOVE_DISARRAY);
+    cr_assert(play_move(g, best));
+    cr_assert_eq(tb_probe(tb, g, NULL), TB_DRAW);
+    cr_assert(play_move(g, make_move(MOVE_DISARRAY, 0)));
+    cr_assert_eq(state_encode(g), k);
+
+    /* States that outgrow the memory bound stop the generation */
+    opts.max_memory = 1 << 10;
+    cr_assert_not(tb_generate(&opts, path, &stats));
+    cr_assert(stats.out_of_memory);
+
+    game_free(child);
+    game_free(g);
+    tb_close(tb);
+    close(fd);
+    unlink(path);
+}
+
+struct stateset_args {
+    stateset *set;
+    unsigned int start, inserted;
+};
+
+void *stateset_insert_routine(void *arg) {
+    struct stateset_args *a = (struct stateset_args*)arg;
+    for (unsigned int i = 0; i < 20000; i++) {
+        state_key k = (state_key)((a->start + i) % 30000) << 64 | 
+                      (a->start + i) % 30000;
+        a->inserted += stateset_insert(a->set, k);
+    }
+    return NULL;
+}
+
+Test(stateset, concurrent_inserts_keep_one_copy) {
+    stateset *set = stateset_new(1 << 20);
+    struct stateset_args args[4];
+    pthread_t tids[4];
+    for (unsigned int t = 0; t < 4; t++) {
+        args[t].set = set;
+        args[t].start = t * 5000;
+        args[t].inserted = 0;
+        pthread_create(&tids[t], NULL, stateset_insert_routine, &args[t]);
+    }
+    unsigned int inserted = 0;
+    for (unsigned int t = 0; t < 4; t++) {
+        pthread_join(tids[t], NULL);
+        inserted += args[t].inserted;
+    }
+    cr_assert_eq(inserted, 30000);
+    cr_assert_not(stateset_insert(set, 0));
+
+    state_key *keys;
+    size_t n = stateset_drain(set, &keys);
+    cr_assert_eq(n, 30000);
+    for (size_t i = 0; i < n; i++) {
+        cr_assert(keys[i] == ((state_key)i << 64 | i));
+    }
+    stateset_clear(set);
+    cr_assert(stateset_insert(set, 0));
+    stateset_free(set);
+}
+
+Test(hash, mirror_keys_and_incremental_drops) {
+    game *g = new_game(3, 5, 4, BITS), *m = new_game(3, 5, 4, MATRIX);
+    key_pair k = game_key_pair(g);
+    cr_assert_eq(k.key, k.mirror);
+    unsigned int cols[] = {0, 1, 1, 4, 3};
+    for (unsigned int i = 0; i < sizeof(cols) / sizeof(cols[0]); i++) {
+        cr_assert(drop_piece(g, cols[i]));
+        cr_assert(play_move(m, mirror_move(make_move(MOVE_DROP, cols[i]), 5)));
+        key_pair_drop(&k, g);
+        key_pair full = game_key_pair(g);
+        cr_assert_eq(k.key, full.key);
+        cr_assert_eq(k.mirror, full.mirror);
+    }
+    key_pair km = game_key_pair(m);
+    cr_assert_eq(km.key, k.mirror);
+    cr_assert_eq(km.mirror, k.key);
+    bool g_mirrored, m_mirrored;
+    cr_assert_eq(canonical_key(k, &g_mirrored), canonical_key(km, &m_mirrored));
+    cr_assert_neq(g_mirrored, m_mirrored);
+
+    state_key s = state_encode(g);
+    cr_assert(state_mirror(s, 5, 4) == state_encode(m));
+    cr_assert(state_mirror(state_mirror(s, 5, 4), 5, 4) == s);
+    cr_assert(state_canonical(s, 5, 4) == 
+              state_canonical(state_encode(m), 5, 4));
+
+    disarray(g);
+    disarray(m);
+    cr_assert_eq(game_key_pair(m).key, game_key_pair(g).mirror);
+    game_free(g);
+    game_free(m);
+}
+
+Test(engine, finds_wins_and_ponders) {
+    engine *e = engine_new(1 << 20);
+    game *g = new_game(3, 4, 4, BITS);
+    unsigned int cols[] = {1, 1, 2, 2};
+    for (unsigned int i = 0; i < 4; i++) {
+        cr_assert(drop_piece(g, cols[i]));
+    }
+    search_result res;
+    cr_assert(engine_search(e, g, 1000, &res));
+    cr_assert_eq(res.source, SOURCE_SEARCH);
+    cr_assert_eq(res.best.kind, MOVE_DROP);
+    cr_assert(res.best.column == 0 || res.best.column == 3);
+    cr_assert_eq(res.score, ENGINE_WIN - 1);
+
+    game_reset(g);
+    cr_assert(drop_piece(g, 0));
+    cr_assert(engine_search(e, g, 50, &res));
+    cr_assert(res.depth > 0);
+    cr_assert(play_move(g, res.best));
+    cr_assert(res.has_reply);
+    cr_assert(engine_ponder(e, g, res.reply, 50));
+    cr_assert(play_move(g, res.reply));
+    search_result pondered;
+    cr_assert(engine_ponder_finish(e, res.reply, &pondered));
+    cr_assert(move_is_legal(g, pondered.best));
+    cr_assert(engine_ponder(e, g, pondered.best, 50));
+    cr_assert_not(engine_ponder_finish(e, make_move(MOVE_OFFSET, 0), NULL));
+    game_free(g);
+    engine_free(e);
+}
+
+/* This helper function counts the reports of an analysis */
+void count_reports(const move_eval* evals, unsigned int num_evals, 
+                   unsigned int depth, unsigned long long nodes, void* arg) {
+    (void)evals, (void)num_evals, (void)depth, (void)nodes;
+    (*(unsigned int*)arg)++;
+}
+
+Test(engine, analyze_scores_every_move) {
+    engine *e = engine_new(1 << 20);
+    e->max_depth = 4;
+    game *g = new_game(3, 4, 4, BITS);
+    unsigned int cols[] = {1, 1, 2, 2};
+    for (unsigned int i = 0; i < 4; i++) {
+        cr_assert(drop_piece(g, cols[i]));
+    }
+    move_eval evals[6];
+    unsigned int reports = 0;
+    unsigned int n = engine_analyze(e, g, 2, 0, count_reports, &reports, 
+                                    evals);
+    cr_assert_eq(n, 6);
+    cr_assert(reports >= 4 * n);
+    for (unsigned int i = 0; i < n; i++) {
+        cr_assert_eq(evals[i].depth, 4);
+        cr_assert(move_is_legal(g, evals[i].m));
+        if (evals[i].m.kind == MOVE_DROP && (evals[i].m.column == 0 || 
+                                             evals[i].m.column == 3)) {
+            cr_assert_eq(evals[i].score, ENGINE_WIN - 1);
+        } else {
+            cr_assert(evals[i].score < ENGINE_WIN - 1);
+        }
+    }
+    cr_assert_eq(g->b->width, 4);
+    game_free(g);
+    engine_free(e);
+}
+
+Test(window_counts, incremental_matches_rebuild) {
+    game *g = new_game(3, 4, 4, BITS);
+    game_track_windows(g);
+    cr_assert(drop_piece(g, 0));
+    cr_assert_eq(window_counts_score(g->windows), 3);
+    take_back_drop(g);
+    cr_assert_eq(window_counts_score(g->windows), 0);
+    game_free(g);
+
+    game *tracked = new_game(4, 7, 6, SPARSE);
+    game *plain = new_game(4, 7, 6, SPARSE);
+    game_track_windows(tracked);
+    srand(11);
+    for (unsigned int i = 0; i < 2000; i++) {
+        move m = move_from_index(7, rand() % 9);
+        cr_assert_eq(play_move(tracked, m), play_move(plain, m));
+        window_counts *fresh = window_counts_new(4, plain->b);
+        cr_assert_eq(window_counts_score(tracked->windows), 
+                     window_counts_score(fresh));
+        cr_assert_eq(memcmp(tracked->windows->counts, fresh->counts,
+                            8 * 7 * 6 * sizeof(unsigned int)), 0);
+        window_counts_free(fresh);
+        outcome o = game_outcome(tracked);
+        cr_assert_eq(o, game_outcome(plain));
+        if (o != IN_PROGRESS) {
+            game_reset(tracked);
+            game_reset(plain);
+            cr_assert_eq(window_counts_score(tracked->windows), 0);
+        }
+    }
+    game_free(tracked);
+    game_free(plain);
+}
+
+Test(ntuple, incremental_matches_rebuild_and_file) {
+    ntuple_net *net = ntuple_new(4, 7, 6);
+    ntuple_train_options opts = {20, 100, 3, 0.1, 0.1};
+    ntuple_train_stats stats;
+    ntuple_train(net, &opts, &stats);
+    cr_assert_eq(stats.black_wins + stats.white_wins + stats.draws, 20);
+    cr_assert(stats.plies > 0);
+
+    game *plain = new_game(4, 7, 6, BITS);
+    ntuple_state *tracked = ntuple_game_state(net, plain);
+    srand(13);
+    for (unsigned int i = 0; i < 1000; i++) {
+        move m = move_from_index(7, rand() % 9);
+        if (play_move(plain, m)) {
+            ntuple_state_play(tracked, plain->b, m);
+        }
+        ntuple_state *fresh = ntuple_state_new(net, plain->b);
+        cr_assert_eq(memcmp(tracked->slots, fresh->slots,
+                            net->num_tuples * sizeof(int32_t)), 0);
+        /* Taking a drop back restores the slots */
+        unsigned int c = rand() % 7;
+        if (game_outcome(plain) == IN_PROGRESS && drop_piece(plain, c)) {
+            ntuple_state_play(tracked, plain->b, make_move(MOVE_DROP, c));
+            ntuple_state_take_back(tracked, plain->b, c);
+            take_back_drop(plain);
+            cr_assert_eq(memcmp(tracked->slots, fresh->slots,
+                                net->num_tuples * sizeof(int32_t)), 0);
+        }
+        ntuple_state_free(fresh);
+        /* Mirror images have the same value */
+        game *mirror = new_game(4, 7, 6, BITS);
+        for (unsigned int r = 0; r < 6; r++) {
+            for (unsigned int c = 0; c < 7; c++) {
+                board_set(mirror->b, make_pos(r, 6 - c),
+                          board_get(plain->b, make_pos(r, c)));
+            }
+        }
+        ntuple_state *mirrored = ntuple_game_state(net, mirror);
+        float a = ntuple_state_value(tracked, plain->player);
+        float b = ntuple_state_value(mirrored, plain->player);
+        cr_assert(a - b < 1e-4 && b - a < 1e-4);
+        ntuple_state_free(mirrored);
+        game_free(mirror);
+        if (game_outcome(plain) != IN_PROGRESS) {
+            game_reset(plain);
+            ntuple_state_rebuild(tracked, plain->b);
+        }
+    }
+
+    char path[] = "/tmp/ntuple_testXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    cr_assert(ntuple_save(net, path));
+    ntuple_net *opened = ntuple_open(path);
+    cr_assert_not_null(opened);
+    cr_assert_eq(opened->num_weights, net->num_weights);
+    cr_assert_eq(memcmp(opened->weights, net->weights,
+                        net->num_weights * sizeof(float)), 0);
+    game_reset(plain);
+    for (unsigned int c = 0; c < 7; c++) {
+        drop_piece(plain, c);
+    }
+    ntuple_state *copy = ntuple_game_state(opened, plain);
+    ntuple_state_rebuild(tracked, plain->b);
+    cr_assert_eq(ntuple_state_value(copy, plain->player),
+                 ntuple_state_value(tracked, plain->player));
+    ntuple_state_free(copy);
+    ntuple_free(opened);
+    unlink(path);
+    cr_assert_null(ntuple_open(path));
+    ntuple_state_free(tracked);
+    game_free(plain);
+    ntuple_free(net);
+}
+
+struct eval_queue_args {
+    eval_queue *q;
+    unsigned int seed, mismatches;
+};
+
+void *eval_queue_routine(void *arg) {
+    struct eval_queue_args *a = (struct eval_queue_args*)arg;
+    game *g = new_game(4, 7, 6, BITS);
+    ntuple_state *st = ntuple_game_state(a->q->net, g);
+    eval_queue_join(a->q);
+    for (unsigned int i = 0; i < 3000; i++) {
+        move m = move_from_index(7, rand_r(&a->seed) % 9);
+        if (play_move(g, m)) {
+            ntuple_state_play(st, g->b, m);
+        }
+        if (game_outcome(g) != IN_PROGRESS) {
+            game_reset(g);
+            ntuple_state_rebuild(st, g->b);
+        }
+        float batched = eval_queue_evaluate(a->q, st, g->player);
+        float alone = ntuple_state_value(st, g->player);
+        a->mismatches += batched - alone > 1e-4 || alone - batched > 1e-4;
+    }
+    eval_queue_park(a->q);
+    ntuple_state_free(st);
+    game_free(g);
+    return NULL;
+}
+
+Test(eval_queue, batches_match_single_evaluations) {
+    ntuple_net *net = ntuple_new(4, 7, 6);
+    ntuple_train_options opts = {20, 100, 5, 0.1, 0.1};
+    ntuple_train(net, &opts, NULL);
+    /* Batches of 8 close once the 5 joined threads are in, and with fewer
+       positions once some have parked */
+    unsigned int sizes[] = {1, 4, 8};
+    for (unsigned int i = 0; i < 3; i++) {
+        eval_queue *q = eval_queue_new(net, sizes[i], 20);
+        struct eval_queue_args args[5];
+        pthread_t tids[5];
+        for (unsigned int t = 0; t < 5; t++) {
+            args[t].q = q;
+            args[t].seed = t + 1;
+            args[t].mismatches = 0;
+            pthread_create(&tids[t], NULL, eval_queue_routine, &args[t]);
+        }
+        for (unsigned int t = 0; t < 5; t++) {
+            pthread_join(tids[t], NULL);
+            cr_assert_eq(args[t].mismatches, 0);
+        }
+        cr_assert_eq(q->evaluated, 15000);
+        cr_assert(q->batches_run <= 15000);
+        if (sizes[i] == 1) {
+            cr_assert_eq(q->batches_run, 15000);
+            cr_assert_eq(q->flushed, 0);
+        }
+        eval_queue_free(q);
+    }
+    ntuple_free(net);
+}
+
+Test(eval_queue, engine_analysis_does_not_wait_for_parked_threads) {
+    ntuple_net *net = ntuple_new(3, 4, 4);
+    ntuple_train_options opts = {200, 100, 5, 0.1, 0.1};
+    ntuple_train(net, &opts, NULL);
+    /* A batch waiting for a thread parked at the depth barrier would only
+       be flushed after a second */
+    eval_queue *q = eval_queue_new(net, 2, 1000000);
+    engine *e = engine_new(1 << 20);
+    e->max_depth = 4;
+    engine_use_eval_queue(e, q);
+    game *g = new_game(3, 4, 4, BITS);
+    cr_assert(drop_piece(g, 1));
+    cr_assert(drop_piece(g, 2));
+    move_eval evals[6];
+    unsigned int n = engine_analyze(e, g, 2, 0, NULL, NULL, evals);
+    cr_assert_eq(n, 6);
+    for (unsigned int i = 0; i < n; i++) {
+        cr_assert_eq(evals[i].depth, 4);
+    }
+    cr_assert(q->evaluated > 0);
+    cr_assert_eq(q->flushed, 0);
+    /* A search alone has its positions evaluated one at a time at once */
+    unsigned long long evaluated = q->evaluated, batches = q->batches_run;
+    engine *single = engine_new(1 << 20);
+    single->max_depth = 4;
+    engine_use_eval_queue(single, q);
+    search_result r;
+    cr_assert(engine_search(single, g, 0, &r));
+    cr_assert_eq(r.depth, 4);
+    cr_assert(q->evaluated > evaluated);
+    cr_assert_eq(q->batches_run - batches, q->evaluated - evaluated);
+    cr_assert_eq(q->flushed, 0);
+    game_free(g);
+    engine_free(single);
+    engine_free(e);
+    eval_queue_free(q);
+    ntuple_free(net);
+}
+
+void count_pairs(const match_stats *s, void *arg) {
+    (void)s;
+    (*(unsigned int*)arg)++;
+}
+
+Test(match, statistics_and_paired_games) {
+    double elo, margin;
+    match_elo(60, 40, 100, &elo, &margin);
+    cr_assert(elo > 34.859 && elo < 34.861);
+    cr_assert(margin > 34.158 && margin < 34.160);
+    unsigned int better[5] = {5, 15, 40, 25, 15};
+    unsigned int worse[5] = {15, 25, 40, 15, 5};
+    double llr = match_llr(better, 0, 10);
+    cr_assert(llr > 1.4061 && llr < 1.4063);
+    cr_assert(match_llr(worse, 0, 10) < 0);
+    /* Pairs split evenly, such as a win and a loss each, show nothing */
+    unsigned int even[5] = {0, 0, 10, 0, 0};
+    cr_assert_eq(match_llr(even, 0, 10), 0);
+
+    match_options opts;
+    memset(&opts, 0, sizeof(match_options));
+    opts.width = 5;
+    opts.height = 4;
+    opts.run = 3;
+    opts.threads = 3;
+    opts.max_games = 41;
+    opts.opening_plies = 2;
+    opts.seed = 7;
+    opts.tt_bytes = 1 << 16;
+    opts.alpha = opts.beta = 0.05;
+    opts.a.depth = opts.b.depth = 2;
+    unsigned int pairs = 0;
+    match_stats stats;
+    match_play(&opts, count_pairs, &pairs, &stats);
+    cr_assert_eq(pairs, 20);
+    cr_assert_eq(stats.wins + stats.losses + stats.draws, 40);
+    unsigned int points = 0, counted = 0;
+    for (unsigned int i = 0; i < 5; i++) {
+        counted += stats.pairs[i];
+        points += i * stats.pairs[i];
+    }
+    cr_assert_eq(counted, 20);
+    cr_assert_eq(points, 2 * stats.wins + stats.draws);
+    cr_assert_eq(stats.decision, 0);
+
+    /* The deeper side passes the test */
+    opts.a.depth = 4;
+    opts.b.depth = 1;
+    opts.max_games = 0;
+    opts.elo1 = 50;
+    match_play(&opts, NULL, NULL, &stats);
+    cr_assert_eq(stats.decision, 1);
+}
+
+/* This helper function copies a game through its serialized form */
+game* copy_game(game* g) {
+    size_t size = game_serialized_size(g);
+    unsigned char buf[size];
+    game_serialize(g, buf, size);
+    return game_deserialize(buf, size, -1);
+}
+
+Test(queries, match_playing_the_move) {
+    game *g = new_game(3, 5, 5, BITS);
+    srand(5);
+    for (unsigned int i = 0; i < 3000; i++) {
+        uint64_t key = game_key(g);
+        for (unsigned int c = 0; c < 5; c++) {
+            for (cell color = BLACK; color <= WHITE; color++) {
+                game *after = copy_game(g);
+                after->player = color == BLACK ? BLACKS_TURN : WHITES_TURN;
+                bool dropped = drop_piece(after, c);
+                outcome won = color == BLACK ? BLACK_WIN : WHITE_WIN;
+                cr_assert_eq(drop_completes_run(g, c, color),
+                             dropped && game_outcome(after) == won);
+                game_free(after);
+            }
+        }
+        game *after = copy_game(g);
+        outcome expected = offset(after) ? game_outcome(after) : IN_PROGRESS;
+        cr_assert_eq(offset_outcome(g), expected);
+        game_free(after);
+        after = copy_game(g);
+        disarray(after);
+        cr_assert_eq(disarray_outcome(g), game_outcome(after));
+        game_free(after);
+        cr_assert_eq(game_key(g), key);
+        unsigned int columns[5];
+        cell mover = g->player == BLACKS_TURN ? BLACK : WHITE;
+        unsigned int n = immediate_threats(g, mover, columns);
+        for (unsigned int j = 0; j < n; j++) {
+            cr_assert(drop_wins(g, columns[j]));
+        }
+        play_move(g, move_from_index(5, rand() % 7));
+        if (game_outcome(g) != IN_PROGRESS) {
+            game_reset(g);
+        }
+    }
+    game_free(g);
+}
+
+Test(pns, matches_the_tablebase) {
+    char path[] = "/tmp/pns_testXXXXXX";
+    int fd = mkstemp(path);
+    tb_options opts = {3, 3, 3, 2, 64 << 20};
+    tb_stats stats;
+    cr_assert(tb_generate(&opts, path, &stats));
+    tablebase *tb = tb_open(path);
+    cr_assert_not_null(tb);
+    pns_solver *s = pns_new(1 << 16);
+    game *g = new_game(3, 3, 3, BITS);
+    srand(3);
+    unsigned int collections = 0;
+    for (unsigned int i = 0; i < 40; i++) {
+        pns_stats ps;
+        tb_result r = pns_solve(s, g, 1 + i % 2, 0, NULL, NULL, &ps);
+        cr_assert_eq(r, tb_probe(tb, g, NULL));
+        cr_assert_not(ps.ply_limit);
+        collections = ps.gc_runs;
+        play_move(g, move_from_index(3, rand() % 5));
+        if (game_outcome(g) != IN_PROGRESS) {
+            game_reset(g);
+        }
+    }
+    cr_assert(collections > 0);
+    game_free(g);
+    pns_free(s);
+    tb_close(tb);
+    close(fd);
+    unlink(path);
+}
+
+Test(split, matches_the_tablebase_and_resumes) {
+    char tb_path[] = "/tmp/split_tbXXXXXX";
+    char progress[] = "/tmp/split_progressXXXXXX";
+    int tb_fd = mkstemp(tb_path), progress_fd = mkstemp(progress);
+    tb_options tb_opts = {3, 3, 3, 2, 64 << 20};
+    tb_stats tb_st;
+    cr_assert(tb_generate(&tb_opts, tb_path, &tb_st));
+    tablebase *tb = tb_open(tb_path);
+    cr_assert_not_null(tb);
+    split_options opts = {3, 3, 3, 2, 2, 1 << 16, 1 << 20, "1", progress};
+    game *g = new_game(3, 3, 3, BITS);
+    cr_assert(split_play(g, opts.moves));
+    split_stats first, second;
+    cr_assert(split_solve(&opts, NULL, NULL, &first));
+    cr_assert_eq(first.result, tb_probe(tb, g, NULL));
+    cr_assert_eq(first.depth, 2);
+    cr_assert(first.solved > 0);
+    cr_assert_eq(first.crashes, 0);
+    cr_assert(split_solve(&opts, NULL, NULL, &second));
+    cr_assert_eq(second.result, first.result);
+    cr_assert_eq(second.solved, 0);
+    cr_assert_eq(second.resumed, first.solved);
+    cr_assert_eq(second.skipped, first.skipped);
+    opts.moves = "0";
+    cr_assert_not(split_solve(&opts, NULL, NULL, &second));
+    opts.progress = NULL;
+    opts.depth = 0;
+    opts.moves = "0 1 ^";
+    game_reset(g);
+    cr_assert(split_play(g, opts.moves));
+    cr_assert(split_solve(&opts, NULL, NULL, &second));
+    cr_assert_eq(second.result, tb_probe(tb, g, NULL));
+    cr_assert_not(split_play(g, "3"));
+    game_free(g);
+    tb_close(tb);
+    close(tb_fd);
+    close(progress_fd);
+    unlink(tb_path);
+    unlink(progress);
+}
+
+/* The server waits with epoll, which only Linux has, and is built into
+   the tests only there */
+#if defined(__linux__)
+/* This helper function connects to a server over TCP or its Unix socket */
+int server_connect(server *s, const char *path) {
+    if (path) {
+        struct sockaddr_un addr = {AF_UNIX, {0}};
+        strcpy(addr.sun_path, path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        cr_assert_eq(connect(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+        return fd;
+    }
+    struct sockaddr_in addr = {AF_INET, htons(server_port(s)),
+                               {htonl(INADDR_LOOPBACK)}, {0}};
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    cr_assert_eq(connect(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    return fd;
+}
+
+/* This helper function reads a line of at most cap - 1 bytes, without its
+   newline. Returns its length, or -1 if the connection closed first */
+int read_line(int fd, char *buf, size_t cap) {
+    size_t len = 0;
+    while (len < cap - 1) {
+        if (read(fd, buf + len, 1) != 1) {
+            return -1;
+        }
+        if (buf[len] == '\n') {
+            break;
+        }
+        len++;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/* This helper function sends a request and checks the reply */
+void expect_reply(int fd, const char *request, const char *reply) {
+    char buf[SERVER_BUF];
+    cr_assert_eq(write(fd, request, strlen(request)), strlen(request));
+    cr_assert(read_line(fd, buf, sizeof(buf)) >= 0);
+    cr_assert_eq(strcmp(buf, reply), 0);
+}
+
+Test(server, sessions_play_over_tcp_and_unix_sockets) {
+    char path[] = "/tmp/server_testXXXXXX";
+    int tmp = mkstemp(path);
+    close(tmp);
+    server_options opts = {true, 0, path, 2, 8};
+    server *s = server_start(&opts);
+    cr_assert_not_null(s);
+    cr_assert(server_port(s) > 0);
+
+    int a = server_connect(s, NULL), b = server_connect(s, path);
+    expect_reply(a, "drop 0\n", "error no game");
+    expect_reply(a, "new 4 3 3\n", "ok");
+    expect_reply(b, "new 4 3 3\n", "ok");
+    expect_reply(a, "drop 1\r\n", "ok white");
+    expect_reply(a, "drop 1\n", "ok black");
+    expect_reply(a, "board\n", "ok ..../.o../.*..");
+    expect_reply(b, "board\n", "ok ..../..../....");
+    expect_reply(a, "drop 4\n", "error illegal move");
+    expect_reply(a, "offset 1\n", "error illegal move");
+    expect_reply(a, "castle\n", "error unknown request");
+    expect_reply(a, "drop 3x\n", "error bad arguments");
+    expect_reply(a, "drop -1\n", "error bad arguments");
+    expect_reply(a, "drop 99999999999\n", "error bad arguments");
+    expect_reply(a, "new 4 3 3 1\n", "error bad arguments");
+    expect_reply(a, "board 1\n", "error bad arguments");
+    expect_reply(a, "drop 3 0\n", "error illegal move");
+    expect_reply(a, "new 4 3 5\n", "error unplayable game");
+    expect_reply(a, "state\n", "ok black");
+    expect_reply(b, "drop 0\ndrop 3\ndrop 0\ndrop 3\n", "ok white");
+    char buf[SERVER_BUF];
+    for (unsigned int i = 0; i < 3; i++) {
+        cr_assert(read_line(b, buf, sizeof(buf)) >= 0);
+    }
+    expect_reply(b, "drop 0\n", "ok black-wins");
+    expect_reply(b, "disarray\n", "error game over");
+    expect_reply(b, "reset\n", "ok");
+    expect_reply(b, "disarray\n", "ok white");
+    expect_reply(b, "quit\n", "ok");
+    cr_assert_eq(read_line(b, buf, sizeof(buf)), -1);
+    close(b);
+
+    /* Replies to a burst of requests larger than the buffers all come back,
+       in order, once the client reads them */
+    char burst[20 * 12];
+    for (unsigned int i = 0; i < 20; i++) {
+        memcpy(burst + 12 * i, "board\nstate\n", 12);
+    }
+    for (unsigned int i = 0; i < 100; i++) {
+        cr_assert_eq(write(a, burst, sizeof(burst)), sizeof(burst));
+    }
+    for (unsigned int i = 0; i < 2000; i++) {
+        cr_assert(read_line(a, buf, sizeof(buf)) >= 0);
+        cr_assert_eq(strcmp(buf, "ok ..../.o../.*.."), 0);
+        cr_assert(read_line(a, buf, sizeof(buf)) >= 0);
+        cr_assert_eq(strcmp(buf, "ok black"), 0);
+    }
+
+    /* Sessions beyond those of every loop are closed at once */
+    int more[16];
+    for (unsigned int i = 0; i < 16; i++) {
+        more[i] = server_connect(s, NULL);
+    }
+    unsigned int served = 0;
+    for (unsigned int i = 0; i < 16; i++) {
+        if (send(more[i], "state\n", 6, MSG_NOSIGNAL) == 6 &&
+            read_line(more[i], buf, sizeof(buf)) >= 0) {
+            cr_assert_eq(strcmp(buf, "error no game"), 0);
+            served++;
+        }
+        close(more[i]);
+    }
+    cr_assert(served <= 15);
+    close(a);
+
+    server_stats stats;
+    server_stop(s, &stats);
+    cr_assert_eq(stats.accepted, 2 + served);
+    cr_assert_eq(access(path, F_OK), -1);
+}
+#endif
+
+Test(hist, percentiles_within_bucket_error) {
+    histogram* h = (histogram*)malloc(sizeof(histogram));
+    histogram* other = (histogram*)malloc(sizeof(histogram));
+    hist_clear(h);
+    hist_clear(other);
+    cr_assert_eq(hist_percentile(h, 50), 0);
+    // Small values are exact
+    for (uint64_t v = 1; v <= 100; v++) {
+        hist_record(h, v);
+    }
+    cr_assert_eq(hist_percentile(h, 50), 50);
+    cr_assert_eq(hist_percentile(h, 99), 99);
+    cr_assert_eq(hist_percentile(h, 100), 100);
+    cr_assert_eq(h->min, 1);
+    // Larger ones are read back within 1 / HIST_SUB above them
+    for (uint64_t v = 1000; v < 100000000000ull; v = v * 3 + 7) {
+        hist_clear(other);
+        hist_record(other, v);
+        uint64_t read = hist_percentile(other, 50);
+        cr_assert(read >= v && read - v <= v / HIST_SUB);
+    }
+    // Merging adds the counts, and the top bucket holds the largest value
+    hist_clear(other);
+    for (int i = 0; i < 100; i++) {
+        hist_record(other, 1000000);
+    }
+    hist_record(other, UINT64_MAX);
+    hist_merge(h, other);
+    cr_assert_eq(h->total, 201);
+    cr_assert_eq(h->min, 1);
+    cr_assert_eq(h->max, UINT64_MAX);
+    cr_assert_eq(hist_percentile(h, 40), 81);
+    uint64_t p99 = hist_percentile(h, 99);
+    cr_assert(p99 >= 1000000 && p99 - 1000000 <= 1000000 / HIST_SUB);
+    cr_assert_eq(hist_percentile(h, 100), UINT64_MAX);
+    free(h);
+    free(other);
+}
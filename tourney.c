@@ -0,0 +1,254 @@
+#include <string.h>
+#include <unistd.h>
+#include "match.h"
+#include "trace.h"
+
+/* Plays a match between two engine settings, -a and -b, on every core
+   (see match.h) and reports the Elo difference of A over B with its 95%
+   error bars, the test and the games per second every -p games, then
+   once the match is over.
+ * A setting is a list of key=value separated by commas: d for the
+   maximum depth, t for the time per move in milliseconds, n for the path
+   of an N-tuple network, q for the flush time in microseconds of an
+   evaluation queue through which the side's engines on all threads
+   evaluate with that network in batches, k for the path of an opening
+   book, m for the fewest games of its moves and e for the path of an
+   endgame tablebase. Either side searches to depth 4 by default.
+ * The match stops after -g games, 20000 by default, or once the test
+   finds A -E Elo stronger or at most -e Elo stronger, with error rates of
+   5%. It is off when -e and -E are equal, which they are by default.
+ * With -T, a Chrome trace of the playing threads is written to the given
+   file */
+
+#define TOURNEY_MAX_SPEC 4096
+
+struct tourney_options {
+    match_options match;
+    unsigned int tt_mb, report, reported;
+    char* trace_path;
+    char spec_a[TOURNEY_MAX_SPEC], spec_b[TOURNEY_MAX_SPEC];
+};
+
+typedef struct tourney_options tourney_options;
+
+/* This helper function prints the usage line and exits */
+void tourney_usage() {
+    fprintf(stderr, "Usage: tourney -w <width> -h <height> -r <run> "
+                    "[-a <setting>] [-b <setting>] [-g <games>]\n"
+                    "               [-o <plies>] [-l <plies>] "
+                    "[-e <elo0>] [-E <elo1>] [-j <threads>] [-s <seed>]\n"
+                    "               [-M <megabytes>] [-p <games>] "
+                    "[-T <trace.json>]\n");
+    exit(1);
+}
+
+/* This helper function parses the command-line arguments into opts.
+ * -w, -h and -r are required. By default every core plays from seed 1,
+   openings are 4 random drops, each engine has a table of 16 MB and
+   results are reported every 1000 games */
+void parse_tourney_arguments(int argc, char** argv, tourney_options* opts) {
+    memset(opts, 0, sizeof(tourney_options));
+    match_options* m = &opts->match;
+    m->max_games = 20000;
+    m->opening_plies = 4;
+    m->seed = 1;
+    m->alpha = 0.05;
+    m->beta = 0.05;
+    opts->tt_mb = 16;
+    opts->report = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || strlen(argv[i]) != 2 || i == argc - 1) {
+            tourney_usage();
+        }
+        char* arg = argv[i + 1];
+        unsigned int v = atoi(arg);
+        switch (argv[i][1]) {
+            case 'w':
+                m->width = v;
+                break;
+            case 'h':
+                m->height = v;
+                break;
+            case 'r':
+                m->run = v;
+                break;
+            case 'a':
+            case 'b':
+                if (strlen(arg) >= TOURNEY_MAX_SPEC) {
+                    tourney_usage();
+                }
+                strcpy(argv[i][1] == 'a' ? opts->spec_a : opts->spec_b, arg);
+                break;
+            case 'g':
+                m->max_games = v;
+                break;
+            case 'o':
+                m->opening_plies = v;
+                break;
+            case 'l':
+                m->max_plies = v;
+                break;
+            case 'e':
+                m->elo0 = atof(arg);
+                break;
+            case 'E':
+                m->elo1 = atof(arg);
+                break;
+            case 'j':
+                m->threads = v;
+                break;
+            case 's':
+                m->seed = v;
+                break;
+            case 'M':
+                opts->tt_mb = v;
+                break;
+            case 'p':
+                opts->report = v;
+                break;
+            case 'T':
+                opts->trace_path = arg;
+                break;
+            default:
+                tourney_usage();
+        }
+        i++;
+    }
+    if (m->width == 0 || m->height == 0 || m->run == 0 ||
+        m->opening_plies > MATCH_MAX_OPENING || opts->tt_mb == 0 ||
+        (m->max_games == 0 && m->elo0 == m->elo1)) {
+        tourney_usage();
+    }
+    m->tt_bytes = (size_t)opts->tt_mb << 20;
+}
+
+/* This helper function fills the settings of a side from its list of
+   key=value. Exits if a key is unknown or a file cannot be opened */
+void parse_side(const match_options* m, char* spec, match_side* s) {
+    memset(s, 0, sizeof(match_side));
+    s->depth = 4;
+    int flush_us = -1;
+    for (char* item = strtok(spec, ","); item; item = strtok(NULL, ",")) {
+        if (item[0] == '\0' || item[1] != '=') {
+            fprintf(stderr, "Invalid setting %s\n", item);
+            exit(1);
+        }
+        char* value = item + 2;
+        switch (item[0]) {
+            case 'd':
+                s->depth = atoi(value);
+                break;
+            case 't':
+                s->time_ms = atoi(value);
+                break;
+            case 'm':
+                s->book_min_games = atoi(value);
+                break;
+            case 'q':
+                flush_us = atoi(value);
+                break;
+            case 'n':
+                s->net = ntuple_open(value);
+                if (s->net == NULL || s->net->width != m->width ||
+                    s->net->height != m->height || s->net->run != m->run) {
+                    fprintf(stderr, "Could not open network %s for this "
+                                    "configuration\n", value);
+                    exit(1);
+                }
+                break;
+            case 'k':
+                s->bk = book_open(value);
+                if (s->bk == NULL) {
+                    fprintf(stderr, "Could not open book %s\n", value);
+                    exit(1);
+                }
+                break;
+            case 'e':
+                s->tb = tb_open(value);
+                if (s->tb == NULL) {
+                    fprintf(stderr, "Could not open tablebase %s\n", value);
+                    exit(1);
+                }
+                break;
+            default:
+                fprintf(stderr, "Invalid setting %s\n", item);
+                exit(1);
+        }
+    }
+    if (s->depth == 0 || s->depth > ENGINE_MAX_PLY) {
+        fprintf(stderr, "Depths go from 1 to %u\n", ENGINE_MAX_PLY);
+        exit(1);
+    }
+    if (flush_us >= 0) {
+        if (s->net == NULL) {
+            fprintf(stderr, "An evaluation queue needs a network\n");
+            exit(1);
+        }
+        unsigned int threads = m->threads ? m->threads :
+                               sysconf(_SC_NPROCESSORS_ONLN);
+        s->queue = eval_queue_new(s->net, threads, flush_us);
+    }
+}
+
+/* This helper function prints a line of results */
+void print_stats(const match_options* m, const match_stats* s) {
+    unsigned int games = s->wins + s->losses + s->draws;
+    double elo, margin;
+    match_elo(s->wins, s->losses, s->draws, &elo, &margin);
+    printf("%u games: +%u -%u =%u, Elo %.1f +- %.1f", games, s->wins,
+           s->losses, s->draws, elo, margin);
+    if (m->elo0 != m->elo1) {
+        printf(", pairs %u %u %u %u %u, LLR %.2f [%.2f, %.2f]", s->pairs[0],
+               s->pairs[1], s->pairs[2], s->pairs[3], s->pairs[4], s->llr,
+               s->lower, s->upper);
+    }
+    printf(", %.1f games/s\n", s->seconds > 0 ? games / s->seconds : 0);
+    fflush(stdout);
+}
+
+/* This is the event callback of the match */
+void print_event(const match_stats* s, void* arg) {
+    tourney_options* opts = (tourney_options*)arg;
+    unsigned int games = s->wins + s->losses + s->draws;
+    if (opts->report && games >= opts->reported + opts->report) {
+        opts->reported = games - games % opts->report;
+        print_stats(&opts->match, s);
+    }
+}
+
+int main(int argc, char** argv) {
+    tourney_options opts;
+    parse_tourney_arguments(argc, argv, &opts);
+    match_options* m = &opts.match;
+    parse_side(m, opts.spec_a, &m->a);
+    parse_side(m, opts.spec_b, &m->b);
+    if (opts.trace_path) {
+        trace_enable();
+    }
+    match_stats s;
+    match_play(m, print_event, &opts, &s);
+    if (opts.trace_path && !trace_flush(opts.trace_path)) {
+        fprintf(stderr, "Could not write trace to %s\n", opts.trace_path);
+    }
+    print_stats(m, &s);
+    if (s.decision) {
+        printf("The test accepts elo%d = %.1f\n", s.decision > 0,
+               s.decision > 0 ? m->elo1 : m->elo0);
+    }
+    match_side* sides[2] = {&m->a, &m->b};
+    for (unsigned int i = 0; i < 2; i++) {
+        if (sides[i]->queue) {
+            eval_queue_free(sides[i]->queue);
+        }
+        if (sides[i]->net) {
+            ntuple_free(sides[i]->net);
+        }
+        if (sides[i]->bk) {
+            book_close(sides[i]->bk);
+        }
+        if (sides[i]->tb) {
+            tb_close(sides[i]->tb);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#include "pos.h"
+#include "trace.h"
+
+bool trace_on = false;
+
+static trace_ring* rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static uint64_t trace_origin = 0;
+#if !defined(__linux__)
+/* Only Linux gives threads ids of their own; elsewhere they are numbered
+   as they first record */
+static int threads_seen = 0;
+#endif
+
+static __thread trace_ring* local_ring = NULL;
+static __thread int local_tid = 0;
+
+/* This helper function is the destructor of ring_key. It runs when a thread
+   that recorded events exits and hands its ring back for reuse; the events
+   already in it are kept for the next flush */
+void trace_release_ring(void* arg) {
+    trace_ring* ring = (trace_ring*)arg;
+    pthread_mutex_lock(&rings_lock);
+    ring->in_use = false;
+    pthread_mutex_unlock(&rings_lock);
+}
+
+/* This helper function creates ring_key, once */
+void trace_make_ring_key() {
+    pthread_key_create(&ring_key, trace_release_ring);
+}
+
+/* This helper function gives the calling thread a ring, reusing the ring of
+   an exited thread when there is one */
+trace_ring* trace_acquire_ring() {
+    pthread_once(&ring_key_once, trace_make_ring_key);
+    pthread_mutex_lock(&rings_lock);
+    trace_ring* ring = rings;
+    while (ring && ring->in_use) {
+        ring = ring->next;
+    }
+    if (ring == NULL) {
+        ring = (trace_ring*)malloc(sizeof(trace_ring));
+        check_malloc(ring);
+        ring->count = 0;
+        ring->next = rings;
+        rings = ring;
+    }
+    ring->in_use = true;
+    pthread_mutex_unlock(&rings_lock);
+    pthread_setspecific(ring_key, ring);
+#if defined(__linux__)
+    local_tid = syscall(SYS_gettid);
+#else
+    local_tid = __atomic_add_fetch(&threads_seen, 1, __ATOMIC_RELAXED);
+#endif
+    return ring;
+}
+
+/* This helper function appends one event to the calling thread's ring */
+void trace_record(const char* name, char phase) {
+    trace_ring* ring = local_ring;
+    if (ring == NULL) {
+        ring = local_ring = trace_acquire_ring();
+    }
+    trace_event* e = &ring->events[ring->count % TRACE_RING_SIZE];
+    e->name = name;
+    e->ts = now_ns();
+    e->tid = local_tid;
+    e->phase = phase;
+    ring->count++;
+}
+
+void trace_enable() {
+    if (trace_origin == 0) {
+        trace_origin = now_ns();
+    }
+    trace_on = true;
+}
+
+void trace_disable() {
+    trace_on = false;
+}
+
+void trace_begin(const char* name) {
+    if (!trace_on) {
+        return;
+    }
+    trace_record(name, 'B');
+}
+
+void trace_end(const char* name) {
+    if (!trace_on) {
+        return;
+    }
+    trace_record(name, 'E');
+}
+
+bool trace_flush(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        return false;
+    }
+    int pid = getpid();
+    bool first = true;
+    fprintf(f, "{\"traceEvents\":[\n");
+    pthread_mutex_lock(&rings_lock);
+    for (trace_ring* ring = rings; ring; ring = ring->next) {
+        uint64_t start = 0;
+        if (ring->count > TRACE_RING_SIZE) {
+            start = ring->count - TRACE_RING_SIZE;
+        }
+        /* Once a ring has wrapped, the ends of spans whose beginnings were
+           overwritten are left out, so that every span is balanced. A
+           recycled ring holds the events of its threads one after the
+           other */
+        unsigned int depth = 0;
+        int tid = 0;
+        for (uint64_t i = start; i < ring->count; i++) {
+            trace_event* e = &ring->events[i % TRACE_RING_SIZE];
+            if (e->tid != tid) {
+                tid = e->tid;
+                depth = 0;
+            }
+            if (e->phase == 'E' && depth == 0) {
+                continue;
+            }
+            depth += e->phase == 'B' ? 1 : -1;
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                       "\"pid\":%d,\"tid\":%d}",
+                    first ? "" : ",\n", e->name, e->phase,
+                    (e->ts - trace_origin) / 1000.0, pid, e->tid);
+            first = false;
+        }
+        ring->count = 0;
+    }
+    pthread_mutex_unlock(&rings_lock);
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(f);
+    return true;
+}
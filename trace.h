@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of events kept per thread. When a thread records more, its oldest
+   events are overwritten */
+#define TRACE_RING_SIZE 4096
+
+
+struct trace_event {
+    const char* name;
+    uint64_t ts;
+    int tid;
+    char phase;
+};
+
+typedef struct trace_event trace_event;
+
+
+typedef struct trace_ring trace_ring;
+
+struct trace_ring {
+    trace_event events[TRACE_RING_SIZE];
+    uint64_t count;
+    trace_ring* next;
+    bool in_use;
+};
+
+
+/**
+ * trace_enable
+ *
+ * Turns on event recording. Timestamps in the flushed trace are relative to
+ *  the moment of the first call.
+ */
+void trace_enable();
+
+/**
+ * trace_disable
+ *
+ * Turns off event recording. Recorded events are kept until `trace_flush`.
+ */
+void trace_disable();
+
+/**
+ * trace_begin
+ *
+ * Records the start of a span on the calling thread. Does nothing unless
+ *  recording is on.
+ *
+ * Parameters:
+ *   - name: The span name. It must be a string literal or otherwise outlive
+ *      the next `trace_flush`, as only the pointer is stored.
+ *
+ * Note:
+ *   - Each thread writes into its own ring buffer without locking. Buffers
+ *      of exited threads are recycled, so short-lived threads such as the
+ *      disarray column threads do not grow memory.
+ */
+void trace_begin(const char* name);
+
+/**
+ * trace_end
+ *
+ * Records the end of the innermost span on the calling thread. Does nothing
+ *  unless recording is on.
+ *
+ * Parameters:
+ *   - name: The span name given to the matching `trace_begin`.
+ */
+void trace_end(const char* name);
+
+/**
+ * trace_flush
+ *
+ * Writes every recorded event, from all threads, to a file in the Chrome
+ *  trace event JSON format (loadable in chrome://tracing or Perfetto), then
+ *  discards them.
+ *
+ * Parameters:
+ *   - path: The file to write.
+ *
+ * Returns:
+ *   - `true` if the file was written.
+ *   - `false` if it could not be opened.
+ *
+ * Note:
+ *   - Must not be called while other threads are recording.
+ *   - A thread that recorded more than TRACE_RING_SIZE events keeps only
+ *      its latest; the ends of spans whose beginnings were overwritten are
+ *      left out.
+ */
+bool trace_flush(const char* path);
+
+/* Set by trace_enable and cleared by trace_disable. Read directly by the
+   hooks so that they cost a single branch when recording is off */
+extern bool trace_on;
+
+#endif /* TRACE_H */
@@ -0,0 +1,97 @@
+#include <string.h>
+#include "window.h"
+
+/* The directions of the windows, as (row, column) steps from their first
+   cell: east, south, south east and south west */
+static const int window_dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+window_counts* window_counts_new(unsigned int run, board* b) {
+    window_counts* wc = (window_counts*)malloc(sizeof(window_counts));
+    check_malloc(wc);
+    wc->run = run;
+    wc->width = b->width;
+    wc->height = b->height;
+    wc->counts = (unsigned int*)malloc(8 * (size_t)b->width * b->height *
+                                       sizeof(unsigned int));
+    check_malloc(wc->counts);
+    window_counts_rebuild(wc, b);
+    return wc;
+}
+
+void window_counts_free(window_counts* wc) {
+    free(wc->counts);
+    free(wc);
+}
+
+/* This helper function returns what a window with the given counts adds
+   to the score */
+int window_score(const unsigned int* n) {
+    if (n[0] && !n[1]) {
+        return n[0] * n[0];
+    } else if (n[1] && !n[0]) {
+        return -(int)(n[1] * n[1]);
+    }
+    return 0;
+}
+
+/* This helper function moves one piece into or out of a window, keeping
+   the score and the number of full windows of each color. d is +1 to add
+   the piece and -1 to remove it */
+void window_update(window_counts* wc, size_t i, cell color, int d) {
+    unsigned int* n = wc->counts + 2 * i;
+    unsigned int k = color - BLACK, run = wc->run;
+    wc->score -= window_score(n);
+    wc->runs[k] -= n[k] == run;
+    n[k] += d;
+    wc->runs[k] += n[k] == run;
+    wc->score += window_score(n);
+}
+
+void window_counts_set(window_counts* wc, pos p, cell old, cell new) {
+    if (old == new) {
+        return;
+    }
+    unsigned int run = wc->run, width = wc->width, height = wc->height;
+    for (unsigned int d = 0; d < 4; d++) {
+        int dr = window_dirs[d][0], dc = window_dirs[d][1];
+        for (unsigned int j = 0; j < run; j++) {
+            long long r = (long long)p.r - (long long)j * dr,
+                      c = (long long)p.c - (long long)j * dc;
+            long long last_r = r + (long long)(run - 1) * dr,
+                      last_c = c + (long long)(run - 1) * dc;
+            if (r < 0 || c < 0 || c >= width || last_r >= height ||
+                last_c < 0 || last_c >= width) {
+                continue;
+            }
+            size_t i = ((size_t)d * height + r) * width + c;
+            if (old != EMPTY) {
+                window_update(wc, i, old, -1);
+            }
+            if (new != EMPTY) {
+                window_update(wc, i, new, 1);
+            }
+        }
+    }
+}
+
+void window_counts_rebuild(window_counts* wc, board* b) {
+    memset(wc->counts, 0, 8 * (size_t)wc->width * wc->height *
+                          sizeof(unsigned int));
+    wc->score = 0;
+    wc->runs[0] = wc->runs[1] = 0;
+    for (unsigned int c = 0; c < wc->width; c++) {
+        unsigned int h = board_column_height(b, c);
+        for (unsigned int r = wc->height - h; r < wc->height; r++) {
+            pos p = make_pos(r, c);
+            window_counts_set(wc, p, EMPTY, board_get(b, p));
+        }
+    }
+}
+
+int window_counts_score(window_counts* wc) {
+    return wc->score;
+}
+
+bool window_counts_has_run(window_counts* wc, cell color) {
+    return wc->runs[color - BLACK] > 0;
+}
@@ -0,0 +1,106 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdbool.h>
+#include "board.h"
+
+/* A window is a line of run cells in one of four directions: east, south
+   and the two diagonals going down. Window counts keep, for every window
+   of a board, how many black and how many white pieces it holds.
+ * A changed cell only touches the windows covering it, at most run in
+   each direction, so the counts are kept up to date as the game is played
+   rather than recomputed.
+ * From the counts follow a heuristic score, the sum over the windows
+   holding pieces of one color only of the square of their number of
+   pieces, counted for black and against white, and win detection: a
+   color has a run as long as one of its windows is full */
+
+struct window_counts {
+    unsigned int run, width, height;
+    unsigned int* counts;
+    int score;
+    size_t runs[2];
+};
+
+typedef struct window_counts window_counts;
+
+/**
+ * window_counts_new
+ *
+ * Counts the pieces in every window of a board.
+ *
+ * Parameters:
+ *   - run: The length of the windows, the run of the game.
+ *   - b: A pointer to the board.
+ *
+ * Returns:
+ *   - A pointer to the new `window_counts`.
+ *
+ * Note:
+ *   - The caller is responsible for calling `window_counts_free`.
+ *   - Raises an error if memory allocation fails.
+ */
+window_counts* window_counts_new(unsigned int run, board* b);
+
+/**
+ * window_counts_free
+ *
+ * Frees window counts.
+ *
+ * Parameters:
+ *   - wc: A pointer to the `window_counts`.
+ */
+void window_counts_free(window_counts* wc);
+
+/**
+ * window_counts_set
+ *
+ * Updates the windows covering a cell whose content changes.
+ *
+ * Parameters:
+ *   - wc: A pointer to the `window_counts`.
+ *   - p: The position of the cell.
+ *   - old: What the cell held.
+ *   - new: What the cell holds now.
+ *
+ * Note:
+ *   - Takes time in the run, not in the size of the board.
+ */
+void window_counts_set(window_counts* wc, pos p, cell old, cell new);
+
+/**
+ * window_counts_rebuild
+ *
+ * Counts every window again from a board whose cells changed wholesale.
+ *
+ * Parameters:
+ *   - wc: A pointer to the `window_counts`.
+ *   - b: A pointer to the board, of the size the counts were made for.
+ *
+ * Note:
+ *   - Only the occupied cells of each column are visited.
+ */
+void window_counts_rebuild(window_counts* wc, board* b);
+
+/**
+ * window_counts_score
+ *
+ * Returns the heuristic score of the board, positive when black is ahead.
+ *
+ * Parameters:
+ *   - wc: A pointer to the `window_counts`.
+ */
+int window_counts_score(window_counts* wc);
+
+/**
+ * window_counts_has_run
+ *
+ * Tells whether a color has run pieces in a line, in constant time.
+ *
+ * Parameters:
+ *   - wc: A pointer to the `window_counts`.
+ *   - color: BLACK or WHITE.
+ */
+bool window_counts_has_run(window_counts* wc, cell color);
+
+#endif /* WINDOW_H */